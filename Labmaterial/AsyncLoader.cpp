@@ -0,0 +1,218 @@
+/*
+ * Background loading of meshes and textures.
+ * One loader thread reads and parses files (the OBJ parser itself still
+ * spreads its work over the global ThreadPool), and hands the results
+ * to the GL thread through a bounded queue. All OpenGL calls are made
+ * in processUploads(), since a GL context is current in only one thread.
+ */
+
+#include <cstdio>  // For printf()
+
+#include "AsyncLoader.hpp"
+#include "TriangleSoup.hpp"
+#include "Texture.hpp"
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // For glfwGetTime()
+
+
+/* Constructor: start the loader thread */
+AsyncLoader::AsyncLoader(int maxqueued) {
+
+    numuploads = 0;
+    numfailed = 0;
+    maxqueuedepth = 0;
+    totaluploadtime = 0.0;
+    maxuploadtime = 0.0;
+    totallatency = 0.0;
+    maxlatency = 0.0;
+    totalloadtime = 0.0;
+
+    this->maxqueued = (maxqueued > 0) ? maxqueued : 1;
+    stopping = false;
+    loader = std::thread(&AsyncLoader::loaderLoop, this);
+}
+
+
+/* Destructor: stop and join the loader thread */
+AsyncLoader::~AsyncLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    loader.join();
+}
+
+
+/* Start loading an OBJ file into mesh */
+int AsyncLoader::loadMesh(TriangleSoup *mesh, const char *filename) {
+    return addJob(MESH, mesh, filename);
+}
+
+
+/* Start loading a TGA file into texture */
+int AsyncLoader::loadTexture(Texture *texture, const char *filename) {
+    return addJob(TEXTURE, texture, filename);
+}
+
+
+/* The Status of the load with the given handle */
+int AsyncLoader::status(int handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(handle < 0 || handle >= (int)jobs.size()) return FAILED;
+    return jobs[handle].status;
+}
+
+
+/* The number of loads that are not yet READY or FAILED */
+int AsyncLoader::pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)(jobs.size()) - numuploads - numfailed;
+}
+
+
+/* The number of parsed objects waiting in the upload queue */
+int AsyncLoader::queueDepth() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)uploads.size();
+}
+
+
+/*
+ * processUploads() - upload finished loads until the budget is used up.
+ */
+int AsyncLoader::processUploads(double budgetms) {
+
+    double starttime = glfwGetTime();
+    int count = 0;
+
+    do {
+        int handle;
+        int kind;
+        void *target;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(uploads.empty()) break;
+            handle = uploads.front();
+            uploads.pop_front();
+            kind = jobs[handle].kind;
+            target = jobs[handle].target;
+        }
+        wakeup.notify_all(); // There is room in the queue again
+
+        double uploadstart = glfwGetTime();
+        if(kind == MESH) {
+            ((TriangleSoup*)target)->createBuffers();
+        }
+        else {
+            ((Texture*)target)->upload();
+        }
+        double now = glfwGetTime();
+        count++;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Job &job = jobs[handle];
+        double uploadtime = now - uploadstart;
+        double latency = now - job.parsedtime;
+        job.status = READY;
+        numuploads++;
+        totaluploadtime += uploadtime;
+        if(uploadtime > maxuploadtime) maxuploadtime = uploadtime;
+        totallatency += latency;
+        if(latency > maxlatency) maxlatency = latency;
+        totalloadtime += now - job.requesttime;
+    } while((glfwGetTime() - starttime) * 1000.0 < budgetms);
+
+    return count;
+}
+
+
+/* Print the statistics to the console */
+void AsyncLoader::printStats() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+    int n = (numuploads > 0) ? numuploads : 1; // Avoid division by zero
+    printf("AsyncLoader: %d loaded, %d failed, %d pending\n",
+        numuploads, numfailed, (int)jobs.size() - numuploads - numfailed);
+    printf("  upload queue depth: %d now, %d max (capacity %d)\n",
+        (int)uploads.size(), maxqueuedepth, maxqueued);
+    printf("  upload time:        %.2f ms mean, %.2f ms max\n",
+        1000.0*totaluploadtime/n, 1000.0*maxuploadtime);
+    printf("  upload latency:     %.2f ms mean, %.2f ms max (parsed to uploaded)\n",
+        1000.0*totallatency/n, 1000.0*maxlatency);
+    printf("  total load time:    %.2f ms mean (requested to uploaded)\n",
+        1000.0*totalloadtime/n);
+}
+
+
+/* Add a job for the loader thread and return its handle */
+int AsyncLoader::addJob(int kind, void *target, const char *filename) {
+
+    Job job;
+    job.kind = kind;
+    job.target = target;
+    job.filename = filename;
+    job.status = QUEUED;
+    job.requesttime = glfwGetTime();
+    job.parsedtime = 0.0;
+
+    int handle;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        handle = (int)jobs.size();
+        jobs.push_back(job);
+        requests.push_back(handle);
+    }
+    wakeup.notify_all();
+    return handle;
+}
+
+
+/* The main function of the loader thread: parse files, queue them for upload */
+void AsyncLoader::loaderLoop() {
+
+    for(;;) {
+        int handle;
+        int kind;
+        void *target;
+        std::string filename;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // Wait for a request, and for room in the upload queue
+            while(!stopping && (requests.empty() || (int)uploads.size() >= maxqueued)) {
+                wakeup.wait(lock);
+            }
+            if(stopping) return;
+            handle = requests.front();
+            requests.pop_front();
+            jobs[handle].status = LOADING;
+            kind = jobs[handle].kind;
+            target = jobs[handle].target;
+            filename = jobs[handle].filename;
+        }
+
+        int success;
+        if(kind == MESH) {
+            success = ((TriangleSoup*)target)->loadOBJ(filename.c_str());
+        }
+        else {
+            success = ((Texture*)target)->loadTGA(filename.c_str());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if(success) {
+            jobs[handle].status = UPLOADING;
+            jobs[handle].parsedtime = glfwGetTime();
+            uploads.push_back(handle);
+            if((int)uploads.size() > maxqueuedepth) maxqueuedepth = (int)uploads.size();
+        }
+        else {
+            jobs[handle].status = FAILED;
+            numfailed++;
+        }
+    }
+}
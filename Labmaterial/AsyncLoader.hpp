@@ -0,0 +1,123 @@
+/* AsyncLoader.hpp */
+/* Loads meshes and textures in the background, without stalling the window. */
+/* Usage: call loadMesh() or loadTexture() with an empty TriangleSoup or
+ * Texture and a file name. They return at once with a handle that can be
+ * passed to status(). Files are read and parsed on a loader thread, and
+ * the results wait in a bounded upload queue. Call processUploads() once
+ * per frame, on the thread that owns the OpenGL context, to create the
+ * buffers and textures for as many finished loads as fit in a time budget.
+ * Until then, the objects are simply not drawn (TriangleSoup::render()
+ * does nothing without buffers, and an unloaded Texture has textureID 0).
+ *
+ * The objects must stay alive, and must not be touched by the caller,
+ * until their loads are READY or FAILED. Destroy the AsyncLoader before
+ * the objects it loads into: its destructor waits for the current load.
+ *
+ * Queue depth, upload times and latencies are kept in the public
+ * statistics members, and printStats() shows a summary. */
+
+#ifndef ASYNCLOADER_HPP // Avoid including this header twice
+#define ASYNCLOADER_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <vector>
+
+class TriangleSoup;
+class Texture;
+
+class AsyncLoader {
+
+public:
+
+/* The state of a load, as returned by status() */
+enum Status {
+    QUEUED,    // Waiting for the loader thread
+    LOADING,   // Being read and parsed on the loader thread
+    UPLOADING, // Parsed, waiting in the upload queue for processUploads()
+    READY,     // Uploaded to OpenGL and ready to draw
+    FAILED     // The file could not be loaded
+};
+
+// Statistics, updated by processUploads()
+int numuploads;          // Number of finished uploads
+int numfailed;           // Number of failed loads
+int maxqueuedepth;       // Largest number of loads waiting for upload at once
+double totaluploadtime;  // Time spent in OpenGL uploads, in seconds
+double maxuploadtime;    // Longest single upload, in seconds
+double totallatency;     // Sum of times from parsed to uploaded, in seconds
+double maxlatency;       // Longest time from parsed to uploaded, in seconds
+double totalloadtime;    // Sum of times from request to uploaded, in seconds
+
+/* Constructor: start the loader thread. At most maxqueued parsed
+ * objects wait for upload at a time. When the queue is full, the
+ * loader thread waits, which bounds the memory used by parsed data. */
+AsyncLoader(int maxqueued = 4);
+
+/* Destructor: finish the current load, drop the rest and stop the thread */
+~AsyncLoader();
+
+/* Start loading an OBJ file into mesh (see TriangleSoup::loadOBJ()).
+ * Returns a handle for status(). */
+int loadMesh(TriangleSoup *mesh, const char *filename);
+
+/* Start loading a TGA file into texture (see Texture::loadTGA()).
+ * Returns a handle for status(). */
+int loadTexture(Texture *texture, const char *filename);
+
+/* The Status of the load with the given handle */
+int status(int handle);
+
+/* The number of loads that are not yet READY or FAILED */
+int pending();
+
+/* The number of parsed objects waiting in the upload queue */
+int queueDepth();
+
+/*
+ * processUploads() - upload finished loads to OpenGL until budgetms
+ * milliseconds have passed. At least one upload is done if there is one
+ * waiting, and a single upload is never split, so a huge mesh can take
+ * longer than the budget. Call it from the thread with the GL context.
+ * Returns the number of objects that were uploaded.
+ */
+int processUploads(double budgetms);
+
+/* Print the statistics to the console */
+void printStats();
+
+private:
+
+struct Job {
+    int kind;             // MESH or TEXTURE
+    void *target;         // The TriangleSoup or Texture to load into
+    std::string filename;
+    int status;           // Status enum
+    double requesttime;   // When loadMesh() or loadTexture() was called
+    double parsedtime;    // When the loader thread finished parsing
+};
+
+enum JobKind { MESH, TEXTURE };
+
+std::vector<Job> jobs;            // All loads ever requested, indexed by handle
+std::deque<int> requests;         // Handles waiting for the loader thread
+std::deque<int> uploads;          // Handles waiting for processUploads()
+int maxqueued;                    // Capacity of the upload queue
+bool stopping;                    // Set by the destructor
+std::mutex mutex;                 // Protects everything above
+std::condition_variable wakeup;   // Signals new requests, free queue space or stop
+std::thread loader;
+
+int addJob(int kind, void *target, const char *filename);
+void loaderLoop();
+
+// Threads can't be copied, so neither can the loader
+AsyncLoader(const AsyncLoader &);
+AsyncLoader &operator=(const AsyncLoader &);
+
+};
+
+#endif // ASYNCLOADER_HPP
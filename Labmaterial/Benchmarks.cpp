@@ -0,0 +1,627 @@
+/*
+ * Performance measurements for parts of the framework.
+ * Each benchmark repeats its work a few times and reports the best
+ * time, which is the least disturbed by other activity on the machine.
+ */
+
+#include <cstdio>  // For console messages
+#include <cstdlib> // For strtof() and rand()
+#include <cstring> // For memcmp(), memcpy() and memset()
+#include <cmath>   // For sqrtf()
+#include <ctime>   // For time()
+#include <thread>  // For hardware_concurrency()
+#include <string>
+#include <vector>
+
+#include "Benchmarks.hpp"
+#include "OBJLoader.hpp"
+#include "ThreadPool.hpp"
+#include "Parsing.hpp"
+#include "Bounds.hpp"
+#include "TriangleSoup.hpp"
+#include "DrawBatch.hpp"
+#include "Shader.hpp"
+#include "RenderQueue.hpp"
+#include "GLState.hpp"
+#include "UniformBuffer.hpp"
+#include "ProgramCache.hpp"
+#include "ShaderBatch.hpp"
+#include "ShaderSource.hpp"
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // For glfwGetTime()
+#include "Utilities.hpp"  // To be able to use OpenGL extensions
+
+namespace {
+
+const int REPEATS = 3; // Runs per measurement
+
+// 10 to an integer power, for making test numbers
+double pow10i(int e) {
+    double p = 1.0;
+    for(int i=0; i<e; i++) p *= 10.0;
+    for(int i=0; i>e; i--) p /= 10.0;
+    return p;
+}
+
+/* 1 if the range bound to the FrameBlock binding point holds frame */
+int frameBlockBound(const FrameBlock &frame) {
+    GLint buffer = 0, start = 0, size = 0;
+    glGetIntegeri_v(GL_UNIFORM_BUFFER_BINDING, UNIFORMBUFFER_FRAME_BINDING, &buffer);
+    glGetIntegeri_v(GL_UNIFORM_BUFFER_START, UNIFORMBUFFER_FRAME_BINDING, &start);
+    glGetIntegeri_v(GL_UNIFORM_BUFFER_SIZE, UNIFORMBUFFER_FRAME_BINDING, &size);
+    if(buffer == 0 || size != (GLint)sizeof(FrameBlock)) return 0;
+    FrameBlock bound;
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, (GLuint)buffer);
+    glGetBufferSubData(GL_UNIFORM_BUFFER, start, sizeof(bound), &bound);
+    return !memcmp(&bound, &frame, sizeof(bound));
+}
+
+}
+
+
+/*
+ * objScaling() - parse an OBJ file with an increasing number of threads.
+ */
+void Benchmarks::objScaling(const char *filename, int maxthreads) {
+
+    double singletime = 0.0;
+
+    if(maxthreads <= 0) maxthreads = (int)std::thread::hardware_concurrency();
+    if(maxthreads <= 0) maxthreads = 1;
+
+    printf("OBJ parsing scaling, \"%s\"\n", filename);
+    printf("threads   seconds      MB/s   speedup\n");
+    for(int threads=1; ; threads*=2) {
+        if(threads > maxthreads) threads = maxthreads;
+        ThreadPool pool(threads);
+        double best = 0.0;
+        double megabytes = 0.0;
+        for(int r=0; r<REPEATS; r++) {
+            OBJLoader loader;
+            loader.pool = &pool;
+            loader.verbose = 0;
+            if(!loader.load(filename)) return;
+            if(r == 0 || loader.seconds < best) best = loader.seconds;
+            megabytes = loader.megabytes;
+        }
+        if(threads == 1) singletime = best;
+        printf("%7d %9.3f %9.1f %9.2f\n", threads, best,
+            best > 0.0 ? megabytes/best : 0.0, best > 0.0 ? singletime/best : 0.0);
+        if(threads == maxthreads) break;
+    }
+}
+
+
+/*
+ * numberParsing() - time three ways of parsing the same numbers.
+ */
+void Benchmarks::numberParsing() {
+
+    const int COUNT = 200000; // Numbers per kind
+    const char *kinds[3] = { "short decimals", "long decimals", "exponents" };
+    std::vector<float> results(COUNT);
+    char number[64];
+
+    srand(4711); // Same numbers every time
+    printf("Number parsing, ns per number (%d numbers of each kind)\n", COUNT);
+    printf("%-16s %10s %10s %10s %10s\n", "kind", "parseFloat", "strtof", "sscanf", "mismatches");
+    for(int kind=0; kind<3; kind++) {
+        // One long text with the numbers separated by spaces
+        std::vector<char> text;
+        for(int i=0; i<COUNT; i++) {
+            double x = (rand() - RAND_MAX/2) / (double)(RAND_MAX/2);
+            if(kind == 0) sprintf(number, "%.6f ", x);
+            else if(kind == 1) sprintf(number, "%.9f ", 1000.0*x);
+            else sprintf(number, "%.7e ", x * pow10i(rand() % 40 - 20));
+            text.insert(text.end(), number, number + strlen(number));
+        }
+        text.push_back('\0');
+        const char *begin = &text[0];
+        const char *end = begin + text.size() - 1;
+
+        double best[3] = { 0.0, 0.0, 0.0 };
+        int mismatches = 0;
+        for(int r=0; r<REPEATS; r++) {
+            double t0 = glfwGetTime();
+            const char *p = begin;
+            for(int i=0; i<COUNT; i++) {
+                p = Parsing::parseFloat(p, end, &results[i]) + 1;
+            }
+            double t1 = glfwGetTime();
+            p = begin;
+            char *next;
+            for(int i=0; i<COUNT; i++) {
+                float x = strtof(p, &next);
+                if(memcmp(&x, &results[i], sizeof(float)) != 0) mismatches++;
+                p = next + 1;
+            }
+            double t2 = glfwGetTime();
+            p = begin;
+            int length;
+            for(int i=0; i<COUNT; i++) {
+                sscanf(p, "%f%n", &results[i], &length);
+                p += length + 1;
+            }
+            double t3 = glfwGetTime();
+            double times[3] = { t1-t0, t2-t1, t3-t2 };
+            for(int k=0; k<3; k++) {
+                if(r == 0 || times[k] < best[k]) best[k] = times[k];
+            }
+        }
+        printf("%-16s %10.1f %10.1f %10.1f %10d\n", kinds[kind],
+            1e9*best[0]/COUNT, 1e9*best[1]/COUNT, 1e9*best[2]/COUNT, mismatches/REPEATS);
+    }
+}
+
+
+/*
+ * boundingVolumes() - time the bounding volume kernels on a big array.
+ */
+void Benchmarks::boundingVolumes(int nverts) {
+
+    if(nverts <= 0) nverts = 10000000;
+    std::vector<GLfloat> vertices(8*(size_t)nverts);
+    srand(4711);
+    for(size_t i=0; i<vertices.size(); i++) {
+        vertices[i] = (rand() - RAND_MAX/2) / (float)(RAND_MAX/2);
+    }
+    double megabytes = vertices.size() * sizeof(GLfloat) / 1e6;
+
+    double best[3] = { 0.0, 0.0, 0.0 };
+    GLfloat loopmin[3], loopmax[3], boxmin[3], boxmax[3], center[3], radius;
+    for(int r=0; r<REPEATS; r++) {
+        double t0 = glfwGetTime();
+        for(int k=0; k<3; k++) loopmin[k] = loopmax[k] = vertices[k];
+        for(int i=1; i<nverts; i++) {
+            for(int k=0; k<3; k++) {
+                GLfloat x = vertices[8*(size_t)i + k];
+                if(x < loopmin[k]) loopmin[k] = x;
+                if(x > loopmax[k]) loopmax[k] = x;
+            }
+        }
+        double t1 = glfwGetTime();
+        Bounds::computeBox(&vertices[0], nverts, 8, boxmin, boxmax);
+        double t2 = glfwGetTime();
+        Bounds::computeSphere(&vertices[0], nverts, 8, boxmin, boxmax, center, &radius);
+        double t3 = glfwGetTime();
+        double times[3] = { t1-t0, t2-t1, t3-t2 };
+        for(int k=0; k<3; k++) {
+            if(r == 0 || times[k] < best[k]) best[k] = times[k];
+        }
+    }
+    const char *names[3] = { "plain loop box", "computeBox", "computeSphere" };
+    printf("Bounding volumes, %d vertices (%.0f MB), %d threads\n",
+        nverts, megabytes, ThreadPool::global().size());
+    printf("%-16s %9s %9s\n", "kernel", "ms", "MB/s");
+    for(int k=0; k<3; k++) {
+        printf("%-16s %9.2f %9.0f\n", names[k], 1e3*best[k], best[k] > 0.0 ? megabytes/best[k] : 0.0);
+    }
+    int same = 1;
+    for(int k=0; k<3; k++) {
+        if(boxmin[k] != loopmin[k] || boxmax[k] != loopmax[k]) same = 0;
+    }
+    printf("box %s the plain loop, sphere radius %.4f (box half diagonal %.4f)\n",
+        same ? "matches" : "DIFFERS FROM",
+        radius, 0.5f * sqrtf((boxmax[0]-boxmin[0])*(boxmax[0]-boxmin[0])
+        + (boxmax[1]-boxmin[1])*(boxmax[1]-boxmin[1]) + (boxmax[2]-boxmin[2])*(boxmax[2]-boxmin[2])));
+}
+
+
+/*
+ * drawSubmission() - the same batch submitted both ways. The spheres
+ * have few triangles and cover few pixels, so that the time goes to the
+ * calls rather than to the drawing, which Mesa's llvmpipe does on the CPU.
+ */
+void Benchmarks::drawSubmission(int ndraws) {
+
+    if(ndraws <= 0) ndraws = 10000;
+    const int NUMMESHES = 8;
+    TriangleSoup meshes[NUMMESHES];
+    for(int m=0; m<NUMMESHES; m++) {
+        meshes[m].setOptions(TriangleSoup::USE_GEOMETRY_ARENA);
+        meshes[m].createSphere(0.5f, 2 + m/2); // 8 to 80 triangles
+    }
+
+    // A grid of spheres over the whole viewport
+    std::vector<GLfloat> matrices(16*(size_t)ndraws, 0.0f);
+    std::vector<GLfloat> colors(4*(size_t)ndraws);
+    int side = (int)ceil(sqrt((double)ndraws));
+    float spacing = 2.0f / side;
+    for(int i=0; i<ndraws; i++) {
+        GLfloat *M = &matrices[16*(size_t)i];
+        M[0] = M[5] = M[10] = 0.8f * spacing;
+        M[12] = -1.0f + spacing * (i % side + 0.5f);
+        M[13] = -1.0f + spacing * (i / side + 0.5f);
+        M[15] = 1.0f;
+        for(int k=0; k<3; k++) colors[4*(size_t)i+k] = 0.5f + 0.5f * (float)((i >> k) & 1);
+        colors[4*(size_t)i+3] = 1.0f;
+    }
+
+    Shader shaders[2];
+    shaders[0].createShader("vertex_instanced.glsl", "fragment_instanced.glsl");
+    if(DrawBatch::indirectSupported()) {
+        shaders[1].createShader("vertex_indirect.glsl", "fragment_instanced.glsl");
+    }
+    GLfloat identity[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+    FrameBlock frame;
+    memcpy(frame.P, identity, sizeof(frame.P));
+    memcpy(frame.LV, identity, sizeof(frame.LV));
+    frame.time = 0.0f;
+    ObjectBlock object;
+    memcpy(object.MV, identity, sizeof(object.MV));
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    std::vector<unsigned char> images[2];
+    glEnable(GL_DEPTH_TEST);
+
+    printf("Draw submission, %d draws of %d meshes in a GeometryArena\n", ndraws, NUMMESHES);
+    printf("%-10s %6s %9s %9s %9s %9s\n", "path", "calls", "add ms", "submit ms", "us/draw", "finish ms");
+    DrawBatch batch;
+    for(int path=0; path<2; path++) {
+        batch.setMode(path == 0 ? DrawBatch::LOOP : DrawBatch::AUTO);
+        if(batch.usesIndirect() != path) {
+            printf("%-10s not supported by this OpenGL context\n", "indirect");
+            continue;
+        }
+        GLState::useProgram(shaders[path].programID);
+        UniformRing::get().bindData(UNIFORMBUFFER_FRAME_BINDING, &frame, sizeof(frame));
+        UniformRing::get().bindData(UNIFORMBUFFER_OBJECT_BINDING, &object, sizeof(object));
+        double best[3] = { 0.0, 0.0, 0.0 };
+        for(int r=0; r<=REPEATS; r++) { // The first run is a warm-up, not counted
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glFinish();
+            double t0 = glfwGetTime();
+            batch.clear();
+            for(int i=0; i<ndraws; i++) {
+                batch.add(meshes[i % NUMMESHES], &matrices[16*(size_t)i], &colors[4*(size_t)i]);
+            }
+            double t1 = glfwGetTime();
+            batch.submit();
+            double t2 = glfwGetTime();
+            glFinish();
+            double t3 = glfwGetTime();
+            double times[3] = { t1-t0, t2-t1, t3-t2 };
+            for(int k=0; k<3; k++) {
+                if(r == 1 || times[k] < best[k]) best[k] = times[k];
+            }
+        }
+        images[path].resize(4 * (size_t)viewport[2] * viewport[3]);
+        glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3], GL_RGBA, GL_UNSIGNED_BYTE, &images[path][0]);
+        printf("%-10s %6d %9.3f %9.3f %9.3f %9.3f\n", path == 0 ? "loop" : "indirect", batch.numCalls(),
+            1e3*best[0], 1e3*best[1], 1e6*best[1]/ndraws, 1e3*best[2]);
+    }
+    GLState::useProgram(0);
+    glDisable(GL_DEPTH_TEST);
+    if(!images[1].empty()) {
+        size_t differences = 0;
+        for(size_t i=0; i<images[0].size(); i++) differences += (images[0][i] != images[1][i]);
+        printf("images %s (%d different bytes)\n", differences == 0 ? "match" : "DIFFER", (int)differences);
+    }
+    GeometryArena::printAllStats();
+}
+
+
+/*
+ * renderQueue() - the objects are single triangles, so that drawing
+ * them costs little next to the queue itself.
+ */
+void Benchmarks::renderQueue(int nitems) {
+
+    if(nitems <= 0) nitems = 100000;
+    const int NUMPROGRAMS = 4;
+    const int NUMTEXTURES = 16;
+    const int NUMMESHES = 32;
+    Shader shaders[NUMPROGRAMS];
+    GLuint textures[NUMTEXTURES];
+    TriangleSoup meshes[NUMMESHES];
+    for(int p=0; p<NUMPROGRAMS; p++) shaders[p].createShader("vertex.glsl", "fragment.glsl");
+    glGenTextures(NUMTEXTURES, textures);
+    for(int t=0; t<NUMTEXTURES; t++) {
+        unsigned char texel[4] = { (unsigned char)(16*t), 128, (unsigned char)(255 - 16*t), 255 };
+        GLState::bindTexture(GL_TEXTURE_2D, textures[t]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    }
+    GLState::bindTexture(GL_TEXTURE_2D, 0);
+    for(int m=0; m<NUMMESHES; m++) meshes[m].createTriangle();
+
+    // Random objects in front of the camera
+    srand(4711);
+    std::vector<int> choices(3*(size_t)nitems);
+    std::vector<GLfloat> matrices(16*(size_t)nitems, 0.0f);
+    for(int i=0; i<nitems; i++) {
+        choices[3*(size_t)i] = rand() % NUMPROGRAMS;
+        choices[3*(size_t)i+1] = rand() % NUMTEXTURES;
+        choices[3*(size_t)i+2] = rand() % NUMMESHES;
+        GLfloat *M = &matrices[16*(size_t)i];
+        M[0] = M[5] = M[10] = 0.05f;
+        M[12] = (rand() - RAND_MAX/2) / (float)(RAND_MAX/2);
+        M[13] = (rand() - RAND_MAX/2) / (float)(RAND_MAX/2);
+        M[14] = -0.5f * rand() / (float)RAND_MAX; // Within the clip volume
+        M[15] = 1.0f;
+    }
+    FrameBlock frame = { { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 }, { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 },
+                         0.0f, { 0.0f, 0.0f, 0.0f } };
+    UniformRing::get().bindData(UNIFORMBUFFER_FRAME_BINDING, &frame, sizeof(frame));
+
+    printf("RenderQueue, %d programs, %d textures, %d meshes\n", NUMPROGRAMS, NUMTEXTURES, NUMMESHES);
+    printf("%8s %11s %11s %11s %13s %13s\n", "objects", "submit ns", "sort ns", "draw ns",
+        "binds sorted", "binds unsorted");
+    RenderQueue queue;
+    for(int n = nitems/100; n <= nitems; n *= 10) {
+        if(n <= 0) continue;
+        double best[3] = { 0.0, 0.0, 0.0 };
+        int unsortedbinds = 0;
+        for(int r=0; r<=REPEATS; r++) { // The first run is a warm-up, not counted
+            glFinish();
+            double t0 = glfwGetTime();
+            for(int i=0; i<n; i++) {
+                const int *c = &choices[3*(size_t)i];
+                queue.submit(shaders[c[0]].programID, textures[c[1]], meshes[c[2]], &matrices[16*(size_t)i]);
+            }
+            double t1 = glfwGetTime();
+            unsortedbinds = queue.unsortedBinds();
+            double t2 = glfwGetTime();
+            queue.sort();
+            double t3 = glfwGetTime();
+            queue.execute();
+            glFinish();
+            double t4 = glfwGetTime();
+            double times[3] = { t1-t0, t3-t2, t4-t3 };
+            for(int k=0; k<3; k++) {
+                if(r == 1 || times[k] < best[k]) best[k] = times[k];
+            }
+        }
+        printf("%8d %11.1f %11.1f %11.1f %13d %13d\n", n, 1e9*best[0]/n, 1e9*best[1]/n, 1e9*best[2]/n,
+            queue.frameprogrambinds + queue.frametexturebinds + queue.framevaobinds, unsortedbinds);
+    }
+    GLState::useProgram(0);
+    for(int t=0; t<NUMTEXTURES; t++) GLState::deleteTexture(textures[t]);
+}
+
+
+/*
+ * uniformSetting() - each draw sets MV, P, LV and tex, as the main loop
+ * did for each object, and draws a triangle. The first three ways differ
+ * only in how the plain uniforms are set. The last one uses the uniform
+ * blocks instead: one FrameBlock for the frame, and all the ObjectBlocks
+ * written at once with a glBindBufferRange() per draw.
+ */
+void Benchmarks::uniformSetting(int ndraws) {
+
+    if(ndraws <= 0) ndraws = 1000;
+    Shader shader;
+    shader.createShader("vertex.glsl", "fragment.glsl", "PLAIN_UNIFORMS");
+    Shader blockshader("vertex.glsl", "fragment.glsl");
+    TriangleSoup mesh;
+    mesh.createTriangle();
+    std::vector<GLfloat> matrices(16*(size_t)ndraws, 0.0f);
+    for(int i=0; i<ndraws; i++) {
+        GLfloat *M = &matrices[16*(size_t)i];
+        M[0] = M[5] = M[10] = 0.05f;
+        M[12] = -1.0f + 2.0f * (i % 32) / 32.0f;
+        M[13] = -1.0f + 2.0f * ((i / 32) % 32) / 32.0f;
+        M[15] = 1.0f;
+    }
+    GLfloat identity[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+    GLuint program = shader.programID;
+    Shader::Uniform<GL_FLOAT_MAT4> MV(shader, "MV"), P(shader, "P"), LV(shader, "LV");
+    Shader::Uniform<GL_SAMPLER_2D> tex(shader, "tex");
+    printf("Uniforms, %d draws per frame, %d uniforms in the program\n", ndraws, (int)shader.uniforms.size());
+    printf("%-10s %9s %9s %9s\n", "way", "frame ms", "us/draw", "saved ms");
+
+    FrameBlock frame;
+    memcpy(frame.P, identity, sizeof(frame.P));
+    memcpy(frame.LV, identity, sizeof(frame.LV));
+    frame.time = 0.0f;
+    UniformRing &ring = UniformRing::get();
+    size_t stride = ring.stride(sizeof(ObjectBlock));
+
+    const char *names[4] = { "by name", "locations", "GLState", "UBO ring" };
+    double bynametime = 0.0;
+    for(int way=0; way<4; way++) {
+        GLState::invalidate(); // The other ways set the uniforms behind its back
+        GLState::useProgram(way < 3 ? program : blockshader.programID);
+        if(way == 3) Shader::Uniform<GL_SAMPLER_2D>(blockshader, "tex").set(0);
+        double best = 0.0;
+        for(int r=0; r<=REPEATS; r++) { // The first run is a warm-up, not counted
+            glClear(GL_COLOR_BUFFER_BIT);
+            glFinish();
+            double t0 = glfwGetTime();
+            GLintptr blocks = 0;
+            if(way == 3) { // The frame once, and every object in one write
+                ring.bindData(UNIFORMBUFFER_FRAME_BINDING, &frame, sizeof(frame));
+                char *room = (char *)ring.map(ndraws * stride, &blocks);
+                if(room) {
+                    for(int i=0; i<ndraws; i++) {
+                        memcpy(room + i*stride, &matrices[16*(size_t)i], sizeof(ObjectBlock));
+                    }
+                    ring.unmap();
+                }
+                else { // The room is reserved all the same, so fill it in place
+                    for(int i=0; i<ndraws; i++) {
+                        ring.write(blocks + i*stride, &matrices[16*(size_t)i], sizeof(ObjectBlock));
+                    }
+                }
+            }
+            for(int i=0; i<ndraws; i++) {
+                const GLfloat *M = &matrices[16*(size_t)i];
+                if(way == 0) { // What the main loop did before
+                    glUniformMatrix4fv(glGetUniformLocation(program, "MV"), 1, GL_FALSE, M);
+                    glUniformMatrix4fv(glGetUniformLocation(program, "P"), 1, GL_FALSE, identity);
+                    glUniformMatrix4fv(glGetUniformLocation(program, "LV"), 1, GL_FALSE, identity);
+                    glUniform1i(glGetUniformLocation(program, "tex"), 0);
+                }
+                else if(way == 1) { // The same calls without the lookups
+                    glUniformMatrix4fv(MV.location, 1, GL_FALSE, M);
+                    glUniformMatrix4fv(P.location, 1, GL_FALSE, identity);
+                    glUniformMatrix4fv(LV.location, 1, GL_FALSE, identity);
+                    glUniform1i(tex.location, 0);
+                }
+                else if(way == 2) { // Only the values that changed
+                    MV.set(M);
+                    P.set(identity);
+                    LV.set(identity);
+                    tex.set(0);
+                }
+                else {
+                    ring.bind(UNIFORMBUFFER_OBJECT_BINDING, blocks + i*stride, sizeof(ObjectBlock));
+                }
+                mesh.render();
+            }
+            double t1 = glfwGetTime();
+            glFinish();
+            if(r == 1 || t1 - t0 < best) best = t1 - t0;
+        }
+        if(way == 0) bynametime = best;
+        printf("%-10s %9.3f %9.3f %9.3f\n", names[way], 1e3*best, 1e6*best/ndraws, 1e3*(bynametime - best));
+    }
+    GLState::useProgram(0);
+}
+
+
+/*
+ * shaderCompiling() - the batch finishes its programs in the order the
+ * driver completes them, and the serial way waits for each before the
+ * next, so the difference is what the driver's threads overlap.
+ */
+void Benchmarks::shaderCompiling(int nprograms) {
+
+    if(nprograms <= 0) nprograms = 100;
+    ProgramCache::setDirectory(NULL); // It would turn the second way into loads
+    ShaderSource vertexfile, fragmentfile;
+    if(!vertexfile.load("vertex.glsl") || !fragmentfile.load("fragment.glsl")) {
+        printf("Cannot read vertex.glsl and fragment.glsl\n");
+        return;
+    }
+    const std::string &vertexsource = vertexfile.text;
+    const std::string &fragmentsource = fragmentfile.text;
+    long long salt = (long long)time(NULL);
+
+    ShaderBatch batch; // Before the first way too, so that both get the threads
+    int threads = ShaderBatch::compilerThreads();
+    char threadcount[32];
+    sprintf(threadcount, threads < 0 ? "as the driver likes" : "%d", threads);
+    printf("Shader compiling, %d programs, %s (compiler threads: %s), %d cores\n", nprograms,
+        ShaderBatch::parallelSupported() ? "parallel compiling" : "no parallel compiling",
+        threadcount, (int)std::thread::hardware_concurrency());
+    printf("%-10s %9s %11s\n", "way", "total ms", "ms/program");
+
+    const char *names[2] = { "serial", "batch" };
+    for(int way=0; way<2; way++) {
+        // Every program of both ways is new to the driver
+        std::vector<std::string> vertexvariants(nprograms);
+        for(int p=0; p<nprograms; p++) {
+            char constant[64]; // A comment would not do, as drivers hash the shader without them
+            sprintf(constant, "\nconst int variant_%d_%d_%lld = 0;\n", p, way, salt);
+            vertexvariants[p] = vertexsource + constant;
+        }
+        Shader *shaders = new Shader[nprograms];
+        glFinish();
+        double t0 = glfwGetTime();
+        for(int p=0; p<nprograms; p++) {
+            if(way == 0) {
+                shaders[p].beginShaderSource(vertexvariants[p].c_str(), fragmentsource.c_str());
+                shaders[p].finish();
+            }
+            else {
+                batch.addSource(&shaders[p], vertexvariants[p].c_str(), fragmentsource.c_str());
+            }
+        }
+        batch.finish();
+        double t1 = glfwGetTime();
+        int linked = 0;
+        for(int p=0; p<nprograms; p++) {
+            if(!shaders[p].uniforms.empty()) linked++;
+        }
+        printf("%-10s %9.1f %11.3f%s\n", names[way], 1e3*(t1 - t0), 1e3*(t1 - t0)/nprograms,
+            linked == nprograms ? "" : "  (some did not link)");
+        delete[] shaders;
+    }
+}
+
+
+/*
+ * uniformRingWrap() - the same frame drawn from a ring that never fills
+ * up and from one that starts over several times in the frame. The frame
+ * block is bound once at the start, like in the main loop, and the
+ * objects are mapped a few at a time, like the RenderQueue does.
+ */
+void Benchmarks::uniformRingWrap(int capacity) {
+
+    if(capacity <= 0) capacity = 1024;
+    const int NUMOBJECTS = 64;
+    const int PERMAP = 4; // Objects per map()
+    const int FRAMES = 100;
+    Shader shader("vertex.glsl", "fragment.glsl");
+    TriangleSoup mesh;
+    mesh.createTriangle();
+    GLfloat identity[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+    FrameBlock frame;
+    memset(&frame, 0, sizeof(frame)); // The padding too, for the comparison
+    memcpy(frame.P, identity, sizeof(frame.P));
+    memcpy(frame.LV, identity, sizeof(frame.LV));
+    frame.P[0] = frame.P[5] = 0.5f; // Something a lost frame block would not draw
+    std::vector<ObjectBlock> objects(NUMOBJECTS);
+    for(int i=0; i<NUMOBJECTS; i++) {
+        memcpy(objects[i].MV, identity, sizeof(objects[i].MV));
+        objects[i].MV[0] = objects[i].MV[5] = 0.2f;
+        objects[i].MV[12] = -1.5f + 3.0f * (i % 8) / 8.0f;
+        objects[i].MV[13] = -1.5f + 3.0f * (i / 8) / 8.0f;
+    }
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    std::vector<unsigned char> images[2];
+
+    printf("UniformRing starting over, %d objects per frame, %d per map\n", NUMOBJECTS, PERMAP);
+    printf("%-10s %9s %9s %11s\n", "ring", "bytes", "frame us", "frame block");
+    for(int way=0; way<2; way++) {
+        UniformRing ring(way == 0 ? (size_t)1 << 20 : (size_t)capacity);
+        size_t stride = ring.stride(sizeof(ObjectBlock));
+        GLState::useProgram(shader.programID);
+        Shader::Uniform<GL_SAMPLER_2D>(shader, "tex").set(0);
+        int lost = 0;
+        double best = 0.0;
+        for(int f=0; f<=FRAMES; f++) { // The first frame is a warm-up, not counted
+            int check = (f == FRAMES); // The checks wait for the GPU, so not timed
+            glClear(GL_COLOR_BUFFER_BIT);
+            glFinish();
+            double t0 = glfwGetTime();
+            ring.bindData(UNIFORMBUFFER_FRAME_BINDING, &frame, sizeof(frame));
+            for(int i=0; i<NUMOBJECTS; i+=PERMAP) {
+                GLintptr blocks = 0;
+                char *room = (char *)ring.map(PERMAP * stride, &blocks);
+                if(room) {
+                    for(int k=0; k<PERMAP; k++) memcpy(room + k*stride, &objects[i+k], sizeof(ObjectBlock));
+                    ring.unmap();
+                }
+                else {
+                    for(int k=0; k<PERMAP; k++) ring.write(blocks + k*stride, &objects[i+k], sizeof(ObjectBlock));
+                }
+                for(int k=0; k<PERMAP; k++) {
+                    ring.bind(UNIFORMBUFFER_OBJECT_BINDING, blocks + k*stride, sizeof(ObjectBlock));
+                    if(check && !frameBlockBound(frame)) lost++;
+                    mesh.render();
+                }
+            }
+            double t1 = glfwGetTime();
+            glFinish();
+            if(!check && (f == 1 || t1 - t0 < best)) best = t1 - t0;
+        }
+        images[way].resize(4 * (size_t)viewport[2] * viewport[3]);
+        glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3], GL_RGBA, GL_UNSIGNED_BYTE, &images[way][0]);
+        char kept[32];
+        sprintf(kept, lost ? "LOST %d" : "kept", lost);
+        printf("%-10s %9d %9.3f %11s\n", way == 0 ? "large" : "small",
+            way == 0 ? 1 << 20 : capacity, 1e6*best, kept);
+        ring.printStats(); // How often it started over
+    }
+    GLState::useProgram(0);
+    size_t differences = 0;
+    for(size_t i=0; i<images[0].size(); i++) differences += (images[0][i] != images[1][i]);
+    printf("images %s (%d different bytes)\n", differences == 0 ? "match" : "DIFFER", (int)differences);
+}
@@ -0,0 +1,85 @@
+/* Benchmarks.hpp */
+/*
+ * Performance measurements for parts of the framework.
+ * Usage: run the program with "--bench <name> [arguments]" to run a
+ * benchmark instead of opening the normal window. See main() for the
+ * list of names. The results are printed to the console.
+ */
+
+#ifndef BENCHMARKS_HPP // Avoid including this header twice
+#define BENCHMARKS_HPP
+
+namespace Benchmarks {
+
+/*
+ * objScaling() - parse an OBJ file with 1, 2, 4 ... maxthreads threads
+ * and print the best time out of a few runs, the throughput and the
+ * speedup over a single thread. maxthreads 0 means all hardware threads.
+ */
+void objScaling(const char *filename, int maxthreads);
+
+/*
+ * numberParsing() - compare Parsing::parseFloat() with sscanf("%f") and
+ * strtof() on a few typical kinds of numbers, in nanoseconds per number.
+ * Also checks that parseFloat() gives exactly the same result as strtof().
+ */
+void numberParsing();
+
+/*
+ * boundingVolumes() - time Bounds::computeBox() and computeSphere() on
+ * nverts random vertices in the TriangleSoup format, against a plain
+ * loop like the one printInfo() used to run, and print the bandwidth.
+ */
+void boundingVolumes(int nverts);
+
+/*
+ * drawSubmission() - draw ndraws small spheres from a GeometryArena with
+ * a DrawBatch, once with glMultiDrawElementsIndirect() and once with one
+ * draw call each, and print the CPU time for add() and submit(), and
+ * the time glFinish() then waits for the GPU. Also checks that the two
+ * ways give the same image. Needs an OpenGL context and the shaders.
+ */
+void drawSubmission(int ndraws);
+
+/*
+ * renderQueue() - submit nitems/100, nitems/10 and nitems objects with
+ * random programs, textures and meshes to a RenderQueue, and print the
+ * time per object to submit, sort and draw them, and the binds made
+ * compared to drawing them in the order they came. Needs an OpenGL
+ * context and the shaders.
+ */
+void renderQueue(int nitems);
+
+/*
+ * uniformSetting() - make ndraws draws per frame, each with the uniforms
+ * MV, P, LV and tex, and print the CPU time per frame when they are set
+ * with glGetUniformLocation() for every draw, with the locations from
+ * Shader::Uniform handles, and with the handles through GLState, which
+ * skips the values that did not change, and with the uniform blocks of
+ * a UniformRing instead. Needs an OpenGL context and the shaders.
+ */
+void uniformSetting(int ndraws);
+
+/*
+ * shaderCompiling() - compile and link nprograms variants of the main
+ * shaders, first one by one, each with Shader::beginShaderSource() and
+ * then Shader::finish(), then all at once in a ShaderBatch, and print the
+ * time each way took. The variants differ only in an unused constant
+ * named after the time, so that no cache in the driver has seen them.
+ * The ProgramCache is turned off. Needs an OpenGL context and the shaders.
+ */
+void shaderCompiling(int nprograms);
+
+/*
+ * uniformRingWrap() - draw a frame of small objects with a UniformRing
+ * of 1 MB and with one of capacity bytes, which has to start over many
+ * times in the frame. Checks before every draw that the FrameBlock bound
+ * at the start of the frame is still in place, and that the two rings
+ * give the same image, and prints the CPU time per frame. Needs an
+ * OpenGL context and the shaders.
+ */
+void uniformRingWrap(int capacity);
+
+}
+
+#endif // BENCHMARKS_HPP
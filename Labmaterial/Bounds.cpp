@@ -0,0 +1,259 @@
+/*
+ * Bounding volumes, see Bounds.hpp.
+ * Both kernels load a whole vertex position as 4 floats with one
+ * unaligned SSE load (the fourth float is ignored), which needs a stride
+ * of at least 4 floats. The box kernel keeps the minimum and maximum
+ * of all lanes at once. The distance kernel transposes 4 vertices to
+ * x, y and z vectors and computes 4 squared distances per step, keeping
+ * the vertex numbers of the largest ones in an integer vector.
+ * Without SSE2, or with a smaller stride, plain loops do the same work.
+ */
+
+#include <cmath>     // For sqrtf()
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Bounds.hpp"
+#include "ThreadPool.hpp"
+
+namespace {
+
+const int VERTEX_BLOCK = 65536; // Vertices per parallel task
+const int MAX_GROW_STEPS = 64;  // Ritter steps before the sphere is settled as it is
+
+/* The farthest vertex in one block, or -1 and a distance of -1 if it's empty */
+struct Farthest {
+    int vertex;
+    float distance2;
+};
+
+/* The box of the vertices first to end-1, which must be at least one */
+void boxOfRange(const GLfloat *vertices, int first, int end, int stride,
+                GLfloat *boxmin, GLfloat *boxmax) {
+
+    int i = first;
+#ifdef __SSE2__
+    if(stride >= 4) {
+        // Two sets of accumulators, so consecutive loads don't wait for each other
+        __m128 lo0 = _mm_loadu_ps(vertices + (size_t)stride*i);
+        __m128 hi0 = lo0, lo1 = lo0, hi1 = lo0;
+        for(i=first+1; i+2<=end; i+=2) {
+            __m128 p0 = _mm_loadu_ps(vertices + (size_t)stride*i);
+            __m128 p1 = _mm_loadu_ps(vertices + (size_t)stride*(i+1));
+            lo0 = _mm_min_ps(lo0, p0);
+            hi0 = _mm_max_ps(hi0, p0);
+            lo1 = _mm_min_ps(lo1, p1);
+            hi1 = _mm_max_ps(hi1, p1);
+        }
+        if(i < end) {
+            __m128 p = _mm_loadu_ps(vertices + (size_t)stride*i);
+            lo0 = _mm_min_ps(lo0, p);
+            hi0 = _mm_max_ps(hi0, p);
+        }
+        float lo[4], hi[4];
+        _mm_storeu_ps(lo, _mm_min_ps(lo0, lo1));
+        _mm_storeu_ps(hi, _mm_max_ps(hi0, hi1));
+        for(int k=0; k<3; k++) {
+            boxmin[k] = lo[k];
+            boxmax[k] = hi[k];
+        }
+        return;
+    }
+#endif
+    for(int k=0; k<3; k++) boxmin[k] = boxmax[k] = vertices[(size_t)stride*i + k];
+    for(i=first+1; i<end; i++) {
+        const GLfloat *p = vertices + (size_t)stride*i;
+        for(int k=0; k<3; k++) {
+            if(p[k] < boxmin[k]) boxmin[k] = p[k];
+            if(p[k] > boxmax[k]) boxmax[k] = p[k];
+        }
+    }
+}
+
+/* The farthest of the vertices first to end-1 from point */
+Farthest farthestInRange(const GLfloat *vertices, int first, int end, int stride,
+                         const GLfloat *point) {
+
+    Farthest result = { -1, -1.0f };
+    int i = first;
+#ifdef __SSE2__
+    if(stride >= 4 && end - first >= 4) {
+        const __m128 px = _mm_set1_ps(point[0]);
+        const __m128 py = _mm_set1_ps(point[1]);
+        const __m128 pz = _mm_set1_ps(point[2]);
+        const __m128i four = _mm_set1_epi32(4);
+        __m128 best = _mm_set1_ps(-1.0f);
+        __m128i bestvertex = _mm_set1_epi32(-1);
+        __m128i vertex = _mm_setr_epi32(first, first+1, first+2, first+3);
+        for(; i+4<=end; i+=4) {
+            __m128 x = _mm_loadu_ps(vertices + (size_t)stride*i);
+            __m128 y = _mm_loadu_ps(vertices + (size_t)stride*(i+1));
+            __m128 z = _mm_loadu_ps(vertices + (size_t)stride*(i+2));
+            __m128 w = _mm_loadu_ps(vertices + (size_t)stride*(i+3));
+            _MM_TRANSPOSE4_PS(x, y, z, w); // Now x has the x of all 4 vertices, and so on
+            __m128 dx = _mm_sub_ps(x, px);
+            __m128 dy = _mm_sub_ps(y, py);
+            __m128 dz = _mm_sub_ps(z, pz);
+            __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            // Strictly greater, so each lane keeps the first of equal distances
+            __m128i greater = _mm_castps_si128(_mm_cmpgt_ps(d2, best));
+            best = _mm_max_ps(best, d2);
+            bestvertex = _mm_or_si128(_mm_and_si128(greater, vertex), _mm_andnot_si128(greater, bestvertex));
+            vertex = _mm_add_epi32(vertex, four);
+        }
+        float lanedistance[4];
+        int lanevertex[4];
+        _mm_storeu_ps(lanedistance, best);
+        _mm_storeu_si128((__m128i*)lanevertex, bestvertex);
+        for(int l=0; l<4; l++) {
+            if(lanedistance[l] > result.distance2
+               || (lanedistance[l] == result.distance2 && lanevertex[l] < result.vertex)) {
+                result.distance2 = lanedistance[l];
+                result.vertex = lanevertex[l];
+            }
+        }
+    }
+#endif
+    for(; i<end; i++) {
+        const GLfloat *p = vertices + (size_t)stride*i;
+        float dx = p[0] - point[0], dy = p[1] - point[1], dz = p[2] - point[2];
+        float d2 = dx*dx + dy*dy + dz*dz;
+        if(d2 > result.distance2) {
+            result.distance2 = d2;
+            result.vertex = i;
+        }
+    }
+    return result;
+}
+
+/* The number of parallel tasks for nverts vertices */
+inline int numBlocks(int nverts) {
+    return (nverts + VERTEX_BLOCK - 1) / VERTEX_BLOCK;
+}
+
+} // namespace
+
+
+/*
+ * computeBox() - per block boxes in parallel, then merged in order.
+ */
+void Bounds::computeBox(const GLfloat *vertices, int nverts, int stride,
+                        GLfloat *boxmin, GLfloat *boxmax) {
+
+    for(int k=0; k<3; k++) boxmin[k] = boxmax[k] = 0.0f;
+    if(nverts <= 0) return;
+
+    int numblocks = numBlocks(nverts);
+    if(numblocks == 1) {
+        boxOfRange(vertices, 0, nverts, stride, boxmin, boxmax);
+        return;
+    }
+    std::vector<GLfloat> blockboxes(6*(size_t)numblocks);
+    ThreadPool::global().parallelFor(numblocks, [&](int b) {
+        int end = (nverts - b*VERTEX_BLOCK < VERTEX_BLOCK) ? nverts : (b+1)*VERTEX_BLOCK;
+        boxOfRange(vertices, b*VERTEX_BLOCK, end, stride, &blockboxes[6*b], &blockboxes[6*b+3]);
+    });
+    for(int k=0; k<3; k++) {
+        boxmin[k] = blockboxes[k];
+        boxmax[k] = blockboxes[k+3];
+    }
+    for(int b=1; b<numblocks; b++) {
+        for(int k=0; k<3; k++) {
+            if(blockboxes[6*b+k] < boxmin[k]) boxmin[k] = blockboxes[6*b+k];
+            if(blockboxes[6*b+k+3] > boxmax[k]) boxmax[k] = blockboxes[6*b+k+3];
+        }
+    }
+}
+
+
+/*
+ * farthestVertex() - per block searches in parallel, then the farthest
+ * of the blocks, taken in order so that ties go to the lowest number.
+ */
+int Bounds::farthestVertex(const GLfloat *vertices, int nverts, int stride,
+                           const GLfloat *point, GLfloat *distance2) {
+
+    *distance2 = 0.0f;
+    if(nverts <= 0) return -1;
+
+    int numblocks = numBlocks(nverts);
+    Farthest result;
+    if(numblocks == 1) {
+        result = farthestInRange(vertices, 0, nverts, stride, point);
+    }
+    else {
+        std::vector<Farthest> blockresults(numblocks);
+        ThreadPool::global().parallelFor(numblocks, [&](int b) {
+            int end = (nverts - b*VERTEX_BLOCK < VERTEX_BLOCK) ? nverts : (b+1)*VERTEX_BLOCK;
+            blockresults[b] = farthestInRange(vertices, b*VERTEX_BLOCK, end, stride, point);
+        });
+        result = blockresults[0];
+        for(int b=1; b<numblocks; b++) {
+            if(blockresults[b].distance2 > result.distance2) result = blockresults[b];
+        }
+    }
+    if(result.vertex < 0) result.vertex = 0; // Only NaN coordinates
+    *distance2 = (result.distance2 > 0.0f) ? result.distance2 : 0.0f;
+    return result.vertex;
+}
+
+
+/*
+ * computeSphere() - Ritter's method, with a whole pass over the vertices
+ * for every step. Each step moves the sphere towards the farthest vertex
+ * just enough to take it in, while keeping all of the old sphere inside.
+ * The first search, from the box center, also gives the box sphere, so
+ * it takes three passes when the first guess already holds everything.
+ */
+void Bounds::computeSphere(const GLfloat *vertices, int nverts, int stride,
+                           const GLfloat *boxmin, const GLfloat *boxmax,
+                           GLfloat *center, GLfloat *radius) {
+
+    for(int k=0; k<3; k++) center[k] = 0.0f;
+    *radius = 0.0f;
+    if(nverts <= 0) return;
+
+    // The sphere around the box center, and the vertex farthest from it
+    GLfloat boxcenter[3];
+    for(int k=0; k<3; k++) boxcenter[k] = 0.5f * (boxmin[k] + boxmax[k]);
+    float d2;
+    int a = farthestVertex(vertices, nverts, stride, boxcenter, &d2);
+    float boxradius = sqrtf(d2);
+
+    // First guess: the sphere through that vertex and the one farthest from it
+    const GLfloat *pa = vertices + (size_t)stride*a;
+    int b = farthestVertex(vertices, nverts, stride, pa, &d2);
+    const GLfloat *pb = vertices + (size_t)stride*b;
+    float c[3];
+    for(int k=0; k<3; k++) c[k] = 0.5f * (pa[k] + pb[k]);
+    float r = 0.5f * sqrtf(d2);
+
+    // Grow towards the farthest vertex until it is inside
+    int farvertex = farthestVertex(vertices, nverts, stride, c, &d2);
+    for(int step=0; step<MAX_GROW_STEPS; step++) {
+        float d = sqrtf(d2);
+        if(d <= r) break;
+        const GLfloat *pf = vertices + (size_t)stride*farvertex;
+        float newr = 0.5f * (r + d);
+        float t = (newr - r) / d;
+        for(int k=0; k<3; k++) c[k] += t * (pf[k] - c[k]);
+        r = newr;
+        farvertex = farthestVertex(vertices, nverts, stride, c, &d2);
+    }
+    // The last search gives the exact radius for this center, which can be
+    // a little smaller than the grown one
+    r = sqrtf(d2);
+
+    // The sphere around the box center is smaller for some shapes
+    if(boxradius < r) {
+        r = boxradius;
+        for(int k=0; k<3; k++) c[k] = boxcenter[k];
+    }
+
+    for(int k=0; k<3; k++) center[k] = c[k];
+    // Round up a little, so rounding errors in the distances can't leave a vertex outside
+    *radius = r * (1.0f + 1e-6f);
+}
@@ -0,0 +1,56 @@
+/* Bounds.hpp */
+/* Bounding boxes and bounding spheres for arrays of vertices. */
+/* Usage: call computeBox() and computeSphere() once when a mesh is
+ * built and keep the results, like TriangleSoup does. The vertices are
+ * given as an array of floats with the position (x y z) first in each
+ * vertex and stride floats from one vertex to the next (8 for the
+ * interleaved TriangleSoup format).
+ *
+ * The loops run on 4 floats at a time with SSE, and large arrays are cut
+ * into blocks that are handled in parallel on the global ThreadPool, so
+ * big meshes are limited by the memory bandwidth. The results are the
+ * same for any number of threads. */
+
+#ifndef BOUNDS_HPP // Avoid including this header twice
+#define BOUNDS_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+
+namespace Bounds {
+
+/*
+ * computeBox() - the axis aligned bounding box of nverts vertices.
+ * boxmin and boxmax get 3 floats each, zeros if nverts is 0.
+ */
+void computeBox(const GLfloat *vertices, int nverts, int stride,
+                GLfloat *boxmin, GLfloat *boxmax);
+
+/*
+ * computeSphere() - a small sphere around nverts vertices, with their
+ * box from computeBox().
+ * The center is found with Ritter's method: a first guess from two
+ * vertices far apart, which grows to take in the farthest vertex until
+ * all of them are inside. The sphere around the box center is also
+ * tried, and the smaller one is kept. The radius is always the exact
+ * distance to the farthest vertex, so it is usually within 5-10% of the
+ * smallest possible sphere, and never smaller.
+ */
+void computeSphere(const GLfloat *vertices, int nverts, int stride,
+                   const GLfloat *boxmin, const GLfloat *boxmax,
+                   GLfloat *center, GLfloat *radius);
+
+/*
+ * farthestVertex() - the vertex farthest from point.
+ * Returns its number (the lowest one if there is a tie), or -1 if nverts
+ * is 0, and puts its squared distance from point in *distance2.
+ */
+int farthestVertex(const GLfloat *vertices, int nverts, int stride,
+                   const GLfloat *point, GLfloat *distance2);
+
+}
+
+#endif // BOUNDS_HPP
@@ -0,0 +1,251 @@
+/*
+ * Batched draws with glMultiDrawElementsIndirect(), or one draw call
+ * at a time where that is not available, see DrawBatch.hpp.
+ */
+
+#include <cstring>   // For memcpy() and strcmp()
+#include <algorithm> // For stable_sort()
+
+#include "DrawBatch.hpp"
+#include "GLState.hpp"     // Binds that skip what is already bound
+#include "Utilities.hpp"  // To be able to use OpenGL extensions
+
+namespace {
+
+/* One glMultiDrawElementsIndirect() call: the draws for one VAO */
+struct Group {
+    GLuint vao;
+    GLenum indextype;
+    int firstcommand;
+    int firstdata;
+    int count;
+};
+
+/* Make room for size bytes in a stream buffer and copy data to it */
+void streamBuffer(GLenum target, GLuint buffer, size_t *capacity, const void *data, size_t size) {
+    GLState::bindBuffer(target, buffer);
+    if(size > *capacity) {
+        *capacity = (size > 2 * *capacity) ? size : 2 * *capacity;
+    }
+    // Orphan the old storage, which the GPU may still be reading
+    glBufferData(target, *capacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(target, 0, size, data);
+}
+
+} // namespace
+
+
+/* Constructor: an empty batch */
+DrawBatch::DrawBatch() {
+    commandbuffer = 0;
+    databuffer = 0;
+    commandcapacity = 0;
+    datacapacity = 0;
+    mode = AUTO;
+    indirect = -1;
+    alignment = 1;
+    numcalls = 0;
+}
+
+
+/* Destructor: delete the buffers, if there are any */
+DrawBatch::~DrawBatch() {
+    GLState::deleteBuffer(commandbuffer);
+    GLState::deleteBuffer(databuffer);
+}
+
+
+void DrawBatch::clear() {
+    draws.clear();
+    drawdata.clear();
+}
+
+
+/*
+ * add() - one Draw for each range of the mesh, all with the same data.
+ */
+void DrawBatch::add(TriangleSoup &mesh, const GLfloat *matrix, const GLfloat *color,
+                    float layer, int level) {
+
+    ranges.clear();
+    if(mesh.getDrawRanges(level, ranges) == 0) return;
+
+    DrawData data;
+    const VertexFormat &format = mesh.vertexFormat();
+    memcpy(data.matrix, matrix, sizeof(data.matrix));
+    for(int k=0; k<4; k++) data.color[k] = color ? color[k] : 1.0f;
+    memcpy(data.positionscale, format.positionscale, sizeof(data.positionscale));
+    memcpy(data.positionbias, format.positionbias, sizeof(data.positionbias));
+    memcpy(data.texcoordscalebias, format.texcoordscalebias, sizeof(data.texcoordscalebias));
+    data.positionscale[3] = (format.normaltype == VertexFormat::NORMAL_OCT16) ? 1.0f : 0.0f;
+    data.positionbias[3] = layer;
+    drawdata.push_back(data);
+
+    Draw draw;
+    draw.vao = mesh.vertexArray();
+    draw.indextype = mesh.indexType();
+    draw.data = (int)drawdata.size() - 1;
+    for(size_t i=0; i<ranges.size(); i++) {
+        draw.range = ranges[i];
+        draws.push_back(draw);
+    }
+}
+
+
+/*
+ * submit() - sort the draws by VAO, so that each VAO is bound once,
+ * and draw them one of the two ways.
+ */
+void DrawBatch::submit() {
+
+    numcalls = 0;
+    if(draws.empty()) return;
+    std::stable_sort(draws.begin(), draws.end(), [](const Draw &a, const Draw &b) {
+        return a.vao < b.vao || (a.vao == b.vao && a.indextype < b.indextype);
+    });
+    if(usesIndirect()) submitIndirect();
+    else submitLoop();
+}
+
+
+void DrawBatch::setMode(int mode) {
+    this->mode = mode;
+    indirect = -1; // Check again on the next submit()
+}
+
+
+/* Check once, on the first call, as that needs the OpenGL context */
+int DrawBatch::usesIndirect() {
+    if(indirect < 0) {
+        indirect = (mode != LOOP && indirectSupported()) ? 1 : 0;
+#ifdef GL_SHADER_STORAGE_BUFFER
+        if(indirect) {
+            GLint bytes = 1;
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &bytes);
+            alignment = ((int)bytes + (int)sizeof(DrawData) - 1) / (int)sizeof(DrawData);
+            if(alignment < 1) alignment = 1;
+        }
+#endif
+    }
+    return indirect;
+}
+
+
+/*
+ * indirectSupported() - glMultiDrawElementsIndirect() and shader storage
+ * buffers are core in OpenGL 4.3, but gl_DrawIDARB needs the extension
+ * (or OpenGL 4.6). The macOS headers stop at OpenGL 4.1.
+ */
+int DrawBatch::indirectSupported() {
+#ifdef GL_SHADER_STORAGE_BUFFER
+#ifdef __WIN32__
+    if(!glMultiDrawElementsIndirect) return 0;
+#endif
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if(major * 10 + minor < 43) return 0;
+    GLint numextensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numextensions);
+    for(int i=0; i<numextensions; i++) {
+        const char *name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if(name && !strcmp(name, "GL_ARB_shader_draw_parameters")) return 1;
+    }
+#endif
+    return 0;
+}
+
+
+int DrawBatch::numDraws() const {
+    return (int)draws.size();
+}
+
+int DrawBatch::numCalls() const {
+    return numcalls;
+}
+
+
+/*
+ * private
+ * submitIndirect() - the commands and the data in the same order, a
+ * group for each VAO. gl_DrawIDARB starts from 0 in every call, so each
+ * group gets its own range of the data buffer, which must start at a
+ * multiple of GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT.
+ */
+void DrawBatch::submitIndirect() {
+
+#ifdef GL_SHADER_STORAGE_BUFFER
+    std::vector<Group> groups;
+    commands.clear();
+    sorteddata.clear();
+    for(size_t i=0; i<draws.size(); i++) {
+        const Draw &draw = draws[i];
+        if(groups.empty() || groups.back().vao != draw.vao || groups.back().indextype != draw.indextype) {
+            while(sorteddata.size() % alignment != 0) sorteddata.push_back(sorteddata.back());
+            Group group = { draw.vao, draw.indextype, (int)commands.size(), (int)sorteddata.size(), 0 };
+            groups.push_back(group);
+        }
+        IndirectCommand command = { (GLuint)draw.range.count, 1, (GLuint)draw.range.first,
+                                    draw.range.basevertex, 0 };
+        commands.push_back(command);
+        sorteddata.push_back(drawdata[draw.data]);
+        groups.back().count++;
+    }
+
+    if(!commandbuffer) glGenBuffers(1, &commandbuffer);
+    if(!databuffer) glGenBuffers(1, &databuffer);
+    streamBuffer(GL_SHADER_STORAGE_BUFFER, databuffer, &datacapacity,
+        &sorteddata[0], sorteddata.size() * sizeof(DrawData));
+    streamBuffer(GL_DRAW_INDIRECT_BUFFER, commandbuffer, &commandcapacity,
+        &commands[0], commands.size() * sizeof(IndirectCommand));
+
+    // The indirect buffer binding is not part of the VAO, so it stays
+    // bound for all the groups
+    for(size_t g=0; g<groups.size(); g++) {
+        const Group &group = groups[g];
+        GLState::bindVertexArray(group.vao);
+        GLState::bindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAWBATCH_DATA_BINDING, databuffer,
+            group.firstdata * sizeof(DrawData), group.count * sizeof(DrawData));
+        glMultiDrawElementsIndirect(GL_TRIANGLES, group.indextype,
+            (void*)(group.firstcommand * sizeof(IndirectCommand)), group.count, 0);
+        numcalls++;
+    }
+#endif
+}
+
+
+/*
+ * private
+ * submitLoop() - one draw call each, with the data as constant vertex
+ * attributes. Arrays for the instance attributes, which
+ * TriangleSoup::renderInstanced() may have left enabled in the VAO,
+ * are turned off to let the constants through.
+ */
+void DrawBatch::submitLoop() {
+
+    GLuint vao = 0;
+    for(size_t i=0; i<draws.size(); i++) {
+        const Draw &draw = draws[i];
+        if(draw.vao != vao) {
+            vao = draw.vao;
+            GLState::bindVertexArray(vao);
+            for(int a=TRIANGLESOUP_INSTANCE_MATRIX; a<=TRIANGLESOUP_INSTANCE_LAYER; a++) {
+                glDisableVertexAttribArray(a);
+            }
+        }
+        const DrawData &data = drawdata[draw.data];
+        for(int c=0; c<4; c++) {
+            glVertexAttrib4fv(TRIANGLESOUP_INSTANCE_MATRIX + c, &data.matrix[4*c]);
+        }
+        glVertexAttrib4fv(TRIANGLESOUP_INSTANCE_COLOR, data.color);
+        glVertexAttrib1f(TRIANGLESOUP_INSTANCE_LAYER, data.positionbias[3]);
+        glVertexAttrib4fv(VERTEXFORMAT_POSITION_SCALE, data.positionscale);
+        glVertexAttrib4fv(VERTEXFORMAT_POSITION_BIAS, data.positionbias);
+        glVertexAttrib4fv(VERTEXFORMAT_TEXCOORD_SCALE_BIAS, data.texcoordscalebias);
+        glVertexAttrib1f(VERTEXFORMAT_NORMAL_ENCODING, data.positionscale[3]);
+        size_t indexsize = (draw.indextype == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+        glDrawElementsBaseVertex(GL_TRIANGLES, draw.range.count, draw.indextype,
+            (void*)(draw.range.first * indexsize), draw.range.basevertex);
+        numcalls++;
+    }
+}
@@ -0,0 +1,128 @@
+/* DrawBatch.hpp */
+/* Many TriangleSoup draws submitted to OpenGL together. */
+/* Usage: add() every object to draw this frame, each with its own
+ * matrix (applied before MV, like the instance matrices of
+ * TriangleSoup::renderInstanced()), color and texture layer, then
+ * call submit() with the shader program bound, and clear() before the
+ * next frame. The same mesh may be added any number of times.
+ *
+ * With OpenGL 4.3 and GL_ARB_shader_draw_parameters, submit() writes a
+ * DrawElementsIndirectCommand for every draw to a buffer, and the data
+ * of every draw to a shader storage buffer that the vertex shader reads
+ * with gl_DrawIDARB as the index, see vertex_indirect.glsl. The whole
+ * batch is then one glMultiDrawElementsIndirect() call for each VAO, so
+ * with all meshes in a GeometryArena it is one call per vertex format.
+ * Without them (OpenGL 3.3, or macOS), submit() makes one
+ * glDrawElementsBaseVertex() call per draw instead, with the data as
+ * constant vertex attributes, for vertex_instanced.glsl. usesIndirect()
+ * tells which of the two shaders to bind. Both shaders give the same
+ * outputs, for fragment_instanced.glsl.
+ *
+ * The draws are sorted by VAO, so the order of add() calls is not kept. */
+
+#ifndef DRAWBATCH_HPP // Avoid including this header twice
+#define DRAWBATCH_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+#include "TriangleSoup.hpp"
+
+#include <vector>
+
+// The shader storage binding point of the per-draw data, see vertex_indirect.glsl
+#define DRAWBATCH_DATA_BINDING 0
+
+class DrawBatch {
+
+public:
+
+/* Ways for submit() to draw, for setMode() */
+enum Mode {
+    AUTO = 0, // Indirect if the driver can, else one call per draw
+    LOOP = 1  // One glDrawElementsBaseVertex() per draw, as on OpenGL 3.3
+};
+
+/* Constructor: an empty batch. No OpenGL calls are made until submit(). */
+DrawBatch();
+
+/* Destructor: delete the buffers */
+~DrawBatch();
+
+/* Remove all draws, but keep the buffers for the next frame */
+void clear();
+
+/* Add a level of detail of a mesh, with a matrix (16 floats, column
+ * major), a color (4 floats, NULL for white) and a texture layer.
+ * Meshes without buffers yet are skipped. */
+void add(TriangleSoup &mesh, const GLfloat *matrix, const GLfloat *color = NULL,
+         float layer = 0.0f, int level = 0);
+
+/* Draw everything that was added, with the current shader program */
+void submit();
+
+/* Choose between the two ways to submit, see enum Mode */
+void setMode(int mode);
+
+/* 1 if submit() uses glMultiDrawElementsIndirect() and needs
+ * vertex_indirect.glsl, 0 if it needs vertex_instanced.glsl */
+int usesIndirect();
+
+/* 1 if the current OpenGL context can do indirect batches */
+static int indirectSupported();
+
+/* The number of draws added, and the number of OpenGL draw calls the
+ * last submit() made for them */
+int numDraws() const;
+int numCalls() const;
+
+private:
+
+/* What the shaders get for each draw: std430 layout, 128 bytes */
+struct DrawData {
+    GLfloat matrix[16];
+    GLfloat color[4];
+    GLfloat positionscale[4];     // xyz, and the normal encoding in w
+    GLfloat positionbias[4];      // xyz, and the texture layer in w
+    GLfloat texcoordscalebias[4];
+};
+
+/* The same layout as the DrawElementsIndirectCommand of OpenGL */
+struct IndirectCommand {
+    GLuint count;
+    GLuint instancecount;
+    GLuint firstindex;
+    GLint basevertex;
+    GLuint baseinstance;
+};
+
+/* A range of an index buffer, and its data */
+struct Draw {
+    GLuint vao;
+    GLenum indextype;
+    IndexRange range;
+    int data;         // Index in drawdata
+};
+
+void submitIndirect();
+void submitLoop();
+
+std::vector<Draw> draws;
+std::vector<DrawData> drawdata;
+std::vector<IndexRange> ranges;  // Scratch space for add()
+std::vector<IndirectCommand> commands;
+std::vector<DrawData> sorteddata;
+GLuint commandbuffer;  // GL_DRAW_INDIRECT_BUFFER, 0 until it is needed
+GLuint databuffer;     // GL_SHADER_STORAGE_BUFFER
+size_t commandcapacity; // Bytes in the buffers
+size_t datacapacity;
+int mode;
+int indirect;   // usesIndirect(), -1 until it is known
+int alignment;  // The data for a VAO must start at a multiple of this many draws
+int numcalls;
+
+};
+
+#endif // DRAWBATCH_HPP
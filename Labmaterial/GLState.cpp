@@ -0,0 +1,254 @@
+/*
+ * A shadow copy of the OpenGL bindings, see GLState.hpp.
+ */
+
+#include <cstdio>  // For printf()
+#include <cstring> // For memcmp() and memcpy()
+#include <unordered_map>
+#include <stdint.h>
+
+#include "GLState.hpp"
+#include "Utilities.hpp"  // To be able to use OpenGL extensions
+
+namespace {
+
+const GLuint UNKNOWN = ~(GLuint)0; // Not a name OpenGL gives out
+const int MAX_UNITS = 16;          // Texture units that are shadowed
+const int NUM_TARGETS = 4;         // Texture targets that are shadowed
+
+enum Kind { PROGRAM = 0, VAO, BUFFER, TEXTURE, VIEWPORT, UNIFORM, NUM_KINDS };
+const char *kindnames[NUM_KINDS] = { "programs", "VAOs", "buffers", "textures", "viewport", "uniforms" };
+
+/* A uniform value, as up to 16 floats or ints */
+struct Uniform {
+    GLfloat values[16];
+};
+
+// The defaults of a new context, where nothing is bound
+GLuint program = 0;
+GLuint vao = 0;
+GLuint elementbuffer = 0;       // Of the current VAO
+std::unordered_map<GLenum, GLuint> buffers; // The other targets
+GLuint newbuffertargets = 0;    // The binding of targets not in buffers
+int activeunit = 0;             // 0 for GL_TEXTURE0, -1 if unknown
+GLuint textures[MAX_UNITS][NUM_TARGETS];
+GLint viewportbox[4];
+int viewportknown = 0;
+std::unordered_map<uint64_t, Uniform> uniforms; // By program and location
+
+long long calls[NUM_KINDS];
+long long skipped[NUM_KINDS];
+
+/* The shadowed texture targets, or -1 */
+int targetIndex(GLenum target) {
+    switch(target) {
+        case GL_TEXTURE_2D: return 0;
+        case GL_TEXTURE_2D_ARRAY: return 1;
+        case GL_TEXTURE_CUBE_MAP: return 2;
+        case GL_TEXTURE_3D: return 3;
+        default: return -1;
+    }
+}
+
+/* The binding of a buffer target, which may be UNKNOWN */
+GLuint &bufferBinding(GLenum target) {
+    if(target == GL_ELEMENT_ARRAY_BUFFER) return elementbuffer;
+    std::unordered_map<GLenum, GLuint>::iterator found = buffers.find(target);
+    if(found == buffers.end()) found = buffers.insert(std::make_pair(target, newbuffertargets)).first;
+    return found->second;
+}
+
+/*
+ * sameUniform() - 1 if the uniform already has this value in the current
+ * program, else remember the value and return 0. size is in bytes.
+ */
+int sameUniform(GLint location, const void *value, size_t size) {
+    calls[UNIFORM]++;
+    if(program == UNKNOWN || program == 0) return 0;
+    uint64_t key = ((uint64_t)program << 32) | (uint32_t)location;
+    std::unordered_map<uint64_t, Uniform>::iterator found = uniforms.find(key);
+    if(found != uniforms.end() && !memcmp(found->second.values, value, size)) {
+        skipped[UNIFORM]++;
+        return 1;
+    }
+    memcpy(uniforms[key].values, value, size);
+    return 0;
+}
+
+/* Set all texture bindings to the same value */
+void setTextures(GLuint texture) {
+    for(int u=0; u<MAX_UNITS; u++) {
+        for(int t=0; t<NUM_TARGETS; t++) textures[u][t] = texture;
+    }
+}
+
+} // namespace
+
+
+void GLState::useProgram(GLuint program) {
+    calls[PROGRAM]++;
+    if(program == ::program) {
+        skipped[PROGRAM]++;
+        return;
+    }
+    ::program = program;
+    glUseProgram(program);
+}
+
+
+void GLState::bindVertexArray(GLuint vao) {
+    calls[VAO]++;
+    if(vao == ::vao) {
+        skipped[VAO]++;
+        return;
+    }
+    ::vao = vao;
+    elementbuffer = UNKNOWN; // Each VAO has its own
+    glBindVertexArray(vao);
+}
+
+
+void GLState::bindBuffer(GLenum target, GLuint buffer) {
+    calls[BUFFER]++;
+    GLuint &binding = bufferBinding(target);
+    if(buffer == binding) {
+        skipped[BUFFER]++;
+        return;
+    }
+    binding = buffer;
+    glBindBuffer(target, buffer);
+}
+
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    glBindBufferRange(target, index, buffer, offset, size);
+    bufferBinding(target) = buffer;
+}
+
+
+void GLState::activeTexture(GLenum unit) {
+    calls[TEXTURE]++;
+    int index = (int)(unit - GL_TEXTURE0);
+    if(index == activeunit && index < MAX_UNITS) {
+        skipped[TEXTURE]++;
+        return;
+    }
+    activeunit = (index < MAX_UNITS) ? index : -1; // Not shadowed beyond MAX_UNITS
+    glActiveTexture(unit);
+}
+
+
+void GLState::bindTexture(GLenum target, GLuint texture) {
+    calls[TEXTURE]++;
+    int t = targetIndex(target);
+    if(activeunit >= 0 && t >= 0) {
+        if(textures[activeunit][t] == texture) {
+            skipped[TEXTURE]++;
+            return;
+        }
+        textures[activeunit][t] = texture;
+    }
+    glBindTexture(target, texture);
+}
+
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    calls[VIEWPORT]++;
+    GLint box[4] = { x, y, (GLint)width, (GLint)height };
+    if(viewportknown && !memcmp(box, viewportbox, sizeof(box))) {
+        skipped[VIEWPORT]++;
+        return;
+    }
+    memcpy(viewportbox, box, sizeof(box));
+    viewportknown = 1;
+    glViewport(x, y, width, height);
+}
+
+
+void GLState::uniform1i(GLint location, GLint value) {
+    if(location < 0 || sameUniform(location, &value, sizeof(value))) return;
+    glUniform1i(location, value);
+}
+
+void GLState::uniform1f(GLint location, GLfloat value) {
+    if(location < 0 || sameUniform(location, &value, sizeof(value))) return;
+    glUniform1f(location, value);
+}
+
+void GLState::uniformMatrix4fv(GLint location, const GLfloat *value) {
+    if(location < 0 || sameUniform(location, value, 16 * sizeof(GLfloat))) return;
+    glUniformMatrix4fv(location, 1, GL_FALSE, value);
+}
+
+
+/*
+ * deleteProgram() - a deleted program stays in use until another one is,
+ * but its name may come back for a new program after that, so both the
+ * binding and the uniforms are forgotten.
+ */
+void GLState::deleteProgram(GLuint program) {
+    if(program == 0) return;
+    glDeleteProgram(program);
+    if(program == ::program) ::program = UNKNOWN;
+    for(std::unordered_map<uint64_t, Uniform>::iterator i = uniforms.begin(); i != uniforms.end(); ) {
+        if((GLuint)(i->first >> 32) == program) i = uniforms.erase(i);
+        else ++i;
+    }
+}
+
+
+/* OpenGL unbinds a deleted VAO, buffer or texture where it is bound */
+void GLState::deleteVertexArray(GLuint vao) {
+    if(vao == 0) return;
+    glDeleteVertexArrays(1, &vao);
+    if(vao == ::vao) {
+        ::vao = 0;
+        elementbuffer = UNKNOWN;
+    }
+}
+
+void GLState::deleteBuffer(GLuint buffer) {
+    if(buffer == 0) return;
+    glDeleteBuffers(1, &buffer);
+    if(elementbuffer == buffer) elementbuffer = 0;
+    for(std::unordered_map<GLenum, GLuint>::iterator i = buffers.begin(); i != buffers.end(); ++i) {
+        if(i->second == buffer) i->second = 0;
+    }
+}
+
+void GLState::deleteTexture(GLuint texture) {
+    if(texture == 0) return;
+    glDeleteTextures(1, &texture);
+    for(int u=0; u<MAX_UNITS; u++) {
+        for(int t=0; t<NUM_TARGETS; t++) {
+            if(textures[u][t] == texture) textures[u][t] = 0;
+        }
+    }
+}
+
+
+void GLState::invalidate() {
+    program = UNKNOWN;
+    vao = UNKNOWN;
+    elementbuffer = UNKNOWN;
+    buffers.clear();
+    newbuffertargets = UNKNOWN;
+    activeunit = -1;
+    setTextures(UNKNOWN);
+    viewportknown = 0;
+    uniforms.clear();
+}
+
+
+void GLState::printStats() {
+    printf("GLState: %-10s %10s %10s %8s\n", "", "calls", "skipped", "hit rate");
+    long long totalcalls = 0, totalskipped = 0;
+    for(int k=0; k<NUM_KINDS; k++) {
+        printf("         %-10s %10lld %10lld %7.1f%%\n", kindnames[k], calls[k], skipped[k],
+            calls[k] > 0 ? 100.0 * skipped[k] / calls[k] : 0.0);
+        totalcalls += calls[k];
+        totalskipped += skipped[k];
+    }
+    printf("         %-10s %10lld %10lld %7.1f%%\n", "total", totalcalls, totalskipped,
+        totalcalls > 0 ? 100.0 * totalskipped / totalcalls : 0.0);
+}
@@ -0,0 +1,68 @@
+/* GLState.hpp */
+/* A shadow copy of the OpenGL bindings, to skip calls that change nothing. */
+/* Usage: call GLState::useProgram(), bindVertexArray(), bindBuffer(),
+ * activeTexture(), bindTexture(), viewport() and the uniform functions
+ * instead of the OpenGL functions with the same names. Each of them
+ * remembers the last value it was given and only calls OpenGL when the
+ * new value is different. Uniforms are remembered for each program and
+ * location, and are set in the current program like glUniform*().
+ *
+ * This only works if all code that changes these bindings goes through
+ * GLState. Code that calls OpenGL directly must call invalidate()
+ * afterwards, so that everything is set again the next time. Objects
+ * must be deleted with the delete functions here, as OpenGL unbinds a
+ * deleted object, and may then give its name to a new object.
+ *
+ * The element array buffer binding is part of the VAO, so it is
+ * forgotten when the VAO changes. The shadow copy starts out like a new
+ * context, with nothing bound and texture unit 0 active. The viewport
+ * depends on the window, so the first viewport() call always goes
+ * through.
+ *
+ * Every call is counted, and printStats() shows how many of them were
+ * skipped. The state is for the one OpenGL context of the program, and
+ * may only be used on the thread where it is current. */
+
+#ifndef GLSTATE_HPP // Avoid including this header twice
+#define GLSTATE_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+
+namespace GLState {
+
+/* Bindings */
+void useProgram(GLuint program);
+void bindVertexArray(GLuint vao);
+void bindBuffer(GLenum target, GLuint buffer);
+void activeTexture(GLenum unit); // GL_TEXTURE0, GL_TEXTURE1 ...
+void bindTexture(GLenum target, GLuint texture); // On the active unit
+void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+/* glBindBufferRange() is never skipped, but it also binds the buffer to
+ * the target itself, which the shadow copy must know */
+void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+/* Uniforms of the current program. Location -1 is ignored, like OpenGL does. */
+void uniform1i(GLint location, GLint value);
+void uniform1f(GLint location, GLfloat value);
+void uniformMatrix4fv(GLint location, const GLfloat *value); // One matrix, not transposed
+
+/* Delete objects, and forget them and their uniforms */
+void deleteProgram(GLuint program);
+void deleteVertexArray(GLuint vao);
+void deleteBuffer(GLuint buffer);
+void deleteTexture(GLuint texture);
+
+/* Forget everything, after OpenGL calls that did not go through here */
+void invalidate();
+
+/* Print the number of calls of each kind, and how many were skipped */
+void printStats();
+
+}
+
+#endif // GLSTATE_HPP
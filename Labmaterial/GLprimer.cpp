@@ -22,6 +22,8 @@
 
 // File and console I/O for logging and error reporting
 #include <iostream>
+#include <cstring> // For strcmp() in the command line parsing
+#include <cstdlib> // For atoi()
 
 #include <Utilities.hpp>
 #include <Shader.hpp>
@@ -29,6 +31,19 @@
 #include <TriangleSoup.hpp>
 #include <Texture.hpp>
 #include <Rotator.hpp>
+#include <ThreadPool.hpp>
+#include <AsyncLoader.hpp>
+#include <LODSelector.hpp>
+#include <MeshBVH.hpp>
+#include <GeometryArena.hpp>
+#include <DrawBatch.hpp>
+#include <RenderQueue.hpp>
+#include <GLState.hpp>
+#include <UniformBuffer.hpp>
+#include <ProgramCache.hpp>
+#include <ShaderBatch.hpp>
+#include <ShaderVariants.hpp>
+#include <Benchmarks.hpp>
 
 // In MacOS X, tell GLFW to include the modern OpenGL headers.
 // Windows does not want this, so we make this Mac-only.
@@ -180,6 +195,35 @@ void mat4perspective(float M[], float vfov, float aspect, float znear, float zfa
 }
 /*
  * main(argc, argv) - the standard C++ entry point for the program
+ *
+ * Command line options:
+ * --threads N        Use N threads for parallel work (default: all cores)
+ * --lodpixels E      Largest error in pixels for levels of detail (default: 1)
+ * --normalmap FILE   Draw the dino with a tangent space normal map from a TGA file
+ * --instances N      Draw a grid of N dinos with one instanced draw call
+ * --batch MODE       With --instances, draw the grid as separate dinos and earths
+ *                    in a DrawBatch, MODE "indirect" (if the driver can) or "loop"
+ * --arena            Put the meshes in shared GeometryArena buffers, and print
+ *                    their use and fragmentation at exit
+ * --shadercache DIR  Keep linked shader programs in DIR (default: shadercache),
+ *                    or compile them every time with DIR "none"
+ * --uniformring B    Make the UniformRing B bytes (default 1 MB), so that a
+ *                    small one starts over in the middle of frames
+ * --bench NAME ARGS  Run a benchmark instead of the normal program:
+ *     objscaling FILE  OBJ parsing time for 1, 2, 4 ... N threads
+ *     numbers          Number parsing speed compared to sscanf() and strtof()
+ *     bounds [N]       Bounding box and sphere speed for N vertices (default 10M)
+ *     submit [N]       CPU time to submit N draws with DrawBatch, indirect and
+ *                      one by one (default 10000)
+ *     queue [N]        RenderQueue submit, sort and draw time for up to N
+ *                      objects (default 100000)
+ *     uniforms [N]     CPU time per frame to set the uniforms of N draws by
+ *                      name, by location, through GLState and with uniform
+ *                      buffers (default 1000)
+ *     shaders [N]      Time to compile N programs one by one and in a
+ *                      ShaderBatch (default 100)
+ *     ringwrap [BYTES] Check that the frame's uniforms survive a UniformRing
+ *                      of BYTES that starts over in the frame (default 1024)
  */
 int main(int argc, char *argv[]) {
 
@@ -187,14 +231,84 @@ int main(int argc, char *argv[]) {
 
 	int width, height;
 
+	const char *benchmark = NULL; // Name of a benchmark to run, if any
+	const char *benchfile = NULL; // Input file for the benchmark
+	int numthreads = 0;           // Number of threads, 0 for automatic
+	float lodpixels = 1.0f;       // Screen space error limit for LODSelector
+	const char *normalmapfile = NULL; // Normal map for the dino, if any
+	int numinstances = 0;         // Dinos to draw with renderInstanced(), 0 for just one
+	int usearena = 0;             // Meshes in a GeometryArena (1) or in buffers of their own (0)
+	int batchmode = -1;           // DrawBatch::Mode for the grid, -1 for renderInstanced()
+
+    for(int i=1; i<argc; i++) {
+        if(!strcmp(argv[i], "--threads") && i+1 < argc) {
+            numthreads = atoi(argv[++i]);
+            ThreadPool::setGlobalThreads(numthreads);
+        }
+        else if(!strcmp(argv[i], "--lodpixels") && i+1 < argc) {
+            lodpixels = (float)atof(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "--normalmap") && i+1 < argc) {
+            normalmapfile = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--instances") && i+1 < argc) {
+            numinstances = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "--batch") && i+1 < argc) {
+            batchmode = strcmp(argv[++i], "loop") ? DrawBatch::AUTO : DrawBatch::LOOP;
+        }
+        else if(!strcmp(argv[i], "--arena")) {
+            usearena = 1;
+        }
+        else if(!strcmp(argv[i], "--shadercache") && i+1 < argc) {
+            i++;
+            ProgramCache::setDirectory(strcmp(argv[i], "none") ? argv[i] : NULL);
+        }
+        else if(!strcmp(argv[i], "--uniformring") && i+1 < argc) {
+            UniformRing::setCapacity((size_t)atoi(argv[++i]));
+        }
+        else if(!strcmp(argv[i], "--bench") && i+1 < argc) {
+            benchmark = argv[++i];
+            if(i+1 < argc && argv[i+1][0] != '-') benchfile = argv[++i];
+        }
+        else {
+            cout << "Unknown option " << argv[i] << endl;
+        }
+    }
+
     const GLFWvidmode *vidmode;  // GLFW struct to hold information about the display
 	GLFWwindow *window;    // GLFW struct to hold information about the window
 
     // Initialise GLFW
     glfwInit();
 
+    if(benchmark && strcmp(benchmark, "submit") && strcmp(benchmark, "queue")
+        && strcmp(benchmark, "uniforms") && strcmp(benchmark, "shaders")
+        && strcmp(benchmark, "ringwrap")) {
+        // Benchmarks that don't need a window run here
+        if(!strcmp(benchmark, "objscaling") && benchfile) {
+            Benchmarks::objScaling(benchfile, numthreads);
+        }
+        else if(!strcmp(benchmark, "numbers")) {
+            Benchmarks::numberParsing();
+        }
+        else if(!strcmp(benchmark, "bounds")) {
+            Benchmarks::boundingVolumes(benchfile ? atoi(benchfile) : 0);
+        }
+        else {
+            cout << "Unknown benchmark " << benchmark << endl;
+        }
+        glfwTerminate();
+        return 0;
+    }
+
     /////////////////
-	Shader myShader;
+	ShaderVariants shaderVariants; // Owns the programs below
+	Shader *myShader = NULL;        // For the dino
+	Shader *earthShader = NULL;     // For the earth
+	Shader *normalmapShader = NULL; // For the dino with --normalmap
+	Shader *instancedShader = NULL; // For the dinos with --instances
+	Shader *indirectShader = NULL;  // For the indirect DrawBatch with --batch
 
 	KeyRotator myKeyRotator;
 	MouseRotator myMouseRotator;
@@ -203,20 +317,20 @@ int main(int argc, char *argv[]) {
 
 	Texture dinoTexture;
 	Texture earthTexture;
+	Texture normalmapTexture;
 
-	GLint location_tex;
+	// The uniforms of the frame and of the --instances grid
+	FrameBlock frameblock;
+	ObjectBlock gridblock;
 
     float MV[16];
     mat4identity(MV);
-    GLint location_MV;
 
     float P[16];
     mat4identity(P);
-    GLint location_P;
 
     float LV[16];
     mat4identity(LV);
-    GLint location_LV;
 
     float T[16];
     mat4identity(T);
@@ -232,13 +346,25 @@ int main(int argc, char *argv[]) {
 
 	float time;
 
-	GLuint location_time;
-
 	//TriangleSoup myShape;
 
 	TriangleSoup dino;
 	TriangleSoup earth;
 
+	// The grid for --batch, submitted anew every frame
+	DrawBatch batch;
+
+	// Draws the objects of each frame with as few state changes as possible
+	RenderQueue renderqueue;
+
+	// Picks a level of detail for each object from its size on screen
+	LODSelector lodselector(lodpixels);
+
+	// Loads files in the background. It is declared after the objects it
+	// loads into, so that it is destroyed (and its thread stopped) first.
+	AsyncLoader loader;
+	int statsprinted = 0;
+
     // Determine the desktop size
     vidmode = glfwGetVideoMode(glfwGetPrimaryMonitor());
 
@@ -270,18 +396,109 @@ int main(int argc, char *argv[]) {
 
     glfwSwapInterval(0); // Do not wait for screen refresh between frames
 
-    myShader.createShader("vertex.glsl", "fragment.glsl");
+    if(benchmark) { // Benchmarks that need an OpenGL context run here
+        if(!strcmp(benchmark, "submit")) {
+            Benchmarks::drawSubmission(benchfile ? atoi(benchfile) : 0);
+        }
+        else if(!strcmp(benchmark, "queue")) {
+            Benchmarks::renderQueue(benchfile ? atoi(benchfile) : 0);
+        }
+        else if(!strcmp(benchmark, "uniforms")) {
+            Benchmarks::uniformSetting(benchfile ? atoi(benchfile) : 0);
+        }
+        else if(!strcmp(benchmark, "shaders")) {
+            Benchmarks::shaderCompiling(benchfile ? atoi(benchfile) : 0);
+        }
+        else {
+            Benchmarks::uniformRingWrap(benchfile ? atoi(benchfile) : 0);
+        }
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return 0;
+    }
 
-    // Locate the sampler2D uniform in the shader program
-    location_tex = glGetUniformLocation(myShader.programID, "tex");
+    // Start compiling all the programs at once, and finish each of them
+    // just before it is first needed, so that a driver that compiles in
+    // the background can work on them all while the rest is set up.
+    // The dino has octahedral normals and the earth plain ones, so each
+    // gets a program without the branch on the normal encoding. The
+    // DrawBatch grid mixes the two, and keeps the branch.
+    ShaderBatch shaderbatch;
+    myShader = shaderVariants.get("vertex.glsl", "fragment.glsl", "NORMAL_OCTAHEDRAL", &shaderbatch);
+    earthShader = shaderVariants.get("vertex.glsl", "fragment.glsl", "NORMAL_XYZ", &shaderbatch);
+    if(normalmapfile) {
+        normalmapShader = shaderVariants.get("vertex_normalmap.glsl", "fragment_normalmap.glsl",
+            "NORMAL_OCTAHEDRAL", &shaderbatch);
+    }
+    if(numinstances > 0) {
+        instancedShader = shaderVariants.get("vertex_instanced.glsl", "fragment_instanced.glsl",
+            batchmode >= 0 ? NULL : "NORMAL_OCTAHEDRAL", &shaderbatch);
+        if(batchmode >= 0) {
+            batch.setMode(batchmode);
+            if(batch.usesIndirect()) {
+                indirectShader = shaderVariants.get("vertex_indirect.glsl", "fragment_instanced.glsl",
+                    NULL, &shaderbatch);
+            }
+        }
+    }
+
+    myShader->finish();
+    earthShader->finish();
+    // Tell the sampler2D uniform in the shader programs which texture unit
+    // to use. The program keeps the value, so this is only done once.
+    GLState::useProgram(myShader->programID);
+    Shader::Uniform<GL_SAMPLER_2D>(*myShader, "tex").set(0);
+    GLState::useProgram(earthShader->programID);
+    Shader::Uniform<GL_SAMPLER_2D>(*earthShader, "tex").set(0);
     // Generate one texture object with data from a TGA file
     //myTexture.createTexture ("textures/trex.tga");
-    dinoTexture.createTexture ("textures/trex.tga");
-    earthTexture.createTexture ("textures/earth.tga");
+    // The textures and the dino mesh are loaded in the background, and
+    // show up when they are ready instead of delaying the first frame.
+    loader.loadTexture(&dinoTexture, "textures/trex.tga");
+    loader.loadTexture(&earthTexture, "textures/earth.tga");
+
+    if(normalmapfile) {
+        normalmapShader->finish();
+        GLState::useProgram(normalmapShader->programID);
+        Shader::Uniform<GL_SAMPLER_2D>(*normalmapShader, "tex").set(0);
+        Shader::Uniform<GL_SAMPLER_2D>(*normalmapShader, "normalmap").set(1);
+        loader.loadTexture(&normalmapTexture, normalmapfile);
+    }
 
-    location_time = glGetUniformLocation(myShader.programID, "time");
-    if(location_time == -1){
-        cout << "Unable to locate variable 'time' in shader!" << endl;
+    // A square grid of small dinos in the xy plane, turned different
+    // ways and tinted in different colors
+    float *instancematrices = NULL;
+    float *instancecolors = NULL;
+    if(numinstances > 0) {
+        instancedShader->finish();
+        instancematrices = new float[16 * (size_t)numinstances];
+        instancecolors = new float[4 * (size_t)numinstances];
+        int side = (int)ceil(sqrt((double)numinstances));
+        float spacing = 2.4f / side;
+        for(int i=0; i<numinstances; i++) {
+            float *M = &instancematrices[16 * (size_t)i];
+            mat4rotz(M, 0.7f * i);
+            mat4identity(T); // Not mat4scale(), which scales w as well
+            T[0] = T[5] = T[10] = 0.4f * spacing;
+            mat4mult(T, M, M);
+            mat4translate(T, -1.2f + spacing * (i % side + 0.5f), -1.2f + spacing * (i / side + 0.5f), 0.0f);
+            mat4mult(T, M, M);
+            float *color = &instancecolors[4 * (size_t)i];
+            color[0] = 0.6f + 0.4f * (float)sin(0.37 * i);
+            color[1] = 0.6f + 0.4f * (float)sin(0.37 * i + 2.1);
+            color[2] = 0.6f + 0.4f * (float)sin(0.37 * i + 4.2);
+            color[3] = 1.0f;
+        }
+        mat4identity(T);
+        if(batchmode >= 0) {
+            if(indirectShader) indirectShader->finish();
+            cout << "DrawBatch: " << (batch.usesIndirect() ? "glMultiDrawElementsIndirect()"
+                : "one draw call per object") << endl;
+        }
+        const Shader &gridShader = (batchmode >= 0 && batch.usesIndirect())
+            ? *indirectShader : *instancedShader;
+        GLState::useProgram(gridShader.programID);
+        Shader::Uniform<GL_SAMPLER_2D>(gridShader, "tex").set(0);
     }
 
     myKeyRotator.init(window);
@@ -290,7 +507,14 @@ int main(int argc, char *argv[]) {
     //myShape.createSphere(0.5, 100);
     //myShape.createBox(0.5, 0.5, 0.5);
     //myShape.readOBJ("meshes/trex.obj");
-    dino.readOBJ("meshes/trex.obj");
+    dino.setOptions(TriangleSoup::WELD_VERTICES | TriangleSoup::OPTIMIZE_MESH
+        | TriangleSoup::GENERATE_LODS | TriangleSoup::BUILD_BVH
+        | (normalmapfile ? TriangleSoup::GENERATE_TANGENTS : 0)
+        | (usearena ? TriangleSoup::USE_GEOMETRY_ARENA : 0));
+    dino.setVertexFormat(VertexFormat::POSITION_UNORM16, VertexFormat::NORMAL_OCT16,
+        VertexFormat::TEXCOORD_UNORM16); // 16 bytes per vertex instead of 32
+    loader.loadMesh(&dino, "meshes/trex.obj");
+    if(usearena) earth.setOptions(TriangleSoup::USE_GEOMETRY_ARENA);
     earth.createSphere(0.25, 20);
 
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -304,7 +528,7 @@ int main(int argc, char *argv[]) {
         // size, and will change if the user resizes the window.
         glfwGetWindowSize( window, &width, &height );
         // Set viewport. This is the pixel rectangle we want to draw into.
-        glViewport( 0, 0, width, height ); // The entire window
+        GLState::viewport( 0, 0, width, height ); // The entire window
 		// Set the clear color and depth, and clear the buffers for drawing
         glClearColor( 0.3f, 0.3f, 0.3f, 0.0f );
 
@@ -312,17 +536,17 @@ int main(int argc, char *argv[]) {
 
         //////////////////RENDERING CODE BELOW//////////////////////////
         Utilities::displayFPS(window);
+        lodselector.beginFrame(width, height);
 
-        glUseProgram(myShader.programID);
+        // Send finished background loads to OpenGL, at most ~2 ms per frame
+        loader.processUploads(2.0);
+        if(!statsprinted && loader.pending() == 0) {
+            loader.printStats();
+            statsprinted = 1;
+        }
 
         time = (float)glfwGetTime(); //Number of seconds since the program was started
 
-        location_MV = glGetUniformLocation(myShader.programID, "MV");
-        location_P = glGetUniformLocation(myShader.programID, "P");
-        location_LV = glGetUniformLocation(myShader.programID, "LV");
-
-        glUniform1f(location_time, time);
-
         myMouseRotator.poll(window);
 
         mat4rotz(Rz, myMouseRotator.phi);
@@ -330,8 +554,6 @@ int main(int argc, char *argv[]) {
 
         mat4mult(Rz, Rx, LV);
 
-        glUniformMatrix4fv(location_LV, 1, GL_FALSE, LV); //Copy the value
-
         mat4identity(MV);
 
         myKeyRotator.poll(window);
@@ -346,17 +568,62 @@ int main(int argc, char *argv[]) {
 
         mat4perspective(P, M_PI/6, 1, 0.1, 100.0);
 
-        glUniformMatrix4fv(location_MV, 1, GL_FALSE, MV); //Copy the value
-        glUniformMatrix4fv(location_P, 1, GL_FALSE, P); //Copy the value
+        // The uniforms that are the same for all objects, once per frame
+        // for all programs. RenderQueue writes MV for each object.
+        memcpy(frameblock.P, P, sizeof(frameblock.P));
+        memcpy(frameblock.LV, LV, sizeof(frameblock.LV));
+        frameblock.time = time;
+        UniformRing::get().bindData(UNIFORMBUFFER_FRAME_BINDING, &frameblock, sizeof(frameblock));
+
+        if(normalmapfile) { // The normal map on texture unit 1
+            GLState::activeTexture(GL_TEXTURE1);
+            GLState::bindTexture(GL_TEXTURE_2D, normalmapTexture.textureID);
+            GLState::activeTexture(GL_TEXTURE0);
+        }
 
-        // Draw the TriangleSoup object mySphere
-        // with a shader program that uses a texture
-        glUseProgram (myShader.programID);
-        //glBindTexture (GL_TEXTURE_2D, myTexture.textureID);
-        glBindTexture (GL_TEXTURE_2D, dinoTexture.textureID);
-        glUniform1i (location_tex, 0);
+        if(numinstances > 0) {
+            GLuint program = (batchmode >= 0 && batch.usesIndirect())
+                ? indirectShader->programID : instancedShader->programID;
+            GLState::useProgram(program);
+            memcpy(gridblock.MV, MV, sizeof(gridblock.MV));
+            UniformRing::get().bindData(UNIFORMBUFFER_OBJECT_BINDING, &gridblock, sizeof(gridblock));
+            GLState::bindTexture(GL_TEXTURE_2D, dinoTexture.textureID);
+            if(batchmode >= 0) { // Every other one an earth, all with the dino texture
+                batch.clear();
+                for(int i=0; i<numinstances; i++) {
+                    batch.add((i % 2) ? earth : dino, &instancematrices[16 * (size_t)i],
+                        &instancecolors[4 * (size_t)i]);
+                }
+                batch.submit();
+            }
+            else {
+                dino.renderInstanced(instancematrices, numinstances, instancecolors);
+            }
+        }
+        else {
+            // Draw the dino with a shader program that uses a texture
+            renderqueue.submit(normalmapfile ? normalmapShader->programID : myShader->programID,
+                dinoTexture.textureID, dino, MV, lodselector.select(0, dino, MV, P));
+        }
 
-        dino.render();
+        // Right click: print the dino triangle under the mouse pointer
+        if(myMouseRotator.rightClicked) {
+            float origin[3], direction[3];
+            RayHit hit;
+            if(myMouseRotator.pickRay(window, P, MV, origin, direction)) {
+                double picktime = glfwGetTime();
+                int found = dino.pick(origin, direction, &hit);
+                picktime = glfwGetTime() - picktime;
+                if(found) {
+                    cout << "Picked triangle " << hit.triangle << " at distance " << hit.distance
+                         << ", barycentrics " << hit.u << " " << hit.v;
+                }
+                else {
+                    cout << "Picked nothing";
+                }
+                cout << " (" << 1e6 * picktime << " us)" << endl;
+            }
+        }
 
         ////////////////
         mat4rotz(MV, M_PI/2);
@@ -368,16 +635,12 @@ int main(int argc, char *argv[]) {
         mat4mult(R, MV, MV);
         mat4mult(T, MV, MV);
 
-        glBindTexture (GL_TEXTURE_2D, earthTexture.textureID);
-        glUniform1i (location_tex, 0);
+        renderqueue.submit(earthShader->programID, earthTexture.textureID, earth, MV,
+            lodselector.select(1, earth, MV, P));
 
-        glUniformMatrix4fv(location_MV, 1, GL_FALSE, MV); //Copy the value
-        glUniformMatrix4fv(location_P, 1, GL_FALSE, P); //Copy the value
-
-        earth.render();
-
-        glBindTexture (GL_TEXTURE_2D, 0);
-        glUseProgram (0);
+        // Draw the queued objects, sorted by program, texture and mesh
+        renderqueue.execute();
+        // The program and textures stay bound, for GLState to skip next frame
 
 //              LABB 4
 /////////////////////////////////////////////////////////////////////////
@@ -405,6 +668,16 @@ int main(int argc, char *argv[]) {
 
     }
 
+    lodselector.printStats();
+    renderqueue.printStats();
+    GLState::printStats();
+    UniformRing::get().printStats();
+    ProgramCache::printStats();
+    shaderVariants.printStats();
+    if(usearena) GeometryArena::printAllStats();
+    delete[] instancematrices;
+    delete[] instancecolors;
+
     // Close the OpenGL window and terminate GLFW.
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -0,0 +1,281 @@
+/*
+ * Shared buffers with a best fit free list allocator, see GeometryArena.hpp.
+ */
+
+#include <cstdio>  // For printf()
+#include <climits> // For INT_MIN
+
+#include "GeometryArena.hpp"
+#include "GLState.hpp"     // Binds that skip what is already bound
+#include "Utilities.hpp"  // To be able to use OpenGL extensions
+
+namespace {
+
+/* The arenas from get(), by encodings and index type */
+std::map<int, GeometryArena*> arenas;
+
+inline int arenaKey(const VertexFormat &format, GLenum indextype) {
+    return ((format.positiontype * 4 + format.normaltype) * 4 + format.texcoordtype) * 2
+        + (indextype == GL_UNSIGNED_INT ? 1 : 0);
+}
+
+} // namespace
+
+
+/* The shared arena for a vertex layout and index type, made on first use */
+GeometryArena *GeometryArena::get(const VertexFormat &format, GLenum indextype) {
+    int key = arenaKey(format, indextype);
+    std::map<int, GeometryArena*>::iterator found = arenas.find(key);
+    if(found != arenas.end()) return found->second;
+    GeometryArena *arena = new GeometryArena(format, indextype);
+    arenas[key] = arena;
+    return arena;
+}
+
+
+/* Print the statistics of all arenas */
+void GeometryArena::printAllStats() {
+    for(std::map<int, GeometryArena*>::const_iterator a = arenas.begin(); a != arenas.end(); ++a) {
+        a->second->printStats();
+    }
+}
+
+
+/* Constructor: empty buffers of the given sizes */
+GeometryArena::GeometryArena(const VertexFormat &format, GLenum indextype,
+                             int vertexcapacity, int indexcapacity) {
+
+    this->format.set(format.positiontype, format.normaltype, format.texcoordtype);
+    this->indextype = indextype;
+    numranges = 0;
+    numgrows = 0;
+    vertices.init(vertexcapacity);
+    indices.init(indexcapacity);
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vertexbuffer);
+    glGenBuffers(1, &indexbuffer);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+    glBufferData(GL_ARRAY_BUFFER, (size_t)vertexcapacity * this->format.stride, NULL, GL_STATIC_DRAW);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+    attachBuffers();
+    GLState::bindVertexArray(vao);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexcapacity * indexSize(), NULL, GL_STATIC_DRAW);
+    GLState::bindVertexArray(0);
+}
+
+
+/* Destructor: delete the VAO and the buffers */
+GeometryArena::~GeometryArena() {
+    GLState::deleteVertexArray(vao);
+    GLState::deleteBuffer(vertexbuffer);
+    GLState::deleteBuffer(indexbuffer);
+}
+
+
+/*
+ * allocate() - find room for a mesh. If a buffer is too full, it grows
+ * to twice its size, or more if the mesh needs it.
+ */
+void GeometryArena::allocate(int nverts, int nindices, Range *range) {
+
+    int firstvertex = vertices.allocate(nverts);
+    if(firstvertex < 0) {
+        int capacity = vertices.capacity;
+        int newcapacity = 2 * capacity > capacity + nverts ? 2 * capacity : capacity + nverts;
+        growBuffer(&vertexbuffer, (size_t)capacity * format.stride,
+            (size_t)newcapacity * format.stride);
+        vertices.grow(newcapacity);
+        firstvertex = vertices.allocate(nverts);
+    }
+    int firstindex = indices.allocate(nindices);
+    if(firstindex < 0) {
+        int capacity = indices.capacity;
+        int newcapacity = 2 * capacity > capacity + nindices ? 2 * capacity : capacity + nindices;
+        growBuffer(&indexbuffer, capacity * indexSize(),
+            newcapacity * indexSize());
+        indices.grow(newcapacity);
+        firstindex = indices.allocate(nindices);
+    }
+    range->firstvertex = firstvertex;
+    range->numvertices = nverts;
+    range->firstindex = firstindex;
+    range->numindices = nindices;
+    numranges++;
+}
+
+
+/* Copy a mesh into its range of the buffers */
+void GeometryArena::upload(const Range &range, const void *vertexdata, const void *indexdata) {
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, (size_t)range.firstvertex * format.stride,
+        (size_t)range.numvertices * format.stride, vertexdata);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+    // The element array binding is VAO state, so it can only be bound
+    // with the arena's VAO, or it would change whatever VAO is bound now
+    GLState::bindVertexArray(vao);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, range.firstindex * indexSize(),
+        range.numindices * indexSize(), indexdata);
+    GLState::bindVertexArray(0);
+}
+
+
+/* Give the room of a mesh back */
+void GeometryArena::release(const Range &range) {
+    vertices.release(range.firstvertex, range.numvertices);
+    indices.release(range.firstindex, range.numindices);
+    numranges--;
+}
+
+
+/* Bind the shared VAO */
+void GeometryArena::bind() {
+    GLState::bindVertexArray(vao);
+}
+
+
+GLenum GeometryArena::indexType() const {
+    return indextype;
+}
+
+size_t GeometryArena::indexSize() const {
+    return (indextype == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+GLuint GeometryArena::vertexArray() const {
+    return vao;
+}
+
+
+/*
+ * printStats() - how much of each buffer is used, and how fragmented the
+ * free space is: the share of it that is not in the largest free block,
+ * so 0% means that all of it could be used by one mesh.
+ */
+void GeometryArena::printStats() const {
+    const FreeList *lists[2] = { &vertices, &indices };
+    const char *names[2] = { "vertices", "indices " };
+    size_t unitsizes[2] = { (size_t)format.stride, indexSize() };
+    printf("GeometryArena: %d-byte vertices, %d-bit indices, %d meshes, grown %d times\n",
+        format.stride, (int)indexSize() * 8, numranges, numgrows);
+    for(int i=0; i<2; i++) {
+        const FreeList &list = *lists[i];
+        int freeunits = list.freeUnits();
+        int largest = list.largestBlock();
+        printf("  %s: %.1f of %.1f MB used, %d free blocks, largest %.1f MB, fragmentation %.1f%%\n",
+            names[i], (double)(list.capacity - freeunits) * unitsizes[i] / (1024.0*1024.0),
+            (double)list.capacity * unitsizes[i] / (1024.0*1024.0), (int)list.blocks.size(),
+            (double)largest * unitsizes[i] / (1024.0*1024.0),
+            freeunits > 0 ? 100.0 * (freeunits - largest) / freeunits : 0.0);
+    }
+}
+
+
+/*
+ * private
+ * attachBuffers() - point the VAO at the current buffers.
+ */
+void GeometryArena::attachBuffers() {
+    GLState::bindVertexArray(vao);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+    format.setAttribPointers();
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
+    GLState::bindVertexArray(0);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+/*
+ * private
+ * growBuffer() - replace a buffer by a bigger one with the same contents,
+ * copied on the GPU, and attach it to the VAO.
+ */
+void GeometryArena::growBuffer(GLuint *buffer, size_t oldsize, size_t newsize) {
+    GLuint newbuffer;
+    glGenBuffers(1, &newbuffer);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, newbuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newsize, NULL, GL_STATIC_DRAW);
+    GLState::bindBuffer(GL_COPY_READ_BUFFER, *buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldsize);
+    GLState::bindBuffer(GL_COPY_READ_BUFFER, 0);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    GLState::deleteBuffer(*buffer);
+    *buffer = newbuffer;
+    numgrows++;
+    attachBuffers();
+}
+
+
+/* Start with one free block of the whole capacity */
+void GeometryArena::FreeList::init(int capacity) {
+    this->capacity = capacity;
+    blocks.clear();
+    bysize.clear();
+    if(capacity > 0) insert(0, capacity);
+}
+
+
+/* Take count units from the smallest block they fit in */
+int GeometryArena::FreeList::allocate(int count) {
+    if(count <= 0) return 0;
+    std::set<std::pair<int, int> >::iterator fit = bysize.lower_bound(std::make_pair(count, INT_MIN));
+    if(fit == bysize.end()) return -1;
+    int first = fit->second;
+    int size = fit->first;
+    erase(blocks.find(first));
+    if(size > count) insert(first + count, size - count);
+    return first;
+}
+
+
+/* Free count units, merged with the free blocks next to them */
+void GeometryArena::FreeList::release(int first, int count) {
+    if(count <= 0) return;
+    std::map<int, int>::iterator next = blocks.lower_bound(first);
+    if(next != blocks.begin()) {
+        std::map<int, int>::iterator previous = next;
+        --previous;
+        if(previous->first + previous->second == first) {
+            first = previous->first;
+            count += previous->second;
+            erase(previous);
+        }
+    }
+    if(next != blocks.end() && first + count == next->first) {
+        count += next->second;
+        erase(next);
+    }
+    insert(first, count);
+}
+
+
+/* The new space at the end is free, and joins a free block before it */
+void GeometryArena::FreeList::grow(int newcapacity) {
+    int oldcapacity = capacity;
+    capacity = newcapacity;
+    release(oldcapacity, newcapacity - oldcapacity);
+}
+
+
+int GeometryArena::FreeList::freeUnits() const {
+    int sum = 0;
+    for(std::map<int, int>::const_iterator b = blocks.begin(); b != blocks.end(); ++b) sum += b->second;
+    return sum;
+}
+
+
+int GeometryArena::FreeList::largestBlock() const {
+    return bysize.empty() ? 0 : bysize.rbegin()->first;
+}
+
+
+void GeometryArena::FreeList::insert(int first, int count) {
+    blocks[first] = count;
+    bysize.insert(std::make_pair(count, first));
+}
+
+
+void GeometryArena::FreeList::erase(std::map<int, int>::iterator block) {
+    bysize.erase(std::make_pair(block->second, block->first));
+    blocks.erase(block);
+}
@@ -0,0 +1,133 @@
+/* GeometryArena.hpp */
+/* Large shared vertex and index buffers that many meshes live in. */
+/* Usage: TriangleSoup does this with the option USE_GEOMETRY_ARENA.
+ * get() returns the shared arena for a vertex format and index type,
+ * creating it on first use. allocate() reserves room for a mesh,
+ * upload() copies its data in, and release() gives the room back.
+ * To draw, bind() the arena's VAO and call glDrawElementsBaseVertex()
+ * with the range's first index and first vertex. All meshes in an arena
+ * share one VAO, so drawing them one after another needs no VAO changes.
+ * printStats() shows how full and how fragmented the arenas are.
+ *
+ * The free space in each buffer is kept in a free list of blocks sorted
+ * by position, and a mesh gets the smallest block it fits in (best fit).
+ * Released blocks are merged with free neighbours at once. When nothing
+ * fits, the buffer doubles in size: a new buffer is made, the old
+ * contents are copied over on the GPU with glCopyBufferSubData(), and
+ * the VAO is pointed to the new buffers. The ranges of the meshes stay
+ * the same.
+ *
+ * Indices are relative to the first vertex of their mesh, so 16-bit
+ * indices work for every mesh with at most 65535 vertices no matter
+ * where in the arena it is. Arenas must only be used on the thread
+ * with the OpenGL context, and live until the program ends. */
+
+#ifndef GEOMETRYARENA_HPP // Avoid including this header twice
+#define GEOMETRYARENA_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+#include "VertexFormat.hpp"
+
+#include <map>
+#include <set>
+#include <utility>
+
+class GeometryArena {
+
+public:
+
+/* The part of an arena that holds one mesh */
+struct Range {
+    int firstvertex;  // The base vertex for glDrawElementsBaseVertex()
+    int numvertices;
+    int firstindex;   // First index (not byte) in the index buffer
+    int numindices;
+};
+
+/* Initial sizes of a new arena */
+static const int DEFAULT_VERTEX_CAPACITY = 1 << 20;
+static const int DEFAULT_INDEX_CAPACITY = 3 << 20;
+
+/* The shared arena for this vertex layout (only the encodings of
+ * format matter) and index type, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT */
+static GeometryArena *get(const VertexFormat &format, GLenum indextype);
+
+/* Print printStats() for every arena */
+static void printAllStats();
+
+/* Constructor: empty buffers with room for the given numbers of
+ * vertices and indices. Needs an OpenGL context. */
+GeometryArena(const VertexFormat &format, GLenum indextype,
+              int vertexcapacity = DEFAULT_VERTEX_CAPACITY,
+              int indexcapacity = DEFAULT_INDEX_CAPACITY);
+
+/* Destructor: delete the VAO and the buffers */
+~GeometryArena();
+
+/* Reserve room for a mesh, and grow the buffers if needed */
+void allocate(int nverts, int nindices, Range *range);
+
+/* Copy a mesh into its range. vertices are packed in the arena's
+ * format, and indices are of its index type. */
+void upload(const Range &range, const void *vertices, const void *indices);
+
+/* Give the room of a range back to the free lists */
+void release(const Range &range);
+
+/* Bind the VAO that all the meshes in the arena share */
+void bind();
+
+/* The index type, and the size in bytes of one index */
+GLenum indexType() const;
+size_t indexSize() const;
+
+/* The name of the shared VAO */
+GLuint vertexArray() const;
+
+/* Print the sizes, the use and the fragmentation of the buffers */
+void printStats() const;
+
+private:
+
+/*
+ * The free blocks of a buffer, in units of vertices or indices.
+ * blocks has them by position, bysize by size for the best fit.
+ */
+class FreeList {
+public:
+    int capacity;
+    std::map<int, int> blocks;               // first -> count, never two adjacent
+    std::set<std::pair<int, int> > bysize;   // (count, first)
+
+    void init(int capacity);
+    int allocate(int count);             // First unit of the block, -1 if none fits
+    void release(int first, int count);
+    void grow(int newcapacity);          // Add the new space at the end as free
+    int freeUnits() const;
+    int largestBlock() const;
+
+private:
+    void insert(int first, int count);
+    void erase(std::map<int, int>::iterator block);
+};
+
+void attachBuffers();
+void growBuffer(GLuint *buffer, size_t oldsize, size_t newsize);
+
+VertexFormat format;  // The encodings, and the layout they give
+GLenum indextype;
+GLuint vao;
+GLuint vertexbuffer;
+GLuint indexbuffer;
+FreeList vertices;
+FreeList indices;
+int numranges;        // Meshes in the arena right now
+int numgrows;         // Number of times a buffer has grown
+
+};
+
+#endif // GEOMETRYARENA_HPP
@@ -0,0 +1,132 @@
+#include <cstdio>  // For printf()
+#include <cmath>   // For sqrtf() and fabsf()
+
+#include "LODSelector.hpp"
+#include "TriangleSoup.hpp"
+
+namespace {
+
+/* The length of column c of the upper 3x3 part of a column major 4x4 matrix */
+inline float columnLength(const float *M, int c) {
+    return sqrtf(M[4*c]*M[4*c] + M[4*c+1]*M[4*c+1] + M[4*c+2]*M[4*c+2]);
+}
+
+} // namespace
+
+
+/* Constructor: no objects and no statistics yet */
+LODSelector::LODSelector(float threshold, float hysteresis) {
+    this->threshold = threshold;
+    this->hysteresis = hysteresis;
+    viewportwidth = viewportheight = 1;
+    frames = 0;
+    for(int i=0; i<MAX_LEVELS; i++) {
+        framehistogram[i] = 0;
+        histogram[i] = 0;
+    }
+    frametriangles = framefulltriangles = 0;
+    triangles = fulltriangles = 0;
+}
+
+
+/* Start a new frame and clear the per frame statistics */
+void LODSelector::beginFrame(int width, int height) {
+    viewportwidth = (width > 0) ? width : 1;
+    viewportheight = (height > 0) ? height : 1;
+    frames++;
+    for(int i=0; i<MAX_LEVELS; i++) framehistogram[i] = 0;
+    frametriangles = framefulltriangles = 0;
+}
+
+
+/*
+ * screenError() - project the error of a level to pixels.
+ * The error is measured at the point of the bounding sphere closest to
+ * the camera, which is where it looks the largest. MV may scale the mesh,
+ * so the error is scaled by the largest axis scaling of MV.
+ */
+float LODSelector::screenError(TriangleSoup &mesh, int level, const float *MV, const float *P) {
+
+    float center[3], radius;
+    if(!mesh.getBoundingSphere(center, &radius)) return 0.0f;
+
+    float scale = columnLength(MV, 0);
+    if(columnLength(MV, 1) > scale) scale = columnLength(MV, 1);
+    if(columnLength(MV, 2) > scale) scale = columnLength(MV, 2);
+    float error = mesh.lodError(level) * scale;
+    // Pixels per unit at distance 1 (or anywhere, for an orthographic P),
+    // along the axis where the pixels are the smallest
+    float pixelsperunit = 0.5f * fabsf(P[5]) * viewportheight;
+    if(0.5f * fabsf(P[0]) * viewportwidth > pixelsperunit) pixelsperunit = 0.5f * fabsf(P[0]) * viewportwidth;
+
+    if(P[11] == 0.0f) { // Orthographic projection, no perspective division
+        return error * pixelsperunit;
+    }
+    float z = MV[2]*center[0] + MV[6]*center[1] + MV[10]*center[2] + MV[14];
+    float distance = -z - radius * scale; // The camera looks down -z
+    if(distance <= 0.0f) return 1e30f;    // The camera is inside the sphere
+    return error * pixelsperunit / distance;
+}
+
+
+/*
+ * select() - choose the coarsest level that looks good enough, with
+ * hysteresis around the level from the last frame.
+ */
+int LODSelector::select(int id, TriangleSoup &mesh, const float *MV, const float *P) {
+
+    if(id < 0) return 0;
+    if(id >= (int)levels.size()) levels.resize(id + 1, 0);
+    float center[3], radius;
+    if(!mesh.getBoundingSphere(center, &radius)) return 0; // Not loaded yet
+
+    int numlevels = mesh.numLODs();
+    int level = levels[id];
+    if(level >= numlevels) level = numlevels - 1;
+
+    if(screenError(mesh, level, MV, P) > threshold) { // Too coarse, go finer
+        while(level > 0 && screenError(mesh, level, MV, P) > threshold) level--;
+    }
+    else { // Go coarser, but only well below the threshold
+        while(level + 1 < numlevels
+              && screenError(mesh, level + 1, MV, P) <= threshold * (1.0f - hysteresis)) level++;
+    }
+    levels[id] = level;
+
+    int bin = (level < MAX_LEVELS) ? level : MAX_LEVELS - 1;
+    framehistogram[bin]++;
+    histogram[bin]++;
+    frametriangles += mesh.lodTriangles(level);
+    framefulltriangles += mesh.lodTriangles(0);
+    triangles += mesh.lodTriangles(level);
+    fulltriangles += mesh.lodTriangles(0);
+    return level;
+}
+
+
+/* Select a level and draw it */
+void LODSelector::render(int id, TriangleSoup &mesh, const float *MV, const float *P) {
+    mesh.renderLOD(select(id, mesh, MV, P));
+}
+
+
+/* Print the statistics, with a histogram of the levels over all frames */
+void LODSelector::printStats() {
+
+    long long objects = 0;
+    for(int i=0; i<MAX_LEVELS; i++) objects += histogram[i];
+    printf("LODSelector: %d frames, threshold %.2f pixels, hysteresis %.0f%%\n",
+        frames, threshold, 100.0 * hysteresis);
+    if(objects == 0 || frames == 0) return;
+    printf("  triangles per frame: %.0f drawn of %.0f (%.1f%%), last frame %lld of %lld\n",
+        (double)triangles / frames, (double)fulltriangles / frames,
+        100.0 * triangles / (fulltriangles > 0 ? fulltriangles : 1),
+        frametriangles, framefulltriangles);
+    for(int i=0; i<MAX_LEVELS; i++) {
+        if(histogram[i] == 0) continue;
+        double percent = 100.0 * histogram[i] / objects;
+        printf("  level %d: %5.1f%% ", i, percent);
+        for(int n=0; n<(int)(percent / 2.5 + 0.5); n++) printf("#");
+        printf("\n");
+    }
+}
@@ -0,0 +1,77 @@
+/* LODSelector.hpp */
+/* Chooses a level of detail for each object from its size on screen. */
+/* Usage: call beginFrame() with the viewport size at the start of every
+ * frame, then render() (or select() and TriangleSoup::renderLOD()) for
+ * each object instead of TriangleSoup::render(). Every object gets its
+ * own number, which must stay the same from frame to frame, because the
+ * selector remembers the level each object had in the last frame.
+ *
+ * The bounding sphere of the mesh is transformed by MV and projected
+ * with P, and the error of each level (see TriangleSoup::createLODs())
+ * is scaled to pixels at the point of the sphere closest to the camera.
+ * The coarsest level with an error below threshold pixels is used. To
+ * avoid flickering between two levels when an object sits right at the
+ * limit, a coarser level is only chosen when its error is below
+ * (1 - hysteresis) * threshold, so there is a band where the current
+ * level stays.
+ *
+ * The statistics count objects per level and triangles per frame, both
+ * for the last frame and summed over all frames. printStats() shows a
+ * summary with a histogram of the levels. */
+
+#ifndef LODSELECTOR_HPP // Avoid including this header twice
+#define LODSELECTOR_HPP
+
+#include <vector>
+
+class TriangleSoup;
+
+class LODSelector {
+
+public:
+
+static const int MAX_LEVELS = 8; // Levels counted in the histograms
+
+float threshold;   // Largest allowed error on screen, in pixels
+float hysteresis;  // Fraction of threshold to stay below before coarsening
+
+// Statistics, updated by select() and reset per frame by beginFrame()
+int frames;                          // Number of beginFrame() calls
+long long framehistogram[MAX_LEVELS]; // Objects drawn at each level, last frame
+long long histogram[MAX_LEVELS];     // Objects drawn at each level, all frames
+long long frametriangles;            // Triangles drawn in the last frame
+long long framefulltriangles;        // Triangles without levels of detail, last frame
+long long triangles;                 // Triangles drawn, all frames
+long long fulltriangles;             // Triangles without levels of detail, all frames
+
+/* Constructor: a threshold in pixels, and a hysteresis band */
+LODSelector(float threshold = 1.0f, float hysteresis = 0.25f);
+
+/* Start a new frame, with the viewport size in pixels */
+void beginFrame(int width, int height);
+
+/*
+ * select() - choose the level of detail for object number id, a mesh
+ * drawn with the modelview matrix MV and the projection matrix P.
+ * Returns the level to pass to TriangleSoup::renderLOD().
+ */
+int select(int id, TriangleSoup &mesh, const float *MV, const float *P);
+
+/* Select a level for object number id and draw it */
+void render(int id, TriangleSoup &mesh, const float *MV, const float *P);
+
+/* The error of a level of mesh in pixels, when drawn with MV and P */
+float screenError(TriangleSoup &mesh, int level, const float *MV, const float *P);
+
+/* Print the statistics */
+void printStats();
+
+private:
+
+int viewportwidth;
+int viewportheight;
+std::vector<int> levels; // The level of each object in the last frame
+
+};
+
+#endif // LODSELECTOR_HPP
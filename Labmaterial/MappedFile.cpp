@@ -0,0 +1,124 @@
+/*
+ * A read-only memory mapping of a file.
+ * The operating system pages the file in on demand, so a parser
+ * can scan even very large files without copying them to the heap.
+ */
+
+#include "MappedFile.hpp"
+
+#ifdef __WIN32__
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Constructor: create an empty (unmapped) object */
+MappedFile::MappedFile() {
+    data = NULL;
+    size = 0;
+    empty = 0;
+#ifdef __WIN32__
+    filehandle = NULL;
+    maphandle = NULL;
+#else
+    fd = -1;
+#endif
+}
+
+
+/* Destructor: release the mapping if there is one */
+MappedFile::~MappedFile() {
+    close();
+}
+
+
+/*
+ * open() - map the named file into memory.
+ * Returns 1 on success, 0 if the file could not be opened or mapped.
+ */
+int MappedFile::open(const char *filename) {
+
+    close(); // Release any previous mapping
+    empty = 0;
+
+#ifdef __WIN32__
+    LARGE_INTEGER filesize;
+
+    filehandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(filehandle == INVALID_HANDLE_VALUE) {
+        filehandle = NULL;
+        return 0;
+    }
+    if(!GetFileSizeEx((HANDLE)filehandle, &filesize)) {
+        close();
+        return 0;
+    }
+    if(filesize.QuadPart == 0) {
+        close(); // Empty files can't be mapped
+        empty = 1;
+        return 0;
+    }
+    maphandle = CreateFileMappingA((HANDLE)filehandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!maphandle) {
+        close();
+        return 0;
+    }
+    data = (const char*)MapViewOfFile((HANDLE)maphandle, FILE_MAP_READ, 0, 0, 0);
+    if(!data) {
+        close();
+        return 0;
+    }
+    size = (size_t)filesize.QuadPart;
+#else
+    struct stat filestat;
+    void *mapping;
+
+    fd = ::open(filename, O_RDONLY);
+    if(fd < 0) {
+        return 0;
+    }
+    if(fstat(fd, &filestat) != 0) {
+        close();
+        return 0;
+    }
+    if(filestat.st_size == 0) {
+        close(); // Empty files can't be mapped
+        empty = 1;
+        return 0;
+    }
+    mapping = mmap(NULL, (size_t)filestat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping == MAP_FAILED) {
+        close();
+        return 0;
+    }
+    // We read the file front to back, so ask for aggressive read-ahead
+    madvise(mapping, (size_t)filestat.st_size, MADV_SEQUENTIAL);
+    data = (const char*)mapping;
+    size = (size_t)filestat.st_size;
+#endif
+
+    return 1;
+}
+
+
+/* Release the mapping and close the file */
+void MappedFile::close() {
+
+#ifdef __WIN32__
+    if(data) UnmapViewOfFile(data);
+    if(maphandle) CloseHandle((HANDLE)maphandle);
+    if(filehandle) CloseHandle((HANDLE)filehandle);
+    maphandle = NULL;
+    filehandle = NULL;
+#else
+    if(data) munmap((void*)data, size);
+    if(fd >= 0) ::close(fd);
+    fd = -1;
+#endif
+    data = NULL;
+    size = 0;
+}
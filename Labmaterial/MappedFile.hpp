@@ -0,0 +1,53 @@
+/* MappedFile.hpp */
+/* A class to map a whole file read-only into memory. */
+/* Usage: call open() with a file name, then read the bytes through
+ * the public members data and size. The mapping is released by close()
+ * or by the destructor. The data is NOT zero terminated, so parsers
+ * must stop at data+size.
+ * POSIX mmap() is used on MacOS X and Linux, file mappings on Windows. */
+
+#ifndef MAPPEDFILE_HPP // Avoid including this header twice
+#define MAPPEDFILE_HPP
+
+#include <cstddef> // For size_t
+
+class MappedFile {
+
+public:
+
+const char *data; // First byte of the file contents (NULL if not open)
+size_t size;      // Number of bytes in the file
+int empty;        // 1 if open() failed because the file has no bytes
+
+/* Constructor: create an empty (unmapped) object */
+MappedFile();
+
+/* Destructor: release the mapping if there is one */
+~MappedFile();
+
+/*
+ * open() - map the named file into memory.
+ * Returns 1 on success, 0 if the file could not be opened or mapped.
+ * An empty file can not be mapped, so it gives 0 and sets empty.
+ */
+int open(const char *filename);
+
+/* Release the mapping and close the file */
+void close();
+
+private:
+
+#ifdef __WIN32__
+void *filehandle;    // Win32 HANDLE for the file
+void *maphandle;     // Win32 HANDLE for the file mapping object
+#else
+int fd;              // POSIX file descriptor
+#endif
+
+// Mappings can't be shared, so copying is not allowed
+MappedFile(const MappedFile &);
+MappedFile &operator=(const MappedFile &);
+
+};
+
+#endif // MAPPEDFILE_HPP
@@ -0,0 +1,612 @@
+/*
+ * SAH bounding volume hierarchy, see MeshBVH.hpp.
+ * The build:
+ *  1. finds the box and center of every triangle (in parallel),
+ *  2. splits nodes with more than PARALLEL_SIZE triangles one at a time,
+ *     with the binning done in parallel over blocks of triangles,
+ *  3. builds the subtrees below those nodes in parallel, one per task,
+ *  4. joins the subtrees and collapses the binary tree to four children
+ *     per node, and copies the triangles into leaf order.
+ * Every split bins the triangle centers into NUM_BINS bins along each
+ * axis, or fewer for small nodes, where clearing and sweeping the bins
+ * would cost more than the binning itself. The bins also keep the boxes of their triangles and centers,
+ * so the children's boxes come for free when a split is chosen.
+ */
+
+#include <cmath>     // For fabsf()
+#include <vector>
+#include <algorithm> // For partition(), min() and max()
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "MeshBVH.hpp"
+#include "ThreadPool.hpp"
+
+namespace {
+
+const int NUM_BINS = 16;          // SAH bins along each axis
+const int MAX_LEAF_SIZE = 8;      // Larger leaves are always split
+const int MAX_DEPTH = 64;         // Deeper nodes become leaves, which keeps the query stack small
+const float TRAVERSAL_COST = 1.0f; // Cost of a box test, relative to a triangle test
+const int PARALLEL_SIZE = 16384;  // Nodes at least this big are split with parallel binning
+const int TRIANGLE_BLOCK = 16384; // Triangles per parallel task in the binning
+const int STACK_SIZE = 256;       // Query stack, enough for 3 entries per level of MAX_DEPTH
+
+/* An axis aligned box, empty when min > max. The fourth elements are
+ * not used, they are there so that SSE can grow all three axes at once. */
+struct Box {
+    float boxmin[4], boxmax[4];
+
+    void clear() {
+        for(int k=0; k<4; k++) {
+            boxmin[k] = 1e30f;
+            boxmax[k] = -1e30f;
+        }
+    }
+    /* Grow to hold the point p. p[3] is read, but not used. */
+    void grow(const float *p) {
+#ifdef __SSE2__
+        __m128 point = _mm_loadu_ps(p);
+        _mm_storeu_ps(boxmin, _mm_min_ps(_mm_loadu_ps(boxmin), point));
+        _mm_storeu_ps(boxmax, _mm_max_ps(_mm_loadu_ps(boxmax), point));
+#else
+        for(int k=0; k<3; k++) {
+            boxmin[k] = std::min(boxmin[k], p[k]);
+            boxmax[k] = std::max(boxmax[k], p[k]);
+        }
+#endif
+    }
+    void grow(const Box &b) {
+#ifdef __SSE2__
+        _mm_storeu_ps(boxmin, _mm_min_ps(_mm_loadu_ps(boxmin), _mm_loadu_ps(b.boxmin)));
+        _mm_storeu_ps(boxmax, _mm_max_ps(_mm_loadu_ps(boxmax), _mm_loadu_ps(b.boxmax)));
+#else
+        for(int k=0; k<3; k++) {
+            boxmin[k] = std::min(boxmin[k], b.boxmin[k]);
+            boxmax[k] = std::max(boxmax[k], b.boxmax[k]);
+        }
+#endif
+    }
+    /* Half the surface area, which is all the SAH needs */
+    float area() const {
+        float dx = boxmax[0] - boxmin[0], dy = boxmax[1] - boxmin[1], dz = boxmax[2] - boxmin[2];
+        if(dx < 0.0f) return 0.0f;
+        return dx*dy + dy*dz + dz*dx;
+    }
+};
+
+/* The box and center of one triangle. These are moved around rather
+ * than triangle numbers, so the build reads them in memory order. */
+struct TriangleBox {
+    Box box;
+    float center[3];
+    int triangle;  // Triangle number in the index array, also read as center[3] by Box::grow()
+};
+
+/* Triangles whose centers fall in one bin */
+struct Bin {
+    Box box;       // Box of the triangles
+    Box centers;   // Box of their centers
+    int count;
+
+    void clear() {
+        box.clear();
+        centers.clear();
+        count = 0;
+    }
+    void grow(const Bin &b) {
+        box.grow(b.box);
+        centers.grow(b.centers);
+        count += b.count;
+    }
+};
+
+/* A node of the binary tree during the build */
+struct BuildNode {
+    Box box;       // Box of the triangles
+    Box centers;   // Box of their centers
+    int first;     // First triangle in the triangle order
+    int count;     // Number of triangles
+    int left;      // Child nodes, -1 for a leaf
+    int right;
+    int depth;
+};
+
+/* A chosen split: centers in bins 0 to bin go left */
+struct Split {
+    int axis;
+    int bin;
+    float cost;
+    Bin left, right;
+};
+
+class Builder {
+
+public:
+
+    std::vector<TriangleBox> boxes; // Sorted into the leaves by the build
+
+    /* The number of bins for a node with count triangles */
+    static inline int numBins(int count) {
+        return (count < NUM_BINS) ? std::max(count, 2) : NUM_BINS;
+    }
+
+    /* The bin of a triangle along an axis, for a node with the given center box */
+    static inline int binOf(const TriangleBox &t, int axis, const Box &centers, float scale, int numbins) {
+        int b = (int)((t.center[axis] - centers.boxmin[axis]) * scale);
+        return (b < 0) ? 0 : (b >= numbins ? numbins - 1 : b);
+    }
+
+    static inline float binScale(const Box &centers, int axis, int numbins) {
+        float extent = centers.boxmax[axis] - centers.boxmin[axis];
+        return (extent > 0.0f) ? numbins / extent : 0.0f;
+    }
+
+    /* Bin the triangles boxes[first] to boxes[end-1] along all three axes */
+    void binRange(int first, int end, const Box &centers, int numbins, Bin bins[3][NUM_BINS]) {
+        float scale[3];
+        for(int axis=0; axis<3; axis++) {
+            scale[axis] = binScale(centers, axis, numbins);
+            for(int b=0; b<numbins; b++) bins[axis][b].clear();
+        }
+        for(int i=first; i<end; i++) {
+            const TriangleBox &t = boxes[i];
+            for(int axis=0; axis<3; axis++) {
+                Bin &bin = bins[axis][binOf(t, axis, centers, scale[axis], numbins)];
+                bin.box.grow(t.box);
+                bin.centers.grow(t.center);
+                bin.count++;
+            }
+        }
+    }
+
+    /* Bin a big node in parallel, merging the blocks in order */
+    void binParallel(const BuildNode &node, Bin bins[3][NUM_BINS]) {
+        int numblocks = (node.count + TRIANGLE_BLOCK - 1) / TRIANGLE_BLOCK;
+        std::vector<Bin> blockbins((size_t)numblocks * 3 * NUM_BINS);
+        ThreadPool::global().parallelFor(numblocks, [&](int b) {
+            int first = node.first + b*TRIANGLE_BLOCK;
+            int end = std::min(node.first + node.count, first + TRIANGLE_BLOCK);
+            binRange(first, end, node.centers, NUM_BINS, (Bin(*)[NUM_BINS])&blockbins[(size_t)b * 3 * NUM_BINS]);
+        });
+        for(int axis=0; axis<3; axis++) {
+            for(int i=0; i<NUM_BINS; i++) {
+                bins[axis][i].clear();
+                for(int b=0; b<numblocks; b++) bins[axis][i].grow(blockbins[((size_t)b*3 + axis)*NUM_BINS + i]);
+            }
+        }
+    }
+
+    /* The split with the lowest SAH cost. Returns 0 if the centers can't be separated. */
+    static int chooseSplit(Bin bins[3][NUM_BINS], int numbins, Split *best) {
+        int found = 0;
+        for(int axis=0; axis<3; axis++) {
+            // Sweep from the right, then from the left, with only areas and counts
+            float rightarea[NUM_BINS];
+            int rightcount[NUM_BINS];
+            Box box;
+            box.clear();
+            int count = 0;
+            for(int i=numbins-1; i>0; i--) {
+                box.grow(bins[axis][i].box);
+                count += bins[axis][i].count;
+                rightarea[i] = box.area();
+                rightcount[i] = count;
+            }
+            box.clear();
+            count = 0;
+            for(int i=0; i<numbins-1; i++) {
+                box.grow(bins[axis][i].box);
+                count += bins[axis][i].count;
+                if(count == 0 || rightcount[i+1] == 0) continue;
+                float cost = count * box.area() + rightcount[i+1] * rightarea[i+1];
+                if(!found || cost < best->cost) {
+                    best->axis = axis;
+                    best->bin = i;
+                    best->cost = cost;
+                    found = 1;
+                }
+            }
+        }
+        if(found) { // The boxes of the two sides, for the children
+            best->left.clear();
+            best->right.clear();
+            for(int i=0; i<numbins; i++) {
+                if(i <= best->bin) best->left.grow(bins[best->axis][i]);
+                else best->right.grow(bins[best->axis][i]);
+            }
+        }
+        return found;
+    }
+
+    /* The box and center box of a range of triangles */
+    void rangeBoxes(int first, int end, BuildNode *node) {
+        node->box.clear();
+        node->centers.clear();
+        for(int i=first; i<end; i++) {
+            node->box.grow(boxes[i].box);
+            node->centers.grow(boxes[i].center);
+        }
+    }
+
+    /*
+     * split() - split node into two children, or leave it as a leaf.
+     * The children are filled in, and the return value is 1 if it was split.
+     */
+    int split(const BuildNode &node, Bin bins[3][NUM_BINS], BuildNode *left, BuildNode *right) {
+        if(node.count <= 1) return 0;
+        Split best;
+        int numbins = numBins(node.count);
+        int found = chooseSplit(bins, numbins, &best);
+        int mid;
+        if(found) {
+            // Compare with a leaf: splitting costs a box test and the children's triangles
+            float leafcost = (float)node.count;
+            float splitcost = TRAVERSAL_COST + best.cost / std::max(node.box.area(), 1e-30f);
+            if(splitcost >= leafcost && node.count <= MAX_LEAF_SIZE) return 0;
+            if(node.depth >= MAX_DEPTH) return 0;
+            float scale = binScale(node.centers, best.axis, numbins);
+            TriangleBox *begin = &boxes[0] + node.first;
+            TriangleBox *middle = std::partition(begin, begin + node.count, [&](const TriangleBox &t) {
+                return binOf(t, best.axis, node.centers, scale, numbins) <= best.bin;
+            });
+            mid = (int)(middle - begin);
+            left->box = best.left.box;
+            left->centers = best.left.centers;
+            right->box = best.right.box;
+            right->centers = best.right.centers;
+        }
+        else { // All centers at the same point: halve by count if the leaf is too big
+            if(node.count <= MAX_LEAF_SIZE || node.depth >= MAX_DEPTH) return 0;
+            mid = node.count / 2;
+            rangeBoxes(node.first, node.first + mid, left);
+            rangeBoxes(node.first + mid, node.first + node.count, right);
+        }
+        left->first = node.first;
+        left->count = mid;
+        right->first = node.first + mid;
+        right->count = node.count - mid;
+        left->depth = right->depth = node.depth + 1;
+        left->left = left->right = right->left = right->right = -1;
+        return 1;
+    }
+
+    /* Build the subtree under nodes[index] on this thread */
+    void buildSubtree(std::vector<BuildNode> &nodes, int index) {
+        Bin bins[3][NUM_BINS];
+        BuildNode node = nodes[index];
+        binRange(node.first, node.first + node.count, node.centers, numBins(node.count), bins);
+        BuildNode left, right;
+        if(!split(node, bins, &left, &right)) return;
+        nodes[index].left = (int)nodes.size();
+        nodes.push_back(left);
+        nodes[index].right = (int)nodes.size();
+        nodes.push_back(right);
+        buildSubtree(nodes, nodes[index].left); // Not a reference, nodes may move
+        buildSubtree(nodes, nodes[index].right);
+    }
+};
+
+/* Append the subtree sub (root at 0) to nodes, with its root in nodes[root] */
+void joinSubtree(std::vector<BuildNode> &nodes, int root, const std::vector<BuildNode> &sub) {
+    int offset = (int)nodes.size() - 1; // sub[k] goes to nodes[offset + k], except the root
+    for(size_t k=1; k<sub.size(); k++) {
+        BuildNode n = sub[k];
+        if(n.left >= 0) {
+            n.left += offset;
+            n.right += offset;
+        }
+        nodes.push_back(n);
+    }
+    if(sub[0].left >= 0) {
+        nodes[root].left = sub[0].left + offset;
+        nodes[root].right = sub[0].right + offset;
+    }
+}
+
+} // namespace
+
+
+/* Constructor: no nodes, no triangles */
+MeshBVH::MeshBVH() {
+    seconds = 0.0;
+}
+
+
+/*
+ * build() - see the steps at the top of this file.
+ */
+void MeshBVH::build(const GLfloat *vertices, int nverts, const GLuint *indices, int ntris) {
+
+    double starttime = glfwGetTime();
+    nodes.clear();
+    triangles.clear();
+    triangleids.clear();
+    if(ntris <= 0) return;
+
+    // 1. Triangle boxes and centers
+    Builder builder;
+    builder.boxes.resize(ntris);
+    int numblocks = (ntris + TRIANGLE_BLOCK - 1) / TRIANGLE_BLOCK;
+    std::vector<BuildNode> blockroots(numblocks);
+    ThreadPool::global().parallelFor(numblocks, [&](int b) {
+        int end = std::min(ntris, (b+1) * TRIANGLE_BLOCK);
+        blockroots[b].box.clear();
+        blockroots[b].centers.clear();
+        for(int t=b*TRIANGLE_BLOCK; t<end; t++) {
+            TriangleBox &tb = builder.boxes[t];
+            tb.box.clear();
+            for(int c=0; c<3; c++) {
+                GLuint v = indices[3*(size_t)t + c];
+                if((int)v >= nverts) v = 0; // Bad indices don't crash the build
+                tb.box.grow(vertices + 8*(size_t)v);
+            }
+            for(int k=0; k<3; k++) tb.center[k] = 0.5f * (tb.box.boxmin[k] + tb.box.boxmax[k]);
+            tb.triangle = t;
+            blockroots[b].box.grow(tb.box);
+            blockroots[b].centers.grow(tb.center);
+        }
+    });
+
+    // 2. The top of the tree, down to nodes small enough for one task
+    std::vector<BuildNode> binary(1);
+    BuildNode &root = binary[0];
+    root.box.clear();
+    root.centers.clear();
+    for(int b=0; b<numblocks; b++) {
+        root.box.grow(blockroots[b].box);
+        root.centers.grow(blockroots[b].centers);
+    }
+    root.first = 0;
+    root.count = ntris;
+    root.left = root.right = -1;
+    root.depth = 0;
+    std::vector<int> subtrees; // Nodes that are built as separate tasks
+    std::vector<int> pending(1, 0);
+    while(!pending.empty()) {
+        int index = pending.back();
+        pending.pop_back();
+        if(binary[index].count < PARALLEL_SIZE) {
+            subtrees.push_back(index);
+            continue;
+        }
+        Bin bins[3][NUM_BINS];
+        builder.binParallel(binary[index], bins);
+        BuildNode left, right;
+        if(!builder.split(binary[index], bins, &left, &right)) continue;
+        binary[index].left = (int)binary.size();
+        binary.push_back(left);
+        binary[index].right = (int)binary.size();
+        binary.push_back(right);
+        pending.push_back(binary[index].right);
+        pending.push_back(binary[index].left);
+    }
+
+    // 3. The subtrees, in parallel, each in its own array
+    std::vector< std::vector<BuildNode> > subnodes(subtrees.size());
+    ThreadPool::global().parallelFor((int)subtrees.size(), [&](int s) {
+        subnodes[s].push_back(binary[subtrees[s]]);
+        builder.buildSubtree(subnodes[s], 0);
+    });
+    for(size_t s=0; s<subtrees.size(); s++) {
+        joinSubtree(binary, subtrees[s], subnodes[s]);
+    }
+
+    // 4. Collapse to four children per node. Each inner child is replaced by
+    // its own children, the biggest first, until there are four of them.
+    struct Collapse {
+        const std::vector<BuildNode> &binary;
+        std::vector<Node> &nodes;
+        int run(int b) {
+            int children[4] = { binary[b].left, binary[b].right, -1, -1 };
+            int n = 2;
+            if(binary[b].left < 0) { // A leaf at the root of the tree
+                children[0] = b;
+                n = 1;
+            }
+            while(n < 4) {
+                int biggest = -1;
+                float biggestarea = -1.0f;
+                for(int i=0; i<n; i++) {
+                    const BuildNode &c = binary[children[i]];
+                    if(c.left >= 0 && c.box.area() > biggestarea) {
+                        biggest = i;
+                        biggestarea = c.box.area();
+                    }
+                }
+                if(biggest < 0) break;
+                int c = children[biggest];
+                children[biggest] = binary[c].left;
+                children[n++] = binary[c].right;
+            }
+            int index = (int)nodes.size();
+            nodes.push_back(Node());
+            for(int i=0; i<4; i++) {
+                Node node = nodes[index];
+                if(i < n) {
+                    const BuildNode &c = binary[children[i]];
+                    for(int k=0; k<3; k++) {
+                        node.boxmin[k][i] = c.box.boxmin[k];
+                        node.boxmax[k][i] = c.box.boxmax[k];
+                    }
+                    if(c.left < 0) {
+                        node.child[i] = c.first;
+                        node.count[i] = c.count;
+                    }
+                    else {
+                        node.count[i] = 0;
+                        nodes[index] = node;
+                        int child = run(children[i]);
+                        node = nodes[index];
+                        node.child[i] = child;
+                    }
+                }
+                else {
+                    for(int k=0; k<3; k++) {
+                        node.boxmin[k][i] = 1e30f;
+                        node.boxmax[k][i] = -1e30f;
+                    }
+                    node.child[i] = 0;
+                    node.count[i] = -1;
+                }
+                nodes[index] = node;
+            }
+            return index;
+        }
+    };
+    Collapse collapse = { binary, nodes };
+    collapse.run(0);
+
+    // The triangles in leaf order
+    triangles.resize(9*(size_t)ntris);
+    triangleids.resize(ntris);
+    ThreadPool::global().parallelFor(numblocks, [&](int b) {
+        int end = std::min(ntris, (b+1) * TRIANGLE_BLOCK);
+        for(int i=b*TRIANGLE_BLOCK; i<end; i++) {
+            int t = builder.boxes[i].triangle;
+            triangleids[i] = t;
+            for(int c=0; c<3; c++) {
+                GLuint v = indices[3*(size_t)t + c];
+                if((int)v >= nverts) v = 0;
+                for(int k=0; k<3; k++) triangles[9*(size_t)i + 3*c + k] = vertices[8*(size_t)v + k];
+            }
+        }
+    });
+    seconds = glfwGetTime() - starttime;
+}
+
+
+/*
+ * intersect() - walk the tree with a stack, nearest boxes first, and
+ * skip boxes that start behind the closest hit found so far.
+ */
+int MeshBVH::intersect(const float *origin, const float *direction, RayHit *hit,
+                       float maxdistance) const {
+
+    hit->triangle = -1;
+    hit->distance = maxdistance;
+    hit->u = hit->v = 0.0f;
+    if(nodes.empty()) return 0;
+
+    float invdir[3];
+    for(int k=0; k<3; k++) invdir[k] = 1.0f / direction[k]; // Infinite for 0, which works for the slabs
+
+    struct Entry {
+        int child;   // Node or first triangle
+        int count;   // 0 for a node
+        float enter; // Where the ray enters the box
+    };
+    Entry stack[STACK_SIZE];
+    int top = 0;
+    stack[top].child = 0;
+    stack[top].count = 0;
+    stack[top].enter = 0.0f;
+    top++;
+
+#ifdef __SSE2__
+    const __m128 o[3] = { _mm_set1_ps(origin[0]), _mm_set1_ps(origin[1]), _mm_set1_ps(origin[2]) };
+    const __m128 inv[3] = { _mm_set1_ps(invdir[0]), _mm_set1_ps(invdir[1]), _mm_set1_ps(invdir[2]) };
+#endif
+
+    while(top > 0) {
+        Entry e = stack[--top];
+        if(e.enter > hit->distance) continue;
+
+        if(e.count > 0) { // A leaf: Moller-Trumbore for each triangle
+            for(int i=e.child; i<e.child+e.count; i++) {
+                const float *p0 = &triangles[9*(size_t)i];
+                float e1[3], e2[3], pvec[3], tvec[3], qvec[3];
+                for(int k=0; k<3; k++) {
+                    e1[k] = p0[3+k] - p0[k];
+                    e2[k] = p0[6+k] - p0[k];
+                    tvec[k] = origin[k] - p0[k];
+                }
+                pvec[0] = direction[1]*e2[2] - direction[2]*e2[1];
+                pvec[1] = direction[2]*e2[0] - direction[0]*e2[2];
+                pvec[2] = direction[0]*e2[1] - direction[1]*e2[0];
+                float det = e1[0]*pvec[0] + e1[1]*pvec[1] + e1[2]*pvec[2];
+                if(fabsf(det) < 1e-30f) continue; // The ray is parallel to the triangle
+                float invdet = 1.0f / det;
+                float u = (tvec[0]*pvec[0] + tvec[1]*pvec[1] + tvec[2]*pvec[2]) * invdet;
+                if(u < 0.0f || u > 1.0f) continue;
+                qvec[0] = tvec[1]*e1[2] - tvec[2]*e1[1];
+                qvec[1] = tvec[2]*e1[0] - tvec[0]*e1[2];
+                qvec[2] = tvec[0]*e1[1] - tvec[1]*e1[0];
+                float v = (direction[0]*qvec[0] + direction[1]*qvec[1] + direction[2]*qvec[2]) * invdet;
+                if(v < 0.0f || u + v > 1.0f) continue;
+                float t = (e2[0]*qvec[0] + e2[1]*qvec[1] + e2[2]*qvec[2]) * invdet;
+                if(t >= 0.0f && t < hit->distance) {
+                    hit->triangle = triangleids[i];
+                    hit->distance = t;
+                    hit->u = u;
+                    hit->v = v;
+                }
+            }
+            continue;
+        }
+
+        // An inner node: test the ray against the boxes of all four children
+        const Node &node = nodes[e.child];
+        float enter[4];
+        int mask = 0;
+#ifdef __SSE2__
+        __m128 tnear = _mm_setzero_ps();
+        __m128 tfar = _mm_set1_ps(hit->distance);
+        for(int k=0; k<3; k++) {
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boxmin[k]), o[k]), inv[k]);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boxmax[k]), o[k]), inv[k]);
+            tnear = _mm_max_ps(tnear, _mm_min_ps(t0, t1));
+            tfar = _mm_min_ps(tfar, _mm_max_ps(t0, t1));
+        }
+        mask = _mm_movemask_ps(_mm_cmple_ps(tnear, tfar));
+        _mm_storeu_ps(enter, tnear);
+#else
+        for(int i=0; i<4; i++) {
+            float tn = 0.0f, tf = hit->distance;
+            for(int k=0; k<3; k++) {
+                float t0 = (node.boxmin[k][i] - origin[k]) * invdir[k];
+                float t1 = (node.boxmax[k][i] - origin[k]) * invdir[k];
+                tn = std::max(tn, std::min(t0, t1));
+                tf = std::min(tf, std::max(t0, t1));
+            }
+            enter[i] = tn;
+            if(tn <= tf) mask |= 1 << i;
+        }
+#endif
+        // Push the hit children, farthest first, so the nearest is popped first
+        int hits[4], numhits = 0;
+        for(int i=0; i<4; i++) {
+            if(!(mask & (1 << i)) || node.count[i] < 0) continue;
+            int j = numhits++;
+            while(j > 0 && enter[hits[j-1]] < enter[i]) {
+                hits[j] = hits[j-1];
+                j--;
+            }
+            hits[j] = i;
+        }
+        for(int j=0; j<numhits && top<STACK_SIZE; j++) {
+            stack[top].child = node.child[hits[j]];
+            stack[top].count = node.count[hits[j]];
+            stack[top].enter = enter[hits[j]];
+            top++;
+        }
+    }
+    return hit->triangle >= 0;
+}
+
+
+int MeshBVH::numTriangles() const {
+    return (int)triangleids.size();
+}
+
+
+int MeshBVH::numNodes() const {
+    return (int)nodes.size();
+}
+
+
+double MeshBVH::buildSeconds() const {
+    return seconds;
+}
@@ -0,0 +1,88 @@
+/* MeshBVH.hpp */
+/* A bounding volume hierarchy over the triangles of a mesh, for ray picking. */
+/* Usage: call build() with a mesh in the interleaved TriangleSoup format
+ * (x y z nx ny nz s t) and its index array, then intersect() with rays
+ * in the same coordinates as the vertices. TriangleSoup keeps one of these
+ * for each mesh if it is asked to, see TriangleSoup::buildBVH() and
+ * TriangleSoup::pick(), and MouseRotator::pickRay() makes the ray for the
+ * pixel under the mouse pointer.
+ *
+ * The tree is built top down. Each node is split where the surface area
+ * heuristic (SAH) is lowest, with the triangle centers sorted into bins
+ * along each axis instead of fully sorted. Big nodes near the root are
+ * binned in parallel on the global ThreadPool, and the subtrees below
+ * them are then built in parallel. The result does not depend on the
+ * number of threads.
+ *
+ * The binary tree is then collapsed to a tree with four children per
+ * node, stored so that one SSE slab test checks the ray against all four
+ * boxes at once. The triangles are copied into leaf order, and tested
+ * with the Moller-Trumbore ray-triangle test. */
+
+#ifndef MESHBVH_HPP // Avoid including this header twice
+#define MESHBVH_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+
+#include <vector>
+
+/* The result of a ray query */
+struct RayHit {
+    int triangle;   // Triangle number in the index array, -1 for no hit
+    float distance; // Ray parameter t of the hit, origin + t * direction
+    float u, v;     // Barycentric coordinates, the hit is (1-u-v)*p0 + u*p1 + v*p2
+};
+
+class MeshBVH {
+
+public:
+
+/* Constructor: an empty tree, where every ray misses */
+MeshBVH();
+
+/*
+ * build() - build the tree for ntris triangles in indices, which index
+ * vertices with 8 floats per vertex. The arrays are not used after
+ * build() returns, the tree keeps its own copy of the triangles.
+ */
+void build(const GLfloat *vertices, int nverts, const GLuint *indices, int ntris);
+
+/*
+ * intersect() - find the closest triangle hit by the ray origin + t * direction
+ * with 0 <= t < maxdistance. Both sides of the triangles are hit.
+ * Returns 1 and fills in *hit if there is a hit, otherwise returns 0
+ * and sets hit->triangle to -1.
+ */
+int intersect(const float *origin, const float *direction, RayHit *hit,
+              float maxdistance = 1e30f) const;
+
+/* The number of triangles and nodes in the tree */
+int numTriangles() const;
+int numNodes() const;
+
+/* The time in seconds that the last build() took */
+double buildSeconds() const;
+
+private:
+
+/* A node with up to four children. The boxes are stored with each
+ * coordinate for all four children next to each other, for SSE. */
+struct Node {
+    float boxmin[3][4]; // boxmin[axis][child]
+    float boxmax[3][4];
+    int child[4]; // Node number for an inner child, first triangle for a leaf
+    int count[4]; // Triangles in a leaf, 0 for an inner child, -1 if unused
+};
+
+std::vector<Node> nodes;       // nodes[0] is the root
+std::vector<float> triangles;  // 9 floats per triangle, p0 p1 p2, in leaf order
+std::vector<int> triangleids;  // Triangle number in the index array, in leaf order
+double seconds;
+
+};
+
+#endif // MESHBVH_HPP
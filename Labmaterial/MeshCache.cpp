@@ -0,0 +1,287 @@
+/*
+ * Reading and writing of binary mesh cache files (".tsoup").
+ * The point of the format is that a cache can be used without any
+ * parsing or copying: the file is memory mapped and the vertex and
+ * index sections, already packed and narrowed the way OpenGL gets
+ * them, are handed directly to glBufferData().
+ */
+
+#include <cstdio>  // For file output and console messages
+#include <cstring> // For memcpy(), memcmp() and strlen()
+#include <vector>
+#include <sys/stat.h> // For stat()
+
+#include "MeshCache.hpp"
+#include "ThreadPool.hpp"
+
+namespace {
+
+const char MAGIC[8] = { 'T', 'S', 'O', 'U', 'P', 0, 0, 0 };
+const char *EXTENSION = ".tsoup";
+const size_t ALIGNMENT = 64;   // Section alignment in the file
+const size_t HASHBLOCK = 1 << 20; // Bytes per independently hashed block
+
+inline uint64_t alignUp(uint64_t offset) {
+    return (offset + ALIGNMENT - 1) & ~(uint64_t)(ALIGNMENT - 1);
+}
+
+/* The name of the cache file for a source file */
+std::vector<char> cacheName(const char *sourcefile, const char *suffix) {
+    size_t length = strlen(sourcefile);
+    std::vector<char> name(length + strlen(EXTENSION) + strlen(suffix) + 1);
+    sprintf(&name[0], "%s%s%s", sourcefile, EXTENSION, suffix);
+    return name;
+}
+
+/* Size and modification time of a file. Returns 0 if it doesn't exist. */
+int fileStat(const char *filename, uint64_t *size, int64_t *mtime) {
+    struct stat filestat;
+    if(stat(filename, &filestat) != 0) return 0;
+    *size = (uint64_t)filestat.st_size;
+    *mtime = (int64_t)filestat.st_mtime;
+    return 1;
+}
+
+/* A fast 64-bit hash of one block of data, 8 bytes at a time */
+uint64_t hashBlock(const char *data, size_t size) {
+    const uint64_t PRIME = 0x9E3779B97F4A7C15ull;
+    uint64_t h = size * PRIME;
+    size_t i;
+    for(i=0; i+8 <= size; i+=8) {
+        uint64_t word;
+        memcpy(&word, data+i, 8);
+        h = (h ^ word) * PRIME;
+        h ^= h >> 29;
+    }
+    for(; i<size; i++) {
+        h = (h ^ (unsigned char)data[i]) * PRIME;
+    }
+    h ^= h >> 32;
+    return h;
+}
+
+} // namespace
+
+
+/* Constructor: create an empty (closed) cache */
+MeshCache::MeshCache() {
+}
+
+
+/* Destructor: close the cache file if it is open */
+MeshCache::~MeshCache() {
+    close();
+}
+
+
+/*
+ * open() - map the cache file for sourcefile, if there is a valid one.
+ */
+int MeshCache::open(const char *sourcefile, int options, const VertexFormat &format) {
+
+    uint64_t sourcesize;
+    int64_t sourcemtime;
+
+    close();
+    if(!fileStat(sourcefile, &sourcesize, &sourcemtime)) return 0;
+    if(!file.open(&cacheName(sourcefile, "")[0])) return 0;
+
+    // Check that this is a complete cache file of the right kind
+    const MeshCacheHeader *h = header();
+    if(file.size < sizeof(MeshCacheHeader) || memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0
+        || h->version != MESHCACHE_VERSION || h->options != (uint32_t)options
+        || h->vertexformat[0] != (uint32_t)format.positiontype
+        || h->vertexformat[1] != (uint32_t)format.normaltype
+        || h->vertexformat[2] != (uint32_t)format.texcoordtype
+        || h->vertexsize != (uint32_t)format.stride
+        || (h->indextype != GL_UNSIGNED_SHORT && h->indextype != GL_UNSIGNED_INT)
+        || h->indexsize != ((h->indextype == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint))
+        || h->nindices < 3*(uint64_t)h->ntris || h->numlods > MESHCACHE_MAX_LODS
+        || h->indexoffset + (uint64_t)h->indexsize*h->nindices > file.size
+        || h->vertexoffset + (uint64_t)h->vertexsize*h->nverts > h->indexoffset) {
+        close();
+        return 0;
+    }
+    for(uint32_t i=0; i<h->numlods; i++) {
+        if((uint64_t)h->lods[i].first + h->lods[i].count > h->nindices) {
+            close();
+            return 0;
+        }
+    }
+
+    // Check that it was built from this version of the source file
+    if(h->sourcesize != sourcesize) {
+        close();
+        return 0;
+    }
+    if(h->sourcemtime != sourcemtime && h->sourcehash != hashFile(sourcefile)) {
+        close();
+        return 0;
+    }
+    return 1;
+}
+
+
+/* Unmap the cache file */
+void MeshCache::close() {
+    file.close();
+}
+
+
+/* The header of the open cache file */
+const MeshCacheHeader *MeshCache::header() const {
+    return (const MeshCacheHeader*)file.data;
+}
+
+
+/* The vertex format of the open cache file */
+VertexFormat MeshCache::vertexFormat() const {
+    const MeshCacheHeader *h = header();
+    VertexFormat format(h->vertexformat[0], h->vertexformat[1], h->vertexformat[2]);
+    memcpy(format.positionscale, &h->decoding[0], sizeof(format.positionscale));
+    memcpy(format.positionbias, &h->decoding[4], sizeof(format.positionbias));
+    memcpy(format.texcoordscalebias, &h->decoding[8], sizeof(format.texcoordscalebias));
+    return format;
+}
+
+
+/* The vertex array in the open cache file */
+const void *MeshCache::vertices() const {
+    return file.data + header()->vertexoffset;
+}
+
+
+/* The index array in the open cache file */
+const void *MeshCache::indices() const {
+    return file.data + header()->indexoffset;
+}
+
+
+/* 1 if p points into the open cache file */
+int MeshCache::contains(const void *p) const {
+    return file.data && (const char*)p >= file.data && (const char*)p < file.data + file.size;
+}
+
+
+/*
+ * write() - save a mesh built from sourcefile to its cache file.
+ */
+int MeshCache::write(const char *sourcefile, int options, const VertexFormat &format,
+                     const void *vertexarray, int nverts,
+                     GLenum indextype, const void *indexarray, int ntris,
+                     const GLfloat bounds[10],
+                     const MeshCacheLOD *lods, int numlods) {
+
+    MeshCacheHeader h;
+    static const char padding[ALIGNMENT] = { 0 };
+    std::vector<char> tempname = cacheName(sourcefile, ".tmp");
+    std::vector<char> name = cacheName(sourcefile, "");
+    FILE *cachefile;
+    int writeerror = 0;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = MESHCACHE_VERSION;
+    h.options = (uint32_t)options;
+    if(!fileStat(sourcefile, &h.sourcesize, &h.sourcemtime)) return 0;
+    h.sourcehash = hashFile(sourcefile);
+    h.nverts = (uint32_t)nverts;
+    h.ntris = (uint32_t)ntris;
+    h.vertexsize = (uint32_t)format.stride;
+    h.indextype = (uint32_t)indextype;
+    h.indexsize = (indextype == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+    h.vertexoffset = alignUp(sizeof(h));
+    h.indexoffset = alignUp(h.vertexoffset + (uint64_t)h.vertexsize*nverts);
+    h.nindices = 3*(uint32_t)ntris;
+    if(numlods > MESHCACHE_MAX_LODS) numlods = MESHCACHE_MAX_LODS;
+    h.numlods = (uint32_t)numlods;
+    for(int i=0; i<numlods; i++) {
+        h.lods[i] = lods[i];
+        if(lods[i].first + lods[i].count > h.nindices) h.nindices = lods[i].first + lods[i].count;
+    }
+
+    // The layout is the one of the vertex format, with the constants
+    // that the vertex shader needs to decode it
+    h.numattributes = 3;
+    for(int a=0; a<3; a++) {
+        GLint components;
+        GLenum type;
+        GLboolean normalized;
+        int offset;
+        format.attribute(a, &components, &type, &normalized, &offset);
+        h.attributes[a].location = (uint8_t)a;
+        h.attributes[a].components = (uint8_t)components;
+        h.attributes[a].type = (uint16_t)type;
+        h.attributes[a].normalized = normalized;
+        h.attributes[a].offset = (uint16_t)offset;
+    }
+    h.vertexformat[0] = (uint32_t)format.positiontype;
+    h.vertexformat[1] = (uint32_t)format.normaltype;
+    h.vertexformat[2] = (uint32_t)format.texcoordtype;
+    memcpy(&h.decoding[0], format.positionscale, sizeof(format.positionscale));
+    memcpy(&h.decoding[4], format.positionbias, sizeof(format.positionbias));
+    memcpy(&h.decoding[8], format.texcoordscalebias, sizeof(format.texcoordscalebias));
+
+    memcpy(h.bounds, bounds, sizeof(h.bounds));
+    memcpy(h.sphere, bounds + 6, sizeof(h.sphere));
+
+    cachefile = fopen(&tempname[0], "wb");
+    if(!cachefile) {
+        printError("Cannot write mesh cache", &tempname[0]);
+        return 0;
+    }
+    size_t vertexbytes = (size_t)h.vertexsize*nverts;
+    size_t indexbytes = (size_t)h.indexsize*h.nindices;
+    if(fwrite(&h, sizeof(h), 1, cachefile) != 1
+        || fwrite(padding, 1, h.vertexoffset - sizeof(h), cachefile) != h.vertexoffset - sizeof(h)
+        || fwrite(vertexarray, 1, vertexbytes, cachefile) != vertexbytes
+        || fwrite(padding, 1, h.indexoffset - h.vertexoffset - vertexbytes, cachefile)
+            != h.indexoffset - h.vertexoffset - vertexbytes
+        || fwrite(indexarray, 1, indexbytes, cachefile) != indexbytes) {
+        writeerror = 1;
+    }
+    if(fclose(cachefile) != 0) writeerror = 1;
+
+    if(!writeerror) {
+        remove(&name[0]); // Windows refuses to rename onto an existing file
+        if(rename(&tempname[0], &name[0]) != 0) writeerror = 1;
+    }
+    if(writeerror) {
+        printError("Cannot write mesh cache", &name[0]);
+        remove(&tempname[0]);
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * hashFile() - hash the contents of a file.
+ * The file is hashed in fixed size blocks on the global ThreadPool,
+ * and the block hashes are then combined in order. The result does not
+ * depend on the number of threads.
+ */
+uint64_t MeshCache::hashFile(const char *filename) {
+
+    MappedFile source;
+    if(!source.open(filename)) return 0;
+
+    size_t numblocks = (source.size + HASHBLOCK - 1) / HASHBLOCK;
+    std::vector<uint64_t> blockhashes(numblocks);
+    ThreadPool::global().parallelFor((int)numblocks, [&](int b) {
+        size_t start = (size_t)b * HASHBLOCK;
+        size_t size = source.size - start < HASHBLOCK ? source.size - start : HASHBLOCK;
+        blockhashes[b] = hashBlock(source.data + start, size);
+    });
+    return hashBlock((const char*)&blockhashes[0], numblocks*sizeof(uint64_t));
+}
+
+
+/*
+ * private
+ * printError() - Signal an error.
+ * Simple printf() to console for portability.
+ */
+void MeshCache::printError(const char *errtype, const char *errmsg) {
+  fprintf(stderr, "%s: %s\n", errtype, errmsg);
+}
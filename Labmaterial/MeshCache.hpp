@@ -0,0 +1,153 @@
+/* MeshCache.hpp */
+/* A binary cache file format (".tsoup") for TriangleSoup meshes. */
+/* Usage: after a mesh has been parsed from a text file, call write()
+ * to save its vertex and index arrays next to the source file
+ * ("mesh.obj" is cached in "mesh.obj.tsoup"). The arrays are saved the
+ * way they go to OpenGL: the vertices packed in their VertexFormat and
+ * the indices in their final width, so that a cached mesh is uploaded
+ * from the file as it is. The next time, call open() first. If it
+ * returns 1, the cache is valid, and vertices() and indices() point
+ * straight into the memory mapped cache file. They stay valid until
+ * close() is called or the MeshCache is destroyed.
+ *
+ * A cache is valid if it has the right version, was built with the same
+ * options and vertex format, and the source file has the same size and
+ * modification time as when the cache was written. If only the time
+ * differs (the file was copied or touched), the contents are hashed and
+ * compared instead.
+ *
+ * File layout, all sections start at multiples of 64 bytes:
+ *   header (MeshCacheHeader)
+ *   vertex array (nverts vertices of vertexsize bytes each, in the
+ *     vertex format of the header)
+ *   index array (nindices indices of indexsize bytes each): the 3*ntris
+ *     indices of the full mesh, followed by those of any coarser levels
+ *     of detail listed in the header */
+
+#ifndef MESHCACHE_HPP // Avoid including this header twice
+#define MESHCACHE_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+#include "MappedFile.hpp"
+#include "VertexFormat.hpp"
+
+#include <stdint.h>       // For fixed size integers in the file header
+
+// Bump this whenever the file layout or the meaning of the data changes
+#define MESHCACHE_VERSION 3
+
+#define MESHCACHE_MAX_LODS 8 // Room for levels of detail in the header
+
+// One vertex attribute in the cached vertex array
+struct MeshCacheAttribute {
+    uint8_t location;     // Attribute location in the shader
+    uint8_t components;   // Number of components (1 to 4)
+    uint16_t type;        // GL type of each component, e.g. GL_FLOAT
+    uint16_t normalized;  // GL_TRUE or GL_FALSE
+    uint16_t offset;      // Byte offset from the start of the vertex
+};
+
+// One level of detail, a range in the cached index array
+struct MeshCacheLOD {
+    uint32_t first;       // First index
+    uint32_t count;       // Number of indices
+    float error;          // Simplification error, in mesh units
+    uint32_t reserved;
+};
+
+// The header at the start of a cache file
+struct MeshCacheHeader {
+    char magic[8];            // "TSOUP" followed by zeros
+    uint32_t version;         // MESHCACHE_VERSION
+    uint32_t options;         // TriangleSoup options the mesh was built with
+    uint64_t sourcesize;      // Size of the source file in bytes
+    int64_t sourcemtime;      // Modification time of the source file
+    uint64_t sourcehash;      // MeshCache::hashFile() of the source file
+    uint32_t nverts;          // Number of vertices
+    uint32_t ntris;           // Number of triangles
+    uint32_t vertexsize;      // Bytes per vertex, the stride of the vertex format
+    uint32_t indexsize;       // Bytes per index, 2 or 4
+    uint64_t vertexoffset;    // File offset of the vertex array
+    uint64_t indexoffset;     // File offset of the index array
+    float bounds[6];          // Mesh extents: xmin ymin zmin xmax ymax zmax
+    float sphere[4];          // Bounding sphere: center x y z, radius
+    uint32_t numattributes;   // Number of used entries in attributes[]
+    MeshCacheAttribute attributes[4]; // Vertex layout
+    uint32_t vertexformat[3]; // VertexFormat position, normal and texcoord types
+    float decoding[12];       // VertexFormat positionscale, positionbias, texcoordscalebias
+    uint32_t indextype;       // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t nindices;        // Indices in the index array, at least 3*ntris
+    uint32_t numlods;         // Number of used entries in lods[] (0 if none)
+    MeshCacheLOD lods[MESHCACHE_MAX_LODS]; // Levels of detail, the first is the full mesh
+};
+
+class MeshCache {
+
+public:
+
+/* Constructor: create an empty (closed) cache */
+MeshCache();
+
+/* Destructor: close the cache file if it is open */
+~MeshCache();
+
+/*
+ * open() - map the cache file for sourcefile, if there is a valid one
+ * made with the same options and vertex format (only the encodings of
+ * format are compared). Returns 1 if the cache was opened, 0 if it is
+ * missing or out of date.
+ */
+int open(const char *sourcefile, int options, const VertexFormat &format);
+
+/* Unmap the cache file */
+void close();
+
+/* The header of the open cache file */
+const MeshCacheHeader *header() const;
+
+/* The vertex format of the open cache file, with the decoding
+ * constants of its mesh */
+VertexFormat vertexFormat() const;
+
+/* The vertex array in the open cache file, packed in vertexFormat() */
+const void *vertices() const;
+
+/* The index array in the open cache file, of header()->indextype */
+const void *indices() const;
+
+/* 1 if p points into the open cache file */
+int contains(const void *p) const;
+
+/*
+ * write() - save a mesh built from sourcefile to its cache file.
+ * vertexarray holds nverts vertices packed with format.pack() (or
+ * floats for the float format), indexarray is of indextype.
+ * bounds is the box and the sphere as in MeshCacheHeader.
+ * If numlods > 0, the index array holds all the levels of detail in
+ * lods (at most MESHCACHE_MAX_LODS), otherwise just 3*ntris indices.
+ * The file is written under a temporary name and then renamed, so
+ * a crash never leaves a half-written cache behind.
+ * Returns 1 on success, 0 on failure.
+ */
+static int write(const char *sourcefile, int options, const VertexFormat &format,
+                 const void *vertexarray, int nverts,
+                 GLenum indextype, const void *indexarray, int ntris,
+                 const GLfloat bounds[10],
+                 const MeshCacheLOD *lods = NULL, int numlods = 0);
+
+/* Hash the contents of a file with a fast 64-bit hash (0 on failure) */
+static uint64_t hashFile(const char *filename);
+
+private:
+
+MappedFile file;
+
+static void printError(const char *errtype, const char *errmsg);
+
+};
+
+#endif // MESHCACHE_HPP
@@ -0,0 +1,243 @@
+/*
+ * Vertex cache and vertex fetch optimization for indexed triangle meshes.
+ *
+ * optimizeVertexCache() is Tom Forsyth's greedy algorithm: a small LRU
+ * cache is simulated, every vertex gets a score from its position in
+ * the cache and from how many unemitted triangles still use it, and the
+ * triangle with the highest total score is emitted next. Only triangles
+ * that touch the cache are rescored after each step, so the running
+ * time is linear in the number of triangles.
+ */
+
+#include <cstdio>  // For printf()
+#include <cmath>   // For pow()
+#include <vector>
+
+#include "MeshOptimizer.hpp"
+
+namespace {
+
+const int LRU_SIZE = 32;   // Size of the simulated cache in the reordering
+const int MAX_VALENCE = 32; // Size of the precomputed valence score table
+
+/* The score tables, filled in when they are made (the constants are Forsyth's) */
+struct ScoreTables {
+    float position[LRU_SIZE];   // Score by position in the LRU cache
+    float valence[MAX_VALENCE]; // Score by number of remaining triangles
+
+    ScoreTables() {
+        for(int i=0; i<LRU_SIZE; i++) {
+            if(i < 3) {
+                // The last triangle's vertices get a fixed score, so the
+                // order within it does not matter
+                position[i] = 0.75f;
+            }
+            else {
+                position[i] = (float)pow(1.0 - (i-3) / (double)(LRU_SIZE-3), 1.5);
+            }
+        }
+        valence[0] = 0.0f;
+        for(int i=1; i<MAX_VALENCE; i++) {
+            // Boost vertices with few triangles left, to finish them off
+            valence[i] = (float)(2.0 * pow((double)i, -0.5));
+        }
+    }
+};
+
+/* The tables, made on the first call. Meshes are optimized on the
+ * AsyncLoader thread and on the main thread, and C++11 makes the first
+ * use of a local static safe from both. */
+const ScoreTables &scoreTables() {
+    static const ScoreTables tables;
+    return tables;
+}
+
+/* The score of a vertex at a cache position (-1 if not cached) */
+inline float vertexScore(const ScoreTables &tables, int cacheposition, int remaining) {
+    if(remaining == 0) return -1.0f; // No triangles left to emit
+    float score = (cacheposition >= 0) ? tables.position[cacheposition] : 0.0f;
+    if(remaining < MAX_VALENCE) score += tables.valence[remaining];
+    else score += (float)(2.0 * pow((double)remaining, -0.5));
+    return score;
+}
+
+/* Count the cache misses in a simulated FIFO cache */
+int countMisses(const GLuint *indices, int ntris, int nverts, int cachesize, int *usedverts) {
+
+    // A vertex is in the cache if fewer than cachesize misses have
+    // happened since it was last loaded, so a timestamp is enough.
+    std::vector<int> loadtime(nverts, 0);
+    int time = cachesize + 1;
+    int used = 0;
+    for(int i=0; i<3*ntris; i++) {
+        GLuint v = indices[i];
+        if(loadtime[v] == 0) used++;
+        if(time - loadtime[v] > cachesize) {
+            loadtime[v] = time++;
+        }
+    }
+    if(usedverts) *usedverts = used;
+    return time - (cachesize + 1);
+}
+
+} // namespace
+
+
+/*
+ * optimizeVertexCache() - reorder the triangles, see the top of this file.
+ */
+void MeshOptimizer::optimizeVertexCache(GLuint *indices, int ntris, int nverts) {
+
+    if(ntris <= 0) return;
+    const ScoreTables &tables = scoreTables();
+
+    // The triangles around each vertex, in compressed rows: the triangles
+    // of vertex v are adjacency[offsets[v]] ... adjacency[offsets[v]+remaining[v]-1]
+    std::vector<int> offsets(nverts + 1, 0);
+    std::vector<int> remaining(nverts, 0);
+    for(int i=0; i<3*ntris; i++) remaining[indices[i]]++;
+    for(int v=0; v<nverts; v++) offsets[v+1] = offsets[v] + remaining[v];
+    std::vector<int> adjacency(3*ntris);
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    for(int t=0; t<ntris; t++) {
+        for(int k=0; k<3; k++) adjacency[fill[indices[3*t+k]]++] = t;
+    }
+
+    std::vector<int> cacheposition(nverts, -1);
+    std::vector<float> score(nverts);
+    for(int v=0; v<nverts; v++) score[v] = vertexScore(tables, -1, remaining[v]);
+    std::vector<char> emitted(ntris, 0);
+    std::vector<GLuint> output(3*ntris);
+
+    int cache[LRU_SIZE + 3];
+    int cachesize = 0;
+    int newcache[LRU_SIZE + 3];
+    int besttri = 0; // Start with the first triangle
+    int cursor = 0;  // Where to look for unemitted triangles if the cache runs dry
+
+    for(int n=0; n<ntris; n++) {
+        if(besttri < 0) { // No candidates around the cache, take the next unused triangle
+            while(emitted[cursor]) cursor++;
+            besttri = cursor;
+        }
+
+        // Emit the triangle and remove it from the adjacency of its vertices
+        emitted[besttri] = 1;
+        int newsize = 0;
+        for(int k=0; k<3; k++) {
+            int v = indices[3*besttri+k];
+            output[3*n+k] = v;
+            int *tris = &adjacency[offsets[v]];
+            int last = remaining[v] - 1;
+            for(int j=0; j<=last; j++) {
+                if(tris[j] == besttri) {
+                    tris[j] = tris[last];
+                    break;
+                }
+            }
+            remaining[v]--;
+            newcache[newsize++] = v; // Its vertices move to the front of the cache
+        }
+        for(int i=0; i<cachesize; i++) {
+            int v = cache[i];
+            if(v != newcache[0] && v != newcache[1] && v != newcache[2]) {
+                newcache[newsize++] = v;
+            }
+        }
+
+        // Rescore the cached vertices, including those that just fell out
+        for(int i=0; i<newsize; i++) {
+            int v = newcache[i];
+            cacheposition[v] = (i < LRU_SIZE) ? i : -1;
+            score[v] = vertexScore(tables, cacheposition[v], remaining[v]);
+        }
+
+        // Rescore the triangles around the cache and pick the best one
+        float bestscore = -1.0f;
+        besttri = -1;
+        for(int i=0; i<newsize; i++) {
+            int v = newcache[i];
+            const int *tris = &adjacency[offsets[v]];
+            for(int j=0; j<remaining[v]; j++) {
+                int t = tris[j];
+                float s = score[indices[3*t]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+                if(s > bestscore) {
+                    bestscore = s;
+                    besttri = t;
+                }
+            }
+        }
+
+        cachesize = (newsize < LRU_SIZE) ? newsize : LRU_SIZE;
+        for(int i=0; i<cachesize; i++) cache[i] = newcache[i];
+    }
+
+    for(int i=0; i<3*ntris; i++) indices[i] = output[i];
+}
+
+
+/*
+ * optimizeVertexFetch() - put the vertices in first-use order.
+ */
+int MeshOptimizer::optimizeVertexFetch(GLfloat *vertices, GLuint *indices, int ntris, int nverts, int stride) {
+
+    const GLuint UNUSED = 0xFFFFFFFFu;
+    std::vector<GLuint> remap(nverts, UNUSED);
+    GLuint used = 0;
+
+    for(int i=0; i<3*ntris; i++) {
+        GLuint v = indices[i];
+        if(remap[v] == UNUSED) remap[v] = used++;
+        indices[i] = remap[v];
+    }
+
+    // Unused vertices keep their relative order after the used ones
+    GLuint next = used;
+    for(int v=0; v<nverts; v++) {
+        if(remap[v] == UNUSED) remap[v] = next++;
+    }
+
+    std::vector<GLfloat> original(vertices, vertices + (size_t)nverts * stride);
+    for(int v=0; v<nverts; v++) {
+        const GLfloat *src = &original[(size_t)v * stride];
+        GLfloat *dst = vertices + (size_t)remap[v] * stride;
+        for(int k=0; k<stride; k++) dst[k] = src[k];
+    }
+    return (int)used;
+}
+
+
+/* Vertex shader runs per triangle */
+double MeshOptimizer::computeACMR(const GLuint *indices, int ntris, int nverts, int cachesize) {
+    if(ntris <= 0) return 0.0;
+    return countMisses(indices, ntris, nverts, cachesize, NULL) / (double)ntris;
+}
+
+
+/* Vertex shader runs per used vertex */
+double MeshOptimizer::computeATVR(const GLuint *indices, int ntris, int nverts, int cachesize) {
+    int used;
+    int misses = countMisses(indices, ntris, nverts, cachesize, &used);
+    return (used > 0) ? misses / (double)used : 0.0;
+}
+
+
+/*
+ * optimize() - both optimizations, with statistics.
+ */
+int MeshOptimizer::optimize(GLfloat *vertices, GLuint *indices, int ntris, int nverts, int stride) {
+
+    const int C = DEFAULT_CACHE_SIZE;
+    double starttime = glfwGetTime();
+    double acmrbefore = computeACMR(indices, ntris, nverts, C);
+    double atvrbefore = computeATVR(indices, ntris, nverts, C);
+
+    optimizeVertexCache(indices, ntris, nverts);
+    int used = optimizeVertexFetch(vertices, indices, ntris, nverts, stride);
+    double seconds = glfwGetTime() - starttime;
+
+    printf("MeshOptimizer: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (FIFO cache of %d) in %.3f s\n",
+        acmrbefore, computeACMR(indices, ntris, nverts, C),
+        atvrbefore, computeATVR(indices, ntris, nverts, C), C, seconds);
+    return used;
+}
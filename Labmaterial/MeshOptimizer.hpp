@@ -0,0 +1,59 @@
+/* MeshOptimizer.hpp */
+/* Reorders indexed triangle meshes to make better use of the GPU caches. */
+/* Usage: call optimize() on a vertex array and an index array before
+ * they are sent to OpenGL. It runs two steps, which can also be
+ * called one by one:
+ *   optimizeVertexCache() reorders the triangles so that vertices are
+ *     reused while they are still in the post-transform cache
+ *     (Tom Forsyth's "Linear-speed vertex cache optimisation").
+ *   optimizeVertexFetch() reorders the vertices into the order in which
+ *     the triangles first use them, so that the vertex shader reads
+ *     memory mostly sequentially, and moves unused vertices to the end.
+ *     The indices are remapped to match.
+ * The effect is measured by simulating a FIFO post-transform cache:
+ *   ACMR (average cache miss ratio) is shader runs per triangle, 0.5 at
+ *     best for large regular meshes, 3.0 at worst.
+ *   ATVR (average transformed vertex ratio) is shader runs per vertex,
+ *     1.0 at best.
+ * Only meshes that share vertices between triangles can improve. With
+ * three vertices of its own per triangle, every mesh has ACMR 3.0. */
+
+#ifndef MESHOPTIMIZER_HPP // Avoid including this header twice
+#define MESHOPTIMIZER_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+
+namespace MeshOptimizer {
+
+// Cache size for the statistics, a typical value for real GPUs
+const int DEFAULT_CACHE_SIZE = 16;
+
+/* Reorder the triangles in indices for the post-transform vertex cache */
+void optimizeVertexCache(GLuint *indices, int ntris, int nverts);
+
+/*
+ * optimizeVertexFetch() - reorder the vertices (stride floats each)
+ * into first-use order and remap the indices. Vertices that no triangle
+ * uses are moved to the end. Returns the number of used vertices.
+ */
+int optimizeVertexFetch(GLfloat *vertices, GLuint *indices, int ntris, int nverts, int stride);
+
+/* Vertex shader runs per triangle with a FIFO cache of cachesize entries */
+double computeACMR(const GLuint *indices, int ntris, int nverts, int cachesize);
+
+/* Vertex shader runs per used vertex with a FIFO cache of cachesize entries */
+double computeATVR(const GLuint *indices, int ntris, int nverts, int cachesize);
+
+/*
+ * optimize() - run both optimizations and print ACMR and ATVR before
+ * and after. Returns the number of used vertices, see optimizeVertexFetch().
+ */
+int optimize(GLfloat *vertices, GLuint *indices, int ntris, int nverts, int stride);
+
+}
+
+#endif // MESHOPTIMIZER_HPP
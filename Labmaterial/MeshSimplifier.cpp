@@ -0,0 +1,549 @@
+/*
+ * Quadric error edge collapse, see MeshSimplifier.hpp.
+ * Each pass:
+ *  1. finds the triangles around every vertex (compressed rows),
+ *  2. finds the cheapest collapse for every vertex that may move
+ *     (in parallel, read-only). A vertex on a seam has a twin at the
+ *     same position, and the two move together along the seam,
+ *  3. picks a cost limit so that about the right number of collapses
+ *     are made, and applies them per partition (in parallel), cheapest
+ *     first, never two collapses with overlapping neighborhoods,
+ *  4. renames the collapsed vertices in the index array and removes
+ *     the triangles that became degenerate.
+ */
+
+#include <cmath>     // For sqrt()
+#include <vector>
+#include <algorithm> // For sort() and nth_element()
+#include <stdint.h>
+
+#include "MeshSimplifier.hpp"
+#include "ThreadPool.hpp"
+#include "MeshUtil.hpp"   // For hashPosition()
+
+namespace {
+
+const int MAX_PASSES = 100;            // Give up if the mesh stops shrinking before this
+const double ATTRIBUTE_WEIGHT = 0.01;  // Cost of attribute changes relative to distances
+const double FLIP_LIMIT = 0.2;         // Smallest allowed cosine between old and new triangle normals
+const int MAX_GRID_SIZE = 4;           // Partitions along each axis, at most 64 in all
+const int PARTITION_TRIANGLES = 8192;  // Smallest number of triangles per partition
+const int VERTEX_BLOCK = 4096;         // Vertices per parallel task
+const int MAX_VALENCE = 64;            // Vertices with more neighbors than this never move
+const GLuint NONE = 0xFFFFFFFFu;
+
+/* A symmetric 4x4 matrix for the squared distance to a set of planes */
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22; // The plane normals, n n^T
+    double b0, b1, b2;                   // n d
+    double c;                            // d d
+    double weight;                       // Total area of the planes
+
+    void clear() {
+        a00 = a01 = a02 = a11 = a12 = a22 = b0 = b1 = b2 = c = weight = 0.0;
+    }
+
+    /* Add the plane n.x + d = 0 with the given weight (n has unit length) */
+    void addPlane(const double *n, double d, double w) {
+        a00 += w*n[0]*n[0]; a01 += w*n[0]*n[1]; a02 += w*n[0]*n[2];
+        a11 += w*n[1]*n[1]; a12 += w*n[1]*n[2]; a22 += w*n[2]*n[2];
+        b0 += w*n[0]*d; b1 += w*n[1]*d; b2 += w*n[2]*d;
+        c += w*d*d;
+        weight += w;
+    }
+
+    void add(const Quadric &q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02;
+        a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+    }
+
+    /* The weighted sum of squared distances from p to the planes */
+    double error(const float *p) const {
+        double x = p[0], y = p[1], z = p[2];
+        double e = a00*x*x + a11*y*y + a22*z*z
+                 + 2.0*(a01*x*y + a02*x*z + a12*y*z)
+                 + 2.0*(b0*x + b1*y + b2*z) + c;
+        return (e > 0.0) ? e : 0.0; // Rounding can make it slightly negative
+    }
+};
+
+/* The best collapse found for a vertex */
+struct Collapse {
+    GLuint vertex;   // The vertex that goes away
+    GLuint target;   // The vertex it is merged into
+    GLuint twintarget; // For a seam vertex, where its twin goes
+    float cost;      // Error quadric plus attribute penalty
+    float distance;  // Estimated surface movement, for the error bound
+};
+
+inline const float *position(const GLfloat *vertices, GLuint v) {
+    return vertices + 8*(size_t)v;
+}
+
+/* Twice the area vector (unnormalized normal) of a triangle */
+inline void triangleNormal(const float *p0, const float *p1, const float *p2, double *n) {
+    double e1[3] = { (double)p1[0]-p0[0], (double)p1[1]-p0[1], (double)p1[2]-p0[2] };
+    double e2[3] = { (double)p2[0]-p0[0], (double)p2[1]-p0[1], (double)p2[2]-p0[2] };
+    n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+    n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+    n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+/*
+ * For every vertex, find the first vertex with the same position.
+ * Unused vertices (not in indices) are left out and get group NONE.
+ * groupsize gets the number of vertices in each group.
+ */
+void findPositionGroups(const GLfloat *vertices, int nverts, const GLuint *indices, int ntris,
+                        std::vector<GLuint> &group, std::vector<int> &groupsize) {
+    size_t tablesize = 1;
+    while(tablesize < (size_t)nverts * 2) tablesize *= 2;
+    std::vector<GLuint> table(tablesize, NONE);
+    group.assign(nverts, NONE);
+    groupsize.assign(nverts, 0);
+    std::vector<char> used(nverts, 0);
+    for(int i=0; i<3*ntris; i++) used[indices[i]] = 1;
+    for(int v=0; v<nverts; v++) {
+        if(!used[v]) continue;
+        const float *p = position(vertices, v);
+        size_t slot = MeshUtil::hashPosition(p) & (tablesize - 1);
+        for(;;) {
+            GLuint other = table[slot];
+            if(other == NONE) {
+                table[slot] = v;
+                group[v] = v;
+                break;
+            }
+            const float *q = position(vertices, other);
+            if(p[0] == q[0] && p[1] == q[1] && p[2] == q[2]) {
+                group[v] = other;
+                break;
+            }
+            slot = (slot + 1) & (tablesize - 1);
+        }
+        groupsize[group[v]]++;
+    }
+}
+
+/*
+ * Find the seams and lock the vertices that must not move. A seam vertex
+ * shares its position with exactly one other vertex, its twin, and may
+ * move if the twin moves the same way. Vertices where three or more
+ * vertices meet (seam corners), and the ends of edges that don't have
+ * exactly two triangles (borders and non-manifold edges) are locked.
+ * Edges are compared by position, so a seam edge is not a border.
+ */
+void findSeams(const GLuint *indices, int ntris, const std::vector<GLuint> &group,
+               const std::vector<int> &groupsize, std::vector<GLuint> &twin,
+               std::vector<char> &locked) {
+    int nverts = (int)group.size();
+    twin.assign(nverts, NONE);
+    locked.assign(nverts, 0);
+    std::vector<GLuint> firstmember(nverts, NONE);
+    for(int v=0; v<nverts; v++) {
+        if(group[v] == NONE) continue;
+        int size = groupsize[group[v]];
+        if(size > 2) locked[v] = 1;
+        if(size == 2) {
+            GLuint other = firstmember[group[v]];
+            if(other == NONE) firstmember[group[v]] = v;
+            else {
+                twin[v] = other;
+                twin[other] = v;
+            }
+        }
+    }
+
+    std::vector<uint64_t> edges(3*(size_t)ntris);
+    for(int t=0; t<ntris; t++) {
+        for(int k=0; k<3; k++) {
+            uint64_t a = group[indices[3*t+k]];
+            uint64_t b = group[indices[3*t+(k+1)%3]];
+            edges[3*t+k] = (a < b) ? (a << 32 | b) : (b << 32 | a);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    std::vector<char> lockedgroup(nverts, 0);
+    for(size_t i=0; i<edges.size(); ) {
+        size_t j = i + 1;
+        while(j < edges.size() && edges[j] == edges[i]) j++;
+        if(j - i != 2) {
+            lockedgroup[edges[i] >> 32] = 1;
+            lockedgroup[edges[i] & 0xFFFFFFFFu] = 1;
+        }
+        i = j;
+    }
+    for(int v=0; v<nverts; v++) {
+        if(group[v] != NONE && lockedgroup[group[v]]) locked[v] = 1;
+    }
+}
+
+/* The triangles around each vertex, in compressed rows */
+struct Adjacency {
+    std::vector<int> offsets;   // Triangles of v: triangles[offsets[v]] ... triangles[offsets[v+1]-1]
+    std::vector<int> triangles;
+    const GLuint *indices;
+
+    void build(const GLuint *indexarray, int ntris, int nverts) {
+        indices = indexarray;
+        offsets.assign(nverts + 1, 0);
+        for(int i=0; i<3*ntris; i++) offsets[indices[i]+1]++;
+        for(int v=0; v<nverts; v++) offsets[v+1] += offsets[v];
+        triangles.resize(3*(size_t)ntris);
+        std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+        for(int t=0; t<ntris; t++) {
+            for(int k=0; k<3; k++) triangles[fill[indices[3*t+k]]++] = t;
+        }
+    }
+
+    int begin(GLuint v) const { return offsets[v]; }
+    int end(GLuint v) const { return offsets[v+1]; }
+    const GLuint *triangle(int j) const { return indices + 3*triangles[j]; }
+
+    /* Collect the distinct neighbors of v, returns their number or -1 if too many */
+    int neighbors(GLuint v, GLuint *result) const {
+        int n = 0;
+        for(int j=begin(v); j<end(v); j++) {
+            const GLuint *tri = triangle(j);
+            for(int k=0; k<3; k++) {
+                GLuint w = tri[k];
+                if(w == v) continue;
+                int i = 0;
+                while(i < n && result[i] != w) i++;
+                if(i < n) continue;
+                if(n == MAX_VALENCE) return -1;
+                result[n++] = w;
+            }
+        }
+        return n;
+    }
+
+    bool isNeighbor(GLuint v, GLuint w) const {
+        for(int j=begin(v); j<end(v); j++) {
+            const GLuint *tri = triangle(j);
+            if(tri[0] == w || tri[1] == w || tri[2] == w) return true;
+        }
+        return false;
+    }
+};
+
+} // namespace
+
+
+/*
+ * simplify() - see the top of this file for an outline.
+ */
+int MeshSimplifier::simplify(const GLfloat *vertices, int nverts, const GLuint *indices, int ntris,
+                             int targettris, GLuint *output, float *error) {
+
+    ThreadPool &pool = ThreadPool::global();
+    *error = 0.0f;
+    for(int i=0; i<3*ntris; i++) output[i] = indices[i];
+    if(ntris <= targettris || nverts == 0) return ntris;
+
+    std::vector<GLuint> group, twin;
+    std::vector<int> groupsize;
+    std::vector<char> locked;
+    findPositionGroups(vertices, nverts, indices, ntris, group, groupsize);
+
+    // Triangles with two corners at the same position have no area and
+    // are never seen, but they would lock their edges as non-manifold
+    int currenttris = 0;
+    for(int t=0; t<ntris; t++) {
+        GLuint a = group[output[3*t]], b = group[output[3*t+1]], c = group[output[3*t+2]];
+        if(a == b || b == c || a == c) continue;
+        for(int k=0; k<3; k++) output[3*currenttris+k] = output[3*t+k];
+        currenttris++;
+    }
+    findSeams(output, currenttris, group, groupsize, twin, locked);
+
+    // Bounding box, for the partition grid and to scale attribute costs
+    float lo[3], hi[3];
+    for(int k=0; k<3; k++) lo[k] = hi[k] = vertices[k];
+    for(int v=1; v<nverts; v++) {
+        for(int k=0; k<3; k++) {
+            float x = position(vertices, v)[k];
+            if(x < lo[k]) lo[k] = x;
+            if(x > hi[k]) hi[k] = x;
+        }
+    }
+    double extent = 0.0;
+    for(int k=0; k<3; k++) extent += (double)(hi[k]-lo[k]) * (hi[k]-lo[k]);
+    double attributescale = ATTRIBUTE_WEIGHT * extent;
+
+    int numpartitions = MAX_GRID_SIZE*MAX_GRID_SIZE*MAX_GRID_SIZE;
+    Adjacency adjacency;
+    std::vector<int> partition(nverts);
+    std::vector<Quadric> quadrics(nverts);
+    std::vector<Collapse> best(nverts);
+    std::vector<GLuint> remap(nverts);
+    std::vector<char> touched(nverts);
+    std::vector<char> dirty(nverts, 1); // Neighborhood changed since best[] was found
+    std::vector<char> eligible(nverts);  // best[] can be done in this pass
+    std::vector<float> partitionerror(numpartitions);
+    int numblocks = (nverts + VERTEX_BLOCK - 1) / VERTEX_BLOCK;
+    double maxdistance = 0.0;
+    int stuckpasses = 0;
+
+    /*
+     * The link condition: v and u may have no other common neighbors
+     * than the third corners of their shared triangles, or the collapse
+     * would make the mesh non-manifold.
+     */
+    auto manifold = [&](GLuint v, GLuint u) -> bool {
+        GLuint ring[MAX_VALENCE];
+        int n = adjacency.neighbors(v, ring);
+        if(n < 0) return false;
+        int shared = 0, common = 0;
+        for(int j=adjacency.begin(v); j<adjacency.end(v); j++) {
+            const GLuint *tri = adjacency.triangle(j);
+            if(tri[0] == u || tri[1] == u || tri[2] == u) shared++;
+        }
+        for(int i=0; i<n; i++) {
+            if(ring[i] != u && adjacency.isNeighbor(u, ring[i])) common++;
+        }
+        return common <= shared;
+    };
+
+    /*
+     * The cost of moving v onto u, or -1 if it is not below limit or
+     * would flip a triangle or make the mesh non-manifold. distance2
+     * gets the quadric error.
+     */
+    auto evaluate = [&](GLuint v, GLuint u, double limit, double *distance2) -> double {
+        const float *pv = position(vertices, v);
+        const float *pu = position(vertices, u);
+
+        *distance2 = quadrics[v].error(pu);
+        double attribute2 = 0.0;
+        for(int a=3; a<8; a++) {
+            double d = (double)pu[a] - pv[a];
+            attribute2 += d*d;
+        }
+        double cost = *distance2 + attributescale * quadrics[v].weight * attribute2;
+        if(cost >= limit) return -1.0;
+
+        // Reject collapses that flip or squash a triangle
+        for(int j=adjacency.begin(v); j<adjacency.end(v); j++) {
+            const GLuint *tri = adjacency.triangle(j);
+            if(tri[0] == u || tri[1] == u || tri[2] == u) continue; // Goes away
+            const float *p[3], *q[3];
+            for(int i=0; i<3; i++) {
+                p[i] = position(vertices, tri[i]);
+                q[i] = (tri[i] == v) ? pu : p[i];
+            }
+            double before[3], after[3];
+            triangleNormal(p[0], p[1], p[2], before);
+            triangleNormal(q[0], q[1], q[2], after);
+            double dot = before[0]*after[0] + before[1]*after[1] + before[2]*after[2];
+            double lengths = sqrt((before[0]*before[0] + before[1]*before[1] + before[2]*before[2])
+                                * (after[0]*after[0] + after[1]*after[1] + after[2]*after[2]));
+            if(dot <= FLIP_LIMIT * lengths) return -1.0;
+        }
+
+        return manifold(v, u) ? cost : -1.0;
+    };
+
+    /* Are v and all its neighbors in the same partition? */
+    auto inside = [&](GLuint v) -> bool {
+        for(int j=adjacency.begin(v); j<adjacency.end(v); j++) {
+            const GLuint *tri = adjacency.triangle(j);
+            for(int k=0; k<3; k++) {
+                if(partition[tri[k]] != partition[v]) return false;
+            }
+        }
+        return true;
+    };
+
+    /* Find the cheapest valid collapse of vertex v (and its twin) */
+    auto findBest = [&](GLuint v) {
+        Collapse &c = best[v];
+        GLuint t = twin[v];
+        c.vertex = v;
+        c.target = NONE;
+        if(locked[v] || adjacency.begin(v) == adjacency.end(v)) return;
+        if(t != NONE && (t < v || adjacency.begin(t) == adjacency.end(t))) return;
+
+        double bestcost = 1e300;
+        for(int j=adjacency.begin(v); j<adjacency.end(v); j++) {
+            const GLuint *tri = adjacency.triangle(j);
+            for(int k=0; k<3; k++) {
+                GLuint u = tri[k];
+                if(u == v || u == c.target) continue;
+
+                // The twin must move along the same seam edge
+                GLuint ut = NONE;
+                if(t != NONE) {
+                    if(groupsize[group[u]] < 2) continue; // Not on the seam
+                    for(int m=adjacency.begin(t); m<adjacency.end(t) && ut == NONE; m++) {
+                        const GLuint *other = adjacency.triangle(m);
+                        for(int i=0; i<3; i++) {
+                            if(other[i] != u && group[other[i]] == group[u]) ut = other[i];
+                        }
+                    }
+                    if(ut == NONE) continue;
+                }
+
+                double distance2 = 0.0, twindistance2 = 0.0;
+                double cost = evaluate(v, u, bestcost, &distance2);
+                if(cost < 0.0) continue;
+                if(t != NONE) {
+                    double twincost = evaluate(t, ut, bestcost - cost, &twindistance2);
+                    if(twincost < 0.0) continue;
+                    cost += twincost;
+                }
+
+                bestcost = cost;
+                c.target = u;
+                c.twintarget = ut;
+                c.cost = (float)cost;
+                double w = quadrics[v].weight + ((t != NONE) ? quadrics[t].weight : 0.0);
+                c.distance = (float)sqrt((w > 0.0) ? (distance2 + twindistance2) / w : 0.0);
+            }
+        }
+    };
+
+    for(int pass=0; pass<MAX_PASSES && currenttris > targettris; pass++) {
+
+        // 1. Triangles around each vertex
+        adjacency.build(output, currenttris, nverts);
+
+        if(pass == 0) { // Area weighted plane quadrics of the input mesh, gathered per vertex
+            pool.parallelFor(numblocks, [&](int b) {
+                int end = std::min(nverts, (b+1) * VERTEX_BLOCK);
+                for(int v=b*VERTEX_BLOCK; v<end; v++) {
+                    quadrics[v].clear();
+                    for(int j=adjacency.begin(v); j<adjacency.end(v); j++) {
+                        const GLuint *tri = adjacency.triangle(j);
+                        const float *p0 = position(vertices, tri[0]);
+                        double n[3];
+                        triangleNormal(p0, position(vertices, tri[1]), position(vertices, tri[2]), n);
+                        double length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+                        if(length == 0.0) continue;
+                        for(int k=0; k<3; k++) n[k] /= length;
+                        double d = -(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+                        quadrics[v].addPlane(n, d, 0.5 * length);
+                    }
+                }
+            });
+        }
+
+        // The grid depends on the size of the mesh, not on the number of
+        // threads, so neither does the result. Small meshes get a single
+        // partition. The grid moves by half a cell every other pass.
+        int gridsize = 1;
+        while(gridsize < MAX_GRID_SIZE
+              && (gridsize+1)*(gridsize+1)*(gridsize+1) * PARTITION_TRIANGLES <= currenttris) gridsize++;
+        float cellsize[3];
+        for(int k=0; k<3; k++) cellsize[k] = (hi[k] - lo[k]) / gridsize + 1e-30f;
+        float shift = (pass & 1) ? 0.5f : 0.0f;
+        for(int v=0; v<nverts; v++) {
+            int cell[3];
+            for(int k=0; k<3; k++) {
+                cell[k] = (int)((position(vertices, v)[k] - lo[k]) / cellsize[k] + shift);
+                if(cell[k] >= gridsize) cell[k] = gridsize - 1;
+            }
+            partition[v] = (cell[2]*gridsize + cell[1])*gridsize + cell[0];
+        }
+
+        // 2. The cheapest valid collapse for each vertex. A seam vertex
+        // and its twin are handled by the one with the lower number. The
+        // cost only depends on the triangles around the vertex and on its
+        // quadric, so only vertices next to a collapse need a new search.
+        pool.parallelFor(numblocks, [&](int b) {
+            int end = std::min(nverts, (b+1) * VERTEX_BLOCK);
+            for(int v=b*VERTEX_BLOCK; v<end; v++) {
+                GLuint t = twin[v];
+                if(dirty[v] || (t != NONE && dirty[t])) findBest(v);
+                eligible[v] = best[v].target != NONE && inside(v) && (t == NONE || inside(t));
+            }
+        });
+
+        // 3. Collapse about as many as needed, cheapest first. Each collapse
+        // removes about two triangles (four on a seam). At most a third of
+        // the candidates are used, or the first passes would take the cheap
+        // and the expensive ones alike. Only vertices with their whole
+        // neighborhood in one partition can be collapsed in this pass.
+        std::vector<Collapse> candidates;
+        for(int v=0; v<nverts; v++) {
+            if(eligible[v]) candidates.push_back(best[v]);
+        }
+        if(candidates.empty()) break;
+        size_t wanted = (size_t)(currenttris - targettris) / 2 + 1;
+        size_t limit = std::min(wanted, candidates.size() / 3 + 1);
+        std::vector<float> costs(candidates.size());
+        for(size_t i=0; i<candidates.size(); i++) costs[i] = candidates[i].cost;
+        std::nth_element(costs.begin(), costs.begin() + (limit - 1), costs.end());
+        float costlimit = costs[limit - 1];
+        size_t kept = 0;
+        for(size_t i=0; i<candidates.size(); i++) {
+            if(candidates[i].cost <= costlimit) candidates[kept++] = candidates[i];
+        }
+        candidates.resize(kept);
+
+        // Sort by partition, then by cost
+        std::sort(candidates.begin(), candidates.end(), [&](const Collapse &a, const Collapse &b) {
+            if(partition[a.vertex] != partition[b.vertex]) return partition[a.vertex] < partition[b.vertex];
+            if(a.cost != b.cost) return a.cost < b.cost;
+            return a.vertex < b.vertex; // Same result every time
+        });
+        std::vector<size_t> partitionstart(numpartitions + 1, candidates.size());
+        for(size_t i=candidates.size(); i-- > 0; ) partitionstart[partition[candidates[i].vertex]] = i;
+        for(int p=numpartitions; p-- > 0; ) {
+            if(partitionstart[p] > partitionstart[p+1]) partitionstart[p] = partitionstart[p+1];
+        }
+
+        for(int v=0; v<nverts; v++) remap[v] = v;
+        std::fill(touched.begin(), touched.end(), 0);
+        std::fill(partitionerror.begin(), partitionerror.end(), 0.0f);
+        pool.parallelFor(numpartitions, [&](int p) {
+            for(size_t i=partitionstart[p]; i<partitionstart[p+1]; i++) {
+                const Collapse &c = candidates[i];
+                // Nothing around a collapse may have changed earlier in this
+                // pass, and the target's neighbors may have changed since
+                // the collapse was found
+                GLuint moved[2] = { c.vertex, twin[c.vertex] };
+                GLuint targets[2] = { c.target, c.twintarget };
+                int n = (targets[1] == NONE) ? 1 : 2;
+                bool valid = true;
+                for(int k=0; k<n && valid; k++) {
+                    if(touched[moved[k]] || touched[targets[k]] || !manifold(moved[k], targets[k])) valid = false;
+                }
+                if(!valid) continue;
+                for(int k=0; k<n; k++) {
+                    remap[moved[k]] = targets[k];
+                    quadrics[targets[k]].add(quadrics[moved[k]]);
+                    for(int j=adjacency.begin(moved[k]); j<adjacency.end(moved[k]); j++) {
+                        const GLuint *tri = adjacency.triangle(j);
+                        touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+                    }
+                }
+                if(c.distance > partitionerror[p]) partitionerror[p] = c.distance;
+            }
+        });
+
+        // 4. Rename collapsed vertices and drop degenerate triangles
+        int newtris = 0;
+        for(int t=0; t<currenttris; t++) {
+            GLuint a = remap[output[3*t]], b = remap[output[3*t+1]], c = remap[output[3*t+2]];
+            if(a == b || b == c || a == c) continue;
+            output[3*newtris] = a;
+            output[3*newtris+1] = b;
+            output[3*newtris+2] = c;
+            newtris++;
+        }
+        for(int p=0; p<numpartitions; p++) {
+            if(partitionerror[p] > maxdistance) maxdistance = partitionerror[p];
+        }
+        dirty.swap(touched);
+        stuckpasses = (newtris == currenttris) ? stuckpasses + 1 : 0;
+        if(stuckpasses == 2) break; // Stuck in both grid positions
+        currenttris = newtris;
+    }
+
+    *error = (float)maxdistance;
+    return currenttris;
+}
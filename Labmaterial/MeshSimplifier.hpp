@@ -0,0 +1,54 @@
+/* MeshSimplifier.hpp */
+/* Quadric error mesh simplification, for levels of detail (LODs). */
+/* Usage: call simplify() with a mesh in the interleaved TriangleSoup
+ * format (x y z nx ny nz s t) and a target number of triangles. It writes
+ * a new index array for a coarser mesh that uses a subset of the same
+ * vertices, so all levels of detail can share one vertex buffer. Call it
+ * repeatedly on its own output to build a chain of LODs, and add up the
+ * returned errors.
+ *
+ * The method is edge collapse with Garland-Heckbert error quadrics: each
+ * vertex sums the squared distances to the planes of its triangles, and
+ * a vertex is merged into the neighbor that moves the surface the least.
+ * Differences in normals and texture coordinates add to the cost, so
+ * vertices are kept where the shading changes. Collapses that would flip
+ * a triangle or make the mesh non-manifold are never done.
+ *
+ * A seam is where two vertices share a position but have different
+ * normals or texcoords. Such a pair only moves together, along the seam,
+ * so the seam never opens into a crack and the texture mapping on each
+ * side stays intact. Vertices on open borders, on non-manifold edges and
+ * where three or more vertices share a position never move.
+ *
+ * The work is done in passes. In each pass, large meshes are cut into a
+ * grid of up to 64 spatial partitions that are simplified in parallel on
+ * the global ThreadPool. A collapse is only done if all vertices around
+ * it are in the same partition, and the grid is shifted between passes
+ * so that the partition boundaries move. The result does not depend on
+ * the number of threads. */
+
+#ifndef MESHSIMPLIFIER_HPP // Avoid including this header twice
+#define MESHSIMPLIFIER_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+
+namespace MeshSimplifier {
+
+/*
+ * simplify() - reduce ntris triangles in indices to about targettris.
+ * vertices has 8 floats per vertex. output needs room for 3*ntris indices.
+ * Returns the number of triangles written to output, which is larger than
+ * targettris if the mesh could not be simplified that far. *error gets an
+ * estimate of the largest distance between the old and new surfaces,
+ * in the same units as the vertex coordinates.
+ */
+int simplify(const GLfloat *vertices, int nverts, const GLuint *indices, int ntris,
+             int targettris, GLuint *output, float *error);
+
+}
+
+#endif // MESHSIMPLIFIER_HPP
@@ -0,0 +1,64 @@
+/*
+ * Building blocks for the mesh processing modules, see MeshUtil.hpp.
+ */
+
+#include <atomic>
+#include <algorithm> // For sort() and min()
+
+#include "MeshUtil.hpp"
+#include "ThreadPool.hpp"
+
+namespace {
+
+/* sortByRow() for both types of row numbers */
+template<typename Row>
+void sortRows(const Row *rows, int count, int nrows, std::vector<int> &first, std::vector<int> &sorted) {
+
+    ThreadPool &pool = ThreadPool::global();
+    const int BLOCK = MeshUtil::BLOCK;
+    first.assign(nrows + 1, 0);
+    sorted.resize(count);
+    std::atomic<int> *counters = new std::atomic<int>[nrows];
+    pool.parallelFor(MeshUtil::numBlocks(nrows), [&](int b) {
+        int end = std::min(nrows, (b+1)*BLOCK);
+        for(int r=b*BLOCK; r<end; r++) counters[r] = 0;
+    });
+    pool.parallelFor(MeshUtil::numBlocks(count), [&](int b) {
+        int end = std::min(count, (b+1)*BLOCK);
+        for(int i=b*BLOCK; i<end; i++) counters[rows[i]].fetch_add(1, std::memory_order_relaxed);
+    });
+    int sum = 0;
+    for(int r=0; r<nrows; r++) {
+        first[r] = sum;
+        sum += counters[r];
+        counters[r] = first[r]; // From here on, the next free place in the row
+    }
+    first[nrows] = sum;
+    pool.parallelFor(MeshUtil::numBlocks(count), [&](int b) {
+        int end = std::min(count, (b+1)*BLOCK);
+        for(int i=b*BLOCK; i<end; i++) {
+            sorted[counters[rows[i]].fetch_add(1, std::memory_order_relaxed)] = i;
+        }
+    });
+    delete[] counters;
+
+    // The scatter leaves each row in an order that changes from run to run
+    pool.parallelFor(MeshUtil::numBlocks(nrows), [&](int b) {
+        int end = std::min(nrows, (b+1)*BLOCK);
+        for(int r=b*BLOCK; r<end; r++) {
+            if(first[r+1] - first[r] > 1) std::sort(&sorted[first[r]], &sorted[0] + first[r+1]);
+        }
+    });
+}
+
+} // namespace
+
+
+void MeshUtil::sortByRow(const int *rows, int count, int nrows, std::vector<int> &first, std::vector<int> &sorted) {
+    sortRows(rows, count, nrows, first, sorted);
+}
+
+
+void MeshUtil::sortByRow(const unsigned int *rows, int count, int nrows, std::vector<int> &first, std::vector<int> &sorted) {
+    sortRows(rows, count, nrows, first, sorted);
+}
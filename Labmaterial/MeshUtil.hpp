@@ -0,0 +1,49 @@
+/* MeshUtil.hpp */
+/* Small building blocks shared by the mesh processing modules. */
+/* Usage: hashPosition() hashes a vertex position for finding vertices at
+ * exactly the same place (MeshSimplifier, NormalGenerator).
+ * sortByRow() sorts the corners of a mesh into one row per vertex or
+ * per position, in parallel on the global ThreadPool: the corners are
+ * counted with atomic counters, prefix summed and scattered to their
+ * places, and each row is then sorted, so that the result does not
+ * depend on the number of threads. A gather over the rows can then sum
+ * up the corners of each vertex in a fixed order (NormalGenerator,
+ * TangentGenerator). Loops over a mesh are split into tasks of BLOCK
+ * items, numBlocks() of them. */
+
+#ifndef MESHUTIL_HPP // Avoid including this header twice
+#define MESHUTIL_HPP
+
+#include <vector>
+#include <stdint.h>
+
+namespace MeshUtil {
+
+// Triangles, corners or vertices per parallel task
+const int BLOCK = 16384;
+
+/* The number of tasks for count items */
+inline int numBlocks(int count) {
+    return (count + BLOCK - 1) / BLOCK;
+}
+
+/* A hash for finding positions with exactly the same x, y and z */
+inline uint32_t hashPosition(const float *p) {
+    float xyz[3] = { p[0] + 0.0f, p[1] + 0.0f, p[2] + 0.0f }; // -0 becomes +0, they compare equal
+    uint32_t h = 2166136261u;
+    const unsigned char *bytes = (const unsigned char*)xyz;
+    for(int i=0; i<12; i++) h = (h ^ bytes[i]) * 16777619u;
+    return h;
+}
+
+/*
+ * sortByRow() - the numbers 0 ... count-1 grouped by rows[i], which is
+ * 0 ... nrows-1, in compressed rows: row r is sorted[first[r]] to
+ * sorted[first[r+1]-1], in increasing order.
+ */
+void sortByRow(const int *rows, int count, int nrows, std::vector<int> &first, std::vector<int> &sorted);
+void sortByRow(const unsigned int *rows, int count, int nrows, std::vector<int> &first, std::vector<int> &sorted);
+
+}
+
+#endif // MESHUTIL_HPP
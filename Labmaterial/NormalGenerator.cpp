@@ -0,0 +1,165 @@
+/*
+ * Area and angle weighted normals with a crease angle, see NormalGenerator.hpp.
+ *  1. positions with the same coordinates are merged into groups,
+ *  2. every triangle gets its unit normal, and every corner its weight
+ *     (the triangle's area times its angle at the corner),
+ *  3. the corners are sorted by group with MeshUtil::sortByRow(),
+ *  4. every group sums the weighted normals of its corners, separately
+ *     for each corner if the crease angle splits the group.
+ * The rows from step 3 are sorted, so the sums come out the same every
+ * time. That is also what lets corners with the same sum compare
+ * exactly equal, for the shared output.
+ */
+
+#include <cmath>     // For sqrt(), atan2() and cos()
+#include <cstring>   // For memcmp()
+#include <vector>
+#include <algorithm> // For min()
+#include <stdint.h>
+
+#include "NormalGenerator.hpp"
+#include "ThreadPool.hpp"
+#include "MeshUtil.hpp"   // For hashPosition() and sortByRow()
+
+namespace {
+
+using MeshUtil::BLOCK;
+using MeshUtil::numBlocks;
+
+const int MAX_CREASE_CORNERS = 1024; // Bigger groups are smoothed without creases,
+                                    // because the crease test takes time squared
+
+} // namespace
+
+
+/*
+ * generate() - see the steps at the top of this file.
+ */
+void NormalGenerator::generate(const float *positions, int npositions, const int *corners, int ntris,
+                               float creaseangle, float *normals, int *shared) {
+
+    ThreadPool &pool = ThreadPool::global();
+    int ncorners = 3*ntris;
+    if(ntris <= 0) return;
+
+    // 1. The group of each position: the first position with the same coordinates
+    std::vector<int> group(npositions);
+    {
+        size_t tablesize = 1;
+        while(tablesize < (size_t)npositions * 2) tablesize *= 2;
+        std::vector<uint32_t> hashes(npositions);
+        pool.parallelFor(numBlocks(npositions), [&](int b) {
+            int end = std::min(npositions, (b+1)*BLOCK);
+            for(int p=b*BLOCK; p<end; p++) hashes[p] = MeshUtil::hashPosition(&positions[3*(size_t)p]);
+        });
+        std::vector<int> table(tablesize, -1);
+        for(int p=0; p<npositions; p++) {
+            const float *xyz = &positions[3*(size_t)p];
+            size_t slot = hashes[p] & (tablesize - 1);
+            for(;;) {
+                int other = table[slot];
+                if(other < 0) {
+                    table[slot] = p;
+                    group[p] = p;
+                    break;
+                }
+                const float *q = &positions[3*(size_t)other];
+                if(xyz[0] == q[0] && xyz[1] == q[1] && xyz[2] == q[2]) {
+                    group[p] = other;
+                    break;
+                }
+                slot = (slot + 1) & (tablesize - 1);
+            }
+        }
+    }
+
+    // 2. Unit triangle normals, and corner weights
+    std::vector<float> facenormals(3*(size_t)ntris);
+    std::vector<float> weights(ncorners);
+    pool.parallelFor(numBlocks(ntris), [&](int b) {
+        int end = std::min(ntris, (b+1)*BLOCK);
+        for(int t=b*BLOCK; t<end; t++) {
+            const float *p[3];
+            for(int k=0; k<3; k++) p[k] = &positions[3*(size_t)corners[3*(size_t)t+k]];
+            double e[3][3]; // e[k] goes from corner k to corner k+1
+            for(int k=0; k<3; k++) {
+                for(int j=0; j<3; j++) e[k][j] = p[(k+1)%3][j] - p[k][j];
+            }
+            double n[3] = { e[0][1]*e[2][2] - e[0][2]*e[2][1],
+                            e[0][2]*e[2][0] - e[0][0]*e[2][2],
+                            e[0][0]*e[2][1] - e[0][1]*e[2][0] };
+            // That is e[0] x e[2], which points the wrong way for counterclockwise triangles
+            double length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+            for(int j=0; j<3; j++) facenormals[3*(size_t)t+j] = (length > 0.0) ? (float)(-n[j] / length) : 0.0f;
+            for(int k=0; k<3; k++) {
+                // The angle between the two edges that meet at corner k
+                const double *a = e[k], *c = e[(k+2)%3];
+                double cross[3] = { a[1]*c[2] - a[2]*c[1], a[2]*c[0] - a[0]*c[2], a[0]*c[1] - a[1]*c[0] };
+                double sine = sqrt(cross[0]*cross[0] + cross[1]*cross[1] + cross[2]*cross[2]);
+                double cosine = -(a[0]*c[0] + a[1]*c[1] + a[2]*c[2]);
+                weights[3*(size_t)t+k] = (float)(0.5 * length * atan2(sine, cosine));
+            }
+        }
+    });
+
+    // 3. The corners sorted by group, in compressed rows: the corners of
+    // group g are sorted[first[g]] to sorted[first[g+1]-1]
+    std::vector<int> first, sorted;
+    {
+        std::vector<int> cornergroups(ncorners);
+        pool.parallelFor(numBlocks(ncorners), [&](int b) {
+            int end = std::min(ncorners, (b+1)*BLOCK);
+            for(int c=b*BLOCK; c<end; c++) cornergroups[c] = group[corners[c]];
+        });
+        MeshUtil::sortByRow(&cornergroups[0], ncorners, npositions, first, sorted);
+    }
+
+    // 4. The weighted sums, per group
+    float mincosine = (creaseangle >= 180.0f) ? -2.0f : (float)cos(creaseangle * M_PI / 180.0);
+    pool.parallelFor(numBlocks(npositions), [&](int b) {
+        int end = std::min(npositions, (b+1)*BLOCK);
+        for(int g=b*BLOCK; g<end; g++) {
+            int *row = sorted.empty() ? NULL : &sorted[0] + first[g];
+            int count = first[g+1] - first[g];
+            if(count == 0) continue;
+            bool creases = (mincosine > -2.0f && count <= MAX_CREASE_CORNERS);
+            double smooth[3] = { 0.0, 0.0, 0.0 }; // The sum over all corners
+            for(int i=0; i<count; i++) {
+                const float *fn = &facenormals[3*(size_t)(row[i]/3)];
+                for(int j=0; j<3; j++) smooth[j] += weights[row[i]] * fn[j];
+            }
+            for(int i=0; i<count; i++) {
+                int c = row[i];
+                const float *own = &facenormals[3*(size_t)(c/3)];
+                double n[3] = { smooth[0], smooth[1], smooth[2] };
+                // A triangle without area has no normal of its own to crease against
+                bool flat = (own[0] == 0.0f && own[1] == 0.0f && own[2] == 0.0f);
+                if(creases && !flat) {
+                    for(int j=0; j<3; j++) n[j] = 0.0;
+                    for(int o=0; o<count; o++) {
+                        const float *fn = &facenormals[3*(size_t)(row[o]/3)];
+                        if(own[0]*fn[0] + own[1]*fn[1] + own[2]*fn[2] < mincosine) continue;
+                        for(int j=0; j<3; j++) n[j] += weights[row[o]] * fn[j];
+                    }
+                }
+                double length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+                float *out = &normals[3*(size_t)c];
+                if(length > 0.0) {
+                    for(int j=0; j<3; j++) out[j] = (float)(n[j] / length);
+                }
+                else { // Only triangles without area here, so any normal will do
+                    out[0] = 0.0f; out[1] = 0.0f; out[2] = 1.0f;
+                }
+                if(shared) {
+                    shared[c] = c;
+                    for(int o=0; o<i; o++) { // The rows are sorted, so earlier is lower
+                        if(memcmp(&normals[3*(size_t)row[o]], out, 3*sizeof(float)) == 0) {
+                            shared[c] = shared[row[o]];
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,43 @@
+/* NormalGenerator.hpp */
+/* Smooth vertex normals for triangle meshes that don't have any. */
+/* Usage: call generate() with the positions and the position number of
+ * every triangle corner. It writes one normal per corner, which OBJLoader
+ * uses for faces that have no "vn" indices.
+ *
+ * The normal at a corner is the sum of the normals of the triangles
+ * around its position, each weighted by the triangle's area and by its
+ * angle at that position, so that neither long thin triangles nor many
+ * small ones pull the normal their way. Triangles whose normals differ
+ * from the corner's own triangle by more than the crease angle are left
+ * out, so sharp edges stay sharp. Positions are compared by value, so
+ * a mesh with duplicated positions along a texture seam is still smooth
+ * across the seam.
+ *
+ * The corners are sorted by position (a scatter with atomic counters),
+ * and each position then sums up its own corners (a gather), both in
+ * parallel on the global ThreadPool. The result does not depend on the
+ * number of threads. */
+
+#ifndef NORMALGENERATOR_HPP // Avoid including this header twice
+#define NORMALGENERATOR_HPP
+
+namespace NormalGenerator {
+
+/* The default crease angle, in degrees */
+const float DEFAULT_CREASE_ANGLE = 60.0f;
+
+/*
+ * generate() - normals for the 3*ntris corners of a triangle mesh.
+ * positions has 3 floats per position, and corners has the position
+ * number of each corner, three per triangle. normals gets 3 floats per
+ * corner, of length 1. creaseangle is in degrees, 180 or more makes
+ * everything smooth. If shared is not NULL, it gets the number of the
+ * first corner with the same position and exactly the same normal for
+ * each corner, so that corners can be welded into vertices afterwards.
+ */
+void generate(const float *positions, int npositions, const int *corners, int ntris,
+              float creaseangle, float *normals, int *shared);
+
+}
+
+#endif // NORMALGENERATOR_HPP
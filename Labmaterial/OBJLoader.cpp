@@ -0,0 +1,581 @@
+#include <cstdio>  // For console messages
+#include <cstring> // For memchr() and memcpy()
+#include <climits> // For INT_MIN
+
+#include "OBJLoader.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+#include "Parsing.hpp"
+#include "NormalGenerator.hpp"
+
+using Parsing::skipSpaces;
+using Parsing::nextLine;
+using Parsing::parseFloat;
+using Parsing::parseInt;
+
+namespace {
+
+/*
+ * A simple growable array. The capacity is doubled when it runs full,
+ * so appending N elements costs O(N) copying in total.
+ */
+template<typename T> class GrowArray {
+
+public:
+    T *data;
+    size_t count;
+    size_t capacity;
+
+    GrowArray(size_t initial) {
+        capacity = initial > 16 ? initial : 16;
+        data = new T[capacity];
+        count = 0;
+    }
+
+    ~GrowArray() {
+        delete[] data;
+    }
+
+    // Append n uninitialized elements and return a pointer to the first one
+    T *grow(size_t n) {
+        if(count + n > capacity) {
+            size_t newcapacity = capacity * 2;
+            while(newcapacity < count + n) newcapacity *= 2;
+            T *newdata = new T[newcapacity];
+            memcpy(newdata, data, count * sizeof(T));
+            delete[] data;
+            data = newdata;
+            capacity = newcapacity;
+        }
+        T *first = data + count;
+        count += n;
+        return first;
+    }
+
+    // Hand over the array to the caller
+    T *release() {
+        T *released = data;
+        data = NULL;
+        count = capacity = 0;
+        return released;
+    }
+};
+
+// The index of a texcoord or normal that a face corner does not have
+const int MISSING = INT_MIN;
+
+/*
+ * Parse a "v/t/n", "v//n", "v/t" or "v" face corner into 0-based indices,
+ * with MISSING for the indices that are left out. Positive OBJ indices
+ * are absolute and only need the 1-based offset removed. Negative indices
+ * count backwards from the data read so far, which for a chunk is only
+ * known relative to the start of the chunk. Those are converted using the
+ * chunk-local counts and flagged in *relative (one bit per index), to be
+ * adjusted when the chunk offsets are known.
+ * Returns NULL if the corner is malformed.
+ */
+const char *parseCorner(const char *p, const char *end, int corner[3],
+                        const size_t localcounts[3], int *relative) {
+
+    *relative = 0;
+    corner[1] = corner[2] = MISSING;
+    for(int k=0; k<3; k++) {
+        if(k > 0) {
+            if(p >= end || *p != '/') break; // "v" or "v/t"
+            p++;
+            if(k == 1 && p < end && *p == '/') continue; // "v//n"
+        }
+        p = parseInt(p, end, &corner[k]);
+        if(!p || corner[k] == 0) return NULL;
+        if(corner[k] > 0) corner[k] -= 1;
+        else {
+            corner[k] += (int)localcounts[k];
+            *relative |= 1 << k;
+        }
+    }
+    return p;
+}
+
+// What went wrong in a chunk, if anything
+enum ChunkError { NO_ERROR = 0, VERTEX_ERROR, NORMAL_ERROR, TEXCOORD_ERROR, FACE_ERROR };
+
+/*
+ * A piece of the file, starting and ending at line boundaries,
+ * with the data parsed from it.
+ */
+struct Chunk {
+    const char *begin;
+    const char *end;
+    GrowArray<float> *verts;
+    GrowArray<float> *normals;
+    GrowArray<float> *texcoords;
+    GrowArray<int> *corners;     // v/t/n index triplets, 3 per face
+    GrowArray<size_t> *relative; // Positions in corners of relative indices
+    size_t missingtexcoords;     // Number of corners without a texcoord index
+    size_t missingnormals;       // Number of corners without a normal index
+    // Global positions of this chunk's data, from the prefix sums
+    size_t vertoffset, normaloffset, texcoordoffset, faceoffset;
+    int error;                   // A ChunkError
+    size_t errorelement;         // Chunk-local number of the bad element
+};
+
+/*
+ * Parse all records in one chunk into its own growable arrays.
+ * This runs in parallel for all chunks, so it must not touch anything else.
+ */
+void parseChunk(Chunk *chunk) {
+
+    const char *p = chunk->begin;
+    const char *end = chunk->end;
+    GrowArray<float> &verts = *chunk->verts;
+    GrowArray<float> &normals = *chunk->normals;
+    GrowArray<float> &texcoords = *chunk->texcoords;
+    GrowArray<int> &corners = *chunk->corners;
+    size_t localcounts[3];
+    int relative;
+
+    while(p < end) {
+        p = skipSpaces(p, end);
+        if(p + 1 >= end) break;
+
+        if(p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            float *v = verts.grow(3);
+            p++;
+            for(int k=0; k<3 && p; k++) {
+                p = parseFloat(skipSpaces(p, end), end, &v[k]);
+            }
+            if(!p) {
+                chunk->error = VERTEX_ERROR;
+                chunk->errorelement = verts.count/3;
+                return;
+            }
+        }
+        else if(p[0] == 'v' && p[1] == 'n') {
+            float *n = normals.grow(3);
+            p += 2;
+            for(int k=0; k<3 && p; k++) {
+                p = parseFloat(skipSpaces(p, end), end, &n[k]);
+            }
+            if(!p) {
+                chunk->error = NORMAL_ERROR;
+                chunk->errorelement = normals.count/3;
+                return;
+            }
+        }
+        else if(p[0] == 'v' && p[1] == 't') {
+            float *t = texcoords.grow(2);
+            p += 2;
+            for(int k=0; k<2 && p; k++) {
+                p = parseFloat(skipSpaces(p, end), end, &t[k]);
+            }
+            if(!p) {
+                chunk->error = TEXCOORD_ERROR;
+                chunk->errorelement = texcoords.count/2;
+                return;
+            }
+        }
+        else if(p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            int *face = corners.grow(9);
+            localcounts[0] = verts.count/3;
+            localcounts[1] = texcoords.count/2;
+            localcounts[2] = normals.count/3;
+            p++;
+            for(int k=0; k<3 && p; k++) {
+                p = parseCorner(skipSpaces(p, end), end, &face[3*k], localcounts, &relative);
+                for(int j=0; p && j<3; j++) {
+                    if(relative & (1 << j)) {
+                        *chunk->relative->grow(1) = (face - corners.data) + 3*k + j;
+                    }
+                }
+                if(p) {
+                    if(face[3*k+1] == MISSING) chunk->missingtexcoords++;
+                    if(face[3*k+2] == MISSING) chunk->missingnormals++;
+                }
+            }
+            if(p) { // Reject polygons with more than three corners
+                p = skipSpaces(p, end);
+                if(p < end && *p != '\n' && *p != '\r' && *p != '#') p = NULL;
+            }
+            if(!p) {
+                chunk->error = FACE_ERROR;
+                chunk->errorelement = corners.count/9;
+                return;
+            }
+        }
+        // Anything else ("#", "o", "g", "s", "usemtl"...) is ignored
+        p = nextLine(p, end);
+    }
+}
+
+/*
+ * Write the interleaved vertex (x y z nx ny nz s t) for a resolved
+ * v/t/n index triplet.
+ */
+inline void expandCorner(GLfloat *vertex, const int *corner, const float *verts,
+                         const float *normals, const float *texcoords) {
+    memcpy(vertex, &verts[3*(size_t)corner[0]], 3*sizeof(float));
+    memcpy(vertex+3, &normals[3*(size_t)corner[2]], 3*sizeof(float));
+    memcpy(vertex+6, &texcoords[2*(size_t)corner[1]], 2*sizeof(float));
+}
+
+/*
+ * A hash of a v/t/n index triplet, well mixed in all bits,
+ * because the table size is a power of two.
+ */
+inline unsigned int hashCorner(const int *corner) {
+    unsigned int h = (unsigned int)corner[0] * 0x9E3779B1u;
+    h ^= (unsigned int)corner[1] * 0x85EBCA77u;
+    h = (h << 13) | (h >> 19);
+    h ^= (unsigned int)corner[2] * 0xC2B2AE3Du;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    return h;
+}
+
+/*
+ * Share vertices between faces: every distinct v/t/n triplet becomes
+ * one vertex, in order of first use, and the index array refers to it.
+ * The triplets are found through an open addressing hash table with
+ * linear probing, which holds vertex numbers and is kept at most 80% full.
+ * Returns the new vertex array and its number of vertices in *numvertices.
+ */
+GLfloat *weldCorners(const std::vector<Chunk> &chunks, size_t ncorners,
+                     const float *verts, const float *normals, const float *texcoords,
+                     GLuint *indexarray, int *numvertices) {
+
+    const GLuint EMPTY = 0xFFFFFFFFu;
+    size_t tablesize = 1024;
+    while(tablesize < ncorners + ncorners/4) tablesize *= 2;
+    size_t mask = tablesize - 1;
+    GLuint *table = new GLuint[tablesize];
+    int *unique = new int[3*ncorners]; // v/t/n triplets of the new vertices
+    GLuint nunique = 0;
+    size_t c = 0;
+
+    for(size_t i=0; i<tablesize; i++) table[i] = EMPTY;
+
+    for(size_t k=0; k<chunks.size(); k++) {
+        const int *corners = chunks[k].corners->data;
+        size_t count = chunks[k].corners->count/3;
+        for(size_t i=0; i<count; i++, c++) {
+            const int *corner = &corners[3*i];
+            size_t slot = hashCorner(corner) & mask;
+            for(;;) {
+                GLuint v = table[slot];
+                if(v == EMPTY) { // A new triplet
+                    table[slot] = v = nunique++;
+                    memcpy(&unique[3*v], corner, 3*sizeof(int));
+                }
+                else if(memcmp(&unique[3*v], corner, 3*sizeof(int)) != 0) {
+                    slot = (slot + 1) & mask; // Taken by someone else, probe on
+                    continue;
+                }
+                indexarray[c] = v;
+                break;
+            }
+        }
+    }
+    delete[] table;
+
+    GLfloat *vertexarray = new GLfloat[8*(size_t)nunique];
+    for(GLuint v=0; v<nunique; v++) {
+        expandCorner(&vertexarray[8*(size_t)v], &unique[3*v], verts, normals, texcoords);
+    }
+    delete[] unique;
+
+    *numvertices = (int)nunique;
+    return vertexarray;
+}
+
+// Chunks smaller than this are not worth a task of their own
+const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+} // namespace
+
+
+/* Constructor: initialize an empty loader */
+OBJLoader::OBJLoader() {
+    vertexarray = NULL;
+    indexarray = NULL;
+    nverts = 0;
+    ntris = 0;
+    numverts = 0;
+    numnormals = 0;
+    numtexcoords = 0;
+    seconds = 0.0;
+    megabytes = 0.0;
+    pool = NULL;
+    verbose = 1;
+    weld = 0;
+    creaseangle = NormalGenerator::DEFAULT_CREASE_ANGLE;
+}
+
+
+/* Destructor: delete any arrays that were not taken over */
+OBJLoader::~OBJLoader() {
+    clean();
+}
+
+
+/* Delete all arrays and reset the counters */
+void OBJLoader::clean() {
+    if(vertexarray) {
+        delete[] vertexarray;
+        vertexarray = NULL;
+    }
+    if(indexarray) {
+        delete[] indexarray;
+        indexarray = NULL;
+    }
+    nverts = 0;
+    ntris = 0;
+    numverts = 0;
+    numnormals = 0;
+    numtexcoords = 0;
+}
+
+
+/*
+ * load() - parse an OBJ file into vertexarray and indexarray.
+ * The file is split at line boundaries into a few chunks per thread,
+ * and the chunks are parsed in parallel into chunk-local arrays.
+ * A prefix sum over the chunk counts gives the global position of each
+ * chunk's data. The chunks then copy their data into the global arrays,
+ * and finally resolve their face indices and expand each face to three
+ * interleaved vertices, again all in parallel. If weld is set, the last
+ * step is instead done by weldCorners(), which shares vertices.
+ */
+int OBJLoader::load(const char *filename) {
+
+    MappedFile objfile;
+    ThreadPool &threads = pool ? *pool : ThreadPool::global();
+    double starttime;
+    int numchunks;
+
+    clean();
+    starttime = glfwGetTime();
+
+    if(!objfile.open(filename)) {
+        printError(objfile.empty ? "Empty file" : "File not found", filename);
+        return GL_FALSE;
+    }
+    megabytes = objfile.size / (1024.0 * 1024.0);
+
+    // Cut the file into chunks. Several chunks per thread even out the
+    // differences in parsing speed between different parts of the file.
+    numchunks = 4 * threads.size();
+    if(objfile.size / numchunks < MIN_CHUNK_SIZE) {
+        numchunks = (int)(objfile.size / MIN_CHUNK_SIZE) + 1;
+    }
+    std::vector<Chunk> chunks(numchunks);
+    const char *start = objfile.data;
+    const char *end = objfile.data + objfile.size;
+    for(int c=0; c<numchunks; c++) {
+        const char *chunkend = objfile.data + objfile.size / numchunks * (c+1);
+        if(c == numchunks-1 || chunkend <= start) chunkend = end;
+        else chunkend = nextLine(chunkend, end); // Move the cut past the next newline
+        chunks[c].begin = start;
+        chunks[c].end = chunkend;
+        chunks[c].error = NO_ERROR;
+        chunks[c].errorelement = 0;
+        chunks[c].missingtexcoords = 0;
+        chunks[c].missingnormals = 0;
+        start = chunkend;
+    }
+
+    // Pass 1: parse all chunks.
+    // Guess the array sizes from the chunk size to avoid most of the regrowing.
+    threads.parallelFor(numchunks, [&](int c) {
+        Chunk &chunk = chunks[c];
+        size_t guess = (chunk.end - chunk.begin) / 128;
+        chunk.verts = new GrowArray<float>(3*guess);
+        chunk.normals = new GrowArray<float>(3*guess);
+        chunk.texcoords = new GrowArray<float>(2*guess);
+        chunk.corners = new GrowArray<int>(9*guess);
+        chunk.relative = new GrowArray<size_t>(16);
+        parseChunk(&chunk);
+    });
+
+    // Exclusive prefix sums of the chunk counts give each chunk's offsets
+    size_t totalverts = 0, totalnormals = 0, totaltexcoords = 0, totalfaces = 0;
+    size_t missingtexcoords = 0, missingnormals = 0;
+    for(int c=0; c<numchunks; c++) {
+        chunks[c].vertoffset = totalverts;
+        chunks[c].normaloffset = totalnormals;
+        chunks[c].texcoordoffset = totaltexcoords;
+        chunks[c].faceoffset = totalfaces;
+        totalverts += chunks[c].verts->count/3;
+        totalnormals += chunks[c].normals->count/3;
+        totaltexcoords += chunks[c].texcoords->count/2;
+        totalfaces += chunks[c].corners->count/9;
+        missingtexcoords += chunks[c].missingtexcoords;
+        missingnormals += chunks[c].missingnormals;
+    }
+    numverts = (int)totalverts;
+    numnormals = (int)totalnormals;
+    numtexcoords = (int)totaltexcoords;
+    ntris = (int)totalfaces;
+    nverts = 3*ntris;
+
+    // Report the first error in the file, if there was one
+    int parseerror = 0;
+    for(int c=0; c<numchunks && !parseerror; c++) {
+        const Chunk &chunk = chunks[c];
+        if(chunk.error == VERTEX_ERROR)
+            printf("Malformed vertex data found at vertex %d.\n", (int)(chunk.vertoffset+chunk.errorelement));
+        else if(chunk.error == NORMAL_ERROR)
+            printf("Malformed normal data found at normal %d.\n", (int)(chunk.normaloffset+chunk.errorelement));
+        else if(chunk.error == TEXCOORD_ERROR)
+            printf("Malformed texcoord data found at texcoord %d.\n", (int)(chunk.texcoordoffset+chunk.errorelement));
+        else if(chunk.error == FACE_ERROR)
+            printf("Malformed face data found at face %d.\n", (int)(chunk.faceoffset+chunk.errorelement));
+        parseerror = (chunk.error != NO_ERROR);
+    }
+
+    const size_t NO_FACE = (size_t)-1;
+    std::atomic<size_t> badface(NO_FACE); // The first face with a bad index
+
+    if(!parseerror) {
+        // Corners without a texcoord get (0,0), an extra entry at the end.
+        // If some corners have no normal, normals are generated for all
+        // corners, and stored after the ones from the file.
+        size_t extratexcoords = missingtexcoords > 0 ? 1 : 0;
+        size_t extranormals = missingnormals > 0 ? 3*(size_t)ntris : 0;
+        float *verts = new float[3*totalverts];
+        float *normals = new float[3*(totalnormals + extranormals)];
+        float *texcoords = new float[2*(totaltexcoords + extratexcoords)];
+        int *cornerpositions = extranormals ? new int[3*(size_t)ntris] : NULL;
+        if(!weld) vertexarray = new GLfloat[8*(size_t)nverts];
+        indexarray = new GLuint[3*(size_t)ntris];
+        if(extratexcoords) texcoords[2*totaltexcoords] = texcoords[2*totaltexcoords+1] = 0.0f;
+
+        // Pass 2: gather the data arrays at their global positions
+        threads.parallelFor(numchunks, [&](int c) {
+            const Chunk &chunk = chunks[c];
+            memcpy(&verts[3*chunk.vertoffset], chunk.verts->data, chunk.verts->count*sizeof(float));
+            memcpy(&normals[3*chunk.normaloffset], chunk.normals->data, chunk.normals->count*sizeof(float));
+            memcpy(&texcoords[2*chunk.texcoordoffset], chunk.texcoords->data, chunk.texcoords->count*sizeof(float));
+        });
+
+        // Pass 3: resolve and check the indices. Unless we weld or have
+        // normals to generate, expand the faces right away. Every face then
+        // has its own three vertices, so the index array is trivial.
+        threads.parallelFor(numchunks, [&](int c) {
+            const Chunk &chunk = chunks[c];
+            int *corners = chunk.corners->data;
+            const size_t offsets[3] = { chunk.vertoffset, chunk.texcoordoffset, chunk.normaloffset };
+            for(size_t r=0; r<chunk.relative->count; r++) {
+                size_t i = chunk.relative->data[r];
+                corners[i] += (int)offsets[i%3];
+            }
+            size_t ncorners = chunk.corners->count/3;
+            GLfloat *vertex = vertexarray ? &vertexarray[8*3*chunk.faceoffset] : NULL;
+            GLuint *index = &indexarray[3*chunk.faceoffset];
+            for(size_t i=0; i<ncorners; i++) {
+                int *corner = &corners[3*i];
+                if(cornerpositions) cornerpositions[3*chunk.faceoffset + i] = corner[0];
+                if(corner[0] < 0 || (size_t)corner[0] >= totalverts
+                    || (corner[1] != MISSING && (corner[1] < 0 || (size_t)corner[1] >= totaltexcoords))
+                    || (corner[2] != MISSING && (corner[2] < 0 || (size_t)corner[2] >= totalnormals))) {
+                    size_t face = chunk.faceoffset + i/3;
+                    size_t first = badface;
+                    while(face < first && !badface.compare_exchange_weak(first, face));
+                    if(cornerpositions) cornerpositions[3*chunk.faceoffset + i] = 0;
+                    continue;
+                }
+                if(corner[1] == MISSING) corner[1] = (int)totaltexcoords;
+                if(vertex && !cornerpositions) {
+                    expandCorner(vertex, corner, verts, normals, texcoords);
+                    index[i] = (GLuint)(3*chunk.faceoffset + i);
+                }
+                if(vertex) vertex += 8;
+            }
+        });
+
+        // Pass 4: generate the missing normals, and point the corners
+        // without a normal to them. Corners with the same position and
+        // normal point to the same one, so that they can still be welded.
+        if(cornerpositions && badface == NO_FACE) {
+            double normalstart = glfwGetTime();
+            int *shared = new int[3*(size_t)ntris];
+            NormalGenerator::generate(verts, (int)totalverts, cornerpositions, ntris,
+                creaseangle, &normals[3*totalnormals], shared);
+            threads.parallelFor(numchunks, [&](int c) {
+                const Chunk &chunk = chunks[c];
+                int *corners = chunk.corners->data;
+                size_t ncorners = chunk.corners->count/3;
+                GLfloat *vertex = vertexarray ? &vertexarray[8*3*chunk.faceoffset] : NULL;
+                GLuint *index = &indexarray[3*chunk.faceoffset];
+                for(size_t i=0; i<ncorners; i++) {
+                    int *corner = &corners[3*i];
+                    if(corner[2] == MISSING) {
+                        corner[2] = (int)(totalnormals + shared[3*chunk.faceoffset + i]);
+                    }
+                    if(vertex) {
+                        expandCorner(vertex, corner, verts, normals, texcoords);
+                        vertex += 8;
+                        index[i] = (GLuint)(3*chunk.faceoffset + i);
+                    }
+                }
+            });
+            delete[] shared;
+            if(verbose) {
+                printf("readOBJ(\"%s\"): generated normals for %d of %d face corners in %.3f s.\n",
+                    filename, (int)missingnormals, 3*ntris, glfwGetTime() - normalstart);
+            }
+        }
+
+        if(badface != NO_FACE) {
+            printf("Face %d refers to missing vertex data.\n", (int)badface+1);
+        }
+        else if(weld) {
+            vertexarray = weldCorners(chunks, 3*ntris, verts, normals, texcoords,
+                indexarray, &nverts);
+            if(verbose) {
+                printf("readOBJ(\"%s\"): welded %d face corners into %d vertices (%.1fx fewer).\n",
+                    filename, 3*ntris, nverts, nverts > 0 ? 3.0*ntris/nverts : 0.0);
+            }
+        }
+
+        delete[] verts;
+        delete[] normals;
+        delete[] texcoords;
+        delete[] cornerpositions;
+    }
+
+    for(int c=0; c<numchunks; c++) {
+        delete chunks[c].verts;
+        delete chunks[c].normals;
+        delete chunks[c].texcoords;
+        delete chunks[c].corners;
+        delete chunks[c].relative;
+    }
+
+    if(parseerror || badface != NO_FACE) {
+        printf("Aborting.\n");
+        clean();
+        return GL_FALSE;
+    }
+
+    seconds = glfwGetTime() - starttime;
+
+    if(verbose) {
+        printf("readOBJ(\"%s\"): found %d vertices, %d normals, %d texcoords, %d faces.\n",
+            filename, numverts, numnormals, numtexcoords, ntris);
+        printf("readOBJ(\"%s\"): %.1f MB in %.3f s (%.1f MB/s, %d threads)\n",
+            filename, megabytes, seconds, seconds > 0.0 ? megabytes/seconds : 0.0, threads.size());
+    }
+
+    return GL_TRUE;
+}
+
+
+/*
+ * private
+ * printError() - Signal an error.
+ * Simple printf() to console for portability.
+ */
+void OBJLoader::printError(const char *errtype, const char *errmsg) {
+  fprintf(stderr, "%s: %s\n", errtype, errmsg);
+}
@@ -0,0 +1,77 @@
+/* OBJLoader.hpp */
+/* A fast parser for triangle meshes in Wavefront OBJ files. */
+/* Usage: call load() with a file name. On success, the public members
+ * vertexarray and indexarray hold the mesh on the same interleaved
+ * format as TriangleSoup (x y z nx ny nz s t, by default three vertices
+ * per face).
+ * The arrays are owned by the loader until someone takes them over
+ * and sets the pointers to NULL, which is what TriangleSoup::readOBJ() does.
+ * The file is memory mapped, cut into chunks at line boundaries and
+ * parsed in parallel on a ThreadPool, with the number parsers from
+ * Parsing.hpp instead of sscanf().
+ * With weld set, faces share vertices wherever their v/t/n indices match,
+ * and nverts is usually much smaller than 3*ntris.
+ * Only "v", "vn", "vt" and triangular "f" records are used, everything
+ * else is ignored. Faces with more than 3 corners are rejected. The face
+ * corners can be "v/t/n", "v//n", "v/t" or just "v". A missing texcoord
+ * becomes (0,0), and if normals are missing, smooth normals are made by
+ * NormalGenerator, with sharp edges where faces meet at more than
+ * creaseangle degrees. */
+
+#ifndef OBJLOADER_HPP // Avoid including this header twice
+#define OBJLOADER_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+
+class ThreadPool;
+
+class OBJLoader {
+
+public:
+
+GLfloat *vertexarray; // Interleaved vertex array, 8 floats per vertex
+GLuint *indexarray;   // Element index array, 3 indices per triangle
+int nverts;           // Number of vertices in vertexarray
+int ntris;            // Number of triangles in indexarray
+
+int numverts;         // Number of "v" records in the file
+int numnormals;       // Number of "vn" records in the file
+int numtexcoords;     // Number of "vt" records in the file
+
+double seconds;       // Time spent in the last call to load()
+double megabytes;     // Size of the file read by the last call to load()
+
+ThreadPool *pool;     // Threads to parse with (NULL for ThreadPool::global())
+int verbose;          // Print statistics after loading (1, the default) or not (0)
+int weld;             // Share identical v/t/n corners between faces (1) or
+                      // give every face its own three vertices (0, the default)
+float creaseangle;    // Crease angle in degrees for generated normals
+                      // (NormalGenerator::DEFAULT_CREASE_ANGLE by default)
+
+/* Constructor: initialize an empty loader */
+OBJLoader();
+
+/* Destructor: delete any arrays that were not taken over */
+~OBJLoader();
+
+/* Delete all arrays and reset the counters */
+void clean();
+
+/*
+ * load() - parse an OBJ file into vertexarray and indexarray.
+ * Returns GL_TRUE on success, GL_FALSE if the file could not be read
+ * or contained malformed data. In that case, all arrays are deleted.
+ */
+int load(const char *filename);
+
+private:
+
+void printError(const char *errtype, const char *errmsg);
+
+};
+
+#endif // OBJLOADER_HPP
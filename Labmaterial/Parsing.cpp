@@ -0,0 +1,231 @@
+/*
+ * Fast, locale independent number parsing for text file loaders.
+ *
+ * The float conversion is exact: it returns the same correctly rounded
+ * result as strtof() in the "C" locale. Most numbers take one of two
+ * fast paths, where the decimal mantissa m and the power of ten 10^e
+ * are both exactly representable and a single rounding step remains:
+ *  1. m < 2^24 and |e| <= 10: one float multiply or divide.
+ *  2. m < 2^53 and |e| <= 22: one double multiply or divide, which is
+ *     correctly rounded to double. Rounding that to float gives the
+ *     correctly rounded float unless the double lands exactly halfway
+ *     between two floats, which is checked for.
+ * Everything else goes to strtof() on a copy with the locale's decimal
+ * separator. Digits are scanned 16 at a time with SSE2 and converted
+ * 8 at a time with a few integer multiplications (SWAR).
+ */
+
+#include <cstdlib> // For strtof()
+#include <clocale> // For localeconv()
+#include <cfloat>  // For FLT_MIN and FLT_MAX
+#include <climits> // For INT_MAX
+#include <vector>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Parsing.hpp"
+
+namespace {
+
+// Powers of ten that are exactly representable as floats
+const float floatPowersOf10[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+// Powers of ten that are exactly representable as doubles
+const double doublePowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PARSING_NO_SWAR // The 8-digit trick below assumes little endian
+#endif
+
+/* Convert exactly 8 digits at p to their value */
+inline uint64_t parseEightDigits(const char *p) {
+#ifndef PARSING_NO_SWAR
+    uint64_t v;
+    memcpy(&v, p, 8);
+    v = (v & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;  // Pairs of digits
+    v = (v & 0x00FF00FF00FF00FFull) * 6553601 >> 16; // Groups of 4
+    return (v & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32;
+#else
+    uint64_t v = 0;
+    for(int i=0; i<8; i++) v = v*10 + (p[i] - '0');
+    return v;
+#endif
+}
+
+/* Append n digits at p to the mantissa m */
+inline uint64_t accumulateDigits(uint64_t m, const char *p, int n) {
+    while(n >= 8) {
+        m = m * 100000000u + parseEightDigits(p);
+        p += 8;
+        n -= 8;
+    }
+    while(n-- > 0) m = m * 10 + (*p++ - '0');
+    return m;
+}
+
+/*
+ * The slow path: convert with strtof() on a zero terminated copy,
+ * with the '.' replaced by whatever the current locale uses.
+ */
+const char *parseFloatFallback(const char *start, const char *stop, float *value) {
+    char decimalpoint = localeconv()->decimal_point[0];
+    std::vector<char> buffer(start, stop);
+    for(size_t i=0; i<buffer.size(); i++) {
+        if(buffer[i] == '.') buffer[i] = decimalpoint;
+    }
+    buffer.push_back('\0');
+    *value = strtof(&buffer[0], NULL);
+    return stop;
+}
+
+} // namespace
+
+
+/*
+ * skipDigits() - skip a run of decimal digits.
+ * With SSE2, 16 bytes are classified at once: subtracting '0'-128 maps
+ * the digits to the 10 smallest signed byte values, so one signed
+ * compare finds them all. The first non-digit is the first zero bit.
+ */
+const char *Parsing::skipDigits(const char *p, const char *end) {
+#ifdef __SSE2__
+    const __m128i offset = _mm_set1_epi8((char)('0' - 128));
+    const __m128i limit = _mm_set1_epi8((char)(-128 + 10));
+    while(end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        __m128i digits = _mm_cmplt_epi8(_mm_sub_epi8(chunk, offset), limit);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(digits);
+        if(mask != 0xFFFF) return p + __builtin_ctz(~mask);
+        p += 16;
+    }
+#endif
+    while(p < end && isDigit(*p)) p++;
+    return p;
+}
+
+
+/*
+ * parseFloat() - parse a decimal floating point number like "-1.25e-3".
+ */
+const char *Parsing::parseFloat(const char *p, const char *end, float *value) {
+
+    const char *start = p;
+    bool negative = false;
+    int exponent = 0;
+
+    if(p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    // Find the integer and fraction digits
+    const char *intstart = p;
+    const char *intend = skipDigits(p, end);
+    const char *fracstart = intend;
+    const char *fracend = intend;
+    if(intend < end && *intend == '.') {
+        fracstart = intend + 1;
+        fracend = skipDigits(fracstart, end);
+    }
+    if(intend == intstart && fracend == fracstart) return NULL; // No digits at all
+    p = fracend;
+
+    // An exponent is optional. An 'e' without digits is not part of the number.
+    if(p < end && (*p == 'e' || *p == 'E')) {
+        const char *e = p + 1;
+        bool negexp = false;
+        if(e < end && (*e == '-' || *e == '+')) {
+            negexp = (*e == '-');
+            e++;
+        }
+        if(e < end && isDigit(*e)) {
+            while(e < end && isDigit(*e)) {
+                if(exponent < 100000) exponent = exponent * 10 + (*e - '0');
+                e++;
+            }
+            if(negexp) exponent = -exponent;
+            p = e;
+        }
+    }
+
+    // Leading zeros and trailing fraction zeros are not significant
+    while(intstart < intend && *intstart == '0') intstart++;
+    const char *fracdigits = fracstart;
+    if(intstart == intend) {
+        while(fracdigits < fracend && *fracdigits == '0') fracdigits++;
+    }
+    const char *fraclast = fracend;
+    while(fraclast > fracdigits && fraclast[-1] == '0') fraclast--;
+    int numint = (int)(intend - intstart);
+    int numfrac = (int)(fraclast - fracdigits);
+
+    if(numint + numfrac == 0) { // The value is zero
+        *value = negative ? -0.0f : 0.0f;
+        return p;
+    }
+    if(numint + numfrac > 19) { // Does not fit in 64 bits
+        return parseFloatFallback(start, p, value);
+    }
+
+    uint64_t mantissa = accumulateDigits(0, intstart, numint);
+    mantissa = accumulateDigits(mantissa, fracdigits, numfrac);
+    exponent -= (int)(fraclast - fracstart);
+
+    // Fast path 1: exact float operands, one float rounding
+    if(mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10) {
+        float result = (float)mantissa;
+        if(exponent >= 0) result *= floatPowersOf10[exponent];
+        else result /= floatPowersOf10[-exponent];
+        *value = negative ? -result : result;
+        return p;
+    }
+
+    // Fast path 2: exact double operands, then check for double rounding
+    if(mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double result = (double)mantissa;
+        if(exponent >= 0) result *= doublePowersOf10[exponent];
+        else result /= doublePowersOf10[-exponent];
+        uint64_t bits;
+        memcpy(&bits, &result, 8);
+        // The 29 lowest mantissa bits are the ones rounded off in a float.
+        // 1 followed by 28 zeros is exactly halfway between two floats.
+        if(result >= FLT_MIN && result <= FLT_MAX && (bits & 0x1FFFFFFFu) != 0x10000000u) {
+            *value = (float)(negative ? -result : result);
+            return p;
+        }
+    }
+
+    return parseFloatFallback(start, p, value);
+}
+
+
+/*
+ * parseInt() - parse a decimal integer with an optional sign. Numbers
+ * larger than INT_MAX either way are an error, as an int can not hold them.
+ */
+const char *Parsing::parseInt(const char *p, const char *end, int *value) {
+
+    bool negative = false;
+    uint64_t result = 0; // Room for one digit past INT_MAX
+
+    if(p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+    if(p >= end || !isDigit(*p)) return NULL;
+    while(p < end && isDigit(*p)) {
+        result = result * 10 + (*p - '0');
+        if(result > INT_MAX) return NULL;
+        p++;
+    }
+    *value = negative ? -(int)result : (int)result;
+    return p;
+}
@@ -0,0 +1,52 @@
+/* Parsing.hpp */
+/*
+ * Fast, locale independent number parsing for text file loaders.
+ * Usage: all functions take a pointer p to the current position and a
+ * pointer end to the end of the text, which does not need to be zero
+ * terminated (so they work on memory mapped files). They return a pointer
+ * to the first character after what they read, or NULL if there was no
+ * number at p. The decimal separator is always '.', whatever the locale.
+ *
+ * parseFloat() gives the correctly rounded float for every input.
+ * Numbers with at most 19 significant digits and a moderate exponent,
+ * which is almost all numbers in asset files, are converted with a few
+ * exact integer and floating point operations. Anything else falls back
+ * to strtof() on a copy of the number.
+ */
+
+#ifndef PARSING_HPP // Avoid including this header twice
+#define PARSING_HPP
+
+#include <cstring> // For memchr()
+
+namespace Parsing {
+
+/* Skip spaces and tabs (not newlines) */
+inline const char *skipSpaces(const char *p, const char *end) {
+    while(p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+/* Skip to the start of the next line (or to end) */
+inline const char *nextLine(const char *p, const char *end) {
+    const char *newline = (const char*)memchr(p, '\n', end - p);
+    return newline ? newline + 1 : end;
+}
+
+/* Check for a decimal digit, without any locale lookups */
+inline bool isDigit(char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+/* Skip a run of decimal digits, 16 at a time with SSE2 where available */
+const char *skipDigits(const char *p, const char *end);
+
+/* Parse a decimal floating point number like "-1.25e-3" */
+const char *parseFloat(const char *p, const char *end, float *value);
+
+/* Parse a decimal integer with an optional sign, no larger than INT_MAX */
+const char *parseInt(const char *p, const char *end, int *value);
+
+}
+
+#endif // PARSING_HPP
@@ -0,0 +1,235 @@
+/*
+ * A disk cache of program binaries, see ProgramCache.hpp.
+ */
+
+#include <cstdio>  // For file output and console messages
+#include <cstring> // For memcmp(), memcpy() and strlen()
+#include <string>
+#include <vector>
+#ifdef __WIN32__
+#include <direct.h>   // For _mkdir()
+#else
+#include <sys/stat.h> // For mkdir()
+#endif
+
+#include "ProgramCache.hpp"
+#include "MappedFile.hpp"
+#include "Utilities.hpp"  // To be able to use OpenGL extensions
+
+namespace {
+
+const char MAGIC[8] = { 'G', 'L', 'P', 'R', 'O', 'G', 0, 0 };
+const char *EXTENSION = ".glprog";
+
+std::string directory = "shadercache";
+int enabled = 1;
+int support = -1;      // -1 until supported() has asked the driver
+std::string driver;    // Vendor, renderer and version, once there is a context
+int madedirectory = 0;
+
+// Statistics
+int hits = 0;
+int misses = 0;
+int refused = 0;       // Binaries that the driver did not take
+int saves = 0;
+double savedms = 0.0;  // Compile time of the hits, less their load time
+double compilems = 0.0; // Compile time of the misses
+
+/* A 64-bit FNV-1a hash, continued from h */
+uint64_t hashBytes(uint64_t h, const char *data, size_t size) {
+    for(size_t i=0; i<size; i++) {
+        h = (h ^ (unsigned char)data[i]) * 0x100000001B3ull;
+    }
+    return h;
+}
+
+/* The cache file for a key */
+std::string cacheName(uint64_t key) {
+    char name[17];
+    sprintf(name, "%016llx", (unsigned long long)key);
+    return directory + "/" + name + EXTENSION;
+}
+
+void makeDirectory() {
+    if(madedirectory) return;
+#ifdef __WIN32__
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+    madedirectory = 1; // If it failed, save() says so
+}
+
+} // namespace
+
+
+void ProgramCache::setDirectory(const char *name) {
+    enabled = (name != NULL);
+    if(name) directory = name;
+    madedirectory = 0;
+}
+
+
+/*
+ * supported() - glGetProgramBinary() is core in OpenGL 4.1, and some
+ * drivers have it but list no formats, which means that they can not
+ * load any binary.
+ */
+int ProgramCache::supported() {
+    if(support >= 0) return support;
+    support = 0;
+#ifdef GL_PROGRAM_BINARY_LENGTH
+#ifdef __WIN32__
+    if(!glGetProgramBinary || !glProgramBinary || !glProgramParameteri) return 0;
+#endif
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if(major * 10 + minor < 41) return 0;
+    GLint numformats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numformats);
+    support = (numformats > 0);
+#endif
+    return support;
+}
+
+
+/*
+ * key() - the driver strings go first, with the zero at their ends, so
+ * that no source text can be mistaken for them.
+ */
+uint64_t ProgramCache::key(const char *const *sources, int count) {
+    if(driver.empty()) {
+        const GLenum names[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for(int n=0; n<3; n++) {
+            const char *value = (const char*)glGetString(names[n]);
+            driver += value ? value : "";
+            driver += '\0';
+        }
+    }
+    uint64_t h = 0xCBF29CE484222325ull;
+    h = hashBytes(h, driver.data(), driver.size());
+    for(int s=0; s<count; s++) {
+        uint64_t length = sources[s] ? strlen(sources[s]) : 0;
+        h = hashBytes(h, (const char*)&length, sizeof(length));
+        h = hashBytes(h, sources[s], (size_t)length);
+    }
+    return h;
+}
+
+
+/*
+ * load() - a file that is missing, cut short or for another key is a
+ * miss. A binary that the driver does not link is counted as refused,
+ * and is replaced when the program has been compiled again.
+ */
+GLuint ProgramCache::load(uint64_t key) {
+#ifdef GL_PROGRAM_BINARY_LENGTH
+    if(!enabled || !supported()) return 0;
+    double t0 = glfwGetTime();
+    MappedFile file;
+    if(!file.open(cacheName(key).c_str())) {
+        misses++;
+        return 0;
+    }
+    const ProgramCacheHeader *h = (const ProgramCacheHeader*)file.data;
+    if(file.size < sizeof(ProgramCacheHeader) || memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0
+        || h->version != PROGRAMCACHE_VERSION || h->key != key
+        || sizeof(ProgramCacheHeader) + (uint64_t)h->length > file.size) {
+        misses++;
+        return 0;
+    }
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, h->format, file.data + sizeof(ProgramCacheHeader), h->length);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(linked != GL_TRUE) {
+        glDeleteProgram(program);
+        refused++;
+        return 0;
+    }
+    hits++;
+    savedms += h->compilems - 1e3 * (glfwGetTime() - t0);
+    return program;
+#else
+    return 0;
+#endif
+}
+
+
+/* Without the hint, a driver may throw away what it needs for the binary */
+void ProgramCache::prepare(GLuint program) {
+#ifdef GL_PROGRAM_BINARY_LENGTH
+    if(!enabled || !supported()) return;
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+}
+
+
+/*
+ * save() - the file is written under a temporary name and then renamed,
+ * so that another instance of the program never loads half a binary.
+ */
+int ProgramCache::save(uint64_t key, GLuint program, double ms) {
+    compilems += ms;
+#ifdef GL_PROGRAM_BINARY_LENGTH
+    if(!enabled || !supported()) return 0;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0) return 0;
+
+    ProgramCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = PROGRAMCACHE_VERSION;
+    h.key = key;
+    std::vector<char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &written, &format, &binary[0]);
+    if(written <= 0) return 0;
+    h.format = format;
+    h.length = (uint32_t)written;
+    h.compilems = (float)ms;
+
+    makeDirectory();
+    std::string name = cacheName(key);
+    std::string tempname = name + ".tmp";
+    FILE *cachefile = fopen(tempname.c_str(), "wb");
+    if(!cachefile) {
+        Utilities::printError("Cannot write program cache", tempname.c_str());
+        return 0;
+    }
+    int writeerror = 0;
+    if(fwrite(&h, sizeof(h), 1, cachefile) != 1
+        || fwrite(&binary[0], 1, h.length, cachefile) != h.length) {
+        writeerror = 1;
+    }
+    if(fclose(cachefile) != 0) writeerror = 1;
+    if(!writeerror) {
+        remove(name.c_str()); // Windows refuses to rename onto an existing file
+        if(rename(tempname.c_str(), name.c_str()) != 0) writeerror = 1;
+    }
+    if(writeerror) {
+        Utilities::printError("Cannot write program cache", name.c_str());
+        remove(tempname.c_str());
+        return 0;
+    }
+    saves++;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+
+void ProgramCache::printStats() {
+    if(!enabled || !supported()) {
+        printf("ProgramCache: off, %.1f ms compiling\n", compilems);
+        return;
+    }
+    int loads = hits + misses + refused;
+    printf("ProgramCache: %d of %d programs from %s/ (%.0f%%), %d missing, %d refused, %d saved\n",
+        hits, loads, directory.c_str(), loads ? 100.0 * hits / loads : 0.0, misses, refused, saves);
+    printf("ProgramCache: %.1f ms compiling, about %.1f ms saved by the hits\n", compilems, savedms);
+}
@@ -0,0 +1,80 @@
+/* ProgramCache.hpp */
+/* A disk cache of linked shader programs, to skip GLSL compiling at startup. */
+/* Usage: Shader::createShader() uses this by itself. It hashes the shader
+ * sources with key() and asks load() for a program before compiling. If
+ * there is none, it compiles and links as usual, and then calls save()
+ * with the time that took. Call setDirectory() before the first shader
+ * to move the cache (the default is "shadercache"), or with NULL to turn
+ * it off, and printStats() at exit to see how much time it saved.
+ *
+ * The cache holds the program binaries that the driver gives with
+ * glGetProgramBinary(), one file per program, named by its key. The key
+ * is a hash of the sources and of the GL_VENDOR, GL_RENDERER and
+ * GL_VERSION strings, so a new driver, or another GPU, never sees the
+ * binaries of the old one. A driver may still refuse a binary it wrote
+ * itself, after an update that did not change these strings. load()
+ * then returns 0, and the program is compiled from its sources and saved
+ * again.
+ *
+ * Program binaries are core in OpenGL 4.1. With an older driver, or one
+ * that has no binary formats, load() and save() do nothing. */
+
+#ifndef PROGRAMCACHE_HPP // Avoid including this header twice
+#define PROGRAMCACHE_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+
+#include <stdint.h>       // For fixed size integers in the file header
+
+// Bump this whenever the file layout changes
+#define PROGRAMCACHE_VERSION 1
+
+// The header at the start of a cache file, followed by the binary
+struct ProgramCacheHeader {
+    char magic[8];            // "GLPROG" followed by zeros
+    uint32_t version;         // PROGRAMCACHE_VERSION
+    uint32_t format;          // The binary format from glGetProgramBinary()
+    uint64_t key;             // ProgramCache::key() of the program
+    uint32_t length;          // Bytes in the binary
+    float compilems;          // Time it took to compile and link the program
+};
+
+namespace ProgramCache {
+
+/* Where the cache files are, created when the first one is saved. NULL
+ * turns the cache off. */
+void setDirectory(const char *directory);
+
+/* 1 if the driver can give and take program binaries */
+int supported();
+
+/* The key for a program made from count source strings, in order. Needs
+ * the OpenGL context, for the driver strings. */
+uint64_t key(const char *const *sources, int count);
+
+/*
+ * load() - a new linked program from the cache, or 0 if there is no
+ * binary for the key, or the driver refused it.
+ */
+GLuint load(uint64_t key);
+
+/* Call before glLinkProgram() for a program that will be saved */
+void prepare(GLuint program);
+
+/*
+ * save() - store the binary of a linked program under its key.
+ * compilems is how long it took to compile and link, to estimate
+ * the time that later hits save. Returns 1 on success, 0 on failure.
+ */
+int save(uint64_t key, GLuint program, double compilems);
+
+/* Print the hits, misses and refused binaries, and the time saved */
+void printStats();
+
+}
+
+#endif // PROGRAMCACHE_HPP
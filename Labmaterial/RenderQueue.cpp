@@ -0,0 +1,273 @@
+/*
+ * A sorted render queue, see RenderQueue.hpp.
+ */
+
+#include <cstdio>  // For printf()
+#include <cstring> // For memcpy()
+
+#include "RenderQueue.hpp"
+#include "GLState.hpp"     // Binds that skip what is already bound
+#include "UniformBuffer.hpp" // The ObjectBlock of each object
+#include "Utilities.hpp"  // To be able to use OpenGL extensions
+
+namespace {
+
+const int PROGRAM_BITS = 12;
+const int TEXTURE_BITS = 16;
+const int VAO_BITS = 16;
+const int DEPTH_BITS = 20;
+
+/*
+ * The distance in front of the camera as 20 bits that sort in the same
+ * order. The bits of a positive float sort like the float itself, so the
+ * top 20 of its 31 bits (exponent and 12 bits of mantissa) are enough.
+ */
+inline uint64_t depthBits(float distance) {
+    if(!(distance > 0.0f)) return 0; // Also for NaN
+    uint32_t bits;
+    memcpy(&bits, &distance, sizeof(bits));
+    return bits >> (31 - DEPTH_BITS);
+}
+
+/* A slot number for a name, given in the order the names are first seen */
+inline int slotFor(std::unordered_map<GLuint, int> &slots, GLuint name) {
+    std::unordered_map<GLuint, int>::iterator found = slots.find(name);
+    if(found != slots.end()) return found->second;
+    int slot = (int)slots.size();
+    slots[name] = slot;
+    return slot;
+}
+
+} // namespace
+
+
+/* Constructor: an empty queue, and zero statistics */
+RenderQueue::RenderQueue() {
+    frames = 0;
+    items = 0;
+    programbinds = 0;
+    texturebinds = 0;
+    vaobinds = 0;
+    frameitems = 0;
+    frameprogrambinds = 0;
+    frametexturebinds = 0;
+    framevaobinds = 0;
+    sortseconds = 0.0;
+    sorted = 0;
+}
+
+
+/*
+ * submit() - store the object and its key. Slot numbers beyond the bits
+ * in the key are cut off, which only makes the sorting less good, since
+ * execute() compares the real names.
+ */
+void RenderQueue::submit(GLuint program, GLuint texture, TriangleSoup &mesh, const GLfloat *MV, int level) {
+
+    GLuint vao = mesh.vertexArray();
+    if(!vao) return; // Not uploaded yet
+
+    Item item;
+    item.program = program;
+    item.texture = texture;
+    item.vao = vao;
+    item.mesh = &mesh;
+    item.level = level;
+    memcpy(item.MV, MV, sizeof(item.MV));
+    queue.push_back(item);
+
+    uint64_t key = (uint64_t)(programSlot(program) & ((1 << PROGRAM_BITS) - 1));
+    key = (key << TEXTURE_BITS) | (uint64_t)(textureSlot(texture) & ((1 << TEXTURE_BITS) - 1));
+    key = (key << VAO_BITS) | (uint64_t)(vaoSlot(vao) & ((1 << VAO_BITS) - 1));
+    key = (key << DEPTH_BITS) | depthBits(-MV[14]); // The camera looks along -z
+    keys.push_back(key);
+    sorted = 0;
+}
+
+
+/*
+ * sort() - a least significant digit radix sort of the keys, with the
+ * item numbers moved along. All eight histograms are counted in one
+ * pass over the keys before the sorting passes.
+ */
+void RenderQueue::sort() {
+
+    if(sorted) return;
+    double starttime = glfwGetTime();
+
+    int n = (int)keys.size();
+    order.resize(n);
+    for(int i=0; i<n; i++) order[i] = i;
+    scratchkeys.resize(n);
+    scratchorder.resize(n);
+    sortkeys.assign(keys.begin(), keys.end()); // keys stays in submit() order
+
+    int counts[8][256];
+    memset(counts, 0, sizeof(counts));
+    for(int i=0; i<n; i++) {
+        uint64_t key = sortkeys[i];
+        for(int b=0; b<8; b++) counts[b][(key >> (8*b)) & 0xFF]++;
+    }
+
+    uint64_t *from = n > 0 ? &sortkeys[0] : NULL;
+    uint64_t *to = n > 0 ? &scratchkeys[0] : NULL;
+    int *fromorder = n > 0 ? &order[0] : NULL;
+    int *toorder = n > 0 ? &scratchorder[0] : NULL;
+    for(int b=0; b<8 && n > 0; b++) {
+        int shift = 8*b;
+        if(counts[b][(from[0] >> shift) & 0xFF] == n) continue; // All the same here
+        int offsets[256];
+        int sum = 0;
+        for(int d=0; d<256; d++) {
+            offsets[d] = sum;
+            sum += counts[b][d];
+        }
+        for(int i=0; i<n; i++) {
+            int place = offsets[(from[i] >> shift) & 0xFF]++;
+            to[place] = from[i];
+            toorder[place] = fromorder[i];
+        }
+        uint64_t *swapkeys = from; from = to; to = swapkeys;
+        int *swaporder = fromorder; fromorder = toorder; toorder = swaporder;
+    }
+    if(n > 0 && fromorder != &order[0]) memcpy(&order[0], fromorder, n * sizeof(int));
+
+    sorted = 1;
+    sortseconds += glfwGetTime() - starttime;
+}
+
+
+/*
+ * execute() - write the ObjectBlocks of all objects to the UniformRing in
+ * one go, with glBufferSubData() if the ring could not be mapped, then
+ * draw in key order, with binds only where the state changes. The
+ * decoding constants are set for every new mesh, as several meshes can
+ * share a VAO in a GeometryArena. The binds go through GLState, which
+ * also skips those that are still in place from the last frame.
+ */
+void RenderQueue::execute() {
+
+    sort();
+
+    UniformRing &ring = UniformRing::get();
+    size_t stride = ring.stride(sizeof(ObjectBlock));
+    GLintptr blocks = 0;
+    if(!order.empty()) {
+        size_t size = order.size() * stride;
+        unsigned char *room = (unsigned char*)ring.map(size, &blocks);
+        int mapped = (room != NULL);
+        if(!mapped) { // Write the blocks from a copy here instead
+            scratchblocks.resize(size);
+            room = &scratchblocks[0];
+        }
+        for(size_t o=0; o<order.size(); o++) {
+            memcpy(room + o * stride, queue[order[o]].MV, sizeof(ObjectBlock));
+        }
+        if(mapped) ring.unmap();
+        else ring.write(blocks, room, size);
+    }
+
+    GLuint program = 0, texture = 0, vao = 0;
+    TriangleSoup *mesh = NULL;
+    int numprogrambinds = 0, numtexturebinds = 0, numvaobinds = 0;
+    for(size_t o=0; o<order.size(); o++) {
+        const Item &item = queue[order[o]];
+        if(o == 0 || item.program != program) {
+            program = item.program;
+            GLState::useProgram(program);
+            numprogrambinds++;
+        }
+        if(o == 0 || item.texture != texture) {
+            texture = item.texture;
+            GLState::bindTexture(GL_TEXTURE_2D, texture);
+            numtexturebinds++;
+        }
+        if(o == 0 || item.vao != vao) {
+            vao = item.vao;
+            GLState::bindVertexArray(vao);
+            numvaobinds++;
+        }
+        if(item.mesh != mesh) {
+            mesh = item.mesh;
+            mesh->vertexFormat().setDecodeAttribs();
+        }
+        ring.bind(UNIFORMBUFFER_OBJECT_BINDING, blocks + o * stride, sizeof(ObjectBlock));
+        GLenum indextype = mesh->indexType();
+        size_t indexsize = (indextype == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+        ranges.clear();
+        mesh->getDrawRanges(item.level, ranges);
+        for(size_t r=0; r<ranges.size(); r++) {
+            glDrawElementsBaseVertex(GL_TRIANGLES, ranges[r].count, indextype,
+                (void*)(ranges[r].first * indexsize), ranges[r].basevertex);
+        }
+    }
+
+    frames++;
+    frameitems = (int)queue.size();
+    frameprogrambinds = numprogrambinds;
+    frametexturebinds = numtexturebinds;
+    framevaobinds = numvaobinds;
+    items += frameitems;
+    programbinds += numprogrambinds;
+    texturebinds += numtexturebinds;
+    vaobinds += numvaobinds;
+    clear();
+}
+
+
+void RenderQueue::clear() {
+    queue.clear();
+    keys.clear();
+    order.clear();
+    sorted = 0;
+}
+
+
+int RenderQueue::size() const {
+    return (int)queue.size();
+}
+
+
+/* The binds execute() would make without sorting */
+int RenderQueue::unsortedBinds() const {
+    int binds = 0;
+    for(size_t i=0; i<queue.size(); i++) {
+        if(i == 0 || queue[i].program != queue[i-1].program) binds++;
+        if(i == 0 || queue[i].texture != queue[i-1].texture) binds++;
+        if(i == 0 || queue[i].vao != queue[i-1].vao) binds++;
+    }
+    return binds;
+}
+
+
+/* Print the binds per frame, and how many of them were avoided */
+void RenderQueue::printStats() {
+    if(frames == 0) return;
+    printf("RenderQueue: %d frames, %.1f objects per frame, sorted in %.1f us per frame\n",
+        frames, (double)items / frames, 1e6 * sortseconds / frames);
+    const char *names[3] = { "programs", "textures", "VAOs    " };
+    long long binds[3] = { programbinds, texturebinds, vaobinds };
+    for(int k=0; k<3; k++) {
+        printf("  %s: %.1f binds per frame, %.1f avoided\n", names[k],
+            (double)binds[k] / frames, (double)(items - binds[k]) / frames);
+    }
+}
+
+
+/*
+ * private
+ * Slot numbers for the sort keys.
+ */
+int RenderQueue::programSlot(GLuint program) {
+    return slotFor(programslots, program);
+}
+
+
+int RenderQueue::textureSlot(GLuint texture) {
+    return slotFor(textureslots, texture);
+}
+
+
+int RenderQueue::vaoSlot(GLuint vao) {
+    return slotFor(vaoslots, vao);
+}
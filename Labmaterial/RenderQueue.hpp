@@ -0,0 +1,114 @@
+/* RenderQueue.hpp */
+/* Draws a frame's objects sorted to change as little OpenGL state as possible. */
+/* Usage: submit() every object of the frame with its shader program,
+ * texture, mesh, modelview matrix and level of detail, then call
+ * execute() once. Uniforms that are the same for every object (like P)
+ * must be in the FrameBlock of the UniformRing before execute(). The
+ * queue writes MV of each object to an ObjectBlock in the UniformRing
+ * (see UniformBuffer.hpp) and binds it, binds the texture on the active
+ * texture unit and draws the mesh, and is then empty for the next frame.
+ * Objects whose mesh has no buffers yet are skipped.
+ *
+ * Every object gets a 64-bit sort key: from the top, 12 bits for the
+ * program, 16 for the texture, 16 for the VAO and 20 for the distance
+ * from the camera, so the objects are grouped by program, then by
+ * texture, then by VAO, and drawn front to back within a group to save
+ * fragment work. The program, texture and VAO numbers in the key are
+ * given in the order they are first seen, and are kept from frame to
+ * frame. The keys are sorted with a radix sort, 8 bits per pass, which
+ * takes time in proportion to the number of objects. Passes where all
+ * keys have the same 8 bits are skipped, so a frame with a few programs
+ * and textures needs only a few passes.
+ *
+ * execute() only binds a program, a texture or a VAO when it differs
+ * from the one before, and counts the binds it made and those it
+ * avoided compared to binding all three for every object.
+ * printStats() shows them per frame. */
+
+#ifndef RENDERQUEUE_HPP // Avoid including this header twice
+#define RENDERQUEUE_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+#include "TriangleSoup.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+class RenderQueue {
+
+public:
+
+// Statistics, updated by execute()
+int frames;                 // Number of execute() calls
+long long items;            // Objects drawn, all frames
+long long programbinds;     // glUseProgram() calls made, all frames
+long long texturebinds;     // glBindTexture() calls made, all frames
+long long vaobinds;         // glBindVertexArray() calls made, all frames
+int frameitems;             // The same for the last frame
+int frameprogrambinds;
+int frametexturebinds;
+int framevaobinds;
+double sortseconds;         // Time spent in sort(), all frames
+
+/* Constructor: an empty queue */
+RenderQueue();
+
+/* Add an object to draw in this frame. MV is copied. */
+void submit(GLuint program, GLuint texture, TriangleSoup &mesh, const GLfloat *MV, int level = 0);
+
+/* Sort the objects by their keys. execute() does this first. */
+void sort();
+
+/* Sort and draw the objects, and empty the queue */
+void execute();
+
+/* Empty the queue without drawing */
+void clear();
+
+/* The number of objects in the queue */
+int size() const;
+
+/* State changes that the order of submit() calls would need, counted
+ * like execute() counts them, for comparison. Call before sort(). */
+int unsortedBinds() const;
+
+/* Print the statistics */
+void printStats();
+
+private:
+
+struct Item {
+    GLuint program;
+    GLuint texture;
+    GLuint vao;
+    TriangleSoup *mesh;
+    int level;
+    GLfloat MV[16];
+};
+
+int programSlot(GLuint program);
+int textureSlot(GLuint texture);
+int vaoSlot(GLuint vao);
+
+std::vector<Item> queue;
+std::vector<uint64_t> keys;    // Sort key of each item
+std::vector<int> order;        // Items in sorted order, after sort()
+std::vector<uint64_t> sortkeys; // Copy of keys that sort() sorts
+std::vector<uint64_t> scratchkeys;
+std::vector<int> scratchorder;
+std::vector<unsigned char> scratchblocks; // ObjectBlocks, if the ring can't map
+std::vector<IndexRange> ranges; // Scratch space for execute()
+int sorted;                     // 1 if order is up to date
+
+std::unordered_map<GLuint, int> programslots;
+std::unordered_map<GLuint, int> textureslots;
+std::unordered_map<GLuint, int> vaoslots;
+
+};
+
+#endif // RENDERQUEUE_HPP
@@ -1,5 +1,42 @@
 #include "Rotator.hpp"
 
+namespace {
+
+/* Invert a column major 4x4 matrix with cofactors. Returns 0 if it is singular. */
+int mat4invert(const float *M, float *Minv) {
+
+	float inv[16];
+	inv[0] = M[5]*M[10]*M[15] - M[5]*M[11]*M[14] - M[9]*M[6]*M[15] + M[9]*M[7]*M[14] + M[13]*M[6]*M[11] - M[13]*M[7]*M[10];
+	inv[4] = -M[4]*M[10]*M[15] + M[4]*M[11]*M[14] + M[8]*M[6]*M[15] - M[8]*M[7]*M[14] - M[12]*M[6]*M[11] + M[12]*M[7]*M[10];
+	inv[8] = M[4]*M[9]*M[15] - M[4]*M[11]*M[13] - M[8]*M[5]*M[15] + M[8]*M[7]*M[13] + M[12]*M[5]*M[11] - M[12]*M[7]*M[9];
+	inv[12] = -M[4]*M[9]*M[14] + M[4]*M[10]*M[13] + M[8]*M[5]*M[14] - M[8]*M[6]*M[13] - M[12]*M[5]*M[10] + M[12]*M[6]*M[9];
+	inv[1] = -M[1]*M[10]*M[15] + M[1]*M[11]*M[14] + M[9]*M[2]*M[15] - M[9]*M[3]*M[14] - M[13]*M[2]*M[11] + M[13]*M[3]*M[10];
+	inv[5] = M[0]*M[10]*M[15] - M[0]*M[11]*M[14] - M[8]*M[2]*M[15] + M[8]*M[3]*M[14] + M[12]*M[2]*M[11] - M[12]*M[3]*M[10];
+	inv[9] = -M[0]*M[9]*M[15] + M[0]*M[11]*M[13] + M[8]*M[1]*M[15] - M[8]*M[3]*M[13] - M[12]*M[1]*M[11] + M[12]*M[3]*M[9];
+	inv[13] = M[0]*M[9]*M[14] - M[0]*M[10]*M[13] - M[8]*M[1]*M[14] + M[8]*M[2]*M[13] + M[12]*M[1]*M[10] - M[12]*M[2]*M[9];
+	inv[2] = M[1]*M[6]*M[15] - M[1]*M[7]*M[14] - M[5]*M[2]*M[15] + M[5]*M[3]*M[14] + M[13]*M[2]*M[7] - M[13]*M[3]*M[6];
+	inv[6] = -M[0]*M[6]*M[15] + M[0]*M[7]*M[14] + M[4]*M[2]*M[15] - M[4]*M[3]*M[14] - M[12]*M[2]*M[7] + M[12]*M[3]*M[6];
+	inv[10] = M[0]*M[5]*M[15] - M[0]*M[7]*M[13] - M[4]*M[1]*M[15] + M[4]*M[3]*M[13] + M[12]*M[1]*M[7] - M[12]*M[3]*M[5];
+	inv[14] = -M[0]*M[5]*M[14] + M[0]*M[6]*M[13] + M[4]*M[1]*M[14] - M[4]*M[2]*M[13] - M[12]*M[1]*M[6] + M[12]*M[2]*M[5];
+	inv[3] = -M[1]*M[6]*M[11] + M[1]*M[7]*M[10] + M[5]*M[2]*M[11] - M[5]*M[3]*M[10] - M[9]*M[2]*M[7] + M[9]*M[3]*M[6];
+	inv[7] = M[0]*M[6]*M[11] - M[0]*M[7]*M[10] - M[4]*M[2]*M[11] + M[4]*M[3]*M[10] + M[8]*M[2]*M[7] - M[8]*M[3]*M[6];
+	inv[11] = -M[0]*M[5]*M[11] + M[0]*M[7]*M[9] + M[4]*M[1]*M[11] - M[4]*M[3]*M[9] - M[8]*M[1]*M[7] + M[8]*M[3]*M[5];
+	inv[15] = M[0]*M[5]*M[10] - M[0]*M[6]*M[9] - M[4]*M[1]*M[10] + M[4]*M[2]*M[9] + M[8]*M[1]*M[6] - M[8]*M[2]*M[5];
+
+	float det = M[0]*inv[0] + M[1]*inv[4] + M[2]*inv[8] + M[3]*inv[12];
+	if(det == 0.0f) return 0;
+	for(int i=0; i<16; i++) Minv[i] = inv[i] / det;
+	return 1;
+}
+
+/* Transform the point (x, y, z, 1) by M and divide by w */
+void unproject(const float *M, float x, float y, float z, float *p) {
+	float w = M[3]*x + M[7]*y + M[11]*z + M[15];
+	for(int k=0; k<3; k++) p[k] = (M[k]*x + M[4+k]*y + M[8+k]*z + M[12+k]) / w;
+}
+
+}
+
 void KeyRotator::init(GLFWwindow *window) {
      phi = 0.0;
      theta = 0.0;
@@ -43,6 +80,7 @@ void MouseRotator::init(GLFWwindow *window) {
     glfwGetCursorPos(window, &lastX, &lastY);
 	lastLeft = GL_FALSE;
 	lastRight = GL_FALSE;
+	rightClicked = 0;
 }
 
 void MouseRotator::poll(GLFWwindow *window) {
@@ -72,8 +110,40 @@ void MouseRotator::poll(GLFWwindow *window) {
 	if (theta >= M_PI/2.0) theta = M_PI/2.0;  // Clamp at 90
 	if (theta < -M_PI/2.0) theta = -M_PI/2.0; // Clamp at -90
   }
+  rightClicked = (currentRight && !lastRight);
   lastLeft = currentLeft;
   lastRight = currentRight;
   lastX = currentX;
   lastY = currentY;
 }
+
+int MouseRotator::pickRay(GLFWwindow *window, const float *P, const float *MV,
+                          float *origin, float *direction) {
+
+  double x, y;
+  int windowWidth, windowHeight;
+  float PMV[16], inv[16], farpoint[3];
+
+  glfwGetCursorPos(window, &x, &y);
+  glfwGetWindowSize(window, &windowWidth, &windowHeight);
+  if(windowWidth <= 0 || windowHeight <= 0) return 0;
+
+  // Normalized device coordinates of the pointer, with y up
+  float ndcx = (float)(2.0 * (x + 0.5) / windowWidth - 1.0);
+  float ndcy = (float)(1.0 - 2.0 * (y + 0.5) / windowHeight);
+
+  // Back through P*MV from the near (z=-1) and far (z=1) planes
+  for(int c=0; c<4; c++) {
+    for(int r=0; r<4; r++) {
+      PMV[4*c+r] = P[r]*MV[4*c] + P[4+r]*MV[4*c+1] + P[8+r]*MV[4*c+2] + P[12+r]*MV[4*c+3];
+    }
+  }
+  if(!mat4invert(PMV, inv)) return 0;
+  unproject(inv, ndcx, ndcy, -1.0f, origin);
+  unproject(inv, ndcx, ndcy, 1.0f, farpoint);
+  for(int k=0; k<3; k++) direction[k] = farpoint[k] - origin[k];
+  float length = sqrtf(direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2]);
+  if(length == 0.0f) return 0;
+  for(int k=0; k<3; k++) direction[k] /= length;
+  return 1;
+}
@@ -2,7 +2,9 @@
 /* Two classes to perform viewport rotations on mouse and keyboard input with GLFW . */
 /* Usage: call init() before the rendering loop, call poll() once per frame,
  * read public members phi and theta to construct a rotation matrix.
- * The suggested composite rotation matrix is RotX(theta)*RotY(phi). */
+ * The suggested composite rotation matrix is RotX(theta)*RotY(phi).
+ * MouseRotator::pickRay() gives the ray through the pixel under the
+ * mouse pointer, for picking with TriangleSoup::pick(). */
 /* Stefan Gustavson (stefan.gustavson@liu.se) 2014-03-27 */
 
 #ifndef ROTATOR_HPP // Avoid including this header twice
@@ -34,6 +36,7 @@ class MouseRotator {
 public:
 	float phi;
 	float theta;
+	int rightClicked; // 1 if the right button went down since the last poll()
 
 private:
 	double lastX;
@@ -44,6 +47,14 @@ private:
 public:
     void init(GLFWwindow *window);
     void poll(GLFWwindow *window);
+
+    /* The ray through the mouse pointer, in the coordinates of an object
+     * drawn with the modelview matrix MV and the projection matrix P.
+     * origin is on the near plane, and direction has length 1, so
+     * distances along the ray are in object units. Returns 0 if P*MV
+     * can't be inverted. */
+    int pickRay(GLFWwindow *window, const float *P, const float *MV,
+                float *origin, float *direction);
 };
 
 #endif // ROTATOR_HPP
@@ -1,4 +1,40 @@
 #include "Shader.hpp"
+#include "GLState.hpp" // Binds that skip what is already bound
+#include "UniformBuffer.hpp" // The binding points of uniform blocks
+#include "ProgramCache.hpp" // Programs linked by an earlier run
+#include "ShaderBatch.hpp" // For parallel compiling
+#include "ShaderSource.hpp" // For #include and #define
+#include <algorithm>   // For sort()
+
+namespace {
+
+/* Cut the "[0]" that OpenGL puts after the names of arrays */
+std::string baseName(const char *name, GLsizei length) {
+    std::string base(name, length);
+    if(base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0) {
+        base.resize(base.size() - 3);
+    }
+    return base;
+}
+
+bool byName(const Shader::Variable &a, const Shader::Variable &b) {
+    return a.name < b.name;
+}
+
+/* Binary search in a list sorted by name */
+const Shader::Variable *findVariable(const std::vector<Shader::Variable> &list, const char *name) {
+    size_t low = 0, high = list.size();
+    while(low < high) {
+        size_t middle = (low + high) / 2;
+        int order = list[middle].name.compare(name);
+        if(order == 0) return &list[middle];
+        if(order < 0) low = middle + 1;
+        else high = middle;
+    }
+    return NULL;
+}
+
+} // namespace
 
 /*
  * Constructor without arguments.
@@ -6,6 +42,7 @@
  */
 Shader::Shader() {
     this->programID = 0;
+    this->linking = 0;
 }
 
 
@@ -16,6 +53,8 @@ Shader::Shader() {
  * assembles the shader program.
  */
 Shader::Shader(const char *vertexshaderfile, const char *fragmentshaderfile) {
+    this->programID = 0;
+    this->linking = 0;
     this->createShader(vertexshaderfile, fragmentshaderfile);
 }
 
@@ -25,44 +64,123 @@ Shader::Shader(const char *vertexshaderfile, const char *fragmentshaderfile) {
  * Cleans up by deleting the program if it was compiled.
  */
 Shader::~Shader() {
+    if(linking) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+    }
     if(programID != 0)
-        glDeleteProgram(programID);
+        GLState::deleteProgram(programID);
 }
 
 
 /*
  * createShader() - create, load, compile and link the GLSL Shader objects.
  */
-void Shader::createShader(const char *vertexshaderfile, const char *fragmentshaderfile) {
+void Shader::createShader(const char *vertexshaderfile, const char *fragmentshaderfile,
+                          const char *defines) {
+    beginShader(vertexshaderfile, fragmentshaderfile, defines);
+    finish();
+}
 
-    GLuint programObject;
-    GLuint vertexShader;
-    GLuint fragmentShader;
-    const char *vertexShaderStrings[1];
-    const char *fragmentShaderStrings[1];
-	unsigned char *vertexShaderAssembly;
-	unsigned char *fragmentShaderAssembly;
 
-    GLint vertexCompiled;
-    GLint fragmentCompiled;
-    GLint shadersLinked;
-    char str[4096]; // For error messages from the GLSL compiler and linker
+/*
+ * beginShader() - a file that can't be read gives a NULL source, and
+ * then a compile error.
+ */
+void Shader::beginShader(const char *vertexshaderfile, const char *fragmentshaderfile,
+                         const char *defines) {
+
+    ShaderSource vertexShaderAssembly;
+    ShaderSource fragmentShaderAssembly;
+
+    int vertexloaded = vertexShaderAssembly.load(vertexshaderfile, defines);
+    int fragmentloaded = fragmentShaderAssembly.load(fragmentshaderfile, defines);
+    beginShaderSource(vertexloaded ? vertexShaderAssembly.text.c_str() : NULL,
+                      fragmentloaded ? fragmentShaderAssembly.text.c_str() : NULL);
+}
+
+
+/*
+ * beginShaderSource() - nothing here asks for the compile or link
+ * status, which would make the driver finish the work right away.
+ */
+void Shader::beginShaderSource(const char *vertexsource, const char *fragmentsource,
+                               uint64_t key) {
 
     // If a program is already stored in this object, delete it
+    if(linking) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        linking = 0;
+    }
     if(programID != 0)
-        glDeleteProgram(programID);
+        GLState::deleteProgram(programID);
+    programID = 0;
+    uniforms.clear();
+    attributes.clear();
+    blocks.clear();
+
+    // A program linked from the same sources by an earlier run, if the
+    // driver takes its binary
+    cachekey = 0;
+    if(vertexsource && fragmentsource) {
+        const char *sources[2] = { vertexsource, fragmentsource };
+        cachekey = key ? key : ProgramCache::key(sources, 2);
+        programID = ProgramCache::load(cachekey);
+    }
+    if(programID != 0) {
+        reflect();
+        UniformRing::checkLayout(*this);
+        return;
+    }
+    starttime = glfwGetTime();
 
     // Create the vertex shader.
     vertexShader = glCreateShader(GL_VERTEX_SHADER);
-
-    vertexShaderAssembly = readShaderFile(vertexshaderfile);
-    if(vertexShaderAssembly) { // Don't try to use a NULL pointer
-        vertexShaderStrings[0] = (char*)vertexShaderAssembly;
-        glShaderSource(vertexShader, 1, vertexShaderStrings, NULL);
+    if(vertexsource) { // Don't try to use a NULL pointer
+        glShaderSource(vertexShader, 1, &vertexsource, NULL);
         glCompileShader(vertexShader);
-        delete[] vertexShaderAssembly;
     }
 
+  	// Create the fragment shader.
+    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    if(fragmentsource) { // Don't try to use a NULL pointer
+        glShaderSource(fragmentShader, 1, &fragmentsource, NULL);
+        glCompileShader(fragmentShader);
+    }
+
+    // Create a program object, attach the two shaders and link it
+    programID = glCreateProgram();
+    glAttachShader(programID, vertexShader);
+    glAttachShader(programID, fragmentShader);
+    ProgramCache::prepare(programID);
+    glLinkProgram(programID);
+    linking = 1;
+}
+
+
+/*
+ * ready() - with GL_KHR_parallel_shader_compile, the driver can say if
+ * it is done without waiting. Without it, finish() is as good as now.
+ */
+int Shader::ready() const {
+    if(!linking || !ShaderBatch::parallelSupported()) return 1;
+    GLint completed = GL_TRUE;
+    glGetProgramiv(programID, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+}
+
+
+void Shader::finish() {
+
+    GLint vertexCompiled;
+    GLint fragmentCompiled;
+    GLint shadersLinked;
+    char str[4096]; // For error messages from the GLSL compiler and linker
+
+    if(!linking) return;
+    linking = 0;
+
     glGetShaderiv(vertexShader, GL_COMPILE_STATUS,
                                &vertexCompiled);
     if(vertexCompiled  == GL_FALSE)
@@ -71,89 +189,122 @@ void Shader::createShader(const char *vertexshaderfile, const char *fragmentshad
         printError("Vertex shader compile error", str);
   	}
 
-  	// Create the fragment shader.
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-
-    fragmentShaderAssembly = readShaderFile(fragmentshaderfile);
-    if(fragmentShaderAssembly) { // Don't try to use a NULL pointer
-    	fragmentShaderStrings[0] = (char*)fragmentShaderAssembly;
-        glShaderSource(fragmentShader, 1, fragmentShaderStrings, NULL);
-        glCompileShader(fragmentShader);
-        delete[] fragmentShaderAssembly;
-    }
-
-    glGetProgramiv(fragmentShader, GL_COMPILE_STATUS, &fragmentCompiled);
+    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &fragmentCompiled);
     if(fragmentCompiled == GL_FALSE)
    	{
         glGetShaderInfoLog(fragmentShader, sizeof(str), NULL, str);
         printError("Fragment shader compile error", str);
     }
 
-    // Create a program object and attach the two compiled shaders.
-    programObject = glCreateProgram();
-    glAttachShader(programObject, vertexShader);
-    glAttachShader(programObject, fragmentShader);
-
-    // Link the program object and print out the info log.
-    glLinkProgram(programObject);
-    glGetProgramiv(programObject, GL_LINK_STATUS, &shadersLinked);
+    // Print out the info log of the linker
+    glGetProgramiv(programID, GL_LINK_STATUS, &shadersLinked);
 
     if(shadersLinked == GL_FALSE)
 	{
-		glGetProgramInfoLog( programObject, sizeof(str), NULL, str );
+		glGetProgramInfoLog( programID, sizeof(str), NULL, str );
 		printError("Program object linking error", str);
 	}
 	glDeleteShader(vertexShader);   // After successful linking,
 	glDeleteShader(fragmentShader); // these are no longer needed
 
-	programID = programObject; // Save this value in the class variable
+	if(shadersLinked == GL_TRUE) {
+		if(cachekey != 0) {
+			ProgramCache::save(cachekey, programID, 1e3 * (glfwGetTime() - starttime));
+		}
+		reflect();
+		UniformRing::checkLayout(*this);
+	}
+}
+
+
+const Shader::Variable *Shader::findUniform(const char *name) const {
+    return findVariable(uniforms, name);
+}
+
+const Shader::Variable *Shader::findAttribute(const char *name) const {
+    return findVariable(attributes, name);
 }
 
 
 /*
- * private
- * printError() - Signal an error.
- * Simple printf() to console for portability.
+ * uniformLocation() - the location from the list, without asking OpenGL.
+ * A uniform that is declared but not used in the shader code is not
+ * active, and is not an error.
  */
-void Shader::printError(const char *errtype, const char *errmsg) {
-  fprintf(stderr, "%s: %s\n", errtype, errmsg);
+GLint Shader::uniformLocation(const char *name, GLenum type) const {
+    const Variable *uniform = findUniform(name);
+    if(uniform == NULL) return -1;
+    if(uniform->type != type) {
+        printError("Uniform has another type than expected", name);
+        return -1;
+    }
+    return uniform->location;
 }
 
 
 /*
  * private
- * filelength()
- * Override the Win32 filelength() function with
- * a version that takes a Unix-style file handle as
- * input instead of a file ID number, and which works
- * on platforms other than Windows.
+ * printError() - Signal an error.
+ * Simple printf() to console for portability.
  */
-long Shader::filelength(FILE *file) {
-    long numbytes;
-    long savedpos = ftell(file); // Remember where we are
-    fseek(file, 0, SEEK_END);    // Fast forward to the end
-    numbytes = ftell(file);      // Index of last byte in file
-    fseek(file, savedpos, SEEK_SET); // Get back to where we were
-    return numbytes;             // This is the file length
+void Shader::printError(const char *errtype, const char *errmsg) const {
+  fprintf(stderr, "%s: %s\n", errtype, errmsg);
 }
 
 
 /*
  * private
- * readShaderFile(filename) - read a shader source string from a file
+ * reflect() - list the active uniforms, attributes and uniform blocks
+ * of the linked program, and connect the blocks to their binding
+ * points. An array is listed once, with the location of element 0.
  */
-unsigned char* Shader::readShaderFile(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if(file == NULL)
-    {
-        printError("ERROR", "Cannot open shader file!");
-  		  return 0;
+void Shader::reflect() {
+
+    GLint numuniforms = 0, numattributes = 0, uniformlength = 0, attributelength = 0;
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &numuniforms);
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniformlength);
+    glGetProgramiv(programID, GL_ACTIVE_ATTRIBUTES, &numattributes);
+    glGetProgramiv(programID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &attributelength);
+    std::vector<char> name((uniformlength > attributelength ? uniformlength : attributelength) + 1);
+
+    for(GLint i=0; i<numuniforms; i++) {
+        Variable uniform;
+        GLsizei length = 0;
+        glGetActiveUniform(programID, (GLuint)i, (GLsizei)name.size(), &length,
+            &uniform.size, &uniform.type, &name[0]);
+        uniform.name = baseName(&name[0], length);
+        uniform.location = glGetUniformLocation(programID, &name[0]);
+        GLuint index = (GLuint)i;
+        glGetActiveUniformsiv(programID, 1, &index, GL_UNIFORM_BLOCK_INDEX, &uniform.block);
+        glGetActiveUniformsiv(programID, 1, &index, GL_UNIFORM_OFFSET, &uniform.offset);
+        uniforms.push_back(uniform);
     }
-    int bytesinfile = filelength(file);
-    unsigned char *buffer = new unsigned char[bytesinfile+1];
-    int bytesread = fread( buffer, 1, bytesinfile, file);
-    buffer[bytesread] = 0; // Terminate the string with 0
-    fclose(file);
+    for(GLint i=0; i<numattributes; i++) {
+        Variable attribute;
+        GLsizei length = 0;
+        glGetActiveAttrib(programID, (GLuint)i, (GLsizei)name.size(), &length,
+            &attribute.size, &attribute.type, &name[0]);
+        attribute.name = baseName(&name[0], length);
+        attribute.location = glGetAttribLocation(programID, &name[0]);
+        attribute.block = -1;
+        attribute.offset = -1;
+        attributes.push_back(attribute);
+    }
+    std::sort(uniforms.begin(), uniforms.end(), byName);
 
-    return buffer;
+    GLint numblocks = 0, blocklength = 0;
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORM_BLOCKS, &numblocks);
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &blocklength);
+    name.resize(blocklength + 1);
+    for(GLint i=0; i<numblocks; i++) {
+        Block block;
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(programID, (GLuint)i, (GLsizei)name.size(), &length, &name[0]);
+        block.name.assign(&name[0], length);
+        glGetActiveUniformBlockiv(programID, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.size);
+        block.binding = UniformRing::bindingFor(block.name.c_str());
+        if(block.binding >= 0) glUniformBlockBinding(programID, (GLuint)i, (GLuint)block.binding);
+        blocks.push_back(block);
+    }
+    std::sort(attributes.begin(), attributes.end(), byName);
 }
@@ -1,8 +1,37 @@
 /* Shader.hpp */
 /* A class to load and compile GLSL shaders from files. */
 /* Usage: call createShader() to load and compile a program object,
- * or use the constructor with two file name arguments.
- * Call glUseProgram() with the public member programID as argument. */
+ * or use the constructor with two file name arguments. The files may
+ * #include other files, and createShader() can put #defines in them,
+ * see ShaderSource.hpp. ShaderVariants keeps one program for each set of
+ * defines.
+ * Call GLState::useProgram() with the public member programID as argument.
+ *
+ * After linking, createShader() lists the active uniforms and vertex
+ * attributes of the program with their names, types and locations.
+ * A Shader::Uniform<TYPE> handle looks up its uniform in that list once,
+ * with a check of the GLSL type, and then sets it without the string
+ * lookup of glGetUniformLocation():
+ *     Shader::Uniform<GL_FLOAT_MAT4> P(shader, "P");
+ *     ...
+ *     GLState::useProgram(shader.programID);
+ *     P.set(matrix); // Every frame
+ * The values are set through GLState, so values that did not change
+ * are not sent again.
+ *
+ * Uniform blocks are listed too, and the blocks that UniformBuffer.hpp
+ * knows are connected to their binding points, with a check that their
+ * layout matches the structs there.
+ *
+ * A program that was linked from the same sources in an earlier run is
+ * loaded from the ProgramCache on disk instead of being compiled.
+ *
+ * createShader() waits for the driver to compile and link the program.
+ * To let the driver compile many programs at once, call beginShader()
+ * for each of them instead, or add them to a ShaderBatch, and then
+ * finish() each program before its first use. Until then, programID is
+ * valid but may not be ready to draw with, and the lists of uniforms and
+ * attributes are empty. */
 /* Stefan Gustavson (stefan.gustavson@liu.se) 2014-03-27 */
 
 #ifndef SHADER_HPP // Avoid including this header twice
@@ -14,7 +43,31 @@
 
 #include "GLFW/glfw3.h"
 #include "Utilities.hpp" // For OpenGL extensions
+#include "GLState.hpp"   // For Uniform<TYPE>::set()
 #include <cstdio>
+#include <stdint.h>      // For the ProgramCache key
+#include <string>
+#include <vector>
+
+/* The C++ type of the value, and the GLState function, for each GLSL
+ * type that Shader::Uniform<TYPE> can set */
+template<GLenum TYPE> struct UniformTraits;
+template<> struct UniformTraits<GL_FLOAT> {
+    typedef GLfloat Value;
+    static void set(GLint location, GLfloat value) { GLState::uniform1f(location, value); }
+};
+template<> struct UniformTraits<GL_INT> {
+    typedef GLint Value;
+    static void set(GLint location, GLint value) { GLState::uniform1i(location, value); }
+};
+template<> struct UniformTraits<GL_SAMPLER_2D> { // The texture unit number
+    typedef GLint Value;
+    static void set(GLint location, GLint value) { GLState::uniform1i(location, value); }
+};
+template<> struct UniformTraits<GL_FLOAT_MAT4> { // 16 floats, column major
+    typedef const GLfloat *Value;
+    static void set(GLint location, const GLfloat *value) { GLState::uniformMatrix4fv(location, value); }
+};
 
 class Shader {
 
@@ -22,6 +75,47 @@ public:
 
 GLuint programID;
 
+/* An active uniform or vertex attribute of the program */
+struct Variable {
+    std::string name; // Without the "[0]" of arrays
+    GLenum type;      // GL_FLOAT_MAT4, GL_SAMPLER_2D ...
+    GLint size;       // Number of array elements, 1 if not an array
+    GLint location;   // -1 for uniforms in a uniform block
+    GLint block;      // Index in blocks, -1 if not in a block
+    GLint offset;     // Bytes from the start of the block, -1 if not in a block
+};
+
+/* An active uniform block */
+struct Block {
+    std::string name;
+    GLint size;       // Bytes
+    GLint binding;    // The binding point, -1 if it was not set
+};
+
+/* The active uniforms and attributes, sorted by name */
+std::vector<Variable> uniforms;
+std::vector<Variable> attributes;
+std::vector<Block> blocks;        // In the order of their OpenGL block index
+
+/* A uniform of one GLSL type, found once by its name. set() changes it in
+ * the current program, which must be the one it was resolved in. A
+ * uniform that the program does not have, or that has another type, gets
+ * location -1, and set() does nothing. */
+template<GLenum TYPE> class Uniform {
+public:
+    GLint location;
+    Uniform() { location = -1; }
+    Uniform(const Shader &shader, const char *name) { resolve(shader, name); }
+    /* Find the uniform, 1 if it was there */
+    int resolve(const Shader &shader, const char *name) {
+        location = shader.uniformLocation(name, TYPE);
+        return location >= 0;
+    }
+    void set(typename UniformTraits<TYPE>::Value value) const {
+        UniformTraits<TYPE>::set(location, value);
+    }
+};
+
 /* Argument-less constructor. Creates an invalid shader program. */
 Shader();
 
@@ -33,25 +127,52 @@ Shader(const char *vertexshaderfile, const char *fragmentshaderfile);
 
 /*
  * createShader() - create, load, compile and link the GLSL shader objects.
+ * defines is a list like "NORMAL_OCTAHEDRAL TEXTURED", or NULL.
  */
-void createShader(const char *vertexshaderfile, const char *fragmentshaderfile);
-
-private:
+void createShader(const char *vertexshaderfile, const char *fragmentshaderfile,
+                  const char *defines = NULL);
 
 /*
- * Override the Win32 filelength() function with
- * a version that takes a Unix-style file handle as
- * input instead of a file ID number, and which works
- * on platforms other than Windows.
+ * beginShader() - load the files and start compiling and linking, without
+ * waiting for the result. beginShaderSource() takes the sources instead,
+ * and the ProgramCache::key() of the two, if the caller already has it.
  */
-long filelength(FILE *file);
+void beginShader(const char *vertexshaderfile, const char *fragmentshaderfile,
+                 const char *defines = NULL);
+void beginShaderSource(const char *vertexsource, const char *fragmentsource,
+                       uint64_t key = 0);
+
+/* 1 if finish() would not wait for the driver */
+int ready() const;
 
 /*
- * readShaderFile(filename) - read a shader source string from a file
+ * finish() - wait for the program that beginShader() started, print any
+ * errors from the compiler and the linker, and list the uniforms and
+ * attributes. Does nothing if there is no program being linked.
  */
-unsigned char* readShaderFile(const char *filename);
+void finish();
+
+/* An active uniform or attribute by name, NULL if there is none */
+const Variable *findUniform(const char *name) const;
+const Variable *findAttribute(const char *name) const;
+
+/* The location of a uniform, or -1 if it is not active. A uniform of
+ * another type than the one asked for is an error, and also gives -1. */
+GLint uniformLocation(const char *name, GLenum type) const;
+
+private:
+
+/* Fill in uniforms and attributes after linking */
+void reflect();
+
+void printError(const char *errtype, const char *errmsg) const;
 
-void printError(const char *errtype, const char *errmsg);
+// The program that beginShader() started, until finish()
+int linking;
+GLuint vertexShader;
+GLuint fragmentShader;
+uint64_t cachekey;   // 0 if it is not to be saved in the ProgramCache
+double starttime;
 
 };
 
@@ -0,0 +1,99 @@
+/*
+ * Shader programs compiled together, see ShaderBatch.hpp.
+ */
+
+#include <cstring> // For strcmp()
+
+#include "ShaderBatch.hpp"
+#include "Shader.hpp"
+#include "Utilities.hpp"  // To be able to use OpenGL extensions
+
+namespace {
+
+// glMaxShaderCompilerThreadsKHR() and the ARB version take the same argument
+typedef void (APIENTRY *MaxThreadsFunction)(GLuint count);
+
+int support = -1;      // -1 until parallelSupported() has asked the driver
+MaxThreadsFunction maxShaderCompilerThreads = NULL;
+
+} // namespace
+
+
+/* Constructor: 0xFFFFFFFF lets the driver decide how many threads to use */
+ShaderBatch::ShaderBatch() {
+    if(parallelSupported() && maxShaderCompilerThreads) {
+        maxShaderCompilerThreads(0xFFFFFFFF);
+    }
+}
+
+
+void ShaderBatch::add(Shader *shader, const char *vertexshaderfile, const char *fragmentshaderfile,
+                      const char *defines) {
+    shader->beginShader(vertexshaderfile, fragmentshaderfile, defines);
+    pending.push_back(shader);
+}
+
+
+void ShaderBatch::addSource(Shader *shader, const char *vertexsource, const char *fragmentsource,
+                            uint64_t key) {
+    shader->beginShaderSource(vertexsource, fragmentsource, key);
+    pending.push_back(shader);
+}
+
+
+/*
+ * finish() - the first program that is ready, or the oldest one if none
+ * is. Waiting for the oldest is no loss, as it has been in the driver's
+ * queue the longest.
+ */
+void ShaderBatch::finish() {
+    while(!pending.empty()) {
+        size_t next = 0;
+        for(size_t s=0; s<pending.size(); s++) {
+            if(pending[s]->ready()) {
+                next = s;
+                break;
+            }
+        }
+        pending[next]->finish();
+        pending.erase(pending.begin() + next);
+    }
+}
+
+
+int ShaderBatch::numPending() const {
+    return (int)pending.size();
+}
+
+
+/*
+ * parallelSupported() - the extension is listed like any other, and is
+ * in both the KHR and the ARB version on most drivers that have it.
+ */
+int ShaderBatch::parallelSupported() {
+    if(support >= 0) return support;
+    support = 0;
+    GLint numextensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numextensions);
+    for(int i=0; i<numextensions; i++) {
+        const char *name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if(!name) continue;
+        if(!strcmp(name, "GL_KHR_parallel_shader_compile")) {
+            maxShaderCompilerThreads = (MaxThreadsFunction)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+            support = 1;
+        }
+        else if(!strcmp(name, "GL_ARB_parallel_shader_compile") && !support) {
+            maxShaderCompilerThreads = (MaxThreadsFunction)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+            support = 1;
+        }
+    }
+    return support;
+}
+
+
+int ShaderBatch::compilerThreads() {
+    if(!parallelSupported()) return 0;
+    GLint threads = 0;
+    glGetIntegerv(GL_MAX_SHADER_COMPILER_THREADS_KHR, &threads);
+    return (GLuint)threads == 0xFFFFFFFF ? -1 : threads;
+}
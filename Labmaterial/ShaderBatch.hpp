@@ -0,0 +1,71 @@
+/* ShaderBatch.hpp */
+/* Compile many shader programs at once, where the driver can. */
+/* Usage: add() every program that will be needed, then call finish(), or
+ * call finish() of each Shader just before its first use. add() only
+ * starts the compiling and linking, and nothing asks the driver how it
+ * went before finish(), so a driver with GL_KHR_parallel_shader_compile
+ * (or the ARB version) can compile on its own threads while the program
+ * goes on with other work, such as loading textures. Without the
+ * extension, most drivers compile at the first status query, so the
+ * programs are compiled one by one in finish().
+ *
+ * finish() here takes the programs in the order the driver completes
+ * them, so that it does not wait for one program while others are done. */
+
+#ifndef SHADERBATCH_HPP // Avoid including this header twice
+#define SHADERBATCH_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+
+#include <stdint.h>
+#include <vector>
+
+// From GL_KHR_parallel_shader_compile, which the headers may not have
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+
+class Shader;
+
+class ShaderBatch {
+
+public:
+
+/* Constructor: an empty batch. Lets the driver use as many compiler
+ * threads as it likes, if it can. */
+ShaderBatch();
+
+/* Start compiling and linking a program, see Shader::beginShader() */
+void add(Shader *shader, const char *vertexshaderfile, const char *fragmentshaderfile,
+         const char *defines = NULL);
+void addSource(Shader *shader, const char *vertexsource, const char *fragmentsource,
+               uint64_t key = 0);
+
+/* Finish all the programs added since the last finish() */
+void finish();
+
+/* The number of programs that have not been finished */
+int numPending() const;
+
+/* 1 if the driver compiles in the background and can tell when it is
+ * done with a program. Asks the driver on the first call. */
+static int parallelSupported();
+
+/* The number of compiler threads the driver uses, -1 if the driver
+ * decides for itself, 0 without parallel compiling */
+static int compilerThreads();
+
+private:
+
+std::vector<Shader*> pending;
+
+};
+
+#endif // SHADERBATCH_HPP
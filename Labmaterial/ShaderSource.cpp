@@ -0,0 +1,246 @@
+/*
+ * GLSL source files with #include and injected #defines, see ShaderSource.hpp.
+ */
+
+#include <cstdio>  // For file input and console messages
+#include <cstring> // For strchr()
+#include <cctype>  // For isalnum()
+#include <algorithm> // For sort()
+#include <sys/stat.h> // For stat()
+
+#include "ShaderSource.hpp"
+
+namespace {
+
+/* The modification time of a file, 0 if it doesn't exist */
+int64_t modificationTime(const std::string &filename) {
+    struct stat filestat;
+    if(stat(filename.c_str(), &filestat) != 0) return 0;
+    return (int64_t)filestat.st_mtime;
+}
+
+/* The whole file as a string. Returns 0 if it could not be read. */
+int readFile(const std::string &filename, std::string *contents) {
+    FILE *file = fopen(filename.c_str(), "rb");
+    if(file == NULL) return 0;
+    fseek(file, 0, SEEK_END);    // Fast forward to the end
+    long numbytes = ftell(file); // Index of last byte in file
+    fseek(file, 0, SEEK_SET);
+    contents->resize(numbytes > 0 ? (size_t)numbytes : 0);
+    size_t bytesread = numbytes > 0 ? fread(&(*contents)[0], 1, (size_t)numbytes, file) : 0;
+    contents->resize(bytesread);
+    fclose(file);
+    return 1;
+}
+
+/* The directory part of a file name, with the slash at the end */
+std::string directoryOf(const std::string &filename) {
+    size_t slash = filename.find_last_of("/\\");
+    return (slash == std::string::npos) ? std::string() : filename.substr(0, slash + 1);
+}
+
+/*
+ * normalizePath() - the same file name for every way of writing it: "."
+ * parts are left out, "dir/.." parts cancel, and all slashes are "/".
+ * Leading ".." parts stay, and so does a leading "/". Symbolic links
+ * are not followed, so "link/.." is taken to be ".".
+ */
+std::string normalizePath(const std::string &filename) {
+    int absolute = !filename.empty() && (filename[0] == '/' || filename[0] == '\\');
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while(start <= filename.size()) {
+        size_t slash = filename.find_first_of("/\\", start);
+        if(slash == std::string::npos) slash = filename.size();
+        std::string part = filename.substr(start, slash - start);
+        start = slash + 1;
+        if(part.empty() || part == ".") continue;
+        if(part == ".." && !parts.empty() && parts.back() != "..") parts.pop_back();
+        else if(part == ".." && absolute) continue; // Nothing is above the root
+        else parts.push_back(part);
+    }
+    std::string normalized = absolute ? "/" : "";
+    for(size_t p=0; p<parts.size(); p++) {
+        if(p > 0) normalized += '/';
+        normalized += parts[p];
+    }
+    return normalized;
+}
+
+/* The directive on a line, like "include" for "  #  include", or "" if
+ * the line is not a directive */
+std::string directiveOf(const std::string &line, size_t *end) {
+    size_t i = line.find_first_not_of(" \t");
+    if(i == std::string::npos || line[i] != '#') return std::string();
+    i = line.find_first_not_of(" \t", i + 1);
+    if(i == std::string::npos) return std::string();
+    size_t wordend = i;
+    while(wordend < line.size() && (isalnum((unsigned char)line[wordend]) || line[wordend] == '_')) wordend++;
+    *end = wordend;
+    return line.substr(i, wordend - i);
+}
+
+/*
+ * endsInComment() - whether a line leaves a block comment open, given
+ * that it started inside one or not. Line comments hide the rest of it.
+ */
+int endsInComment(const std::string &line, int incomment) {
+    for(size_t i=0; i+1 < line.size(); i++) {
+        if(incomment) {
+            if(line[i] == '*' && line[i+1] == '/') {
+                incomment = 0;
+                i++;
+            }
+        }
+        else if(line[i] == '/' && line[i+1] == '/') {
+            break;
+        }
+        else if(line[i] == '/' && line[i+1] == '*') {
+            incomment = 1;
+            i++;
+        }
+    }
+    return incomment;
+}
+
+std::string lineDirective(int line, int filenumber) {
+    char directive[32];
+    sprintf(directive, "#line %d %d\n", line, filenumber);
+    return directive;
+}
+
+} // namespace
+
+
+/* Constructor: an empty source */
+ShaderSource::ShaderSource() {
+}
+
+
+int ShaderSource::load(const char *filename, const char *defines) {
+    text.clear();
+    files.clear();
+    mtimes.clear();
+    std::string definelines = defineLines(defines);
+    return append(normalizePath(filename), &definelines);
+}
+
+
+int ShaderSource::changed() const {
+    for(size_t f=0; f<files.size(); f++) {
+        int64_t mtime = modificationTime(files[f]);
+        if(mtime == 0 || mtime != mtimes[f]) return 1;
+    }
+    return 0;
+}
+
+
+/*
+ * defineLines() - split the list at spaces, tabs and commas, and sort it,
+ * so that the same defines always give the same source.
+ */
+std::string ShaderSource::defineLines(const char *defines) {
+    std::vector<std::string> names;
+    std::string name;
+    for(const char *c = defines; c != NULL; c++) {
+        if(*c == '\0' || strchr(" \t\r\n,", *c)) {
+            if(!name.empty()) names.push_back(name);
+            name.clear();
+            if(*c == '\0') break;
+        }
+        else {
+            name += *c;
+        }
+    }
+    std::sort(names.begin(), names.end());
+    std::string lines;
+    for(size_t n=0; n<names.size(); n++) {
+        size_t equals = names[n].find('=');
+        if(equals == std::string::npos) lines += "#define " + names[n] + " 1\n";
+        else lines += "#define " + names[n].substr(0, equals) + " " + names[n].substr(equals + 1) + "\n";
+    }
+    return lines;
+}
+
+
+/*
+ * private
+ * append() - copy the file line by line, and replace the #include lines.
+ * An #include of a file that is already in files becomes an empty line.
+ */
+int ShaderSource::append(const std::string &filename, const std::string *defines) {
+
+    int filenumber = (int)files.size();
+    files.push_back(filename);
+    mtimes.push_back(modificationTime(filename));
+
+    std::string contents;
+    if(!readFile(filename, &contents)) {
+        printError("Cannot open shader file", filename.c_str());
+        return 0;
+    }
+
+    size_t start = text.size();
+    int versionfound = 0;
+    int incomment = 0;
+    int linenumber = 0;
+    size_t position = 0;
+    while(position < contents.size()) {
+        size_t lineend = contents.find('\n', position);
+        if(lineend == std::string::npos) lineend = contents.size();
+        std::string line = contents.substr(position, lineend - position);
+        position = lineend + 1;
+        linenumber++;
+        if(!line.empty() && line[line.size()-1] == '\r') line.resize(line.size() - 1);
+
+        size_t end = 0;
+        std::string directive = incomment ? std::string() : directiveOf(line, &end);
+        if(directive == "include") {
+            size_t open = line.find_first_of("\"<", end);
+            size_t close = (open == std::string::npos) ? open
+                : line.find(line[open] == '<' ? '>' : '"', open + 1);
+            if(close == std::string::npos) {
+                char where[32];
+                sprintf(where, ":%d", linenumber);
+                printError("Malformed #include", (filename + where).c_str());
+                return 0;
+            }
+            // Normalized, so that "./a.glsl" and "../dir/a.glsl" are found
+            // to be the same file as "a.glsl"
+            std::string included = normalizePath(directoryOf(filename)
+                + line.substr(open + 1, close - open - 1));
+            if(std::find(files.begin(), files.end(), included) != files.end()) {
+                text += "\n"; // Included before
+                continue;
+            }
+            text += lineDirective(1, (int)files.size());
+            if(!append(included, NULL)) return 0;
+            text += lineDirective(linenumber + 1, filenumber);
+            continue;
+        }
+        text += line;
+        text += "\n";
+        if(directive == "version" && defines && !defines->empty() && !versionfound) {
+            text += *defines;
+            text += lineDirective(linenumber + 1, filenumber);
+            versionfound = 1;
+        }
+        incomment = endsInComment(line, incomment);
+    }
+
+    // Without a #version, the defines go first
+    if(defines && !versionfound && !defines->empty()) {
+        text.insert(start, *defines + lineDirective(1, filenumber));
+    }
+    return 1;
+}
+
+
+/*
+ * private
+ * printError() - Signal an error.
+ * Simple printf() to console for portability.
+ */
+void ShaderSource::printError(const char *errtype, const char *errmsg) {
+  fprintf(stderr, "%s: %s\n", errtype, errmsg);
+}
@@ -0,0 +1,71 @@
+/* ShaderSource.hpp */
+/* The source of a GLSL shader from a file, with #include and injected #defines. */
+/* Usage: call load() with a file name and a list of defines, such as
+ * "NORMAL_OCTAHEDRAL TEXTURED" or "LIGHTS=4", and give the public member
+ * text to glShaderSource(). Shader::beginShader() does this for both of
+ * its files.
+ *
+ * A line
+ *     #include "blocks.glsl"
+ * is replaced by the named file, which is looked for in the directory of
+ * the file with the #include. Each file is included once, even if it is
+ * named again, or named another way, like "./blocks.glsl" or through
+ * "../", so included files need no include guards, and files that
+ * include each other do no harm. This is done before the GLSL compiler
+ * sees the source, so an #include is not affected by #if and #ifdef.
+ *
+ * The defines go right after the #version line, sorted by name, as
+ * "#define NAME VALUE", or "#define NAME 1" for a NAME without a value.
+ * #line directives keep the line numbers in compiler errors right. They
+ * give the number of the file as the source string number, so an error
+ * at 2:14 is on line 14 of files[2].
+ *
+ * files lists the file and everything it included, with their
+ * modification times, so that changed() can tell if the text is out of
+ * date. */
+
+#ifndef SHADERSOURCE_HPP // Avoid including this header twice
+#define SHADERSOURCE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class ShaderSource {
+
+public:
+
+std::string text;               // The source, with the includes and defines
+std::vector<std::string> files; // The file, then the included files in order,
+                                // with paths like "dir/../a.glsl" normalized
+
+/* Constructor: an empty source */
+ShaderSource();
+
+/*
+ * load() - read the file and the files it includes. Returns 1 on success,
+ * or 0 and prints an error if a file could not be read or an #include
+ * could not be understood.
+ */
+int load(const char *filename, const char *defines = NULL);
+
+/* 1 if one of the files has been changed or removed since load() */
+int changed() const;
+
+/* The #define lines for a list of defines, the same for the same defines
+ * in any order */
+static std::string defineLines(const char *defines);
+
+private:
+
+std::vector<int64_t> mtimes;    // Of files, 0 if a file could not be read
+
+/* Add a file to text, with the defines after its #version line if
+ * defines is not NULL */
+int append(const std::string &filename, const std::string *defines);
+
+static void printError(const char *errtype, const char *errmsg);
+
+};
+
+#endif // SHADERSOURCE_HPP
@@ -0,0 +1,86 @@
+/*
+ * Shader programs by files and defines, see ShaderVariants.hpp.
+ */
+
+#include <cstdio>  // For printf()
+
+#include "ShaderVariants.hpp"
+#include "Shader.hpp"
+#include "ShaderBatch.hpp"
+#include "ProgramCache.hpp" // For the hash of the sources
+
+
+/* Constructor: an empty cache */
+ShaderVariants::ShaderVariants() {
+    requests = 0;
+    shared = 0;
+    remade = 0;
+}
+
+
+/* Destructor: delete all the programs */
+ShaderVariants::~ShaderVariants() {
+    for(size_t s=0; s<shaders.size(); s++) {
+        delete shaders[s];
+    }
+}
+
+
+/*
+ * get() - a variant that was asked for before only costs a look at the
+ * modification times of its files. A new one is preprocessed and hashed,
+ * and compiled only if no other variant has the same sources.
+ */
+Shader *ShaderVariants::get(const char *vertexshaderfile, const char *fragmentshaderfile,
+                            const char *defines, ShaderBatch *batch) {
+
+    requests++;
+    std::string name = std::string(vertexshaderfile) + '\n' + fragmentshaderfile + '\n'
+        + ShaderSource::defineLines(defines);
+    std::map<std::string, Variant>::iterator found = variants.find(name);
+    if(found != variants.end()) {
+        if(!found->second.vertex.changed() && !found->second.fragment.changed()) {
+            return found->second.shader;
+        }
+        remade++;
+    }
+
+    Variant variant;
+    int vertexloaded = variant.vertex.load(vertexshaderfile, defines);
+    int fragmentloaded = variant.fragment.load(fragmentshaderfile, defines);
+    int loaded = vertexloaded && fragmentloaded;
+    const char *sources[2] = { variant.vertex.text.c_str(), variant.fragment.text.c_str() };
+    uint64_t key = ProgramCache::key(sources, 2);
+    std::map<uint64_t, Shader*>::iterator program = programs.find(key);
+    if(loaded && program != programs.end()) {
+        variant.shader = program->second;
+        shared++;
+    }
+    else {
+        variant.shader = new Shader();
+        shaders.push_back(variant.shader);
+        // A file that could not be read is given as NULL, so that the
+        // program fails like one from createShader() would
+        const char *vertexsource = vertexloaded ? sources[0] : NULL;
+        const char *fragmentsource = fragmentloaded ? sources[1] : NULL;
+        // With the key, so that the sources are not hashed a second time
+        if(batch) batch->addSource(variant.shader, vertexsource, fragmentsource, key);
+        else variant.shader->beginShaderSource(vertexsource, fragmentsource, key);
+        if(loaded) programs[key] = variant.shader;
+    }
+    variant.vertex.text.clear();   // OpenGL has its own copy
+    variant.fragment.text.clear();
+    variants[name] = variant;
+    return variant.shader;
+}
+
+
+int ShaderVariants::numPrograms() const {
+    return (int)shaders.size();
+}
+
+
+void ShaderVariants::printStats() const {
+    printf("ShaderVariants: %d requests for %d variants, %d programs (%d variants shared one, %d made again)\n",
+        requests, (int)variants.size(), (int)shaders.size(), shared, remade);
+}
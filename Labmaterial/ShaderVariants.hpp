@@ -0,0 +1,84 @@
+/* ShaderVariants.hpp */
+/* A cache of shader programs made from the same files with different defines. */
+/* Usage: instead of a general shader that branches on what each mesh or
+ * material needs, write the choices with #ifdef in the GLSL files, and
+ * get() a program for each set of defines that is used:
+ *     Shader *dinoShader = variants.get("vertex.glsl", "fragment.glsl", "NORMAL_OCTAHEDRAL");
+ *     ...
+ *     dinoShader->finish(); // Before the first use
+ *     GLState::useProgram(dinoShader->programID);
+ * A variant is compiled the first time it is asked for, and the same
+ * Shader is returned after that. Like Shader::beginShader(), get() only
+ * starts the compiling, or adds it to a ShaderBatch, so the program must
+ * be finished before it is used. The ShaderVariants owns its Shaders,
+ * and deletes them when it is destroyed.
+ *
+ * The programs are kept by a hash of their preprocessed sources (see
+ * ShaderSource.hpp), which have the defines in them. Variants whose
+ * defines make no difference, or files that are copies of each other,
+ * share one program. A variant is made again if one of its files, or a
+ * file that they include, has been changed since it was made. The old
+ * Shader stays valid for anyone who still uses it. */
+
+#ifndef SHADERVARIANTS_HPP // Avoid including this header twice
+#define SHADERVARIANTS_HPP
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ShaderSource.hpp"
+
+class Shader;
+class ShaderBatch;
+
+class ShaderVariants {
+
+public:
+
+/* Constructor: an empty cache */
+ShaderVariants();
+
+/* Destructor: delete all the programs */
+~ShaderVariants();
+
+/*
+ * get() - the program for the two files with a list of defines, such as
+ * "NORMAL_OCTAHEDRAL TEXTURED". A new program is added to batch, if it
+ * is not NULL.
+ */
+Shader *get(const char *vertexshaderfile, const char *fragmentshaderfile,
+            const char *defines = NULL, ShaderBatch *batch = NULL);
+
+/* The number of different programs */
+int numPrograms() const;
+
+/* Print the number of requests, programs and reused programs */
+void printStats() const;
+
+private:
+
+/* A set of files and defines, and the sources that were made from them */
+struct Variant {
+    Shader *shader;
+    ShaderSource vertex;   // Only the file list is kept
+    ShaderSource fragment;
+};
+
+std::map<std::string, Variant> variants;  // By file names and define lines
+std::map<uint64_t, Shader*> programs;     // By hash of the sources
+std::vector<Shader*> shaders;             // All of them, to delete
+
+// Statistics
+int requests;
+int shared;   // Variants with the sources of another one
+int remade;   // Variants made again after their files changed
+
+// The Shaders can't be shared, so copying is not allowed
+ShaderVariants(const ShaderVariants &);
+ShaderVariants &operator=(const ShaderVariants &);
+
+};
+
+#endif // SHADERVARIANTS_HPP
@@ -0,0 +1,151 @@
+/*
+ * Tangents in the MikkTSpace conventions, see TangentGenerator.hpp.
+ *  1. every triangle gets its unit tangent and bitangent from the texture
+ *     coordinates, and every corner its angle as a weight,
+ *  2. the corners are sorted by vertex with MeshUtil::sortByRow(),
+ *  3. every vertex sums the weighted tangents of its corners, projected
+ *     onto the plane of its normal.
+ * The rows from step 2 are sorted, so the sums come out the same every
+ * time.
+ */
+
+#include <cmath>     // For sqrt() and atan2()
+#include <vector>
+#include <algorithm> // For min()
+
+#include "TangentGenerator.hpp"
+#include "ThreadPool.hpp"
+#include "MeshUtil.hpp"   // For sortByRow()
+
+namespace {
+
+using MeshUtil::BLOCK;
+using MeshUtil::numBlocks;
+
+/* Scale v to length 1. Returns 0 and leaves v alone if it is too short. */
+inline int normalize(double *v) {
+    double length = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+    if(!(length > 1e-20)) return 0;
+    for(int j=0; j<3; j++) v[j] /= length;
+    return 1;
+}
+
+/* Remove the part of v along the unit vector n */
+inline void project(double *v, const double *n) {
+    double d = v[0]*n[0] + v[1]*n[1] + v[2]*n[2];
+    for(int j=0; j<3; j++) v[j] -= d * n[j];
+}
+
+} // namespace
+
+
+/*
+ * generate() - see the steps at the top of this file.
+ */
+void TangentGenerator::generate(const GLfloat *vertices, int nverts, const GLuint *indices, int ntris,
+                                GLfloat *tangents) {
+
+    ThreadPool &pool = ThreadPool::global();
+    int ncorners = 3*ntris;
+
+    // 1. Unit tangents and bitangents of the triangles (zero where the
+    // texture coordinates don't give any), and corner angles
+    std::vector<float> facetangents(6*(size_t)ntris);
+    std::vector<float> angles(ncorners);
+    pool.parallelFor(numBlocks(ntris), [&](int b) {
+        int end = std::min(ntris, (b+1)*BLOCK);
+        for(int t=b*BLOCK; t<end; t++) {
+            const GLfloat *v[3];
+            for(int k=0; k<3; k++) v[k] = &vertices[8*(size_t)indices[3*(size_t)t+k]];
+            double e1[3], e2[3];
+            for(int j=0; j<3; j++) {
+                e1[j] = v[1][j] - v[0][j];
+                e2[j] = v[2][j] - v[0][j];
+            }
+            double s1 = v[1][6] - v[0][6], t1 = v[1][7] - v[0][7];
+            double s2 = v[2][6] - v[0][6], t2 = v[2][7] - v[0][7];
+            double det = s1*t2 - s2*t1;
+            double tangent[3], bitangent[3];
+            for(int j=0; j<3; j++) { // Solve e = s * tangent + t * bitangent for both edges
+                tangent[j] = t2*e1[j] - t1*e2[j];
+                bitangent[j] = s1*e2[j] - s2*e1[j];
+                if(det < 0.0) { // Only the directions matter
+                    tangent[j] = -tangent[j];
+                    bitangent[j] = -bitangent[j];
+                }
+            }
+            if(det == 0.0 || !normalize(tangent) || !normalize(bitangent)) {
+                for(int j=0; j<3; j++) tangent[j] = bitangent[j] = 0.0;
+            }
+            for(int j=0; j<3; j++) {
+                facetangents[6*(size_t)t+j] = (float)tangent[j];
+                facetangents[6*(size_t)t+3+j] = (float)bitangent[j];
+            }
+            for(int k=0; k<3; k++) {
+                // The angle between the two edges that meet at corner k
+                double a[3], c[3];
+                for(int j=0; j<3; j++) {
+                    a[j] = v[(k+1)%3][j] - v[k][j];
+                    c[j] = v[(k+2)%3][j] - v[k][j];
+                }
+                double cross[3] = { a[1]*c[2] - a[2]*c[1], a[2]*c[0] - a[0]*c[2], a[0]*c[1] - a[1]*c[0] };
+                double sine = sqrt(cross[0]*cross[0] + cross[1]*cross[1] + cross[2]*cross[2]);
+                angles[3*(size_t)t+k] = (float)atan2(sine, a[0]*c[0] + a[1]*c[1] + a[2]*c[2]);
+            }
+        }
+    });
+
+    // 2. The corners sorted by vertex, in compressed rows: the corners of
+    // vertex i are sorted[first[i]] to sorted[first[i+1]-1]
+    std::vector<int> first, sorted;
+    MeshUtil::sortByRow(indices, ncorners, nverts, first, sorted);
+
+    // 3. The weighted sums, per vertex
+    pool.parallelFor(numBlocks(nverts), [&](int b) {
+        int end = std::min(nverts, (b+1)*BLOCK);
+        for(int i=b*BLOCK; i<end; i++) {
+            int *row = sorted.empty() ? NULL : &sorted[0] + first[i];
+            int count = first[i+1] - first[i];
+            const GLfloat *vertex = &vertices[8*(size_t)i];
+            double normal[3] = { vertex[3], vertex[4], vertex[5] };
+            if(!normalize(normal)) {
+                normal[0] = normal[1] = 0.0;
+                normal[2] = 1.0;
+            }
+            double tangent[3] = { 0.0, 0.0, 0.0 }, bitangent[3] = { 0.0, 0.0, 0.0 };
+            for(int o=0; o<count; o++) {
+                const float *face = &facetangents[6*(size_t)(row[o]/3)];
+                double t[3] = { face[0], face[1], face[2] };
+                double s[3] = { face[3], face[4], face[5] };
+                project(t, normal);
+                project(s, normal);
+                float weight = angles[row[o]];
+                if(normalize(t)) {
+                    for(int j=0; j<3; j++) tangent[j] += weight * t[j];
+                }
+                if(normalize(s)) {
+                    for(int j=0; j<3; j++) bitangent[j] += weight * s[j];
+                }
+            }
+            project(tangent, normal); // Still in the plane, but not quite after rounding
+            if(!normalize(tangent)) {
+                // No texture mapping here. Any tangent will do, take the
+                // coordinate axis that is farthest from the normal.
+                int axis = (fabs(normal[0]) < fabs(normal[1])) ? 0 : 1;
+                if(fabs(normal[2]) < fabs(normal[axis])) axis = 2;
+                for(int j=0; j<3; j++) tangent[j] = (j == axis) ? 1.0 : 0.0;
+                project(tangent, normal);
+                normalize(tangent);
+            }
+            // Which side of the normal the bitangent is on: mirrored
+            // texture coordinates have the bitangent on the other side
+            double cross[3] = { normal[1]*tangent[2] - normal[2]*tangent[1],
+                                normal[2]*tangent[0] - normal[0]*tangent[2],
+                                normal[0]*tangent[1] - normal[1]*tangent[0] };
+            double side = cross[0]*bitangent[0] + cross[1]*bitangent[1] + cross[2]*bitangent[2];
+            GLfloat *out = &tangents[4*(size_t)i];
+            for(int j=0; j<3; j++) out[j] = (GLfloat)tangent[j];
+            out[3] = (side < 0.0) ? -1.0f : 1.0f;
+        }
+    });
+}
@@ -0,0 +1,46 @@
+/* TangentGenerator.hpp */
+/* Tangent vectors for normal mapping of triangle meshes. */
+/* Usage: call generate() with a mesh in the interleaved TriangleSoup
+ * format (x y z nx ny nz s t) and its index array. It writes 4 floats per
+ * vertex: the tangent (x y z), which points along increasing s, and the
+ * sign of the bitangent (w, 1 or -1). The shader rebuilds the bitangent
+ * as w * cross(normal, tangent). TriangleSoup does this with the option
+ * GENERATE_TANGENTS and sends the tangents as attribute 3, see
+ * vertex_normalmap.glsl.
+ *
+ * The conventions are those of MikkTSpace, which most tools use when they
+ * bake normal maps: each triangle's tangent and bitangent are projected
+ * onto the plane of the vertex normal, normalized, and summed with the
+ * triangle's angle at the vertex as the weight. The bitangent is not
+ * stored, only which side of the normal it ends up on. Unlike MikkTSpace,
+ * vertices are never split, so a vertex shared by triangles with mirrored
+ * texture coordinates gets one average tangent. Mirrored parts of a
+ * texture normally have their own vertices along the seam anyway.
+ *
+ * The triangles are handled in parallel, and each vertex then sums up its
+ * own triangles, also in parallel on the global ThreadPool. The result
+ * does not depend on the number of threads. */
+
+#ifndef TANGENTGENERATOR_HPP // Avoid including this header twice
+#define TANGENTGENERATOR_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+
+namespace TangentGenerator {
+
+/*
+ * generate() - tangents for nverts vertices (8 floats each) used by the
+ * ntris triangles in indices. tangents gets 4 floats per vertex. Vertices
+ * without usable texture coordinates get a tangent at a right angle to
+ * their normal, and a sign of 1.
+ */
+void generate(const GLfloat *vertices, int nverts, const GLuint *indices, int ntris,
+              GLfloat *tangents);
+
+}
+
+#endif // TANGENTGENERATOR_HPP
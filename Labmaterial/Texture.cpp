@@ -1,4 +1,5 @@
 #include "Texture.hpp"
+#include "GLState.hpp" // Binds that skip what is already bound
 
 /* Constructor */
 Texture::Texture() {
@@ -12,11 +13,18 @@ Texture::Texture() {
 
 /* Constructor to load and intialize the texture all at once */
 Texture::Texture(const char *filename) {
+    width = 0;
+    height = 0;
+    textureID = 0;
+    type = 0;
+    imageData = NULL;
+    bpp = 0;
     createTexture(filename);
 }
 
 /* Destructor */
 Texture::~Texture() {
+    delete[] imageData; // Only if the image was loaded but never uploaded
 }
 
 
@@ -86,6 +94,7 @@ int Texture::loadUncompressedTGA(FILE *TGAfile) // Load an uncompressed TGA
 		if(this->imageData != NULL)										// If image data was allocated
 		{
 			delete[] this->imageData;										// Deallocate that data
+			this->imageData = NULL;
 		}
 		fclose(TGAfile);														// Close file
 		return GL_FALSE;													// Return "failure"
@@ -136,7 +145,7 @@ int Texture::loadTGA(const char *filename)
 
 	if(memcmp(uTGAcompare, &tgaheader, sizeof(tgaheader)) == 0)	// See if header matches the predefined header of
 	{															// an Uncompressed TGA image
-		this->loadUncompressedTGA(TGAfile);		                // If so, jump to Uncompressed TGA loading code
+		return this->loadUncompressedTGA(TGAfile);	            // If so, jump to Uncompressed TGA loading code
 	}
 	else if(memcmp(cTGAcompare, &tgaheader, sizeof(tgaheader)) == 0) // See if header matches the predefined header of
 	{																 // an RLE compressed TGA image
@@ -158,11 +167,20 @@ int Texture::loadTGA(const char *filename)
  */
 void Texture::createTexture(const char *filename) {
 
-    this->loadTGA(filename); // Private method, reads this->imageData from TGA file
+    if(this->loadTGA(filename)) { // Reads this->imageData from TGA file
+        this->upload();
+    }
+}
+
+/*
+ * Create the texture object from this->imageData. This is the only part
+ * of createTexture() that needs an OpenGL context.
+ */
+void Texture::upload() {
 
 	glEnable(GL_TEXTURE_2D); // Required for glBuildMipmap() to work (!)
 	glGenTextures(1, &(this->textureID));     // Create The texture ID
-    glBindTexture ( GL_TEXTURE_2D , this->textureID );
+    GLState::bindTexture ( GL_TEXTURE_2D , this->textureID );
     // Set parameters to determine how the texture is resized
     glTexParameteri ( GL_TEXTURE_2D , GL_TEXTURE_MIN_FILTER , GL_LINEAR_MIPMAP_LINEAR );
     glTexParameteri ( GL_TEXTURE_2D , GL_TEXTURE_MAG_FILTER , GL_LINEAR );
@@ -175,4 +193,5 @@ void Texture::createTexture(const char *filename) {
 	glGenerateMipmap(GL_TEXTURE_2D);
 
 	delete[] this->imageData; // Image data was copied to the GPU, so we can delete it
+	this->imageData = NULL;
 }
@@ -3,7 +3,10 @@
 /* Modified, stripped-down and cleaned-up version of TGA loader from NeHe tutorial 33. */
 /* Usage: Call createTexture() with a TGA file as argument to load a texture,
  * or use the constructor with a file name argument. Uncompressed RGB or RGBA only.
- * Call glBindTexture() with the public member textureID as argument. */
+ * createTexture() can also be done in two steps: loadTGA() reads the image
+ * without any OpenGL calls (for example on a background thread, see
+ * AsyncLoader), and upload() then creates the texture object.
+ * Call GLState::bindTexture() with the public member textureID as argument. */
 /* Stefan Gustavson (stefan.gustavson@liu.se 2014-02-28 */
 
 #ifndef TEXTURE_HPP
@@ -50,11 +53,14 @@ Texture(const char *filename);
 // The external entry point for loading a texture from a TGA file
 void createTexture(const char *filename); // Load GL texture from file
 
+// The two halves of createTexture()
+int loadTGA(const char *filename);		    // Open, check and load a TGA file
+void upload();                              // Create the GL texture from the loaded image
+
 private:
 
-// Internal "private" funtions, called internally by createTexture()
+// Internal "private" funtion, called internally by loadTGA()
 int loadUncompressedTGA(FILE *tgafile); // Load data from an uncompressed TGA file
-int loadTGA(const char *filename);		    // Open, check and load a TGA file
 
 };
 
@@ -0,0 +1,134 @@
+/*
+ * A minimal thread pool for data parallel loops.
+ * Worker threads sleep on a condition variable between jobs and
+ * grab task numbers from a shared atomic counter while a job runs,
+ * which balances the load when tasks take different amounts of time.
+ */
+
+#include "ThreadPool.hpp"
+
+namespace {
+ThreadPool *globalpool = NULL;
+int globalthreads = 0;
+std::mutex globalmutex;
+}
+
+
+/* Constructor: start a pool with numthreads threads in total */
+ThreadPool::ThreadPool(int numthreads) {
+
+    job = NULL;
+    jobcount = 0;
+    nexttask = 0;
+    generation = 0;
+    busyworkers = 0;
+    stopping = false;
+
+    if(numthreads <= 0) {
+        numthreads = (int)std::thread::hardware_concurrency();
+        if(numthreads <= 0) numthreads = 1; // The count is not always known
+    }
+    // The calling thread also works, so start one thread less
+    for(int i=1; i<numthreads; i++) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+
+/* Destructor: stop and join all worker threads */
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for(size_t i=0; i<workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+
+/* The number of threads that work on a parallelFor(), including the caller */
+int ThreadPool::size() const {
+    return (int)workers.size() + 1;
+}
+
+
+/*
+ * parallelFor() - run task(0) ... task(count-1) on all threads and wait.
+ */
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &task) {
+
+    if(count <= 0) return;
+    if(workers.empty() || count == 1) { // Nothing to gain from waking anyone up
+        for(int i=0; i<count; i++) task(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> calllock(callmutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &task;
+        jobcount = count;
+        nexttask = 0;
+        busyworkers = (int)workers.size();
+        generation++;
+    }
+    wakeup.notify_all();
+
+    runTasks(); // Help out instead of just waiting
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while(busyworkers > 0) finished.wait(lock);
+    job = NULL;
+}
+
+
+/* Hand out task numbers until there are none left */
+void ThreadPool::runTasks() {
+    int i;
+    while((i = nexttask++) < jobcount) {
+        (*job)(i);
+    }
+}
+
+
+/* The main function of each worker thread: wait for a job, work, repeat */
+void ThreadPool::workerLoop() {
+
+    int seengeneration = 0;
+
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(!stopping && generation == seengeneration) wakeup.wait(lock);
+            if(stopping) return;
+            seengeneration = generation;
+        }
+        runTasks();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyworkers--;
+        }
+        finished.notify_one();
+    }
+}
+
+
+/* The shared pool for the whole program, created on first use */
+ThreadPool &ThreadPool::global() {
+    std::lock_guard<std::mutex> lock(globalmutex);
+    if(!globalpool) globalpool = new ThreadPool(globalthreads);
+    return *globalpool;
+}
+
+
+/* Set the size of the global pool (0 for automatic) */
+void ThreadPool::setGlobalThreads(int numthreads) {
+    std::lock_guard<std::mutex> lock(globalmutex);
+    globalthreads = numthreads;
+    if(globalpool) {
+        delete globalpool;
+        globalpool = NULL;
+    }
+}
@@ -0,0 +1,74 @@
+/* ThreadPool.hpp */
+/* A small pool of worker threads for data parallel loops. */
+/* Usage: call parallelFor() with a number of tasks and a function
+ * that performs task number i. The tasks are handed out to the worker
+ * threads and to the calling thread, and parallelFor() returns when
+ * all of them are done. Use ThreadPool::global() to share one pool
+ * between all parts of the program instead of creating new threads.
+ * The size of the global pool can be set with setGlobalThreads()
+ * (the --threads command line option), and defaults to the number
+ * of hardware threads. */
+
+#ifndef THREADPOOL_HPP // Avoid including this header twice
+#define THREADPOOL_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+class ThreadPool {
+
+public:
+
+/* Constructor: start a pool with numthreads threads in total,
+ * including the calling thread. 0 means one per hardware thread. */
+ThreadPool(int numthreads = 0);
+
+/* Destructor: stop and join all worker threads */
+~ThreadPool();
+
+/* The number of threads that work on a parallelFor(), including the caller */
+int size() const;
+
+/*
+ * parallelFor() - run task(0), task(1) ... task(count-1) on all threads
+ * and wait for them to finish. The order of execution is undefined, so
+ * the tasks must be independent. Calls from several threads at once
+ * are serialized. Do not call parallelFor() from inside a task.
+ */
+void parallelFor(int count, const std::function<void(int)> &task);
+
+/* The shared pool for the whole program */
+static ThreadPool &global();
+
+/* Set the size of the global pool (0 for automatic). This restarts the
+ * pool, so it should be done at startup, before anything uses it. */
+static void setGlobalThreads(int numthreads);
+
+private:
+
+std::vector<std::thread> workers;
+std::mutex mutex;                 // Protects the job description below
+std::mutex callmutex;             // Serializes calls to parallelFor()
+std::condition_variable wakeup;   // Signals workers that a job has started
+std::condition_variable finished; // Signals the caller that workers are done
+const std::function<void(int)> *job; // The current task function
+int jobcount;                     // Number of tasks in the current job
+std::atomic<int> nexttask;        // Next task number to hand out
+int generation;                   // Incremented for every new job
+int busyworkers;                  // Workers still working on the current job
+bool stopping;                    // Set by the destructor
+
+void workerLoop();
+void runTasks();
+
+// Threads can't be copied, so neither can the pool
+ThreadPool(const ThreadPool &);
+ThreadPool &operator=(const ThreadPool &);
+
+};
+
+#endif // THREADPOOL_HPP
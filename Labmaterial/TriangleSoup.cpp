@@ -1,20 +1,45 @@
-#include <cstdio>  // For C-style file input in readOBJ()
-#include <cmath>   // For sin() and cos() in soupCreateSphere()
-#include <cstring> // For strcmp() - a leftover from the C version
-
+#include <cstdio>  // For printf() in print() and printInfo()
+#include <cmath>   // For sin() and cos() in soupCreateSphere()
+#include <cstring> // For memset()
+
 #include "TriangleSoup.hpp"
+#include "OBJLoader.hpp"  // The file parser used by readOBJ()
+#include "MeshCache.hpp"  // The binary cache used by readOBJ()
+#include "MeshOptimizer.hpp" // Cache optimization for the OPTIMIZE_MESH option
+#include "MeshSimplifier.hpp" // Levels of detail for createLODs()
+#include "Bounds.hpp"      // Bounding volumes for computeBounds()
+#include "MeshBVH.hpp"     // Ray picking for pick()
+#include "TangentGenerator.hpp" // Tangents for generateTangents()
+#include "GeometryArena.hpp" // Shared buffers for the USE_GEOMETRY_ARENA option
+#include "GLState.hpp"       // Binds that skip what is already bound
 
 #include "Utilities.hpp"  // To be able to use OpenGL extensions
 
+/* Half, a quarter, an eighth and a sixteenth of the triangles */
+const float TriangleSoup::DEFAULT_LOD_RATIOS[TriangleSoup::DEFAULT_NUM_LODS] = { 0.5f, 0.25f, 0.12f, 0.06f };
+
 /* Constructor: initialize a TriangleSoup object to all zeros */
 TriangleSoup::TriangleSoup() {
 	vao = 0;
 	vertexbuffer = 0;
 	indexbuffer = 0;
+	tangentbuffer = 0;
+	instancebuffer = 0;
+	instancecapacity = 0;
+	arena = NULL;
 	vertexarray = NULL;
+	packedarray = NULL;
 	indexarray = NULL;
+	shortindexarray = NULL;
+	tangentarray = NULL;
 	nverts = 0;
 	ntris = 0;
+	options = 0;
+	cache = NULL;
+	indextype = GL_UNSIGNED_INT;
+	boundradius = -1.0f;
+	bvh = NULL;
+	memset(&retired, 0, sizeof(retired));
 }
 
 
@@ -25,37 +50,124 @@ TriangleSoup::~TriangleSoup() {
 
 
 void TriangleSoup::clean() {
+	retireBuffers();
+	releaseRetired();
+	cleanArrays();
+}
 
-	if(glIsVertexArray(vao)) {
-		glDeleteVertexArrays(1, &vao);
-	}
-	vao = 0;
 
-	if(glIsBuffer(vertexbuffer)) {
-		glDeleteBuffers(1, &vertexbuffer);
+/*
+ * private
+ * retireBuffers() - take the OpenGL objects off the mesh without any
+ * OpenGL calls, so that loadOBJ() can clean a mesh on a thread without
+ * the context. releaseRetired() deletes them later. createBuffers()
+ * calls it before it makes new ones, so only one set is ever waiting.
+ */
+void TriangleSoup::retireBuffers() {
+	if(!vao && !vertexbuffer && !indexbuffer && !tangentbuffer && !instancebuffer && !arena) {
+		return; // Nothing to take, and the waiting set, if any, stays
 	}
+	retired.vao = arena ? 0 : vao; // The VAO of an arena belongs to the arena
+	retired.vertexbuffer = vertexbuffer;
+	retired.indexbuffer = indexbuffer;
+	retired.tangentbuffer = tangentbuffer;
+	retired.instancebuffer = instancebuffer;
+	retired.arena = arena;
+	retired.arenarange = arenarange;
+	vao = 0;
 	vertexbuffer = 0;
+	indexbuffer = 0;
+	tangentbuffer = 0;
+	instancebuffer = 0;
+	instancecapacity = 0;
+	arena = NULL;
+}
+
 
-	if(glIsBuffer(indexbuffer)) {
-		glDeleteBuffers(1, &indexbuffer);
+/*
+ * private
+ * releaseRetired() - delete what retireBuffers() took off, and give the
+ * room in the arena back. Makes no OpenGL calls if nothing is waiting.
+ */
+void TriangleSoup::releaseRetired() {
+	if(retired.arena) {
+		retired.arena->release(retired.arenarange);
 	}
-	indexbuffer = 0;
+	if(retired.vao && glIsVertexArray(retired.vao)) {
+		GLState::deleteVertexArray(retired.vao);
+	}
+	GLuint buffers[4] = { retired.vertexbuffer, retired.indexbuffer,
+		retired.tangentbuffer, retired.instancebuffer };
+	for(int b=0; b<4; b++) {
+		if(buffers[b] && glIsBuffer(buffers[b])) {
+			GLState::deleteBuffer(buffers[b]);
+		}
+	}
+	memset(&retired, 0, sizeof(retired));
+}
 
+
+/*
+ * private
+ * cleanArrays() - delete the mesh data in memory. No OpenGL calls.
+ */
+void TriangleSoup::cleanArrays() {
+
+	if(cache) { // The arrays that point into the mapped cache file are not deleted
+		if(cache->contains(vertexarray)) vertexarray = NULL;
+		if(cache->contains(packedarray)) packedarray = NULL;
+		if(cache->contains(indexarray)) indexarray = NULL;
+		if(cache->contains(shortindexarray)) shortindexarray = NULL;
+		delete cache;
+		cache = NULL;
+	}
 	if(vertexarray) {
 		delete[] vertexarray;
 		vertexarray = NULL;
 	}
+	delete[] packedarray;
+	packedarray = NULL;
 	if(indexarray) 	{
 		delete[] indexarray;
 		indexarray = NULL;
 	}
+	delete[] shortindexarray;
+	shortindexarray = NULL;
+	delete[] tangentarray; // Never in the cache file
+	tangentarray = NULL;
 	nverts = 0;
 	ntris = 0;
+	indextype = GL_UNSIGNED_INT;
+	clusters.clear();
+	lods.clear();
+	boundradius = -1.0f;
+	delete bvh;
+	bvh = NULL;
+}
+
+
+/* Set the flags (from enum Options) for how the next mesh is built */
+void TriangleSoup::setOptions(int flags) {
+	options = flags;
+}
+
+
+/* Choose the vertex format for the GPU copy of the next mesh */
+void TriangleSoup::setVertexFormat(int positiontype, int normaltype, int texcoordtype) {
+	if(packedarray) { // Packed in the old format, so pack it again later
+		unpackVertices();
+		if(!cache || !cache->contains(packedarray)) delete[] packedarray;
+		packedarray = NULL;
+	}
+	format.set(positiontype, normaltype, texcoordtype);
 }
 
 
 /* Create a demo object with a single triangle */
 void TriangleSoup::createTriangle() {
+    // Delete any previous content in the TriangleSoup object
+    clean();
+
     // Constant data arrays for this simple test.
     // Note, however, that they need to be copied to dynamic arrays
     // in the class. These local variables are not persistent.
@@ -82,168 +194,129 @@ void TriangleSoup::createTriangle() {
     nverts = 3;
     ntris = 1;
 
-	// Generate one vertex array object (VAO) and bind it
-	glGenVertexArrays(1, &(vao));
-	glBindVertexArray(vao);
-
-	// Generate two buffer IDs
-	glGenBuffers(1, &vertexbuffer);
-	glGenBuffers(1, &indexbuffer);
-
- 	// Activate the vertex buffer
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
- 	// Present our vertex coordinates to OpenGL
-	glBufferData(GL_ARRAY_BUFFER,
-		8*nverts * sizeof(GLfloat), vertexarray, GL_STATIC_DRAW);
-	// Specify how many attribute arrays we have in our VAO
-	glEnableVertexAttribArray(0); // Vertex coordinates
-	glEnableVertexAttribArray(1); // Normals
-	glEnableVertexAttribArray(2); // Texture coordinates
-	// Specify how OpenGL should interpret the vertex buffer data:
-	// Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-	// Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-	// Type GL_FLOAT
-	// Not normalized (GL_FALSE)
-	// Stride 8 floats (interleaved array with 8 floats per vertex)
-	// Array buffer offset 0, 3 or 6 floats (offset into first vertex)
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)0); // xyz coordinates
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)(3*sizeof(GLfloat))); // normals
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)(6*sizeof(GLfloat))); // texcoords
-
- 	// Activate the index buffer
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
- 	// Present our vertex indices to OpenGL
- 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-	 	3*ntris*sizeof(GLuint), indexarray, GL_STATIC_DRAW);
-
-	// Deactivate (unbind) the VAO and the buffers again.
-	// Do NOT unbind the index buffer while the VAO is still bound.
-	// The index buffer is an essential part of the VAO state.
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	createBuffers();
 };
 
 
 /* Create a simple box geometry */
-void TriangleSoup::createBox(float xsize, float ysize, float zsize) {
-
-	float x = xsize/2;
-	float y = ysize/2;
-	float z = zsize/2;
-	/*
-
-    const GLfloat vertex_array_data[] = {
-         x, y, z,     0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //vertex 1,0   Top
-         x, y, z,     1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //vertex 1,1   Right
-         x, y, z,     0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //vertex 1,2   Front
-
-         x, -y, z,    0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //vertex 2,3   Bottom
-         x, -y, z,    1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //vertex 2,4   Right
-         x, -y, z,    0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //vertex 2,5   Front
-
-         -x, -y, z,   0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //vertex 3,6   Bottom
-         -x, -y, z,   -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //vertex 3,7   Left
-         -x, -y, z,   0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //vertex 3,8   Front
-
-         -x, y, z,    0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //vertex 4,9   Top
-         -x, y, z,    -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //vertex 4,10  Left
-         -x, y, z,    0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //vertex 4,11  Front
-
-         x, y, -z,    0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //vertex 5,12  Top
-         x, y, -z,    1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //vertex 5,13  Right
-         x, y, -z,    0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //vertex 5,14  Back
-
-         x, -y, -z,   0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //vertex 6,15  Bottom
-         x, -y, -z,   1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //vertex 6,16  Right
-         x, -y, -z,   0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //vertex 6,17  Back
-
-         -x, -y, -z,  0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //vertex 7,18  Bottom
-         -x, -y, -z,  -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //vertex 7,19  Left
-         -x, -y, -z,  0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //vertex 7,20  Back
-
-         -x, y, -z,   0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //vertex 8,21  Top
-         -x, y, -z,   -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //vertex 8,22  Left
-         -x, y, -z,   0.0f, 0.0f, -1.0f,    0.0f, 0.0f   //vertex 8,23  Back
-    };
-
-    const GLuint index_array_data[] = {
-        //Front (4 3 2 1)
-        2, 11, 5,    5, 11, 8,
-
-        //Top (8 4 1 5)
-        12, 21, 0,    0, 21, 9,
-
-        //Back (5 6 7 8)
-        23, 14, 17,    17, 20, 23,
-
-        //Bottom (6 2 3 7)
-        3, 6, 18,    18, 15, 3,
-
-        //Right (1 2 6 5)
-        16, 13, 4,    4, 13, 1,
-
-        //Left  (4, 8, 7, 3)
-        19, 7, 10,   10, 22, 19
-    };
-    */
-
-    const GLfloat vertex_array_data[] = {
-        x, y, z,     0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //Front 0
-        -x, y, z,    0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //Front 1
-        x, -y, z,    0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //Front 2
-        -x, -y, z,   0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //Front 3
-
-        x, y, -z,    0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //Top 4
-        -x, y, -z,   0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //Top 5
-        x, y, z,     0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //Top 6
-        -x, y, z,    0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //Top 7
-
-        -x, y, -z,   0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //Back 8
-        x, y, -z,    0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //Back 9
-        x, -y, -z,   0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //Back 10
-        -x, -y, -z,  0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //Back 11
-
-        x, -y, z,    0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //Bottom 12
-        -x, -y, z,   0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //Bottom 13
-        -x, -y, -z,  0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //Bottom 14
-        x, -y, -z,   0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //Bottom 15
-
-        x, -y, -z,   1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //Right 16
-        x, y, -z,    1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //Right 17
-        x, -y, z,    1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //Right 18
-        x, y, z,     1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //Right 19
-
-        -x, -y, -z,  -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //Left 20
-        -x, -y, z,   -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //Left 21
-        -x, y, z,    -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //Left 22
-        -x, y, -z,   -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //Left 23
-
-    };
-
-    const GLuint index_array_data[] = {
-        //Front (4 3 2 1)
-        0, 1, 2,    2, 1, 3,
-
-        //Top (8 4 1 5)
-        4, 5, 6,     6, 5, 7,
-
-        //Back (5 6 7 8)
-        8, 9, 10,      10, 11, 8,
-
-        //Bottom (6 2 3 7)
-        12, 13, 14,  14, 15, 12,
-
-        //Right (1 2 6 5)
-        16, 17, 18,     18, 17, 19,
-
-        //Left  (4, 8, 7, 3)
-        20, 21, 22,  22, 23, 20
-    };
-
+void TriangleSoup::createBox(float xsize, float ysize, float zsize) {
+
+	// Delete any previous content in the TriangleSoup object
+	clean();
+
+	float x = xsize/2;
+	float y = ysize/2;
+	float z = zsize/2;
+	/*
+
+    const GLfloat vertex_array_data[] = {
+         x, y, z,     0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //vertex 1,0   Top
+         x, y, z,     1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //vertex 1,1   Right
+         x, y, z,     0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //vertex 1,2   Front
+
+         x, -y, z,    0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //vertex 2,3   Bottom
+         x, -y, z,    1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //vertex 2,4   Right
+         x, -y, z,    0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //vertex 2,5   Front
+
+         -x, -y, z,   0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //vertex 3,6   Bottom
+         -x, -y, z,   -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //vertex 3,7   Left
+         -x, -y, z,   0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //vertex 3,8   Front
+
+         -x, y, z,    0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //vertex 4,9   Top
+         -x, y, z,    -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //vertex 4,10  Left
+         -x, y, z,    0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //vertex 4,11  Front
+
+         x, y, -z,    0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //vertex 5,12  Top
+         x, y, -z,    1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //vertex 5,13  Right
+         x, y, -z,    0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //vertex 5,14  Back
+
+         x, -y, -z,   0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //vertex 6,15  Bottom
+         x, -y, -z,   1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //vertex 6,16  Right
+         x, -y, -z,   0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //vertex 6,17  Back
+
+         -x, -y, -z,  0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //vertex 7,18  Bottom
+         -x, -y, -z,  -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //vertex 7,19  Left
+         -x, -y, -z,  0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //vertex 7,20  Back
+
+         -x, y, -z,   0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //vertex 8,21  Top
+         -x, y, -z,   -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //vertex 8,22  Left
+         -x, y, -z,   0.0f, 0.0f, -1.0f,    0.0f, 0.0f   //vertex 8,23  Back
+    };
+
+    const GLuint index_array_data[] = {
+        //Front (4 3 2 1)
+        2, 11, 5,    5, 11, 8,
+
+        //Top (8 4 1 5)
+        12, 21, 0,    0, 21, 9,
+
+        //Back (5 6 7 8)
+        23, 14, 17,    17, 20, 23,
+
+        //Bottom (6 2 3 7)
+        3, 6, 18,    18, 15, 3,
+
+        //Right (1 2 6 5)
+        16, 13, 4,    4, 13, 1,
+
+        //Left  (4, 8, 7, 3)
+        19, 7, 10,   10, 22, 19
+    };
+    */
+
+    const GLfloat vertex_array_data[] = {
+        x, y, z,     0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //Front 0
+        -x, y, z,    0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //Front 1
+        x, -y, z,    0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //Front 2
+        -x, -y, z,   0.0f, 0.0f, 1.0f,     0.0f, 0.0f,  //Front 3
+
+        x, y, -z,    0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //Top 4
+        -x, y, -z,   0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //Top 5
+        x, y, z,     0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //Top 6
+        -x, y, z,    0.0f, 1.0f, 0.0f,     0.0f, 0.0f,  //Top 7
+
+        -x, y, -z,   0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //Back 8
+        x, y, -z,    0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //Back 9
+        x, -y, -z,   0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //Back 10
+        -x, -y, -z,  0.0f, 0.0f, -1.0f,    0.0f, 0.0f,  //Back 11
+
+        x, -y, z,    0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //Bottom 12
+        -x, -y, z,   0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //Bottom 13
+        -x, -y, -z,  0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //Bottom 14
+        x, -y, -z,   0.0f, -1.0f, 0.0f,    0.0f, 0.0f,  //Bottom 15
+
+        x, -y, -z,   1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //Right 16
+        x, y, -z,    1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //Right 17
+        x, -y, z,    1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //Right 18
+        x, y, z,     1.0f, 0.0f, 0.0f,     0.0f, 0.0f,  //Right 19
+
+        -x, -y, -z,  -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //Left 20
+        -x, -y, z,   -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //Left 21
+        -x, y, z,    -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //Left 22
+        -x, y, -z,   -1.0f, 0.0f, 0.0f,    0.0f, 0.0f,  //Left 23
+
+    };
+
+    const GLuint index_array_data[] = {
+        //Front (4 3 2 1)
+        0, 1, 2,    2, 1, 3,
+
+        //Top (8 4 1 5)
+        4, 5, 6,     6, 5, 7,
+
+        //Back (5 6 7 8)
+        8, 9, 10,      10, 11, 8,
+
+        //Bottom (6 2 3 7)
+        12, 13, 14,  14, 15, 12,
+
+        //Right (1 2 6 5)
+        16, 17, 18,     18, 17, 19,
+
+        //Left  (4, 8, 7, 3)
+        20, 21, 22,  22, 23, 20
+    };
+
     nverts = 24;
     ntris = 12;
 
@@ -256,49 +329,11 @@ void TriangleSoup::createBox(float xsize, float ysize, float zsize) {
         indexarray[i]=index_array_data[i];
     }
 
-	// Generate one vertex array object (VAO) and bind it
-	glGenVertexArrays(1, &(vao));
-	glBindVertexArray(vao);
-
-	// Generate two buffer IDs
-	glGenBuffers(1, &vertexbuffer);
-	glGenBuffers(1, &indexbuffer);
-
- 	// Activate the vertex buffer
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
- 	// Present our vertex coordinates to OpenGL
-	glBufferData(GL_ARRAY_BUFFER,
-		24*nverts * sizeof(GLfloat), vertexarray, GL_STATIC_DRAW);
-	// Specify how many attribute arrays we have in our VAO
-	glEnableVertexAttribArray(0); // Vertex coordinates
-	glEnableVertexAttribArray(1); // Normals
-	glEnableVertexAttribArray(2); // Texture coordinates
-	// Specify how OpenGL should interpret the vertex buffer data:
-	// Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-	// Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-	// Type GL_FLOAT
-	// Not normalized (GL_FALSE)
-	// Stride 8 floats (interleaved array with 8 floats per vertex)
-	// Array buffer offset 0, 3 or 6 floats (offset into first vertex)
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)0); // xyz coordinates
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)(3*sizeof(GLfloat))); // normals
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)(6*sizeof(GLfloat))); // texcoords
-
- 	// Activate the index buffer
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
- 	// Present our vertex indices to OpenGL
- 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-	 	3*ntris*sizeof(GLuint), indexarray, GL_STATIC_DRAW);
-
-	// Deactivate (unbind) the VAO and the buffers again.
-	// Do NOT unbind the index buffer while the VAO is still bound.
-	// The index buffer is an essential part of the VAO state.
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	if(options & OPTIMIZE_MESH) {
+		optimize();
+	}
+
+	createBuffers();
 };
 
 /*
@@ -410,49 +445,11 @@ void TriangleSoup::createSphere(float radius, int segments) {
 		indexarray[base+3*i+2] = nverts-3-i;
 	}
 
-	// Generate one vertex array object (VAO) and bind it
-	glGenVertexArrays(1, &(vao));
-	glBindVertexArray(vao);
-
-	// Generate two buffer IDs
-	glGenBuffers(1, &vertexbuffer);
-	glGenBuffers(1, &indexbuffer);
-
- 	// Activate the vertex buffer
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
- 	// Present our vertex coordinates to OpenGL
-	glBufferData(GL_ARRAY_BUFFER,
-		8*nverts * sizeof(GLfloat), vertexarray, GL_STATIC_DRAW);
-	// Specify how many attribute arrays we have in our VAO
-	glEnableVertexAttribArray(0); // Vertex coordinates
-	glEnableVertexAttribArray(1); // Normals
-	glEnableVertexAttribArray(2); // Texture coordinates
-	// Specify how OpenGL should interpret the vertex buffer data:
-	// Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-	// Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-	// Type GL_FLOAT
-	// Not normalized (GL_FALSE)
-	// Stride 8 (interleaved array with 8 floats per vertex)
-	// Array buffer offset 0, 3, 6 (offset into first vertex)
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)0); // xyz coordinates
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)(3*sizeof(GLfloat))); // normals
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)(6*sizeof(GLfloat))); // texcoords
-
- 	// Activate the index buffer
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
- 	// Present our vertex indices to OpenGL
- 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-	 	3*ntris*sizeof(GLuint), indexarray, GL_STATIC_DRAW);
-
-	// Deactivate (unbind) the VAO and the buffers again.
-	// Do NOT unbind the buffers while the VAO is still bound.
-	// The index buffer is an essential part of the VAO state.
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	if(options & OPTIMIZE_MESH) {
+		optimize();
+	}
+
+	createBuffers();
 
 };
 
@@ -460,218 +457,552 @@ void TriangleSoup::createSphere(float radius, int segments) {
 /*
  * readObj(const char* filename)
  *
- * Load TriangleSoup geometry data from an OBJ file.
+ * Load TriangleSoup geometry data from an OBJ file and send it to OpenGL.
+ * This is loadOBJ() followed by createBuffers().
  * The vertex array is on interleaved format. For each vertex, there
  * are 8 floats: three for the vertex coordinates (x, y, z), three
  * for the normal vector (n_x, n_y, n_z) and finally two for texture
- * coordinates (s, t). The returned arrays are allocated by malloc()
- * inside the function and should be disposed of using free() when
- * they are no longer needed, e.g. by calling soupDelete().
+ * coordinates (s, t). The parsing is done by an OBJLoader, which
+ * memory maps the file and reads it in parallel chunks. The arrays
+ * it creates are taken over by this object and deleted by clean().
+ * With the option WELD_VERTICES, faces share their vertices wherever
+ * the file uses the same v/vt/vn triplet, which makes the mesh truly
+ * indexed. Otherwise each face gets three vertices of its own.
+ *
+ * After parsing, the arrays are saved to a binary cache file next to
+ * the OBJ file ("mesh.obj.tsoup", see MeshCache), as they will be
+ * uploaded: the vertices packed in the vertex format and the indices
+ * in their final width. If a valid cache for the same vertex format is
+ * found, nothing is parsed: the arrays point straight into the memory
+ * mapped cache, and its pages are handed to glBufferData() without any
+ * copying. The option NO_MESH_CACHE turns the cache off.
+ *
+ * loadOBJ() makes no OpenGL calls, so it can run on a background
+ * thread (see AsyncLoader). If the object already has buffers, they
+ * are deleted by the createBuffers() that follows, on the GL thread.
  *
  * Author: Stefan Gustavson (stegu@itn.liu.se) 2014.
  * This code is in the public domain.
  */
 void TriangleSoup::readOBJ(const char* filename) {
 
-	FILE *objfile;
-
-	int numverts = 0;
-	int numnormals = 0;
-	int numtexcoords = 0;
-	int numfaces = 0;
-	int i_v = 0;
-	int i_n = 0;
-	int i_t = 0;
-	int i_f = 0;
-	float *verts, *normals, *texcoords;
-
-	char line[256];
-	char tag[3];
-	int v1, v2, v3, n1, n2, n3, t1, t2, t3;
-	int numargs, readerror, currentv;
-
-	readerror = 0;
-
-	objfile = fopen(filename, "r");
-
-	if(!objfile) {
-        printError("File not found", filename);
-		readerror = 1;
-	}
-
-	// Scan through the file to count the number of data elements
-	while(fgets(line, 256, objfile)) {
-		sscanf(line, "%2s ", tag);
-		if(!strcmp(tag, "v")) numverts++;
-		else if(!strcmp(tag, "vn")) numnormals++;
-		else if(!strcmp(tag, "vt")) numtexcoords++;
-		else if(!strcmp(tag, "f")) numfaces++;
-		//else printf("Ignoring line starting with \"%s\"\n", tag);
-	}
-
-	printf("loadObj(\"%s\"): found %d vertices, %d normals, %d texcoords, %d faces.\n",
-		filename, numverts, numnormals, numtexcoords, numfaces);
-
-	verts = new float[3*numverts];
-	normals = new float[3*numnormals];
-	texcoords = new float[2*numtexcoords];
-
-	vertexarray = new float[8*3*numfaces];
-	indexarray = new unsigned int[3*numfaces];
-	nverts = 3*numfaces;
-	ntris = numfaces;
-
-	rewind(objfile); // Start from the top again to read data
-
-	while(fgets(line, 256, objfile)) {
-		tag[0] = '\0';
-		sscanf(line, "%2s ", tag);
-		if(!strcmp(tag, "v")) {
-//			printf("Reading vertex %d\n", i_v+1);
-			numargs = sscanf(line, "v %f %f %f",
-				&verts[3*i_v], &verts[3*i_v+1], &verts[3*i_v+2]);
-			if(numargs != 3) {
-				printf("Malformed vertex data found at vertex %d.\n", i_v+1);
-				printf("Aborting.\n");
-				readerror = 1;
-				break;
+	if(loadOBJ(filename)) {
+		createBuffers();
+	}
+};
+
+
+/* Load geometry from an OBJ file into the arrays, without any OpenGL calls */
+int TriangleSoup::loadOBJ(const char* filename) {
+
+	OBJLoader loader;
+	// The options that change the cached arrays. The rest act after the
+	// cache (tangents, BVH) or only on the GPU copy (splitting, arena).
+	int cacheoptions = options & (WELD_VERTICES | OPTIMIZE_MESH | GENERATE_LODS);
+
+	// Delete any previous content in the TriangleSoup object. This may
+	// run without the OpenGL context, so the buffers are only taken off
+	// here, and createBuffers() deletes them.
+	retireBuffers();
+	cleanArrays();
+
+	// Use the binary cache if there is a valid one
+	if(!(options & NO_MESH_CACHE)) {
+		double starttime = glfwGetTime();
+		cache = new MeshCache;
+		// The indices must also have the width that narrowIndices() gives
+		if(cache->open(filename, cacheoptions, format)
+			&& (cache->header()->indextype == GL_UNSIGNED_SHORT)
+				== ((int)cache->header()->nverts - 1 <= MAX_16BIT_INDEX)) {
+			const MeshCacheHeader *h = cache->header();
+			// The mapping is read-only, but nothing writes to the arrays
+			// after they are built, so it is safe to drop the const.
+			// The float vertices of a packed format are only decoded if
+			// they are needed, see unpackVertices().
+			format = cache->vertexFormat(); // With the decoding constants
+			if(format.isFloat()) vertexarray = (GLfloat*)cache->vertices();
+			else packedarray = (unsigned char*)cache->vertices();
+			if(h->indextype == GL_UNSIGNED_SHORT) shortindexarray = (GLushort*)cache->indices();
+			else indexarray = (GLuint*)cache->indices();
+			nverts = h->nverts;
+			ntris = h->ntris;
+			for(uint32_t i=0; i<h->numlods; i++) {
+				LODLevel level = { (int)h->lods[i].first, (int)h->lods[i].count, h->lods[i].error };
+				lods.push_back(level);
 			}
-//			printf("Read vertex coord %d: %8.2f %8.2f %8.2f\n",
-//			i_v, verts[3*i_v], verts[3*i_v+1], verts[3*i_v+2]);
-			i_v++;
-		}
-		else if(!strcmp(tag, "vn")) {
-//			printf("Reading normal %d\n", i_n+1);
-			numargs = sscanf(line, "vn %f %f %f",
-				&normals[3*i_n], &normals[3*i_n+1], &normals[3*i_n+2]);
-			if(numargs != 3) {
-				printf("Malformed normal data found at normal %d.\n", i_n+1);
-				printf("Aborting.\n");
-				readerror = 1;
-				break;
+			for(int k=0; k<3; k++) {
+				boundmin[k] = h->bounds[k];
+				boundmax[k] = h->bounds[3+k];
+				boundcenter[k] = h->sphere[k];
 			}
-			i_n++;
+			boundradius = h->sphere[3];
+			printf("readOBJ(\"%s\"): %d vertices, %d faces from cache in %.3f s\n",
+				filename, nverts, ntris, glfwGetTime() - starttime);
 		}
-		else if(!strcmp(tag, "vt"))  {
-//          printf("Reading texcoord %d\n", i_t+1);
-			numargs = sscanf(line, "vt %f %f",
-				&texcoords[2*i_t], &texcoords[2*i_t+1]);
-			if(numargs != 2) {
-				printf("Malformed texcoord data found at texcoord %d.\n", i_t+1);
-				printf("Aborting.\n");
-				readerror = 1;
-				break;
-			}
-			i_t++;
+		else {
+			delete cache;
+			cache = NULL;
+		}
+	}
+
+	if(!cache) {
+		loader.weld = (options & WELD_VERTICES) ? 1 : 0;
+
+		if(!loader.load(filename)) { // Bail out if a read error occured
+			printError("Mesh read error","No mesh data generated");
+			return 0;
+		}
+
+		// Take over the arrays from the loader
+		vertexarray = loader.vertexarray;
+		indexarray = loader.indexarray;
+		nverts = loader.nverts;
+		ntris = loader.ntris;
+		loader.vertexarray = NULL;
+		loader.indexarray = NULL;
+
+		// Optimize before caching, so the cache has the optimized mesh
+		if(options & OPTIMIZE_MESH) {
+			optimize();
+		}
+
+		if(options & GENERATE_LODS) {
+			createLODs(DEFAULT_LOD_RATIOS, DEFAULT_NUM_LODS);
+		}
+	}
+
+	// Here rather than in createBuffers(), to keep the work off the
+	// rendering thread when the mesh is loaded in the background
+	if(boundradius < 0.0f) computeBounds(); // A cache has them in its header
+	if(options & BUILD_BVH) buildBVH();
+	if(options & GENERATE_TANGENTS) generateTangents();
+	packVertices();
+	narrowIndices(); // Last, as the steps above take 32-bit indices
+
+	// Cache the arrays the way createBuffers() uploads them
+	if(!cache && !(options & NO_MESH_CACHE)) {
+		MeshCacheLOD cachelods[MESHCACHE_MAX_LODS];
+		int numcachelods = 0;
+		for(size_t i=0; i<lods.size() && i<MESHCACHE_MAX_LODS; i++) {
+			MeshCacheLOD lod = { (uint32_t)lods[i].first, (uint32_t)lods[i].count, lods[i].error, 0 };
+			cachelods[numcachelods++] = lod;
+		}
+		GLfloat bounds[10] = { boundmin[0], boundmin[1], boundmin[2], boundmax[0], boundmax[1], boundmax[2],
+			boundcenter[0], boundcenter[1], boundcenter[2], boundradius };
+		MeshCache::write(filename, cacheoptions, format,
+			packedarray ? (const void*)packedarray : (const void*)vertexarray, nverts,
+			shortindexarray ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+			shortindexarray ? (const void*)shortindexarray : (const void*)indexarray, ntris,
+			bounds, cachelods, numcachelods);
+	}
+	return 1;
+};
+
+
+/* Create the VAO and the buffers and copy the arrays to OpenGL */
+void TriangleSoup::createBuffers() {
+
+	releaseRetired(); // Buffers of the previous mesh, from loadOBJ()
+
+	// Use 16-bit indices where they are wide enough. Split meshes get
+	// a vertex buffer with a separate range of vertices for each part,
+	// and their 16-bit indices are only made for the upload.
+	// The levels of detail, if any, follow the full mesh in the index array.
+	GLushort *shortindices = NULL;
+	unsigned char *splitvertices = NULL;
+	GLfloat *splittangents = NULL;
+	if((options & GENERATE_TANGENTS) && !tangentarray) generateTangents();
+	packVertices(); // If the mesh was not built by loadOBJ()
+	narrowIndices();
+	const unsigned char *vertexdata = packedarray ? packedarray : (const unsigned char*)vertexarray;
+	int numgpuverts = nverts;
+	int nindices = numIndices();
+	clusters.clear();
+	indextype = GL_UNSIGNED_INT;
+	if(shortindexarray) {
+		indextype = GL_UNSIGNED_SHORT;
+	}
+	else if(nverts - 1 > MAX_16BIT_INDEX && (options & SPLIT_16BIT_INDICES) && lods.empty()) {
+		indextype = GL_UNSIGNED_SHORT;
+		shortindices = new GLushort[3*ntris];
+		splitvertices = splitClusters(vertexdata, shortindices, &numgpuverts, &splittangents);
+	}
+	size_t indexsize = (indextype == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	const void *indexdata = shortindexarray ? (const void*)shortindexarray
+		: shortindices ? (const void*)shortindices : (const void*)indexarray;
+
+	const void *data = splitvertices ? splitvertices : vertexdata;
+
+	// Meshes in a GeometryArena only copy their data into its shared
+	// buffers and use its VAO. Tangents need a buffer of their own,
+	// so meshes with tangents always get their own VAO.
+	if((options & USE_GEOMETRY_ARENA) && !tangentarray) {
+		arena = GeometryArena::get(format, indextype);
+		arena->allocate(numgpuverts, nindices, &arenarange);
+		arena->upload(arenarange, data, indexdata);
+		vao = arena->vertexArray();
+		instancecapacity = 0;
+	}
+	else {
+		// Generate one vertex array object (VAO) and bind it
+		glGenVertexArrays(1, &vao);
+		GLState::bindVertexArray(vao);
+		instancecapacity = 0; // renderInstanced() sets up the new VAO on first use
+
+		// Generate two buffer IDs
+		glGenBuffers(1, &vertexbuffer);
+		glGenBuffers(1, &indexbuffer);
+
+	 	// Activate the vertex buffer
+		GLState::bindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+	 	// Present our vertex coordinates to OpenGL
+		glBufferData(GL_ARRAY_BUFFER,
+			(size_t)numgpuverts * format.stride, data, GL_STATIC_DRAW);
+		// Specify how OpenGL should interpret the vertex buffer data:
+		// Attributes 0, 1, 2 for coordinates, normals and texture coordinates
+		// (must match the layout in the shader), with the types, offsets and
+		// stride of the chosen VertexFormat. For the default format, this is
+		// an interleaved array with 8 floats per vertex.
+		format.setAttribPointers();
+
+		// Attribute 3 for the tangents, if any, from a buffer of their own,
+		// so that the main vertex buffer keeps the same layout
+		if(tangentarray) {
+			glGenBuffers(1, &tangentbuffer);
+			GLState::bindBuffer(GL_ARRAY_BUFFER, tangentbuffer);
+			glBufferData(GL_ARRAY_BUFFER, (size_t)numgpuverts * 4 * sizeof(GLfloat),
+				splittangents ? splittangents : tangentarray, GL_STATIC_DRAW);
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)0);
 		}
-		else if(!strcmp(tag, "f")) {
-//			printf("Reading face %d\n", i_f+1);
-			numargs = sscanf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d",
-				&v1, &t1, &n1, &v2, &t2, &n2, &v3, &t3, &n3);
-			if(numargs != 9) {
-				printf("Malformed face data found at face %d.\n", i_f+1);
-				printf("Aborting.\n");
-				readerror = 1;
-				break;
+
+	 	// Activate the index buffer
+	 	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
+	 	// Present our vertex indices to OpenGL
+	 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+		 	nindices*indexsize, indexdata, GL_STATIC_DRAW);
+
+		// Deactivate (unbind) the VAO and the buffers again.
+		// Do NOT unbind the buffers while the VAO is still bound.
+		// The index buffer is an essential part of the VAO state.
+		GLState::bindVertexArray(0);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	 	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	delete[] shortindices; // Only the split indices, never shortindexarray
+	delete[] splitvertices;
+	delete[] splittangents;
+	if(!cache || !cache->contains(packedarray)) { // Only needed for the upload
+		delete[] packedarray;
+		packedarray = NULL;
+	}
+
+	// Meshes from loadOBJ() got their bounds (and tree) on the loading thread
+	if(boundradius < 0.0f) computeBounds();
+	if((options & BUILD_BVH) && !bvh) buildBVH();
+};
+
+
+/*
+ * private
+ * computeBounds() - find the bounding box and a tight bounding sphere
+ * once, when the mesh is built, with the SSE kernels in Bounds.
+ */
+void TriangleSoup::computeBounds() {
+	unpackVertices();
+	Bounds::computeBox(vertexarray, nverts, 8, boundmin, boundmax);
+	Bounds::computeSphere(vertexarray, nverts, 8, boundmin, boundmax, boundcenter, &boundradius);
+};
+
+
+/*
+ * private
+ * packVertices() - the vertices in the format of the vertex buffer, for
+ * createBuffers() and the cache file. Made once the mesh is built, as
+ * pack() sets the decoding constants from all the vertices.
+ */
+void TriangleSoup::packVertices() {
+	if(packedarray || !vertexarray || format.isFloat()) return;
+	packedarray = format.pack(vertexarray, nverts);
+	format.printErrors(vertexarray, packedarray, nverts);
+};
+
+
+/*
+ * private
+ * unpackVertices() - decode the float vertices from the packed ones, for
+ * a mesh from a cache file with a packed format, which has no others.
+ * Decoded, they are what the GPU draws, give or take the float rounding.
+ */
+void TriangleSoup::unpackVertices() {
+	if(vertexarray || !packedarray) return;
+	vertexarray = new GLfloat[(size_t)8 * nverts];
+	for(int i=0; i<nverts; i++) format.unpack(packedarray, i, vertexarray + (size_t)8 * i);
+};
+
+
+/*
+ * private
+ * splitClusters() - cut the mesh into runs of whole triangles that use
+ * at most MAX_16BIT_INDEX+1 different vertices each. Every part gets
+ * its own copy of the vertices it uses, in first-use order, so the
+ * split works for any index order. Vertices on the border between two
+ * parts are duplicated. The parts are stored in clusters, the indices
+ * relative to the first vertex of their part in shortindices.
+ * vertices are the ones that are uploaded, format.stride bytes each.
+ * Returns a new[] array of them for all parts, with the number of
+ * vertices in *numsplitverts. If there are tangents, *splittangents
+ * gets a new[] array of them to match, otherwise NULL.
+ */
+unsigned char *TriangleSoup::splitClusters(const unsigned char *vertices, GLushort *shortindices,
+                                           int *numsplitverts, GLfloat **splittangents) {
+
+	std::vector<int> owner(nverts, -1);   // The last part that used each vertex
+	std::vector<int> localindex(nverts);  // Its index within that part
+	std::vector<GLuint> sources;          // Original vertex for each split vertex
+	IndexRange range = { 0, 0, 0 };
+	int part = 0;
+	int partverts = 0;
+
+	sources.reserve(nverts + nverts/16);
+	for(int t=0; t<ntris; t++) {
+		const GLuint *tri = indexarray + 3*t;
+		int newverts = 0;
+		for(int k=0; k<3; k++) {
+			if(owner[tri[k]] != part) newverts++;
+		}
+		if(partverts + newverts > MAX_16BIT_INDEX + 1) { // Start a new part
+			clusters.push_back(range);
+			range.first += range.count;
+			range.count = 0;
+			range.basevertex = (int)sources.size();
+			part++;
+			partverts = 0;
+		}
+		for(int k=0; k<3; k++) {
+			GLuint v = tri[k];
+			if(owner[v] != part) {
+				owner[v] = part;
+				localindex[v] = partverts++;
+				sources.push_back(v);
 			}
-//			printf("Read vertex data %d/%d/%d %d/%d/%d %d/%d/%d\n",
-//			v1, t1, n1, v2, t2, n2, v3, t3, n3);
-			v1--; v2--; v3--; n1--; n2--; n3--; t1--; t2--; t3--;
-			currentv = 8*3*i_f;
-			vertexarray[currentv] = verts[3*v1];
-			vertexarray[currentv+1] = verts[3*v1+1];
-			vertexarray[currentv+2] = verts[3*v1+2];
-			vertexarray[currentv+3] = normals[3*n1];
-			vertexarray[currentv+4] = normals[3*n1+1];
-			vertexarray[currentv+5] = normals[3*n1+2];
-			vertexarray[currentv+6] = texcoords[2*t1];
-			vertexarray[currentv+7] = texcoords[2*t1+1];
-			vertexarray[currentv+8] = verts[3*v2];
-			vertexarray[currentv+9] = verts[3*v2+1];
-			vertexarray[currentv+10] = verts[3*v2+2];
-			vertexarray[currentv+11] = normals[3*n2];
-			vertexarray[currentv+12] = normals[3*n2+1];
-			vertexarray[currentv+13] = normals[3*n2+2];
-			vertexarray[currentv+14] = texcoords[2*t2];
-			vertexarray[currentv+15] = texcoords[2*t2+1];
-			vertexarray[currentv+16] = verts[3*v3];
-			vertexarray[currentv+17] = verts[3*v3+1];
-			vertexarray[currentv+18] = verts[3*v3+2];
-			vertexarray[currentv+19] = normals[3*n3];
-			vertexarray[currentv+20] = normals[3*n3+1];
-			vertexarray[currentv+21] = normals[3*n3+2];
-			vertexarray[currentv+22] = texcoords[2*t3];
-			vertexarray[currentv+23] = texcoords[2*t3+1];
-			indexarray[3*i_f] = 3*i_f;
-			indexarray[3*i_f+1] = 3*i_f+1;
-			indexarray[3*i_f+2] = 3*i_f+2;
-			i_f++;
-		};
-	}
-
-	// Clean up the temporary arrays we created
-	delete[] verts; verts = NULL;
-	delete[] normals; normals = NULL;
-	delete[] texcoords; texcoords = NULL;
-	fclose(objfile);
-
-	if(readerror) { // Delete corrupt data and bail out if a read error occured
-        printError("Mesh read error","No mesh data generated");
-		clean();
+			shortindices[3*t+k] = (GLushort)localindex[v];
+		}
+		range.count += 3;
+	}
+	if(range.count > 0) clusters.push_back(range);
+
+	int numsplit = (int)sources.size();
+	size_t stride = (size_t)format.stride;
+	unsigned char *splitvertices = new unsigned char[stride * numsplit];
+	for(int i=0; i<numsplit; i++) {
+		memcpy(splitvertices + stride * i, vertices + stride * sources[i], stride);
+	}
+	*splittangents = NULL;
+	if(tangentarray) {
+		*splittangents = new GLfloat[(size_t)4 * numsplit];
+		for(int i=0; i<numsplit; i++) {
+			const GLfloat *src = tangentarray + (size_t)4 * sources[i];
+			for(int k=0; k<4; k++) (*splittangents)[(size_t)4*i + k] = src[k];
+		}
+	}
+	printf("TriangleSoup: split into %d parts with 16-bit indices, %d vertices duplicated (%.1f%%)\n",
+		(int)clusters.size(), numsplit - nverts, 100.0 * (numsplit - nverts) / nverts);
+
+	*numsplitverts = numsplit;
+	return splitvertices;
+};
+
+
+/* Reorder the triangles and vertices for the GPU vertex caches */
+void TriangleSoup::optimize() {
+
+	if(cache || ntris == 0) return; // The arrays in a mapped cache file are read-only
+	widenIndices();
+	delete[] packedarray; // Made again from the new order
+	packedarray = NULL;
+	// Unused vertices are moved to the end, so leave them out
+	nverts = MeshOptimizer::optimize(vertexarray, indexarray, ntris, nverts, 8);
+	if(tangentarray) generateTangents(); // The vertices have moved
+};
+
+
+/*
+ * createLODs() - simplify the mesh step by step and append each level
+ * of detail to the index array. Every level is made from the previous
+ * one, so the error bounds add up.
+ */
+void TriangleSoup::createLODs(const float *ratios, int numratios) {
+
+	if(cache || ntris == 0) return; // The arrays in a mapped cache file are read-only
+	widenIndices();
+
+	double starttime = glfwGetTime();
+	std::vector<GLuint> allindices(indexarray, indexarray + 3*ntris);
+	std::vector<GLuint> simplified(3*ntris);
+	float error = 0.0f;
+	lods.clear();
+	LODLevel full = { 0, 3*ntris, 0.0f };
+	lods.push_back(full);
+
+	for(int i=0; i<numratios; i++) {
+		LODLevel previous = lods.back();
+		int target = (int)(ratios[i] * ntris);
+		float steperror;
+		int n = MeshSimplifier::simplify(vertexarray, nverts, &allindices[previous.first],
+			previous.count/3, target, &simplified[0], &steperror);
+		if(n >= previous.count/3) continue; // Could not get any smaller
+		MeshOptimizer::optimizeVertexCache(&simplified[0], n, nverts);
+		error += steperror;
+		LODLevel level = { (int)allindices.size(), 3*n, error };
+		allindices.insert(allindices.end(), simplified.begin(), simplified.begin() + 3*n);
+		lods.push_back(level);
+	}
+	if(lods.size() == 1) { // Nothing to add
+		lods.clear();
 		return;
 	}
 
-	// Generate one vertex array object (VAO) and bind it
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-
-	// Generate two buffer IDs
-	glGenBuffers(1, &vertexbuffer);
-	glGenBuffers(1, &indexbuffer);
-
- 	// Activate the vertex buffer
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
- 	// Present our vertex coordinates to OpenGL
-	glBufferData(GL_ARRAY_BUFFER,
-		8*nverts * sizeof(GLfloat), vertexarray, GL_STATIC_DRAW);
-
-	// Specify how many attribute arrays we have in our VAO
-	glEnableVertexAttribArray(0); // Vertex coordinates
-	glEnableVertexAttribArray(1); // Normals
-	glEnableVertexAttribArray(2); // Texture coordinates
-	// Specify how OpenGL should interpret the vertex buffer data:
-	// Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-	// Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-	// Type GL_FLOAT
-	// Not normalized (GL_FALSE)
-	// Stride 8 (interleaved array with 8 floats per vertex)
-	// Array buffer offset 0, 3, 6 (offset into first vertex)
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)0); // xyz coordinates
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)(3*sizeof(GLfloat))); // normals
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE,
-		8*sizeof(GLfloat), (void*)(6*sizeof(GLfloat))); // texcoords
-
- 	// Activate the index buffer
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
- 	// Present our vertex indices to OpenGL
- 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-	 	3*ntris*sizeof(GLuint), indexarray, GL_STATIC_DRAW);
-
-	// Deactivate (unbind) the VAO and the buffers again.
-	// Do NOT unbind the buffers while the VAO is still bound.
-	// The index buffer is an essential part of the VAO state.
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-	return;
+	delete[] indexarray;
+	indexarray = new GLuint[allindices.size()];
+	for(size_t i=0; i<allindices.size(); i++) indexarray[i] = allindices[i];
+
+	printf("createLODs(): %d levels in %.3f s\n", (int)lods.size() - 1, glfwGetTime() - starttime);
+	for(size_t i=1; i<lods.size(); i++) {
+		printf("  LOD %d: %d triangles (%.1f%%), error %g\n", (int)i, lods[i].count/3,
+			100.0 * lods[i].count / (3.0 * ntris), lods[i].error);
+	}
+};
+
+
+/* The number of levels of detail, including the full mesh */
+int TriangleSoup::numLODs() {
+	return lods.empty() ? 1 : (int)lods.size();
+};
+
+
+/* The simplification error of a level of detail */
+float TriangleSoup::lodError(int level) {
+	if(level <= 0 || level >= (int)lods.size()) return 0.0f;
+	return lods[level].error;
+};
+
+
+/* The number of triangles in a level of detail */
+int TriangleSoup::lodTriangles(int level) {
+	if(level <= 0 || level >= (int)lods.size()) return ntris;
+	return lods[level].count / 3;
+};
+
+
+/*
+ * getDrawRanges() - the draw calls that render() or renderLOD() would
+ * make, with the offsets of the mesh in its GeometryArena added.
+ */
+int TriangleSoup::getDrawRanges(int level, std::vector<IndexRange> &ranges) {
+
+	if(!vao) return 0;
+	int firstindex = arena ? arenarange.firstindex : 0;
+	int firstvertex = arena ? arenarange.firstvertex : 0;
+	IndexRange range;
+	if(level > 0 && !lods.empty()) {
+		if(level >= (int)lods.size()) level = (int)lods.size() - 1;
+		range.first = firstindex + lods[level].first;
+		range.count = lods[level].count;
+		range.basevertex = firstvertex;
+		ranges.push_back(range);
+		return 1;
+	}
+	if(clusters.empty()) {
+		range.first = firstindex;
+		range.count = 3 * ntris;
+		range.basevertex = firstvertex;
+		ranges.push_back(range);
+		return 1;
+	}
+	for(size_t i=0; i<clusters.size(); i++) {
+		range.first = firstindex + clusters[i].first;
+		range.count = clusters[i].count;
+		range.basevertex = firstvertex + clusters[i].basevertex;
+		ranges.push_back(range);
+	}
+	return (int)clusters.size();
+};
+
+
+GLuint TriangleSoup::vertexArray() {
+	return vao;
 };
 
+GLenum TriangleSoup::indexType() {
+	return indextype;
+};
+
+const VertexFormat &TriangleSoup::vertexFormat() {
+	return format;
+};
+
+
+/*
+ * private
+ * narrowIndices() - keep the indices in 16 bits if the mesh has few
+ * enough vertices, and drop the 32-bit array. The steps that build the
+ * mesh all take 32-bit indices, so this is done once it is built.
+ */
+void TriangleSoup::narrowIndices() {
+	if(!indexarray || ntris == 0 || nverts - 1 > MAX_16BIT_INDEX) return;
+	int nindices = numIndices();
+	shortindexarray = new GLushort[nindices];
+	for(int i=0; i<nindices; i++) shortindexarray[i] = (GLushort)indexarray[i];
+	if(!cache || !cache->contains(indexarray)) delete[] indexarray;
+	indexarray = NULL;
+};
+
+
+/*
+ * private
+ * widenIndices() - back to 32-bit indices, for optimize() and
+ * createLODs() on a mesh that is already built.
+ */
+void TriangleSoup::widenIndices() {
+	if(!shortindexarray) return;
+	int nindices = numIndices();
+	indexarray = new GLuint[nindices];
+	for(int i=0; i<nindices; i++) indexarray[i] = shortindexarray[i];
+	delete[] shortindexarray;
+	shortindexarray = NULL;
+};
+
+
+/*
+ * private
+ * wideIndices() - the indices as 32-bit numbers, for the code that
+ * only reads them. That is a copy in copy if they are kept in 16 bits.
+ */
+const GLuint *TriangleSoup::wideIndices(std::vector<GLuint> &copy) {
+	if(!shortindexarray) return indexarray;
+	copy.assign(shortindexarray, shortindexarray + numIndices());
+	return &copy[0];
+};
+
+
+/*
+ * private
+ * numIndices() - the length of the index array, with all levels of detail.
+ */
+int TriangleSoup::numIndices() {
+	if(lods.empty()) return 3*ntris;
+	return lods.back().first + lods.back().count;
+};
+
+
 /* Print data from a TriangleSoup object, for debugging purposes */
 void TriangleSoup::print() {
      int i;
+     std::vector<GLuint> copy;
+     const GLuint *indices = wideIndices(copy);
+     unpackVertices();
 
      printf("TriangleSoup vertex data:\n\n");
      for(i=0; i<nverts; i++) {
@@ -681,49 +1012,242 @@ void TriangleSoup::print() {
      printf("\nTriangleSoup face index data:\n\n");
      for(i=0; i<ntris; i++) {
          printf("%d: %d %d %d\n", i,
-         indexarray[3*i], indexarray[3*i+1], indexarray[3*i+2]);
+         indices[3*i], indices[3*i+1], indices[3*i+2]);
      }
 };
 
 /* Print information about a TriangleSoup object (stats and extents) */
 void TriangleSoup::printInfo() {
      int i;
-     float x, y, z, xmin, xmax, ymin, ymax, zmin, zmax;
 
      printf("TriangleSoup information:\n");
      printf("vertices : %d\n", nverts);
      printf("triangles: %d\n", ntris);
-     xmin = xmax = vertexarray[0];
-     ymin = ymax = vertexarray[1];
-     zmin = zmax = vertexarray[2];
-     for(i=1; i<nverts; i++) {
-         x = vertexarray[8*i];
-         y = vertexarray[8*i+1];
-         z = vertexarray[8*i+2];
-//         printf("x y z : %8.2f %8.2f %8.2f\n", x, y, z);
-         if(x<xmin) xmin = x;
-         if(x>xmax) xmax = x;
-         if(y<ymin) ymin = y;
-         if(y>ymax) ymax = y;
-         if(z<zmin) zmin = z;
-         if(z>zmax) zmax = z;
+     printf("indices  : %d bit", (indextype == GL_UNSIGNED_SHORT) ? 16 : 32);
+     if(!clusters.empty()) printf(", %d parts", (int)clusters.size());
+     printf("\n");
+     for(i=1; i<(int)lods.size(); i++) {
+         printf("LOD %d    : %d triangles, error %g\n", i, lods[i].count/3, lods[i].error);
+     }
+     if(boundradius < 0.0f) computeBounds(); // The extents are kept, not recomputed
+     printf("xmin: %8.2f\n", boundmin[0]);
+     printf("xmax: %8.2f\n", boundmax[0]);
+     printf("ymin: %8.2f\n", boundmin[1]);
+     printf("ymax: %8.2f\n", boundmax[1]);
+     printf("zmin: %8.2f\n", boundmin[2]);
+     printf("zmax: %8.2f\n", boundmax[2]);
+     printf("sphere: center %.2f %.2f %.2f, radius %.2f\n",
+         boundcenter[0], boundcenter[1], boundcenter[2], boundradius);
+     if(bvh) {
+         printf("BVH      : %d nodes, built in %.3f s\n", bvh->numNodes(), bvh->buildSeconds());
+     }
+     if(tangentarray) printf("tangents : yes\n");
+     if(arena) {
+         printf("arena    : vertices %d to %d, indices %d to %d\n",
+             arenarange.firstvertex, arenarange.firstvertex + arenarange.numvertices - 1,
+             arenarange.firstindex, arenarange.firstindex + arenarange.numindices - 1);
      }
-     printf("xmin: %8.2f\n", xmin);
-     printf("xmax: %8.2f\n", xmax);
-     printf("ymin: %8.2f\n", ymin);
-     printf("ymax: %8.2f\n", ymax);
-     printf("zmin: %8.2f\n", zmin);
-     printf("zmax: %8.2f\n", zmax);
 };
 
-/* Render the geometry in a TriangleSoup object */
+/* The bounding box from computeBounds() */
+int TriangleSoup::getBoundingBox(GLfloat *boxmin, GLfloat *boxmax) {
+	// Check vao, which only the rendering thread sets, and not the bounds,
+	// because the loading thread may be writing them
+	if(vao == 0) return 0;
+	for(int k=0; k<3; k++) {
+		boxmin[k] = boundmin[k];
+		boxmax[k] = boundmax[k];
+	}
+	return 1;
+};
+
+/* The bounding sphere from computeBounds() */
+int TriangleSoup::getBoundingSphere(GLfloat *center, GLfloat *radius) {
+	if(vao == 0) return 0; // See getBoundingBox()
+	for(int k=0; k<3; k++) center[k] = boundcenter[k];
+	*radius = boundradius;
+	return 1;
+};
+
+
+/* Build the tree for pick() */
+void TriangleSoup::buildBVH() {
+	std::vector<GLuint> copy;
+	unpackVertices();
+	if(!bvh) bvh = new MeshBVH;
+	bvh->build(vertexarray, nverts, wideIndices(copy), ntris);
+};
+
+/* Tangents for normal mapping, 4 floats per vertex */
+void TriangleSoup::generateTangents() {
+	if(nverts == 0) return;
+	double starttime = glfwGetTime();
+	std::vector<GLuint> copy;
+	unpackVertices();
+	if(!tangentarray) tangentarray = new GLfloat[(size_t)4 * nverts];
+	TangentGenerator::generate(vertexarray, nverts, wideIndices(copy), ntris, tangentarray);
+	printf("generateTangents(): %d vertices in %.3f s\n", nverts, glfwGetTime() - starttime);
+};
+
+/* Pick with the tree from buildBVH() */
+int TriangleSoup::pick(const float *origin, const float *direction, RayHit *hit) {
+	hit->triangle = -1;
+	if(vao == 0 || !bvh) return 0; // See getBoundingBox()
+	return bvh->intersect(origin, direction, hit);
+};
+
+
+/*
+ * Render the geometry in a TriangleSoup object. The VAO is left bound,
+ * as GLState skips binding it again for the next draw of the same mesh.
+ */
 void TriangleSoup::render() {
 
-	glBindVertexArray(vao);
-	glDrawElements(GL_TRIANGLES, 3 * ntris, GL_UNSIGNED_INT, (void*)0);
-	// (mode, vertex count, type, element array buffer offset)
-	glBindVertexArray(0);
+	if(!vao) return; // Nothing uploaded yet, e.g. still loading in the background
+
+	format.setDecodeAttribs(); // Constants for unpacking the vertices in the shader
+	GLState::bindVertexArray(vao);
+	if(arena) {
+		// The mesh is a range of the shared buffers, with indices
+		// relative to its first vertex
+		size_t indexsize = arena->indexSize();
+		if(clusters.empty()) {
+			glDrawElementsBaseVertex(GL_TRIANGLES, 3 * ntris, indextype,
+				(void*)(arenarange.firstindex * indexsize), arenarange.firstvertex);
+		}
+		else {
+			for(size_t i=0; i<clusters.size(); i++) {
+				glDrawElementsBaseVertex(GL_TRIANGLES, clusters[i].count, GL_UNSIGNED_SHORT,
+					(void*)((arenarange.firstindex + clusters[i].first) * indexsize),
+					arenarange.firstvertex + clusters[i].basevertex);
+			}
+		}
+		return;
+	}
+	if(clusters.empty()) {
+		glDrawElements(GL_TRIANGLES, 3 * ntris, indextype, (void*)0);
+		// (mode, vertex count, type, element array buffer offset)
+	}
+	else {
+		// A split mesh has one draw call per part, with 16-bit indices
+		// relative to the first vertex of the part
+		for(size_t i=0; i<clusters.size(); i++) {
+			glDrawElementsBaseVertex(GL_TRIANGLES, clusters[i].count, GL_UNSIGNED_SHORT,
+				(void*)(clusters[i].first * sizeof(GLushort)), clusters[i].basevertex);
+		}
+	}
+
+};
+
+/* Render one level of detail */
+void TriangleSoup::renderLOD(int level) {
+
+	if(level <= 0 || lods.empty()) {
+		render();
+		return;
+	}
+	if(!vao) return;
+	if(level >= (int)lods.size()) level = (int)lods.size() - 1;
+
+	size_t indexsize = (indextype == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	format.setDecodeAttribs();
+	GLState::bindVertexArray(vao);
+	if(arena) {
+		glDrawElementsBaseVertex(GL_TRIANGLES, lods[level].count, indextype,
+			(void*)((arenarange.firstindex + lods[level].first) * indexsize), arenarange.firstvertex);
+		return;
+	}
+	glDrawElements(GL_TRIANGLES, lods[level].count, indextype,
+		(void*)(lods[level].first * indexsize));
+};
 
+/*
+ * renderInstanced() - stream the instance data and draw all instances.
+ * The instance buffer holds all matrices, then all colors, then all
+ * layers, each part sized for instancecapacity instances, so the
+ * attribute pointers only change when the buffer grows. Each call
+ * orphans the old contents with glBufferData(NULL) before writing, so
+ * it never waits for the GPU to finish drawing the previous batch.
+ * Meshes in a GeometryArena share their VAO with other meshes, which
+ * may point the instance attributes at their own buffers, so for them
+ * the pointers are set on every call.
+ */
+void TriangleSoup::renderInstanced(const GLfloat *matrices, int ninstances,
+                                   const GLfloat *colors, const GLfloat *layers, int level) {
+
+	if(!vao || ninstances <= 0) return;
+
+	const size_t MATRIX_SIZE = 16 * sizeof(GLfloat);
+	const size_t COLOR_SIZE = 4 * sizeof(GLfloat);
+	const size_t LAYER_SIZE = sizeof(GLfloat);
+
+	GLState::bindVertexArray(vao);
+	if(!instancebuffer) glGenBuffers(1, &instancebuffer);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, instancebuffer);
+
+	if(ninstances > instancecapacity || arena) { // Grow the buffer and point the attributes at it
+		int capacity = (instancecapacity > 256) ? instancecapacity : 256;
+		while(capacity < ninstances) capacity *= 2;
+		instancecapacity = capacity;
+		for(int c=0; c<4; c++) {
+			glVertexAttribPointer(TRIANGLESOUP_INSTANCE_MATRIX + c, 4, GL_FLOAT, GL_FALSE,
+				MATRIX_SIZE, (void*)(c * 4 * sizeof(GLfloat))); // Column c
+			glVertexAttribDivisor(TRIANGLESOUP_INSTANCE_MATRIX + c, 1);
+		}
+		glVertexAttribPointer(TRIANGLESOUP_INSTANCE_COLOR, 4, GL_FLOAT, GL_FALSE,
+			COLOR_SIZE, (void*)(capacity * MATRIX_SIZE));
+		glVertexAttribDivisor(TRIANGLESOUP_INSTANCE_COLOR, 1);
+		glVertexAttribPointer(TRIANGLESOUP_INSTANCE_LAYER, 1, GL_FLOAT, GL_FALSE,
+			LAYER_SIZE, (void*)(capacity * (MATRIX_SIZE + COLOR_SIZE)));
+		glVertexAttribDivisor(TRIANGLESOUP_INSTANCE_LAYER, 1);
+	}
+	// Enabled on every call, as DrawBatch may have turned them off
+	for(int c=0; c<4; c++) glEnableVertexAttribArray(TRIANGLESOUP_INSTANCE_MATRIX + c);
+
+	size_t capacity = (size_t)instancecapacity;
+	glBufferData(GL_ARRAY_BUFFER, capacity * (MATRIX_SIZE + COLOR_SIZE + LAYER_SIZE),
+		NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, ninstances * MATRIX_SIZE, matrices);
+	// Without an array, the attributes take the constant values instead
+	if(colors) {
+		glBufferSubData(GL_ARRAY_BUFFER, capacity * MATRIX_SIZE, ninstances * COLOR_SIZE, colors);
+		glEnableVertexAttribArray(TRIANGLESOUP_INSTANCE_COLOR);
+	}
+	else {
+		glDisableVertexAttribArray(TRIANGLESOUP_INSTANCE_COLOR);
+		glVertexAttrib4f(TRIANGLESOUP_INSTANCE_COLOR, 1.0f, 1.0f, 1.0f, 1.0f);
+	}
+	if(layers) {
+		glBufferSubData(GL_ARRAY_BUFFER, capacity * (MATRIX_SIZE + COLOR_SIZE),
+			ninstances * LAYER_SIZE, layers);
+		glEnableVertexAttribArray(TRIANGLESOUP_INSTANCE_LAYER);
+	}
+	else {
+		glDisableVertexAttribArray(TRIANGLESOUP_INSTANCE_LAYER);
+		glVertexAttrib1f(TRIANGLESOUP_INSTANCE_LAYER, 0.0f);
+	}
+
+	format.setDecodeAttribs();
+	size_t indexsize = (indextype == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	// Where the mesh starts in the arena, or 0 in buffers of its own
+	int firstindex = arena ? arenarange.firstindex : 0;
+	int firstvertex = arena ? arenarange.firstvertex : 0;
+	if(level > 0 && !lods.empty()) {
+		if(level >= (int)lods.size()) level = (int)lods.size() - 1;
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lods[level].count, indextype,
+			(void*)((firstindex + lods[level].first) * indexsize), ninstances, firstvertex);
+	}
+	else if(clusters.empty()) {
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, 3 * ntris, indextype,
+			(void*)(firstindex * indexsize), ninstances, firstvertex);
+	}
+	else {
+		for(size_t i=0; i<clusters.size(); i++) {
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, clusters[i].count, GL_UNSIGNED_SHORT,
+				(void*)((firstindex + clusters[i].first) * sizeof(GLushort)), ninstances,
+				firstvertex + clusters[i].basevertex);
+		}
+	}
 };
 
 /*
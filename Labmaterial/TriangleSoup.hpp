@@ -4,10 +4,31 @@
  * in an OpenGL vertex array object. */
 /* Usage: The methods createXXX() create geometry from fixed
  * arrays or procedural descriptions.
- * The method loadOBJ() loads geometry from an OBJ file.
+ * The method readOBJ() loads geometry from an OBJ file. It can also be
+ * done in two steps: loadOBJ() reads the file without any OpenGL calls
+ * (for example on a background thread, see AsyncLoader), and then
+ * createBuffers() sends the data to OpenGL.
  * Only the mesh is loaded. Material information is ignored.
  * Only triangles are supported. OBJ files with quads are rejected.
- * Call render() to draw the mesh in OpenGL. */
+ * Call setOptions() before readOBJ() to change how the mesh is built.
+ * Call render() to draw the mesh in OpenGL. Before the buffers
+ * are created, render() draws nothing.
+ * createLODs() (or the option GENERATE_LODS) adds simplified versions
+ * of the mesh to the index array. They use the same vertex buffer and
+ * are drawn with renderLOD().
+ * buildBVH() (or the option BUILD_BVH) makes a MeshBVH for the mesh,
+ * and pick() finds the triangle hit by a ray, for example the one
+ * from MouseRotator::pickRay().
+ * generateTangents() (or the option GENERATE_TANGENTS) adds tangents
+ * for normal mapping, which are sent as vertex attribute 3 from a
+ * buffer of their own (see TangentGenerator and vertex_normalmap.glsl).
+ * renderInstanced() draws many copies of the mesh in one draw call,
+ * each with its own transform, with a shader like vertex_instanced.glsl.
+ * With the option USE_GEOMETRY_ARENA, the mesh is put in a GeometryArena
+ * instead of buffers of its own, and all meshes with the same vertex
+ * format share one VAO. render() then leaves that VAO bound, so drawing
+ * them one after another needs no VAO changes. Meshes with tangents
+ * always get their own buffers. */
 /* Author: Stefan Gustavson 2013-2014 (stefan.gustavson@liu.se)
  * This code is in the public domain.
  */
@@ -20,6 +41,34 @@
 #endif
 
 #include "GLFW/glfw3.h"   // To use OpenGL datatypes
+#include "VertexFormat.hpp"
+#include "GeometryArena.hpp"
+
+#include <vector>
+
+// Attribute locations for the per-instance data of renderInstanced(),
+// see vertex_instanced.glsl
+#define TRIANGLESOUP_INSTANCE_MATRIX 8  // mat4, one column in each of locations 8 to 11
+#define TRIANGLESOUP_INSTANCE_COLOR 12  // vec4, (1,1,1,1) if no colors are given
+#define TRIANGLESOUP_INSTANCE_LAYER 13  // float, 0 if no layers are given
+
+class MeshCache;
+class MeshBVH;
+struct RayHit;
+
+/* A part of the index array that is drawn with one draw call */
+struct IndexRange {
+    int first;      // First index (not triangle) in the index array
+    int count;      // Number of indices
+    int basevertex; // Added to every index in the range by glDrawElementsBaseVertex()
+};
+
+/* One level of detail, a part of the index array */
+struct LODLevel {
+    int first;      // First index in the index array
+    int count;      // Number of indices
+    float error;    // Largest distance to the full mesh, in mesh units
+};
 
 /* A struct to hold geometry data and send it off for rendering */
 class TriangleSoup {
@@ -32,20 +81,88 @@ private:
     int ntris;  // Number of triangles in the index array (may be zero)
     GLuint vertexbuffer; // Buffer ID to bind to GL_ARRAY_BUFFER
     GLuint indexbuffer;  // Buffer ID to bind to GL_ELEMENT_ARRAY_BUFFER
-    GLfloat *vertexarray; // Vertex array on interleaved format: x y z nx ny nz s t
-    GLuint *indexarray;   // Element index array
+    GLuint tangentbuffer; // Buffer ID for the tangents, 0 if there are none
+    GLfloat *vertexarray; // Vertex array on interleaved format: x y z nx ny nz s t,
+                          // NULL for a packed cache file until something needs it
+    unsigned char *packedarray; // The vertices packed in format, as they are uploaded,
+                                // or NULL for the float format, where it is vertexarray
+    GLuint *indexarray;   // Element index array, NULL if it is in shortindexarray
+    GLushort *shortindexarray; // The same in 16 bits, for a built mesh with at
+                               // most MAX_16BIT_INDEX+1 vertices, else NULL
+    GLfloat *tangentarray; // Tangents for the vertex array: tx ty tz sign, or NULL
+    int options;          // Flags from setOptions()
+    MeshCache *cache;     // Mapped cache file that the arrays point into, if any
+    VertexFormat format;  // Layout of the vertex buffer, see setVertexFormat()
+    GLenum indextype;     // Type of the uploaded indices, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    std::vector<IndexRange> clusters; // 16-bit parts of a split mesh, empty if not split
+    std::vector<LODLevel> lods;       // Levels of detail, empty if there are none
+    GLfloat boundmin[3];    // Bounding box, see computeBounds()
+    GLfloat boundmax[3];
+    GLfloat boundcenter[3]; // Bounding sphere
+    GLfloat boundradius;    // Negative if the bounds are not computed yet
+    MeshBVH *bvh;           // Tree for pick(), NULL if there is none
+    GLuint instancebuffer;  // Stream buffer for renderInstanced(), 0 until it is used
+    int instancecapacity;   // Instances that fit in it, 0 if the VAO doesn't use it yet
+    GeometryArena *arena;   // Shared buffers that the mesh is in, NULL if it has its own
+    GeometryArena::Range arenarange; // Where in the arena the mesh is
+
+    // OpenGL objects of the previous mesh that loadOBJ() took off, for
+    // createBuffers() to delete on the thread with the context
+    struct RetiredBuffers {
+        GLuint vao, vertexbuffer, indexbuffer, tangentbuffer, instancebuffer;
+        GeometryArena *arena;
+        GeometryArena::Range arenarange;
+    };
+    RetiredBuffers retired;
 
 public:
 
+/* Flags for setOptions(), combine them with | */
+enum Options {
+    WELD_VERTICES = 1, // readOBJ(): faces share vertices with identical v/vt/vn
+    NO_MESH_CACHE = 2, // readOBJ(): always parse the file, don't use a .tsoup cache
+    OPTIMIZE_MESH = 4, // Reorder triangles and vertices for the GPU caches (see optimize())
+    SPLIT_16BIT_INDICES = 8, // Split meshes with more than 65535 vertices into parts
+                             // that use 16-bit indices, drawn one by one
+    GENERATE_LODS = 16, // readOBJ(): add levels of detail with createLODs()
+    BUILD_BVH = 32, // Build a MeshBVH for pick() when the mesh is built
+    GENERATE_TANGENTS = 64, // Add tangents for normal mapping when the mesh is built
+    USE_GEOMETRY_ARENA = 128 // createBuffers(): put the mesh in the shared GeometryArena
+                             // for its vertex format instead of buffers of its own
+};
+
+/* The largest vertex number in a 16-bit index buffer. 0xFFFF itself is
+ * never used, so it stays free as the primitive restart index. */
+static const int MAX_16BIT_INDEX = 0xFFFE;
+
+/* The triangle ratios of the levels of detail for GENERATE_LODS */
+static const int DEFAULT_NUM_LODS = 4;
+static const float DEFAULT_LOD_RATIOS[DEFAULT_NUM_LODS];
+
 /* Constructor: initialize a triangleSoup object to all zeros */
 TriangleSoup();
 
 /* Destructor: clean up allocated data in a triangleSoup object */
 ~TriangleSoup();
 
-/* Clean up allocated data in a triangleSoup object */
+/* Clean up allocated data in a triangleSoup object. This deletes the
+ * OpenGL objects, so call it on the thread with the context. */
 void clean();
 
+/* Set the flags (from enum Options) for how the next mesh is built */
+void setOptions(int flags);
+
+/* Choose how the vertices are packed in the vertex buffer, with
+ * enums from VertexFormat, before readOBJ() or loadOBJ(). The packed
+ * copy is made when the mesh is built and is what the .tsoup cache
+ * stores, so that a cached mesh goes to OpenGL straight from the file.
+ * The float array in memory is for the CPU side (bounds, BVH, tangents);
+ * for a mesh from a packed cache, it is decoded from the packed vertices
+ * only if one of those needs it. Packed formats need a vertex shader that
+ * decodes them, like the one in vertex.glsl. The default is the plain
+ * float format. */
+void setVertexFormat(int positiontype, int normaltype, int texcoordtype);
+
 /* Create a very simple demo mesh with a single triangle */
 void createTriangle();
 
@@ -58,19 +175,125 @@ void createSphere(float radius, int segments);
 /* Load geometry from an OBJ file */
 void readOBJ(const char* filename);
 
+/* Read an OBJ file into the arrays, without making any OpenGL calls.
+ * Returns 1 on success, 0 on failure. */
+int loadOBJ(const char* filename);
+
+/* Create the vertex array object and buffers from the arrays.
+ * Meshes with at most 65535 vertices get 16-bit indices, larger ones
+ * 32-bit indices, or 16-bit parts with the option SPLIT_16BIT_INDICES.
+ * The 16-bit indices of the smaller meshes are also what is kept in
+ * memory, from when loadOBJ() or createBuffers() has built the mesh. */
+void createBuffers();
+
+/* Reorder the triangles and vertices with MeshOptimizer, and drop the
+ * vertices that no triangle uses, before createBuffers().
+ * Done automatically when the OPTIMIZE_MESH option is set. */
+void optimize();
+
+/* Add levels of detail with MeshSimplifier, before createBuffers().
+ * Level i+1 has about ratios[i] times the triangles of the full mesh.
+ * Levels that can't be made smaller than the previous one are left out.
+ * Done automatically with DEFAULT_LOD_RATIOS when the GENERATE_LODS
+ * option is set. Meshes with levels of detail are never split into
+ * parts, so they keep 32-bit indices if they have too many vertices. */
+void createLODs(const float *ratios, int numratios);
+
+/* The number of levels of detail, 1 if only the full mesh is there */
+int numLODs();
+
+/* The simplification error of a level of detail, 0 for level 0 */
+float lodError(int level);
+
+/* The number of triangles in a level of detail */
+int lodTriangles(int level);
+
+/* The draw calls for a level of detail as ranges of the index buffer,
+ * for drawing the mesh some other way than with render(), like
+ * DrawBatch does. first and basevertex include the place of the mesh in
+ * its GeometryArena, if it is in one. The ranges are added to the end of
+ * ranges. Returns their number, 0 before createBuffers(). */
+int getDrawRanges(int level, std::vector<IndexRange> &ranges);
+
+/* The VAO to bind for the ranges, 0 before createBuffers() */
+GLuint vertexArray();
+
+/* The type of the indices, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT */
+GLenum indexType();
+
+/* The vertex layout, with the constants for decoding packed vertices */
+const VertexFormat &vertexFormat();
+
 /* Print data from a triangleSoup object, for debugging purposes */
 void print();
 
 /* Print information about a triangleSoup object (stats and extents) */
 void printInfo();
 
+/* The bounding box of the mesh, in mesh coordinates. Returns 1, or 0
+ * if createBuffers() has not been called yet (still loading). */
+int getBoundingBox(GLfloat *boxmin, GLfloat *boxmax);
+
+/* The bounding sphere of the mesh, in mesh coordinates. Returns 1, or 0
+ * if createBuffers() has not been called yet (still loading). */
+int getBoundingSphere(GLfloat *center, GLfloat *radius);
+
+/* Build the MeshBVH for pick(), from the full mesh. Done automatically
+ * when the BUILD_BVH option is set, on the loading thread for loadOBJ(). */
+void buildBVH();
+
+/* Make the tangents for normal mapping with TangentGenerator, before
+ * createBuffers(). Done automatically when the GENERATE_TANGENTS option
+ * is set, on the loading thread for loadOBJ(). */
+void generateTangents();
+
+/* Find the closest triangle of the full mesh hit by the ray
+ * origin + t * direction, in mesh coordinates. Returns 1 and fills in
+ * *hit if there is a hit, 0 if there is none, no BVH or no buffers yet. */
+int pick(const float *origin, const float *direction, RayHit *hit);
+
 /* Render the geometry in a triangleSoup object */
 void render();
 
+/* Render a level of detail, 0 is the full mesh (same as render()) */
+void renderLOD(int level);
+
+/* Render ninstances copies of a level of detail with one instanced draw
+ * call (one per part for a split mesh). matrices has 16 floats per
+ * instance, column major, which the shader applies before MV. colors
+ * (4 floats per instance) and layers (1 float per instance, for example
+ * a texture array layer) may be NULL. The data is copied to a stream
+ * buffer on every call. */
+void renderInstanced(const GLfloat *matrices, int ninstances,
+                     const GLfloat *colors = NULL, const GLfloat *layers = NULL, int level = 0);
+
 private:
 
 void printError(const char *errtype, const char *errmsg);
 
+void computeBounds();
+
+void packVertices();
+
+void unpackVertices();
+
+void cleanArrays();
+
+void narrowIndices();
+
+void widenIndices();
+
+const GLuint *wideIndices(std::vector<GLuint> &copy);
+
+void retireBuffers();
+
+void releaseRetired();
+
+unsigned char *splitClusters(const unsigned char *vertices, GLushort *shortindices,
+                             int *numsplitverts, GLfloat **splittangents);
+
+int numIndices();
+
 };
 
 #endif // TRIANGLESOUP_HPP
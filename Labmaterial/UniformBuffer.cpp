@@ -0,0 +1,228 @@
+/*
+ * Uniform buffers for the frame and object constants, see UniformBuffer.hpp.
+ */
+
+#include <cstdio>  // For printf()
+#include <cstring> // For memcpy() and strcmp()
+#include <string>
+
+#include "UniformBuffer.hpp"
+#include "Shader.hpp"
+#include "GLState.hpp"    // Binds that skip what is already bound
+#include "Utilities.hpp"  // To be able to use OpenGL extensions
+
+namespace {
+
+size_t sharedcapacity = 1 << 20; // Bytes in the shared ring
+
+/* A block, and where its members are in the structs */
+struct BlockLayout {
+    const char *name;
+    int binding;
+    size_t size;
+};
+const BlockLayout blocklayouts[] = {
+    { "FrameBlock", UNIFORMBUFFER_FRAME_BINDING, sizeof(FrameBlock) },
+    { "ObjectBlock", UNIFORMBUFFER_OBJECT_BINDING, sizeof(ObjectBlock) }
+};
+const int NUM_BLOCKS = sizeof(blocklayouts) / sizeof(blocklayouts[0]);
+
+struct MemberLayout {
+    const char *block;
+    const char *name;
+    size_t offset;
+};
+const MemberLayout memberlayouts[] = {
+    { "FrameBlock", "P", offsetof(FrameBlock, P) },
+    { "FrameBlock", "LV", offsetof(FrameBlock, LV) },
+    { "FrameBlock", "time", offsetof(FrameBlock, time) },
+    { "ObjectBlock", "MV", offsetof(ObjectBlock, MV) }
+};
+const int NUM_MEMBERS = sizeof(memberlayouts) / sizeof(memberlayouts[0]);
+
+UniformRing *sharedring = NULL;
+
+} // namespace
+
+
+UniformRing &UniformRing::get() {
+    if(!sharedring) sharedring = new UniformRing(sharedcapacity);
+    return *sharedring;
+}
+
+
+void UniformRing::setCapacity(size_t capacity) {
+    sharedcapacity = capacity;
+}
+
+
+/* Constructor: the buffer, and the alignment of this OpenGL driver */
+UniformRing::UniformRing(size_t capacity) {
+    this->capacity = capacity;
+    head = 0;
+    bytes = 0;
+    maps = 0;
+    binds = 0;
+    wraps = 0;
+    grows = 0;
+    GLint bytealignment = 256; // The largest that drivers ask for
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &bytealignment);
+    alignment = bytealignment > 0 ? (size_t)bytealignment : 1;
+    glGenBuffers(1, &buffer);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+}
+
+
+UniformRing::~UniformRing() {
+    GLState::deleteBuffer(buffer);
+}
+
+
+size_t UniformRing::stride(size_t size) const {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+
+/*
+ * map() - the next free room, or new storage if the rest of the buffer
+ * is too small. The new storage must also have room for the kept
+ * blocks, which go first. The range is mapped unsynchronized, as
+ * nothing in it has been written since the storage was new.
+ */
+void *UniformRing::map(size_t size, GLintptr *offset) {
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer);
+    size_t start = stride(head);
+    if(start + size > capacity) {
+        size_t needed = 0;
+        for(size_t k=0; k<kept.size(); k++) needed += stride(kept[k].data.size());
+        needed += size;
+        if(needed > capacity) {
+            capacity = (needed > 2 * capacity) ? needed : 2 * capacity;
+            grows++;
+        }
+        glBufferData(GL_UNIFORM_BUFFER, capacity, NULL, GL_STREAM_DRAW); // Orphan
+        head = 0;
+        wraps++;
+        restoreKept();
+        start = stride(head);
+    }
+    head = start + size;
+    *offset = (GLintptr)start;
+    bytes += size;
+    maps++;
+    return glMapBufferRange(GL_UNIFORM_BUFFER, start, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+
+void UniformRing::unmap() {
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+}
+
+
+void UniformRing::write(GLintptr offset, const void *data, size_t size) {
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+}
+
+
+/* bind() - a binding point that is bound to a range from map() no longer
+ * gets its kept block back */
+void UniformRing::bind(GLuint binding, GLintptr offset, size_t size) {
+    for(size_t k=0; k<kept.size(); k++) {
+        if(kept[k].binding == binding) {
+            kept.erase(kept.begin() + k);
+            break;
+        }
+    }
+    GLState::bindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+    binds++;
+}
+
+
+void UniformRing::bindData(GLuint binding, const void *data, size_t size) {
+    GLintptr offset;
+    void *room = map(size, &offset);
+    if(room) {
+        memcpy(room, data, size);
+        unmap();
+    }
+    else {
+        write(offset, data, size);
+    }
+    bind(binding, offset, size);
+    KeptBlock block;
+    block.binding = binding;
+    block.data.assign((const unsigned char*)data, (const unsigned char*)data + size);
+    kept.push_back(block);
+}
+
+
+/*
+ * private
+ * restoreKept() - the storage was just orphaned, so nothing in it can be
+ * in use, and glBufferSubData() does not have to wait. The ranges are
+ * bound again even where the offset is the same, so that no binding
+ * depends on being the same as before.
+ */
+void UniformRing::restoreKept() {
+    for(size_t k=0; k<kept.size(); k++) {
+        size_t start = stride(head);
+        size_t size = kept[k].data.size();
+        glBufferSubData(GL_UNIFORM_BUFFER, start, size, &kept[k].data[0]);
+        GLState::bindBufferRange(GL_UNIFORM_BUFFER, kept[k].binding, buffer, start, size);
+        head = start + size;
+        bytes += size;
+        binds++;
+    }
+}
+
+
+void UniformRing::printStats() const {
+    printf("UniformRing: %.1f KB written in %lld maps, %lld binds, started over %d times, grown %d times (%.1f KB, aligned to %d bytes)\n",
+        bytes / 1024.0, maps, binds, wraps, grows, capacity / 1024.0, (int)alignment);
+}
+
+
+/*
+ * checkLayout() - compare the offsets and sizes that OpenGL gives for the
+ * program with the structs. With std140 they should always match, so
+ * an error means that a shader and the structs were not changed together.
+ */
+int UniformRing::checkLayout(const Shader &shader) {
+    int matches = 1;
+    for(size_t b=0; b<shader.blocks.size(); b++) {
+        const Shader::Block &block = shader.blocks[b];
+        for(int l=0; l<NUM_BLOCKS; l++) {
+            if(block.name != blocklayouts[l].name) continue;
+            if((size_t)block.size != blocklayouts[l].size) {
+                Utilities::printError("Uniform block has another size than its struct", block.name.c_str());
+                matches = 0;
+            }
+        }
+    }
+    for(size_t u=0; u<shader.uniforms.size(); u++) {
+        const Shader::Variable &uniform = shader.uniforms[u];
+        if(uniform.block < 0) continue;
+        const std::string &blockname = shader.blocks[uniform.block].name;
+        for(int m=0; m<NUM_MEMBERS; m++) {
+            if(blockname == memberlayouts[m].block && uniform.name == memberlayouts[m].name
+               && (size_t)uniform.offset != memberlayouts[m].offset) {
+                Utilities::printError("Uniform block member has another offset than in its struct",
+                    uniform.name.c_str());
+                matches = 0;
+            }
+        }
+    }
+    return matches;
+}
+
+
+int UniformRing::bindingFor(const char *blockname) {
+    for(int l=0; l<NUM_BLOCKS; l++) {
+        if(!strcmp(blockname, blocklayouts[l].name)) return blocklayouts[l].binding;
+    }
+    return -1;
+}
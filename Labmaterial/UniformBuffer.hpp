@@ -0,0 +1,137 @@
+/* UniformBuffer.hpp */
+/* Uniform buffer objects for the constants of each frame and each object. */
+/* Usage: the shaders declare the uniforms that are the same for a whole
+ * frame (P, LV, time) in the uniform block FrameBlock, and the uniforms
+ * of each object (MV) in ObjectBlock, both with the std140 layout, see
+ * vertex.glsl. Shader::createShader() connects the blocks of every
+ * program to the binding points below and checks their layout against
+ * the structs FrameBlock and ObjectBlock.
+ *
+ * Once per frame, fill in a FrameBlock and give it to bindData() of the
+ * shared UniformRing::get() with UNIFORMBUFFER_FRAME_BINDING. Every
+ * program then sees the same values, so changing programs in the middle
+ * of a frame needs no new uploads. For many objects, map() room for all
+ * their ObjectBlocks at once, spaced stride() bytes apart, and bind()
+ * the range of each object before its draw, as RenderQueue does. A draw
+ * then only needs a glBindBufferRange() instead of glUniform calls.
+ *
+ * The ring is one buffer that is written from the start to the end,
+ * never over data written before. When it is full, its storage is
+ * orphaned with glBufferData(NULL) and writing starts over at the
+ * beginning, so it never needs to wait for the GPU to finish with
+ * the old data. A range that is still bound then points into the new
+ * storage, so the ring keeps a copy of the last block that bindData()
+ * bound to each binding point, writes it again at the beginning of the
+ * new storage and binds it there. A FrameBlock bound once per frame
+ * thus stays valid however often the ring starts over in the frame.
+ * Ranges from map() are not copied, and must be bound again after the
+ * next map(), as RenderQueue does for each draw. */
+
+#ifndef UNIFORMBUFFER_HPP // Avoid including this header twice
+#define UNIFORMBUFFER_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+
+#include <cstddef>
+#include <vector>
+
+class Shader;
+
+// The uniform buffer binding points of the blocks
+#define UNIFORMBUFFER_FRAME_BINDING 0
+#define UNIFORMBUFFER_OBJECT_BINDING 1
+
+/* The std140 layout of FrameBlock in the shaders. A mat4 is four vec4
+ * columns of 16 bytes each, and a float after it starts on the next
+ * 4-byte boundary. The size of a block is rounded up to 16 bytes. */
+struct FrameBlock {
+    GLfloat P[16];      // Offset 0
+    GLfloat LV[16];     // Offset 64
+    GLfloat time;       // Offset 128
+    GLfloat padding[3];
+};
+
+/* The std140 layout of ObjectBlock */
+struct ObjectBlock {
+    GLfloat MV[16];     // Offset 0
+};
+
+class UniformRing {
+
+public:
+
+/* The ring that the program shares, created on the first call, which
+ * must be made with an OpenGL context */
+static UniformRing &get();
+
+/* The capacity in bytes of the ring that get() creates, if it is called
+ * before the first get(). A small one starts over often, for testing. */
+static void setCapacity(size_t capacity);
+
+/* Constructor: a buffer of capacity bytes. It grows if one map() asks
+ * for more. */
+UniformRing(size_t capacity);
+
+/* Destructor: delete the buffer */
+~UniformRing();
+
+/* size rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, the spacing of
+ * blocks that are bound one by one */
+size_t stride(size_t size) const;
+
+/* Room for size bytes in the buffer, at *offset. Write the data to the
+ * pointer, then unmap() before drawing. If the buffer could not be
+ * mapped, map() returns NULL and the room is still reserved, to be
+ * filled with write() instead. unmap() is then not needed. */
+void *map(size_t size, GLintptr *offset);
+void unmap();
+
+/* Copy data to a range reserved by map() with glBufferSubData() */
+void write(GLintptr offset, const void *data, size_t size);
+
+/* Bind a range of the buffer to a binding point */
+void bind(GLuint binding, GLintptr offset, size_t size);
+
+/* Copy one block to the ring and bind it. The block is bound again if
+ * the ring starts over, until something else is bound there. */
+void bindData(GLuint binding, const void *data, size_t size);
+
+/* Print how much was written, and how often the ring started over */
+void printStats() const;
+
+/* Check that a program's FrameBlock and ObjectBlock match the structs
+ * above, and print an error if they do not. 1 if they match. */
+static int checkLayout(const Shader &shader);
+
+/* The binding point for a block name, or -1 for a block not listed above */
+static int bindingFor(const char *blockname);
+
+private:
+
+/* The last block that bindData() bound to a binding point */
+struct KeptBlock {
+    GLuint binding;
+    std::vector<unsigned char> data;
+};
+
+/* Write the kept blocks at the beginning of new storage and bind them */
+void restoreKept();
+
+GLuint buffer;
+size_t capacity;
+size_t head;        // Where the next map() starts
+size_t alignment;
+std::vector<KeptBlock> kept;
+long long bytes;    // Statistics
+long long maps;
+long long binds;
+int wraps;
+int grows;
+
+};
+
+#endif // UNIFORMBUFFER_HPP
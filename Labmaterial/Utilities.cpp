@@ -39,6 +39,9 @@ PFNGLUNIFORM1FPROC                glUniform1f          = NULL;
 PFNGLUNIFORM1FVPROC               glUniform1fv         = NULL;
 PFNGLUNIFORM1IPROC                glUniform1i          = NULL;
 PFNGLUNIFORMMATRIX4FVPROC         glUniformMatrix4fv   = NULL;
+PFNGLGETACTIVEUNIFORMPROC         glGetActiveUniform   = NULL;
+PFNGLGETACTIVEATTRIBPROC          glGetActiveAttrib    = NULL;
+PFNGLGETATTRIBLOCATIONPROC        glGetAttribLocation  = NULL;
 PFNGLGENBUFFERSPROC               glGenBuffers         = NULL;
 PFNGLISBUFFERPROC                 glIsBuffer           = NULL;
 PFNGLBINDBUFFERPROC               glBindBuffer         = NULL;
@@ -51,7 +54,31 @@ PFNGLDELETEVERTEXARRAYSPROC       glDeleteVertexArrays = NULL;
 PFNGLENABLEVERTEXATTRIBARRAYPROC  glEnableVertexAttribArray  = NULL;
 PFNGLVERTEXATTRIBPOINTERPROC      glVertexAttribPointer      = NULL;
 PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray = NULL;
+PFNGLVERTEXATTRIB1FPROC           glVertexAttrib1f           = NULL;
+PFNGLVERTEXATTRIB4FVPROC          glVertexAttrib4fv          = NULL;
+PFNGLDRAWELEMENTSBASEVERTEXPROC   glDrawElementsBaseVertex   = NULL;
+PFNGLBUFFERSUBDATAPROC            glBufferSubData            = NULL;
+PFNGLVERTEXATTRIB4FPROC           glVertexAttrib4f           = NULL;
+PFNGLVERTEXATTRIBDIVISORPROC      glVertexAttribDivisor      = NULL;
+PFNGLDRAWELEMENTSINSTANCEDPROC    glDrawElementsInstanced    = NULL;
+PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC glDrawElementsInstancedBaseVertex = NULL;
+PFNGLCOPYBUFFERSUBDATAPROC        glCopyBufferSubData        = NULL;
 PFNGLGENERATEMIPMAPPROC           glGenerateMipmap           = NULL;
+PFNGLACTIVETEXTUREPROC            glActiveTexture            = NULL;
+PFNGLBINDBUFFERRANGEPROC          glBindBufferRange          = NULL;
+PFNGLUNIFORMBLOCKBINDINGPROC      glUniformBlockBinding      = NULL;
+PFNGLGETACTIVEUNIFORMBLOCKIVPROC  glGetActiveUniformBlockiv  = NULL;
+PFNGLGETACTIVEUNIFORMBLOCKNAMEPROC glGetActiveUniformBlockName = NULL;
+PFNGLGETACTIVEUNIFORMSIVPROC      glGetActiveUniformsiv      = NULL;
+PFNGLMAPBUFFERRANGEPROC           glMapBufferRange           = NULL;
+PFNGLUNMAPBUFFERPROC              glUnmapBuffer              = NULL;
+PFNGLGETINTEGERI_VPROC            glGetIntegeri_v            = NULL;
+PFNGLGETBUFFERSUBDATAPROC         glGetBufferSubData         = NULL;
+PFNGLGETSTRINGIPROC               glGetStringi               = NULL;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glMultiDrawElementsIndirect = NULL;
+PFNGLGETPROGRAMBINARYPROC         glGetProgramBinary         = NULL;
+PFNGLPROGRAMBINARYPROC            glProgramBinary            = NULL;
+PFNGLPROGRAMPARAMETERIPROC        glProgramParameteri        = NULL;
 #endif
 
 
@@ -91,12 +118,16 @@ void Utilities::loadExtensions() {
     glUniform1fv         = (PFNGLUNIFORM1FVPROC)glfwGetProcAddress("glUniform1fv");
     glUniform1i          = (PFNGLUNIFORM1IPROC)glfwGetProcAddress("glUniform1i");
 	glUniformMatrix4fv   = (PFNGLUNIFORMMATRIX4FVPROC)glfwGetProcAddress("glUniformMatrix4fv");
+    glGetActiveUniform   = (PFNGLGETACTIVEUNIFORMPROC)glfwGetProcAddress("glGetActiveUniform");
+    glGetActiveAttrib    = (PFNGLGETACTIVEATTRIBPROC)glfwGetProcAddress("glGetActiveAttrib");
+    glGetAttribLocation  = (PFNGLGETATTRIBLOCATIONPROC)glfwGetProcAddress("glGetAttribLocation");
 
     if( !glCreateProgram || !glDeleteProgram || !glUseProgram ||
         !glCreateShader || !glDeleteShader || !glShaderSource || !glCompileShader ||
         !glGetShaderiv || !glGetShaderInfoLog || !glAttachShader || !glLinkProgram ||
         !glGetProgramiv || !glGetProgramInfoLog || !glGetUniformLocation ||
-        !glUniform1fv || !glUniform1f || !glUniform1i || !glUniformMatrix4fv )
+        !glUniform1fv || !glUniform1f || !glUniform1i || !glUniformMatrix4fv ||
+        !glGetActiveUniform || !glGetActiveAttrib || !glGetAttribLocation )
     {
         printError("GL init error", "One or more required OpenGL shader-related functions were not found");
         return;
@@ -114,22 +145,65 @@ void Utilities::loadExtensions() {
 	glEnableVertexAttribArray  = (PFNGLENABLEVERTEXATTRIBARRAYPROC)glfwGetProcAddress("glEnableVertexAttribArray");
 	glVertexAttribPointer      = (PFNGLVERTEXATTRIBPOINTERPROC)glfwGetProcAddress("glVertexAttribPointer");
 	glDisableVertexAttribArray = (PFNGLDISABLEVERTEXATTRIBARRAYPROC)glfwGetProcAddress("glDisableVertexAttribArray");
+	glVertexAttrib1f           = (PFNGLVERTEXATTRIB1FPROC)glfwGetProcAddress("glVertexAttrib1f");
+	glVertexAttrib4fv          = (PFNGLVERTEXATTRIB4FVPROC)glfwGetProcAddress("glVertexAttrib4fv");
+	glDrawElementsBaseVertex   = (PFNGLDRAWELEMENTSBASEVERTEXPROC)glfwGetProcAddress("glDrawElementsBaseVertex");
+	glBufferSubData            = (PFNGLBUFFERSUBDATAPROC)glfwGetProcAddress("glBufferSubData");
+	glVertexAttrib4f           = (PFNGLVERTEXATTRIB4FPROC)glfwGetProcAddress("glVertexAttrib4f");
+	glVertexAttribDivisor      = (PFNGLVERTEXATTRIBDIVISORPROC)glfwGetProcAddress("glVertexAttribDivisor");
+	glDrawElementsInstanced    = (PFNGLDRAWELEMENTSINSTANCEDPROC)glfwGetProcAddress("glDrawElementsInstanced");
+	glDrawElementsInstancedBaseVertex = (PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC)glfwGetProcAddress("glDrawElementsInstancedBaseVertex");
+	glCopyBufferSubData        = (PFNGLCOPYBUFFERSUBDATAPROC)glfwGetProcAddress("glCopyBufferSubData");
 
 	if( !glGenBuffers || !glIsBuffer || !glBindBuffer || !glBufferData || !glDeleteBuffers ||
 	    !glGenVertexArrays || !glIsVertexArray || !glBindVertexArray || !glDeleteVertexArrays ||
 		!glEnableVertexAttribArray || !glVertexAttribPointer ||
-		!glDisableVertexAttribArray )
+		!glDisableVertexAttribArray || !glVertexAttrib1f || !glVertexAttrib4fv ||
+		!glDrawElementsBaseVertex || !glBufferSubData || !glVertexAttrib4f ||
+		!glVertexAttribDivisor || !glDrawElementsInstanced || !glDrawElementsInstancedBaseVertex ||
+		!glCopyBufferSubData )
     	{
 	   		printError("GL init error", "One or more required OpenGL vertex array functions were not found");
             return;
         }
 
 	glGenerateMipmap = (PFNGLGENERATEMIPMAPPROC)glfwGetProcAddress("glGenerateMipmap");
-	if( !glGenerateMipmap)
+	glActiveTexture  = (PFNGLACTIVETEXTUREPROC)glfwGetProcAddress("glActiveTexture");
+	if( !glGenerateMipmap || !glActiveTexture)
     	{
-	   		printError("GL init error", "The required OpenGL function glGenerateMipmap() was not found");
+	   		printError("GL init error", "The required OpenGL texture functions were not found");
             return;
         }
+
+	glBindBufferRange           = (PFNGLBINDBUFFERRANGEPROC)glfwGetProcAddress("glBindBufferRange");
+	glUniformBlockBinding       = (PFNGLUNIFORMBLOCKBINDINGPROC)glfwGetProcAddress("glUniformBlockBinding");
+	glGetActiveUniformBlockiv   = (PFNGLGETACTIVEUNIFORMBLOCKIVPROC)glfwGetProcAddress("glGetActiveUniformBlockiv");
+	glGetActiveUniformBlockName = (PFNGLGETACTIVEUNIFORMBLOCKNAMEPROC)glfwGetProcAddress("glGetActiveUniformBlockName");
+	glGetActiveUniformsiv       = (PFNGLGETACTIVEUNIFORMSIVPROC)glfwGetProcAddress("glGetActiveUniformsiv");
+	glMapBufferRange            = (PFNGLMAPBUFFERRANGEPROC)glfwGetProcAddress("glMapBufferRange");
+	glUnmapBuffer               = (PFNGLUNMAPBUFFERPROC)glfwGetProcAddress("glUnmapBuffer");
+	glGetIntegeri_v             = (PFNGLGETINTEGERI_VPROC)glfwGetProcAddress("glGetIntegeri_v");
+	glGetBufferSubData          = (PFNGLGETBUFFERSUBDATAPROC)glfwGetProcAddress("glGetBufferSubData");
+	if( !glBindBufferRange || !glUniformBlockBinding ||
+	    !glGetActiveUniformBlockiv || !glGetActiveUniformBlockName || !glGetActiveUniformsiv ||
+	    !glMapBufferRange || !glUnmapBuffer || !glGetIntegeri_v || !glGetBufferSubData )
+    	{
+	   		printError("GL init error", "The required OpenGL uniform buffer functions were not found");
+            return;
+        }
+
+	glGetStringi = (PFNGLGETSTRINGIPROC)glfwGetProcAddress("glGetStringi");
+	if( !glGetStringi )
+    	{
+	   		printError("GL init error", "The required OpenGL extension list function was not found");
+            return;
+        }
+
+	// Not required, the programs check for NULL
+	glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)glfwGetProcAddress("glMultiDrawElementsIndirect");
+	glGetProgramBinary          = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+	glProgramBinary             = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+	glProgramParameteri         = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
 #endif
 }
 
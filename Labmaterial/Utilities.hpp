@@ -43,6 +43,9 @@ extern PFNGLUNIFORM1FPROC                glUniform1f;
 extern PFNGLUNIFORM1FVPROC               glUniform1fv;
 extern PFNGLUNIFORM1IPROC                glUniform1i;
 extern PFNGLUNIFORMMATRIX4FVPROC         glUniformMatrix4fv;
+extern PFNGLGETACTIVEUNIFORMPROC         glGetActiveUniform;
+extern PFNGLGETACTIVEATTRIBPROC          glGetActiveAttrib;
+extern PFNGLGETATTRIBLOCATIONPROC        glGetAttribLocation;
 extern PFNGLGENBUFFERSPROC               glGenBuffers;
 extern PFNGLISBUFFERPROC                 glIsBuffer;
 extern PFNGLBINDBUFFERPROC               glBindBuffer;
@@ -55,7 +58,33 @@ extern PFNGLDELETEVERTEXARRAYSPROC       glDeleteVertexArrays;
 extern PFNGLENABLEVERTEXATTRIBARRAYPROC  glEnableVertexAttribArray;
 extern PFNGLVERTEXATTRIBPOINTERPROC      glVertexAttribPointer;
 extern PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray;
+extern PFNGLVERTEXATTRIB1FPROC           glVertexAttrib1f;
+extern PFNGLVERTEXATTRIB4FVPROC          glVertexAttrib4fv;
+extern PFNGLDRAWELEMENTSBASEVERTEXPROC   glDrawElementsBaseVertex;
+extern PFNGLBUFFERSUBDATAPROC            glBufferSubData;
+extern PFNGLVERTEXATTRIB4FPROC           glVertexAttrib4f;
+extern PFNGLVERTEXATTRIBDIVISORPROC      glVertexAttribDivisor;
+extern PFNGLDRAWELEMENTSINSTANCEDPROC    glDrawElementsInstanced;
+extern PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC glDrawElementsInstancedBaseVertex;
+extern PFNGLCOPYBUFFERSUBDATAPROC       glCopyBufferSubData;
 extern PFNGLGENERATEMIPMAPPROC           glGenerateMipmap;
+extern PFNGLACTIVETEXTUREPROC            glActiveTexture;
+extern PFNGLBINDBUFFERRANGEPROC          glBindBufferRange;
+extern PFNGLUNIFORMBLOCKBINDINGPROC      glUniformBlockBinding;
+extern PFNGLGETACTIVEUNIFORMBLOCKIVPROC  glGetActiveUniformBlockiv;
+extern PFNGLGETACTIVEUNIFORMBLOCKNAMEPROC glGetActiveUniformBlockName;
+extern PFNGLGETACTIVEUNIFORMSIVPROC      glGetActiveUniformsiv;
+extern PFNGLMAPBUFFERRANGEPROC           glMapBufferRange;
+extern PFNGLUNMAPBUFFERPROC              glUnmapBuffer;
+extern PFNGLGETINTEGERI_VPROC            glGetIntegeri_v;
+extern PFNGLGETBUFFERSUBDATAPROC         glGetBufferSubData;
+extern PFNGLGETSTRINGIPROC               glGetStringi;
+// Optional, NULL if the driver lacks OpenGL 4.3 (see DrawBatch)
+extern PFNGLMULTIDRAWELEMENTSINDIRECTPROC glMultiDrawElementsIndirect;
+// Optional, NULL if the driver lacks OpenGL 4.1 (see ProgramCache)
+extern PFNGLGETPROGRAMBINARYPROC         glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC            glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC        glProgramParameteri;
 
 #endif
 
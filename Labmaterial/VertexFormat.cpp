@@ -0,0 +1,408 @@
+/*
+ * Packing and unpacking of quantized vertex formats.
+ * The conversions follow the OpenGL rules for normalized integers:
+ * unsigned c with n bits means c / (2^n - 1), signed c means
+ * max(c / (2^(n-1) - 1), -1). The error report decodes the packed data
+ * with the same rules, so it shows what the vertex shader really gets.
+ */
+
+#include <cstdio>  // For printf()
+#include <cmath>   // For floor(), sqrt(), atan2()
+#include <cstring> // For memcpy()
+#include <stdint.h>
+
+#include "VertexFormat.hpp"
+#include "Utilities.hpp"  // To be able to use OpenGL extensions
+
+namespace {
+
+// The glVertexAttribPointer() arguments for each encoding, in enum order
+struct AttribLayout {
+    GLint components;
+    GLenum type;
+    GLboolean normalized;
+};
+const AttribLayout POSITION_LAYOUTS[] = {
+    { 3, GL_FLOAT, GL_FALSE },         // POSITION_FLOAT
+    { 4, GL_UNSIGNED_SHORT, GL_TRUE }  // POSITION_UNORM16
+};
+const AttribLayout NORMAL_LAYOUTS[] = {
+    { 3, GL_FLOAT, GL_FALSE },         // NORMAL_FLOAT
+    { 2, GL_SHORT, GL_TRUE },          // NORMAL_OCT16
+    { 4, GL_INT_2_10_10_10_REV, GL_TRUE } // NORMAL_INT2101010
+};
+const AttribLayout TEXCOORD_LAYOUTS[] = {
+    { 2, GL_FLOAT, GL_FALSE },         // TEXCOORD_FLOAT
+    { 2, GL_HALF_FLOAT, GL_FALSE },    // TEXCOORD_HALF
+    { 2, GL_UNSIGNED_SHORT, GL_TRUE }  // TEXCOORD_UNORM16
+};
+
+/* Convert a float to a half float, rounding to nearest even */
+uint16_t floatToHalf(float f) {
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    uint16_t sign = (uint16_t)((x >> 16) & 0x8000);
+    int exponent = (int)((x >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = x & 0x007FFFFF;
+
+    if(((x >> 23) & 0xFF) == 0xFF) { // Inf or NaN
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    }
+    if(exponent >= 31) return sign | 0x7C00; // Too large, becomes Inf
+    if(exponent <= 0) { // Subnormal half, or zero
+        if(exponent < -10) return sign;
+        mantissa |= 0x00800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if(rest > halfway || (rest == halfway && (half & 1))) half++;
+        return sign | (uint16_t)half;
+    }
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    if(rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++; // May carry into the exponent, which is right
+    return sign | (uint16_t)half;
+}
+
+/* Convert a half float to a float */
+float halfToFloat(uint16_t h) {
+    int exponent = (h >> 10) & 0x1F;
+    int mantissa = h & 0x3FF;
+    float f;
+    if(exponent == 0) f = (float)ldexp((double)mantissa, -24);
+    else if(exponent == 31) f = mantissa ? NAN : INFINITY;
+    else f = (float)ldexp((double)(mantissa | 0x400), exponent - 25);
+    return (h & 0x8000) ? -f : f;
+}
+
+inline float clamp(float x, float lo, float hi) {
+    return (x < lo) ? lo : ((x > hi) ? hi : x);
+}
+
+/* Quantize x in [0,1] to an unsigned 16 bit normalized integer */
+inline uint16_t toUnorm16(float x) {
+    return (uint16_t)floor(clamp(x, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+/* Quantize x in [-1,1] to a signed normalized integer with the given maximum */
+inline int toSnorm(float x, int maxvalue) {
+    return (int)floor(clamp(x, -1.0f, 1.0f) * maxvalue + 0.5f);
+}
+
+inline float fromSnorm(int c, int maxvalue) {
+    float x = (float)c / maxvalue;
+    return (x < -1.0f) ? -1.0f : x;
+}
+
+/* Map an octahedral encoding in [-1,1]^2 back to a unit vector */
+void octDecode(float ex, float ey, float *n) {
+    float x = ex, y = ey, z = 1.0f - fabsf(ex) - fabsf(ey);
+    if(z < 0.0f) {
+        x = (1.0f - fabsf(ey)) * (ex >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - fabsf(ex)) * (ey >= 0.0f ? 1.0f : -1.0f);
+    }
+    float length = sqrtf(x*x + y*y + z*z);
+    n[0] = x / length;
+    n[1] = y / length;
+    n[2] = z / length;
+}
+
+/*
+ * Octahedral normal encoding: project onto the octahedron |x|+|y|+|z| = 1,
+ * fold the lower half over the upper, and keep x and y. Of the four
+ * nearest quantized points, the one that decodes closest is chosen.
+ */
+void octEncode(const float *n, int16_t *e) {
+    float sum = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    if(sum == 0.0f) { // Zero normal, just pick something
+        e[0] = e[1] = 0;
+        return;
+    }
+    float x = n[0] / sum, y = n[1] / sum;
+    if(n[2] < 0.0f) {
+        float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+    float bestdot = -2.0f;
+    for(int i=0; i<4; i++) {
+        int cx = (int)((i & 1) ? ceil(x * 32767.0f) : floor(x * 32767.0f));
+        int cy = (int)((i & 2) ? ceil(y * 32767.0f) : floor(y * 32767.0f));
+        if(cx < -32767) cx = -32767;
+        if(cx > 32767) cx = 32767;
+        if(cy < -32767) cy = -32767;
+        if(cy > 32767) cy = 32767;
+        float d[3];
+        octDecode(fromSnorm(cx, 32767), fromSnorm(cy, 32767), d);
+        float dot = d[0]*n[0] + d[1]*n[1] + d[2]*n[2];
+        if(dot > bestdot) {
+            bestdot = dot;
+            e[0] = (int16_t)cx;
+            e[1] = (int16_t)cy;
+        }
+    }
+}
+
+} // namespace
+
+
+/* Constructor: the given encodings */
+VertexFormat::VertexFormat(int positiontype, int normaltype, int texcoordtype) {
+    set(positiontype, normaltype, texcoordtype);
+}
+
+
+/* Choose the encodings and compute the stride and offsets */
+void VertexFormat::set(int positiontype, int normaltype, int texcoordtype) {
+
+    this->positiontype = positiontype;
+    this->normaltype = normaltype;
+    this->texcoordtype = texcoordtype;
+
+    positionoffset = 0;
+    normaloffset = positionoffset + ((positiontype == POSITION_FLOAT) ? 12 : 8);
+    texcoordoffset = normaloffset + ((normaltype == NORMAL_FLOAT) ? 12 : 4);
+    stride = texcoordoffset + ((texcoordtype == TEXCOORD_FLOAT) ? 8 : 4);
+
+    // Decoding constants for the identity mapping
+    for(int i=0; i<4; i++) {
+        positionscale[i] = 1.0f;
+        positionbias[i] = 0.0f;
+    }
+    texcoordscalebias[0] = texcoordscalebias[1] = 1.0f;
+    texcoordscalebias[2] = texcoordscalebias[3] = 0.0f;
+}
+
+
+/* Is this the plain 8 floats per vertex layout? */
+bool VertexFormat::isFloat() const {
+    return positiontype == POSITION_FLOAT && normaltype == NORMAL_FLOAT
+        && texcoordtype == TEXCOORD_FLOAT;
+}
+
+
+/*
+ * pack() - encode vertices in this format.
+ */
+unsigned char *VertexFormat::pack(const GLfloat *vertices, int nverts) {
+
+    unsigned char *packed = new unsigned char[(size_t)nverts * stride];
+
+    // The ranges that positions and texcoords are quantized within
+    float lo[5], hi[5];
+    for(int k=0; k<5; k++) lo[k] = hi[k] = (nverts > 0) ? vertices[(k < 3) ? k : k+3] : 0.0f;
+    for(int i=1; i<nverts; i++) {
+        const GLfloat *v = vertices + 8*i;
+        for(int k=0; k<5; k++) {
+            float x = v[(k < 3) ? k : k+3];
+            if(x < lo[k]) lo[k] = x;
+            if(x > hi[k]) hi[k] = x;
+        }
+    }
+    if(positiontype == POSITION_UNORM16) {
+        for(int k=0; k<3; k++) {
+            positionscale[k] = hi[k] - lo[k];
+            positionbias[k] = lo[k];
+        }
+    }
+    if(texcoordtype == TEXCOORD_UNORM16) {
+        for(int k=0; k<2; k++) {
+            texcoordscalebias[k] = hi[k+3] - lo[k+3];
+            texcoordscalebias[k+2] = lo[k+3];
+        }
+    }
+
+    for(int i=0; i<nverts; i++) {
+        const GLfloat *v = vertices + 8*i;
+        unsigned char *p = packed + (size_t)i * stride;
+
+        if(positiontype == POSITION_FLOAT) {
+            memcpy(p + positionoffset, v, 12);
+        }
+        else {
+            uint16_t q[4];
+            for(int k=0; k<3; k++) {
+                q[k] = (positionscale[k] > 0.0f) ? toUnorm16((v[k] - positionbias[k]) / positionscale[k]) : 0;
+            }
+            q[3] = 0;
+            memcpy(p + positionoffset, q, 8);
+        }
+
+        if(normaltype == NORMAL_FLOAT) {
+            memcpy(p + normaloffset, v + 3, 12);
+        }
+        else if(normaltype == NORMAL_OCT16) {
+            int16_t e[2];
+            octEncode(v + 3, e);
+            memcpy(p + normaloffset, e, 4);
+        }
+        else {
+            uint32_t bits = 0;
+            for(int k=0; k<3; k++) {
+                bits |= (uint32_t)(toSnorm(v[3+k], 511) & 0x3FF) << (10*k);
+            }
+            memcpy(p + normaloffset, &bits, 4);
+        }
+
+        if(texcoordtype == TEXCOORD_FLOAT) {
+            memcpy(p + texcoordoffset, v + 6, 8);
+        }
+        else if(texcoordtype == TEXCOORD_HALF) {
+            uint16_t h[2] = { floatToHalf(v[6]), floatToHalf(v[7]) };
+            memcpy(p + texcoordoffset, h, 4);
+        }
+        else {
+            uint16_t q[2];
+            for(int k=0; k<2; k++) {
+                float scale = texcoordscalebias[k];
+                q[k] = (scale > 0.0f) ? toUnorm16((v[6+k] - texcoordscalebias[k+2]) / scale) : 0;
+            }
+            memcpy(p + texcoordoffset, q, 4);
+        }
+    }
+    return packed;
+}
+
+
+/*
+ * setAttribPointers() - attributes 0, 1, 2 are the vertex coordinates,
+ * the normals and the texture coordinates.
+ */
+void VertexFormat::setAttribPointers() const {
+
+    for(int location=0; location<3; location++) {
+        GLint components;
+        GLenum type;
+        GLboolean normalized;
+        int offset;
+        attribute(location, &components, &type, &normalized, &offset);
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, components, type, normalized, stride, (void*)(size_t)offset);
+    }
+}
+
+
+/* The layout of attribute 0, 1 or 2 */
+void VertexFormat::attribute(int location, GLint *components, GLenum *type, GLboolean *normalized,
+                             int *offset) const {
+
+    const AttribLayout &layout = (location == 0) ? POSITION_LAYOUTS[positiontype]
+        : (location == 1) ? NORMAL_LAYOUTS[normaltype] : TEXCOORD_LAYOUTS[texcoordtype];
+    *components = layout.components;
+    *type = layout.type;
+    *normalized = layout.normalized;
+    *offset = (location == 0) ? positionoffset : (location == 1) ? normaloffset : texcoordoffset;
+}
+
+
+/* Set the decoding constants for the vertex shader */
+void VertexFormat::setDecodeAttribs() const {
+    glVertexAttrib4fv(VERTEXFORMAT_POSITION_SCALE, positionscale);
+    glVertexAttrib4fv(VERTEXFORMAT_POSITION_BIAS, positionbias);
+    glVertexAttrib4fv(VERTEXFORMAT_TEXCOORD_SCALE_BIAS, texcoordscalebias);
+    glVertexAttrib1f(VERTEXFORMAT_NORMAL_ENCODING, (normaltype == NORMAL_OCT16) ? 1.0f : 0.0f);
+}
+
+
+/* Decode packed vertex i back to 8 floats */
+void VertexFormat::unpack(const unsigned char *packed, int i, GLfloat *vertex) const {
+
+    const unsigned char *p = packed + (size_t)i * stride;
+
+    if(positiontype == POSITION_FLOAT) {
+        memcpy(vertex, p + positionoffset, 12);
+    }
+    else {
+        uint16_t q[4];
+        memcpy(q, p + positionoffset, 8);
+        for(int k=0; k<3; k++) vertex[k] = q[k] / 65535.0f * positionscale[k] + positionbias[k];
+    }
+
+    if(normaltype == NORMAL_FLOAT) {
+        memcpy(vertex + 3, p + normaloffset, 12);
+    }
+    else if(normaltype == NORMAL_OCT16) {
+        int16_t e[2];
+        memcpy(e, p + normaloffset, 4);
+        octDecode(fromSnorm(e[0], 32767), fromSnorm(e[1], 32767), vertex + 3);
+    }
+    else {
+        uint32_t bits;
+        memcpy(&bits, p + normaloffset, 4);
+        for(int k=0; k<3; k++) {
+            int c = (int)((bits >> (10*k)) & 0x3FF);
+            if(c >= 512) c -= 1024; // Sign extend
+            vertex[3+k] = fromSnorm(c, 511);
+        }
+    }
+
+    if(texcoordtype == TEXCOORD_FLOAT) {
+        memcpy(vertex + 6, p + texcoordoffset, 8);
+    }
+    else if(texcoordtype == TEXCOORD_HALF) {
+        uint16_t h[2];
+        memcpy(h, p + texcoordoffset, 4);
+        vertex[6] = halfToFloat(h[0]);
+        vertex[7] = halfToFloat(h[1]);
+    }
+    else {
+        uint16_t q[2];
+        memcpy(q, p + texcoordoffset, 4);
+        for(int k=0; k<2; k++) {
+            vertex[6+k] = q[k] / 65535.0f * texcoordscalebias[k] + texcoordscalebias[k+2];
+        }
+    }
+}
+
+
+/*
+ * printErrors() - compare the decoded vertices with the originals.
+ */
+void VertexFormat::printErrors(const GLfloat *vertices, const unsigned char *packed, int nverts) const {
+
+    double positionerror = 0.0, texcoorderror = 0.0; // Largest errors
+    double normalerror = 0.0; // Largest angle between a normal and its encoding
+    GLfloat v[8];
+
+    for(int i=0; i<nverts; i++) {
+        const GLfloat *original = vertices + 8*i;
+        unpack(packed, i, v);
+        for(int k=0; k<3; k++) {
+            double e = fabs(v[k] - original[k]);
+            if(e > positionerror) positionerror = e;
+        }
+        for(int k=6; k<8; k++) {
+            double e = fabs(v[k] - original[k]);
+            if(e > texcoorderror) texcoorderror = e;
+        }
+        // Compare directions, since the shader normalizes the normals.
+        // atan2() of |cross| and dot is accurate for tiny angles, acos() is not.
+        const GLfloat *n = original + 3;
+        double cx = (double)n[1]*v[5] - (double)n[2]*v[4];
+        double cy = (double)n[2]*v[3] - (double)n[0]*v[5];
+        double cz = (double)n[0]*v[4] - (double)n[1]*v[3];
+        double dot = (double)n[0]*v[3] + (double)n[1]*v[4] + (double)n[2]*v[5];
+        double angle = atan2(sqrt(cx*cx + cy*cy + cz*cz), dot);
+        if(angle > normalerror) normalerror = angle;
+    }
+    normalerror *= 180.0 / 3.14159265358979;
+
+    double size = 0.0; // Bounding box diagonal, for a relative position error
+    for(int k=0; k<3; k++) size += (double)positionscale[k] * positionscale[k];
+    size = sqrt(size);
+
+    printf("VertexFormat: %d vertices, %d bytes per vertex instead of 32 (%.1f MB saved)\n",
+        nverts, stride, nverts * (32.0 - stride) / (1024.0*1024.0));
+    if(positiontype == POSITION_UNORM16) {
+        printf("  position error max %.3g (%.4f%% of the bounding box diagonal)\n",
+            positionerror, (size > 0.0) ? 100.0 * positionerror / size : 0.0);
+    }
+    if(normaltype != NORMAL_FLOAT) {
+        printf("  normal error max %.4f degrees\n", normalerror);
+    }
+    if(texcoordtype != TEXCOORD_FLOAT) {
+        printf("  texcoord error max %.3g\n", texcoorderror);
+    }
+}
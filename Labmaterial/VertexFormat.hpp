@@ -0,0 +1,102 @@
+/* VertexFormat.hpp */
+/* Compact, quantized vertex layouts for the GPU copy of a mesh. */
+/* Usage: choose an encoding for each attribute in the constructor (or
+ * with set()), then call pack() with an array in the usual interleaved
+ * format (x y z nx ny nz s t, 8 floats per vertex) to get the packed
+ * vertices, stride bytes each. With the vertex buffer bound and the VAO
+ * active, setAttribPointers() describes the layout to OpenGL. Before
+ * drawing, setDecodeAttribs() sets the constants the vertex shader
+ * needs to decode the data (see vertex.glsl). printErrors() reports the
+ * largest quantization errors for a mesh.
+ *
+ * Encodings:
+ *   positions  POSITION_FLOAT   3 floats (12 bytes)
+ *              POSITION_UNORM16 4 unsigned shorts (8 bytes, one unused),
+ *                               relative to the bounding box of the mesh
+ *   normals    NORMAL_FLOAT     3 floats (12 bytes)
+ *              NORMAL_OCT16     octahedral mapping to 2 shorts (4 bytes)
+ *              NORMAL_INT2101010 x, y, z in 10 bits each (4 bytes)
+ *   texcoords  TEXCOORD_FLOAT   2 floats (8 bytes)
+ *              TEXCOORD_HALF    2 half floats (4 bytes)
+ *              TEXCOORD_UNORM16 2 unsigned shorts (4 bytes), relative
+ *                               to the texture coordinate range of the mesh
+ * The full float layout is 32 bytes per vertex, the most compact is 16.
+ * Every attribute starts on a 4 byte boundary, which is why a quantized
+ * position takes 8 bytes instead of 6.
+ *
+ * The decoding constants are passed as generic vertex attributes 4 to 7
+ * without any arrays. Their values are context state, not VAO state,
+ * which is why they must be set before each draw call. */
+
+#ifndef VERTEXFORMAT_HPP // Avoid including this header twice
+#define VERTEXFORMAT_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#include "GLFW/glfw3.h"   // To use OpenGL datatypes
+
+// Attribute locations used by vertex.glsl to decode packed vertices
+#define VERTEXFORMAT_POSITION_SCALE 4  // vec4: xyz scale for positions
+#define VERTEXFORMAT_POSITION_BIAS  5  // vec4: xyz offset for positions
+#define VERTEXFORMAT_TEXCOORD_SCALE_BIAS 6 // vec4: st scale (xy), st offset (zw)
+#define VERTEXFORMAT_NORMAL_ENCODING 7 // float: 1.0 for octahedral normals, else 0.0
+
+class VertexFormat {
+
+public:
+
+enum PositionType { POSITION_FLOAT, POSITION_UNORM16 };
+enum NormalType { NORMAL_FLOAT, NORMAL_OCT16, NORMAL_INT2101010 };
+enum TexCoordType { TEXCOORD_FLOAT, TEXCOORD_HALF, TEXCOORD_UNORM16 };
+
+int positiontype;     // PositionType
+int normaltype;       // NormalType
+int texcoordtype;     // TexCoordType
+int stride;           // Bytes per packed vertex
+int positionoffset;   // Byte offsets of the attributes in a packed vertex
+int normaloffset;
+int texcoordoffset;
+
+GLfloat positionscale[4];     // Decoding constants, computed by pack()
+GLfloat positionbias[4];
+GLfloat texcoordscalebias[4];
+
+/* Constructor: the given encodings, by default the plain float layout */
+VertexFormat(int positiontype = POSITION_FLOAT, int normaltype = NORMAL_FLOAT,
+             int texcoordtype = TEXCOORD_FLOAT);
+
+/* Choose the encodings and compute the stride and offsets */
+void set(int positiontype, int normaltype, int texcoordtype);
+
+/* Is this the plain 8 floats per vertex layout? */
+bool isFloat() const;
+
+/*
+ * pack() - encode nverts vertices (8 floats each) in this format.
+ * Returns a new[] array of nverts*stride bytes, which the caller deletes.
+ * The decoding constants are set to match the mesh.
+ */
+unsigned char *pack(const GLfloat *vertices, int nverts);
+
+/* Set up attributes 0, 1, 2 for the bound GL_ARRAY_BUFFER and VAO */
+void setAttribPointers() const;
+
+/* The layout of attribute 0, 1 or 2, as setAttribPointers() gives it
+ * to glVertexAttribPointer() */
+void attribute(int location, GLint *components, GLenum *type, GLboolean *normalized,
+               int *offset) const;
+
+/* Set the decoding constants for the vertex shader */
+void setDecodeAttribs() const;
+
+/* Decode packed vertex i back to 8 floats, the way the GPU does it */
+void unpack(const unsigned char *packed, int i, GLfloat *vertex) const;
+
+/* Print the largest encoding errors of packed compared to vertices */
+void printErrors(const GLfloat *vertices, const unsigned char *packed, int nverts) const;
+
+};
+
+#endif // VERTEXFORMAT_HPP
@@ -0,0 +1,24 @@
+//////// UNIFORM BLOCKS ////////
+// The constants of the frame and of each object, for #include in every
+// vertex and fragment shader. They come from uniform buffers (see
+// UniformBuffer.hpp), and the layout must match FrameBlock and
+// ObjectBlock there.
+//
+// With PLAIN_UNIFORMS defined, they are plain uniforms instead, which
+// are set one by one with glUniform*() (see Benchmarks::uniformSetting()).
+
+#ifdef PLAIN_UNIFORMS
+uniform mat4 P;
+uniform mat4 LV;
+uniform float time;
+uniform mat4 MV;
+#else
+layout(std140) uniform FrameBlock {
+    mat4 P;
+    mat4 LV;
+    float time;
+};
+layout(std140) uniform ObjectBlock {
+    mat4 MV;
+};
+#endif
@@ -1,17 +1,8 @@
-/////////// OLD FRAGMENT ////////
-//#version 330 core
-//
-//uniform float time;
-//
-//out vec4 finalcolor;
-//in vec3 interpolatedColor;
-//
-//void main() {
-//    finalcolor = vec4(interpolatedColor, 1.0);
-//}
-
-
 ///////// LABB 4 FRAGMENT ////////
+// Defines that make variants of this shader (see ShaderSource.hpp):
+//   TEXTURED        The diffuse color from the texture
+//   UNLIT           Only the texture color, without the shading (LABB 5)
+//   PLAIN_UNIFORMS  Plain uniforms instead of blocks
 #version 330 core
 
     // vec3 L is the light direction
@@ -29,20 +20,26 @@
 in vec3 interpolatedNormal;
 uniform sampler2D tex; // A uniform varible to identify the texture
 in vec2 st; // Interpolated texture coords, setn from the vertex shader
-uniform mat4 LV;
+#include "blocks.glsl"
 
 out vec4 finalcolor;
 
 void main() {
 
+#ifdef UNLIT
+    finalcolor = texture(tex, st); // Use the texture to set the surface color
+#else
     vec3 L = normalize( mat3(LV)*vec3(1.0, 1.0, 1.0) );
     vec3 V = vec3(0.0, 0.0, 1.0);
     vec3 N = interpolatedNormal;
     float n = 40;
     vec3 ka = vec3(0.2, 0.2, 0.2);
     vec3 Ia = vec3(0.6, 0.6, 0.6);
+#ifdef TEXTURED
+    vec3 kd = vec3(texture(tex, st));
+#else
     vec3 kd = vec3(0.0, 0.5, 0.92);
-    //vec3 kd = vec3(texture(tex, st));
+#endif
     vec3 Id = vec3(0.8, 0.8, 0.8);
     vec3 ks = vec3(0.5, 0.5, 0.5);
     vec3 Is = vec3(0.5, 0.5, 0.5);
@@ -54,16 +51,5 @@ void main() {
     if (dotNL == 0.0) dotRV = 0.0; // Do not show highlight on the dark side
     vec3 shadedcolor = Ia*ka + Id*kd*dotNL + Is*ks*pow(dotRV, n);
     finalcolor = vec4(shadedcolor, 1.0);
+#endif
 }
-
-/*
-//////// LABB 5 VERTEX ////////
-#version 330 core
-uniform sampler2D tex; // A uniform varible to identify the texture
-in vec2 st; // Interpolated texture coords, setn from the vertex shader
-out vec4 finalcolor;
-
-void main(){
-    finalcolor = texture(tex, st); // Use the texture to set the surface color
-}
-*/
@@ -0,0 +1,40 @@
+//////// NORMAL MAPPING FRAGMENT ////////
+// The shading from fragment.glsl, with the normal taken from a
+// tangent space normal map (RGB = xyz * 0.5 + 0.5, as most tools bake them).
+#version 330 core
+
+in vec3 interpolatedNormal;
+in vec3 interpolatedTangent;
+in float bitangentSign;
+in vec2 st;
+
+uniform sampler2D tex;       // Surface color, texture unit 0
+uniform sampler2D normalmap; // Tangent space normals, texture unit 1
+#include "blocks.glsl"
+
+out vec4 finalcolor;
+
+void main() {
+
+    // The bitangent is rebuilt per fragment, as MikkTSpace expects
+    vec3 bitangent = bitangentSign * cross(interpolatedNormal, interpolatedTangent);
+    vec3 m = texture(normalmap, st).rgb * 2.0 - 1.0;
+    vec3 N = normalize(m.x * interpolatedTangent + m.y * bitangent + m.z * interpolatedNormal);
+
+    vec3 L = normalize( mat3(LV)*vec3(1.0, 1.0, 1.0) );
+    vec3 V = vec3(0.0, 0.0, 1.0);
+    float n = 40;
+    vec3 ka = vec3(0.2, 0.2, 0.2);
+    vec3 Ia = vec3(0.6, 0.6, 0.6);
+    vec3 kd = vec3(texture(tex, st));
+    vec3 Id = vec3(0.8, 0.8, 0.8);
+    vec3 ks = vec3(0.5, 0.5, 0.5);
+    vec3 Is = vec3(0.5, 0.5, 0.5);
+
+    vec3 R = 2.0*dot(N,L)*N - L;
+    float dotNL = max(dot(N,L), 0.0);
+    float dotRV = max(dot(R,V), 0.0);
+    if (dotNL == 0.0) dotRV = 0.0; // Do not show highlight on the dark side
+    vec3 shadedcolor = Ia*ka + Id*kd*dotNL + Is*ks*pow(dotRV, n);
+    finalcolor = vec4(shadedcolor, 1.0);
+}
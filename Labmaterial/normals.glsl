@@ -0,0 +1,27 @@
+//////// NORMAL DECODING ////////
+// Normals in the vertex formats of VertexFormat.hpp, for #include in the
+// vertex shaders. The encoding is a vertex attribute that differs from
+// mesh to mesh, so a general shader has to branch on it. A program that
+// only draws meshes of one kind can leave the branch out with
+// NORMAL_OCTAHEDRAL or NORMAL_XYZ defined.
+
+// Unfold an octahedral normal from its two components
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0) {
+        vec2 signs = vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(e.yx)) * signs;
+    }
+    return n;
+}
+
+// The normal, from the Normal attribute and the encoding, 1.0 for octahedral
+vec3 decodeNormal(vec4 normal, float encoding) {
+#if defined(NORMAL_OCTAHEDRAL)
+    return octahedralDecode(normal.xy);
+#elif defined(NORMAL_XYZ)
+    return normal.xyz;
+#else
+    return (encoding > 0.5) ? octahedralDecode(normal.xy) : normal.xyz;
+#endif
+}
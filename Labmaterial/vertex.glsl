@@ -1,42 +1,36 @@
-/*//////// OLD vertex ////////
-#version 330 core
-
-uniform float time;
-
-uniform mat4 M;
-
-layout(location = 0) in vec3 Position;
-
-layout(location = 1) in vec3 Color;
-
-out vec3 interpolatedColor;
-
-void main() {
-    gl_Position = M*vec4(Position, 1.0);
-
-    interpolatedColor = Color;
-}
-*/
-
 //////// LABB 4 VERTEX ////////
+// Defines that make variants of this shader (see ShaderSource.hpp):
+//   NORMAL_OCTAHEDRAL, NORMAL_XYZ  For meshes with one normal encoding
+//   PLAIN_UNIFORMS                 Plain uniforms instead of blocks
 #version 330 core
 
 layout(location=0) in vec3 Position;
-layout(location=1) in vec3 Normal;
+layout(location=1) in vec4 Normal;
 layout(location=2) in vec2 TexCoord;
 
-uniform mat4 MV;
-uniform mat4 P;
+// Constants to decode packed vertices (see VertexFormat.hpp), set by
+// TriangleSoup::render(). For unpacked vertices, they change nothing.
+layout(location=4) in vec3 PositionScale;
+layout(location=5) in vec3 PositionBias;
+layout(location=6) in vec4 TexCoordScaleBias; // Scale in xy, offset in zw
+layout(location=7) in float NormalEncoding;   // 1.0 for octahedral normals
+
+#include "blocks.glsl"
 
 
 out vec3 interpolatedNormal;
 out vec2 st;
 
+#include "normals.glsl"
+
 void main() {
-    vec3 transformedNormal = mat3(MV) * Normal;
+    vec3 position = Position * PositionScale + PositionBias;
+    vec3 normal = decodeNormal(Normal, NormalEncoding);
+
+    vec3 transformedNormal = mat3(MV) * normal;
     interpolatedNormal = normalize(transformedNormal);
 
-    gl_Position = P*MV*vec4(Position, 1.0);
-    st = TexCoord;
+    gl_Position = P*MV*vec4(position, 1.0);
+    st = TexCoord * TexCoordScaleBias.xy + TexCoordScaleBias.zw;
 }
 
@@ -0,0 +1,48 @@
+//////// INDIRECT VERTEX ////////
+// The vertex shader from vertex_instanced.glsl, for the indirect batches
+// of DrawBatch. The data of each draw, which vertex_instanced.glsl gets as
+// vertex attributes, is read from a shader storage buffer instead, with
+// the number of the draw in glMultiDrawElementsIndirect() as the index.
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
+
+layout(location=0) in vec3 Position;
+layout(location=1) in vec4 Normal;
+layout(location=2) in vec2 TexCoord;
+
+// The same as DrawBatch::DrawData
+struct DrawData {
+    mat4 matrix;
+    vec4 color;
+    vec4 positionScale;     // Normal encoding in w, 1.0 for octahedral normals
+    vec4 positionBias;      // Texture layer in w
+    vec4 texCoordScaleBias; // Scale in xy, offset in zw
+};
+
+// Binding point DRAWBATCH_DATA_BINDING
+layout(std430, binding=0) readonly buffer DrawBlock {
+    DrawData draws[];
+};
+
+#include "blocks.glsl"
+
+out vec3 interpolatedNormal;
+out vec2 st;
+out vec4 instanceColor;
+flat out float instanceLayer; // For a shader that samples a texture array
+
+#include "normals.glsl"
+
+void main() {
+    DrawData draw = draws[gl_DrawIDARB];
+    vec3 position = Position * draw.positionScale.xyz + draw.positionBias.xyz;
+    vec3 normal = decodeNormal(Normal, draw.positionScale.w);
+
+    mat4 M = MV * draw.matrix;
+    interpolatedNormal = normalize(mat3(M) * normal); // Assumes no uneven scaling
+
+    gl_Position = P*M*vec4(position, 1.0);
+    st = TexCoord * draw.texCoordScaleBias.xy + draw.texCoordScaleBias.zw;
+    instanceColor = draw.color;
+    instanceLayer = draw.positionBias.w;
+}
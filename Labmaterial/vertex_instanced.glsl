@@ -0,0 +1,43 @@
+//////// INSTANCED VERTEX ////////
+// The vertex shader from vertex.glsl, for TriangleSoup::renderInstanced().
+// Every instance has its own matrix, applied before MV, and a color
+// and a layer number that are passed on to the fragment shader.
+#version 330 core
+
+layout(location=0) in vec3 Position;
+layout(location=1) in vec4 Normal;
+layout(location=2) in vec2 TexCoord;
+
+// Constants to decode packed vertices (see VertexFormat.hpp), set by
+// TriangleSoup::render(). For unpacked vertices, they change nothing.
+layout(location=4) in vec3 PositionScale;
+layout(location=5) in vec3 PositionBias;
+layout(location=6) in vec4 TexCoordScaleBias; // Scale in xy, offset in zw
+layout(location=7) in float NormalEncoding;   // 1.0 for octahedral normals
+
+// Per instance (see TRIANGLESOUP_INSTANCE_* in TriangleSoup.hpp)
+layout(location=8) in mat4 InstanceMatrix; // Uses locations 8 to 11
+layout(location=12) in vec4 InstanceColor;
+layout(location=13) in float InstanceLayer;
+
+#include "blocks.glsl"
+
+out vec3 interpolatedNormal;
+out vec2 st;
+out vec4 instanceColor;
+flat out float instanceLayer; // For a shader that samples a texture array
+
+#include "normals.glsl"
+
+void main() {
+    vec3 position = Position * PositionScale + PositionBias;
+    vec3 normal = decodeNormal(Normal, NormalEncoding);
+
+    mat4 M = MV * InstanceMatrix;
+    interpolatedNormal = normalize(mat3(M) * normal); // Assumes no uneven scaling
+
+    gl_Position = P*M*vec4(position, 1.0);
+    st = TexCoord * TexCoordScaleBias.xy + TexCoordScaleBias.zw;
+    instanceColor = InstanceColor;
+    instanceLayer = InstanceLayer;
+}
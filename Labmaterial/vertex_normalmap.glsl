@@ -0,0 +1,39 @@
+//////// NORMAL MAPPING VERTEX ////////
+// The vertex shader from vertex.glsl, with tangents for normal mapping.
+// Meshes need the TriangleSoup option GENERATE_TANGENTS.
+#version 330 core
+
+layout(location=0) in vec3 Position;
+layout(location=1) in vec4 Normal;
+layout(location=2) in vec2 TexCoord;
+layout(location=3) in vec4 Tangent; // xyz along increasing s, w is the bitangent sign
+
+// Constants to decode packed vertices (see VertexFormat.hpp), set by
+// TriangleSoup::render(). For unpacked vertices, they change nothing.
+layout(location=4) in vec3 PositionScale;
+layout(location=5) in vec3 PositionBias;
+layout(location=6) in vec4 TexCoordScaleBias; // Scale in xy, offset in zw
+layout(location=7) in float NormalEncoding;   // 1.0 for octahedral normals
+
+#include "blocks.glsl"
+
+out vec3 interpolatedNormal;
+out vec3 interpolatedTangent;
+out float bitangentSign;
+out vec2 st;
+
+#include "normals.glsl"
+
+void main() {
+    vec3 position = Position * PositionScale + PositionBias;
+    vec3 normal = decodeNormal(Normal, NormalEncoding);
+
+    // Not normalized here: MikkTSpace normal maps are baked against the
+    // interpolated, unnormalized vectors
+    interpolatedNormal = mat3(MV) * normalize(normal);
+    interpolatedTangent = mat3(MV) * Tangent.xyz;
+    bitangentSign = Tangent.w;
+
+    gl_Position = P*MV*vec4(position, 1.0);
+    st = TexCoord * TexCoordScaleBias.xy + TexCoordScaleBias.zw;
+}